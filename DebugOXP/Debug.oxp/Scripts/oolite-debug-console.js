@@ -96,6 +96,27 @@ reducedDetailMode: Boolean (read/write)
 displayFPS : Boolean (read/write)
 	Boolean specifying whether FPS (and associated information) should be
 	displayed.
+
+collisionBroadphase : String (read/write)
+	The algorithm used to find potentially colliding pairs. One of:
+		"COLLISION_BROADPHASE_SWEEP"	(sorted axis lists, the default)
+		"COLLISION_BROADPHASE_GRID"		(uniform spatial hash grid)
+	The pair counts for the last tick are shown in the FPS display, so the two
+	can be compared. The default can be set with the collision-broadphase
+	preference.
+
+frameTracing : Boolean (read/write)
+	While true, the begin and end times of update stages, drawing passes,
+	world script events, frame callbacks and async tasks are recorded in a
+	ring buffer (of frame-trace-buffer-size events, default 262144). Setting
+	it to true discards anything previously recorded.
+
+splitEntityUpdate : Boolean (read/write)
+	If true, the flight model step of NPC ships (applying their speed, roll,
+	pitch and yaw) runs in parallel on worker threads once all entities have
+	been updated, and the results are committed on the main thread. Their
+	behaviour, AI and script events still run on the main thread. The default
+	can be set with the split-entity-update preference.
  
 glVendorString : String (read-only)
 glRendererString : String (read-only)
@@ -129,6 +150,8 @@ function isExecutableJavaScript(code : String) : Boolean
 function profile(func : function [, this : Object]) : String
 	Time the specified function, report the time spent in various Oolite
 	functions and how much time is excluded from the time limiter mechanism.
+	World script events sent during the call are listed with the number of
+	handlers called and the number of world scripts skipped for lack of one.
 	NOTE: while profile() is running, the time limiter is effectively disabled
 	(specifically, it's set to ten million seconds).
 
@@ -140,6 +163,11 @@ function getProfile(func : function [, this : Object]) : Object
 function writeLogMarker()
 	Writes a separator to the log.
 
+function writeFrameTrace() : String
+	Writes the events recorded with frameTracing to a file in the Chrome
+	trace event format, which can be loaded into chrome://tracing or the
+	Perfetto UI, and returns its path.
+
 
 Useful properties of the console script (which can be used directly in the
 console, e.g. “log($)”):
@@ -31,7 +31,7 @@ MA 02110-1301, USA.
 #define AI_THINK_INTERVAL					0.125
 
 
-@class ShipEntity;
+@class ShipEntity, OOAICompiledStateMachine;
 
 
 @interface AI: OOWeakRefObject
@@ -41,6 +41,7 @@ MA 02110-1301, USA.
 	NSString			*ownerDesc;					// describes the object this is the AI for
 	
 	NSDictionary		*stateMachine;
+	OOAICompiledStateMachine *compiledStateMachine;	// Pre-parsed actions for stateMachine
 	NSString			*stateMachineName;
 	NSString			*currentState;
 	NSMutableSet		*pendingMessages;
@@ -52,6 +52,53 @@ typedef struct
 static AI *sCurrentlyRunningAI = nil;
 
 
+/*	An AI action, parsed once when its state machine is loaded rather than
+	every time it runs. The IMP is looked up for the first owner class to
+	run it and cached; owners of other classes fall back to a fresh lookup.
+*/
+@interface OOAIAction: NSObject
+{
+@private
+	NSString			*_action;
+	SEL					_selector;
+	NSString			*_argument;
+	Class				_cachedClass;
+	IMP					_cachedIMP;
+}
+
+- (id) initWithActionString:(NSString *)action;
+
+- (NSString *) actionString;
+- (SEL) selector;
+- (NSString *) argument;
+
+// Returns NO if the owner doesn't implement the action's method.
+- (BOOL) performWithOwner:(ShipEntity *)owner;
+
+@end
+
+
+/*	State -> message -> array of OOAIAction. Compiled state machines are kept
+	in a table keyed by state machine name, and reused as long as the cached
+	state machine dictionary is the same object they were compiled from.
+*/
+@interface OOAICompiledStateMachine: NSObject
+{
+@private
+	NSDictionary		*_source;
+	NSDictionary		*_states;
+}
+
++ (OOAICompiledStateMachine *) compiledStateMachine:(NSDictionary *)stateMachine name:(NSString *)name;
+
+- (id) initWithStateMachine:(NSDictionary *)stateMachine;
+
+- (NSDictionary *) source;
+- (NSArray *) actionsForMessage:(NSString *)message inState:(NSString *)state;
+
+@end
+
+
 @interface AI (OOPrivate)
 
 // Wrapper for performSelector:withObject:afterDelay: to catch/fix bugs.
@@ -60,6 +107,8 @@ static AI *sCurrentlyRunningAI = nil;
 
 - (void) refreshOwnerDesc;
 
+- (void) performAction:(OOAIAction *)action;
+
 // Set state machine and state without side effects.
 - (void) directSetStateMachine:(NSDictionary *)newSM name:(NSString *)name;
 - (void) directSetState:(NSString *)state;
@@ -160,6 +209,7 @@ extern void GenerateGraphVizForAIStateMachine(NSDictionary *stateMachine, NSStri
 	DESTROY(ownerDesc);
 	DESTROY(aiStack);
 	DESTROY(stateMachine);
+	DESTROY(compiledStateMachine);
 	DESTROY(stateMachineName);
 	DESTROY(currentState);
 	DESTROY(pendingMessages);
@@ -468,7 +518,8 @@ static AIStackElement *sStack = NULL;
 	}
 #endif
 	
-	actions = [[[messagesForState objectForKey:message] copy] autorelease];
+	// Retained because an action may change state machine.
+	actions = [[[compiledStateMachine actionsForMessage:message inState:currentState] retain] autorelease];
 	
 	sCurrentlyRunningAI = self;
 	if ([actions count] > 0)
@@ -478,7 +529,7 @@ static AIStackElement *sStack = NULL;
 		{
 			for (i = 0; i < [actions count]; i++)
 			{
-				[self takeAction:[actions objectAtIndex:i]];
+				[self performAction:[actions objectAtIndex:i]];
 			}
 		}
 		@catch (NSException *exception)
@@ -509,66 +560,9 @@ static AIStackElement *sStack = NULL;
 
 - (void) takeAction:(NSString *)action
 {
-	ShipEntity *owner = [self owner];
-	
-#ifndef NDEBUG
-	BOOL report = [owner reportAIMessages];
-	if (report)
-	{
-		OOLog(@"ai.takeAction", @"%@ to take action %@", ownerDesc, action);
-		OOLogIndent();
-	}
-#endif
-	
-	NSArray *tokens = ScanTokensFromString(action);
-	NSUInteger tokenCount = [tokens count];
-	
-	if (tokenCount != 0)
-	{
-		NSString *selectorStr = [tokens objectAtIndex:0];
-		
-		if (owner != nil)
-		{
-			NSString *dataString = nil;
-			
-			if (tokenCount == 2)
-			{
-				dataString = [tokens objectAtIndex:1];
-			}
-			else if ([tokens count] > 1)
-			{
-				dataString = [[tokens subarrayWithRange:NSMakeRange(1, tokenCount - 1)] componentsJoinedByString:@" "];
-			}
-			
-			SEL selector = NSSelectorFromString(selectorStr);
-			if ([owner respondsToSelector:selector])
-			{
-				if (dataString != nil)  [owner performSelector:selector withObject:dataString];
-				else  [owner performSelector:selector];
-			}
-			else
-			{
-				OOLogERR(@"ai.takeAction.badSelector", @"in AI %@ in state %@: %@ does not respond to %@", stateMachineName, currentState, ownerDesc, selectorStr);
-			}
-		}
-		else
-		{
-			OOLog(@"ai.takeAction.orphaned", @"***** AI %@, trying to perform %@, is orphaned (no owner)", stateMachineName, selectorStr);
-		}
-	}
-	else
-	{
-#ifndef NDEBUG
-		if (report)  OOLog(@"ai.takeAction.noAction", @"DEBUG: - no action '%@'", action);
-#endif
-	}
-	
-#ifndef NDEBUG
-	if (report)
-	{
-		OOLogOutdent();
-	}
-#endif
+	OOAIAction *compiled = [[OOAIAction alloc] initWithActionString:action];
+	[self performAction:compiled];
+	[compiled release];
 }
 
 
@@ -773,12 +767,57 @@ static AIStackElement *sStack = NULL;
 }
 
 
+- (void) performAction:(OOAIAction *)action
+{
+	ShipEntity *owner = [self owner];
+	
+#ifndef NDEBUG
+	BOOL report = [owner reportAIMessages];
+	if (report)
+	{
+		OOLog(@"ai.takeAction", @"%@ to take action %@", ownerDesc, [action actionString]);
+		OOLogIndent();
+	}
+#endif
+	
+	if ([action selector] != NULL)
+	{
+		if (owner != nil)
+		{
+			if (![action performWithOwner:owner])
+			{
+				OOLogERR(@"ai.takeAction.badSelector", @"in AI %@ in state %@: %@ does not respond to %@", stateMachineName, currentState, ownerDesc, NSStringFromSelector([action selector]));
+			}
+		}
+		else
+		{
+			OOLog(@"ai.takeAction.orphaned", @"***** AI %@, trying to perform %@, is orphaned (no owner)", stateMachineName, NSStringFromSelector([action selector]));
+		}
+	}
+	else
+	{
+#ifndef NDEBUG
+		if (report)  OOLog(@"ai.takeAction.noAction", @"DEBUG: - no action '%@'", [action actionString]);
+#endif
+	}
+	
+#ifndef NDEBUG
+	if (report)
+	{
+		OOLogOutdent();
+	}
+#endif
+}
+
+
 - (void) directSetStateMachine:(NSDictionary *)newSM name:(NSString *)name
 {
 	if (stateMachine != newSM)
 	{
 		[stateMachine release];
 		stateMachine = [newSM copy];
+		[compiledStateMachine release];
+		compiledStateMachine = [[OOAICompiledStateMachine compiledStateMachine:stateMachine name:name] retain];
 	}
 	if (stateMachineName != name)
 	{
@@ -1047,3 +1086,178 @@ static AIStackElement *sStack = NULL;
 }
 
 @end
+
+
+@implementation OOAIAction
+
+- (id) initWithActionString:(NSString *)action
+{
+	if ((self = [super init]))
+	{
+		_action = [action copy];
+		
+		NSArray *tokens = ScanTokensFromString(action);
+		NSUInteger tokenCount = [tokens count];
+		if (tokenCount != 0)
+		{
+			_selector = NSSelectorFromString([tokens objectAtIndex:0]);
+			if (tokenCount == 2)
+			{
+				_argument = [[tokens objectAtIndex:1] copy];
+			}
+			else if (tokenCount > 2)
+			{
+				_argument = [[[tokens subarrayWithRange:NSMakeRange(1, tokenCount - 1)] componentsJoinedByString:@" "] retain];
+			}
+		}
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_action);
+	DESTROY(_argument);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return _action;
+}
+
+
+- (NSString *) actionString
+{
+	return _action;
+}
+
+
+- (SEL) selector
+{
+	return _selector;
+}
+
+
+- (NSString *) argument
+{
+	return _argument;
+}
+
+
+- (BOOL) performWithOwner:(ShipEntity *)owner
+{
+	Class ownerClass = [owner class];
+	IMP method = NULL;
+	
+	if (EXPECT(ownerClass == _cachedClass))
+	{
+		method = _cachedIMP;
+	}
+	else
+	{
+		if (![owner respondsToSelector:_selector])  return NO;
+		method = [owner methodForSelector:_selector];
+		if (method == NULL)  return NO;
+		
+		_cachedClass = ownerClass;
+		_cachedIMP = method;
+	}
+	
+	if (_argument != nil)  ((void (*)(id, SEL, id))method)(owner, _selector, _argument);
+	else  ((void (*)(id, SEL))method)(owner, _selector);
+	
+	return YES;
+}
+
+@end
+
+
+static NSMutableDictionary *sCompiledStateMachines = nil;
+
+
+@implementation OOAICompiledStateMachine
+
++ (OOAICompiledStateMachine *) compiledStateMachine:(NSDictionary *)stateMachine name:(NSString *)name
+{
+	if (stateMachine == nil)  return nil;
+	
+	OOAICompiledStateMachine *result = nil;
+	if (name != nil)  result = [sCompiledStateMachines objectForKey:name];
+	if (result == nil || [result source] != stateMachine)
+	{
+		result = [[[self alloc] initWithStateMachine:stateMachine] autorelease];
+		if (name != nil)
+		{
+			if (sCompiledStateMachines == nil)  sCompiledStateMachines = [[NSMutableDictionary alloc] init];
+			[sCompiledStateMachines setObject:result forKey:name];
+		}
+	}
+	
+	return result;
+}
+
+
+- (id) initWithStateMachine:(NSDictionary *)stateMachine
+{
+	if ((self = [super init]))
+	{
+		NSMutableDictionary *states = [NSMutableDictionary dictionaryWithCapacity:[stateMachine count]];
+		NSString *stateKey = nil;
+		
+		foreachkey (stateKey, stateMachine)
+		{
+			NSDictionary *handlers = [stateMachine objectForKey:stateKey];
+			if (![handlers isKindOfClass:[NSDictionary class]])  continue;	// jsScript
+			
+			NSMutableDictionary *compiledHandlers = [NSMutableDictionary dictionaryWithCapacity:[handlers count]];
+			NSString *handlerKey = nil;
+			foreachkey (handlerKey, handlers)
+			{
+				NSArray *actions = [handlers oo_arrayForKey:handlerKey];
+				NSMutableArray *compiledActions = [NSMutableArray arrayWithCapacity:[actions count]];
+				NSString *action = nil;
+				foreach (action, actions)
+				{
+					OOAIAction *compiled = [[OOAIAction alloc] initWithActionString:action];
+					[compiledActions addObject:compiled];
+					[compiled release];
+				}
+				[compiledHandlers setObject:[NSArray arrayWithArray:compiledActions] forKey:handlerKey];
+			}
+			[states setObject:[NSDictionary dictionaryWithDictionary:compiledHandlers] forKey:stateKey];
+		}
+		
+		_source = [stateMachine retain];
+		_states = [states copy];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_source);
+	DESTROY(_states);
+	
+	[super dealloc];
+}
+
+
+- (NSDictionary *) source
+{
+	return _source;
+}
+
+
+- (NSArray *) actionsForMessage:(NSString *)message inState:(NSString *)state
+{
+	return [[_states objectForKey:state] objectForKey:message];
+}
+
+@end
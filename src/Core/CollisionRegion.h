@@ -33,7 +33,7 @@ MA 02110-1301, USA.
 #define	COLLISION_MAX_ENTITIES			128
 #define MINIMUM_SHADOWING_ENTITY_RADIUS 75.0
 
-@class Entity, OOSunEntity;
+@class Entity, OOSunEntity, OOSpatialGrid;
 
 
 @interface CollisionRegion: NSObject
@@ -48,6 +48,8 @@ MA 02110-1301, USA.
 
 	unsigned			checks_this_tick;
 	unsigned			checks_within_range;
+	unsigned			gridCellCount;
+	BOOL				usedGrid;			// YES if the last collision pass used the grid broadphase
 
 	NSMutableArray		*subregions;
 	
@@ -72,9 +74,14 @@ MA 02110-1301, USA.
 - (BOOL) checkEntity:(Entity *)ent;
 
 - (void) findCollisions;
+/*	Alternative to -findCollisions, using a spatial grid instead of the
+	collision chains built by -[Universe filterSortedLists]. Tests all of the
+	given entities in one pass regardless of subregion.
+*/
+- (void) findCollisionsUsingGrid:(OOSpatialGrid *)grid entities:(Entity **)entities count:(unsigned)count;
 - (void) findShadowedEntities;
 
-// Description for FPS HUD
+// Description for FPS HUD: pairs checked and pairs within range in the last tick
 - (NSString *) collisionDescription;
 
 - (NSString *) debugOut;
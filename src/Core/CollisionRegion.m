@@ -32,6 +32,7 @@ MA 02110-1301, USA.
 #import "StationEntity.h"
 #import "PlayerEntity.h"
 #import "OODebugFlags.h"
+#import "OOSpatialGrid.h"
 
 
 static BOOL positionIsWithinRegion(HPVector position, CollisionRegion *region);
@@ -252,11 +253,145 @@ static BOOL positionIsWithinBorders(HPVector position, CollisionRegion *region)
 }
 
 
+static void ResetCollisionState(Entity *e1)
+{
+	if (e1->hasCollided)
+	{
+		[[e1 collisionArray] removeAllObjects];
+		e1->hasCollided = NO;
+	}
+	if (e1->isShip)
+	{
+		[(ShipEntity*)e1 setProximityAlert:nil];
+	}
+	e1->collider = nil;
+}
+
+
+/*	Narrow phase for a single candidate pair, shared by the collision chain
+	and grid broad phases. Returns YES if the pair was within proximity range.
+*/
+static BOOL TestCollisionPair(Entity *e1, Entity *e2)
+{
+	double		dist2, r1, r2, r0, min_dist2;
+	
+	if (e1->isShip && e2->isShip && 
+		[(ShipEntity *)e1 collisionExceptedFor:(ShipEntity *)e2]) 
+	{
+		// nothing happens
+		return NO;
+	}
+	
+	r1 = e1->collision_radius;
+	r2 = e2->collision_radius;
+	r0 = r1 + r2;
+	dist2 = HPdistance2(e2->position, e1->position);
+	min_dist2 = r0 * r0;
+	if (dist2 >= PROXIMITY_WARN_DISTANCE2 * min_dist2)
+	{
+		return NO;
+	}
+	
+#ifndef NDEBUG
+	if (gDebugFlags & DEBUG_COLLISIONS)
+	{
+		OOLog(@"collisionRegion.debug", @"DEBUG Testing collision between %@ (%@) and %@ (%@)",
+			  e1, (e1->collisionTestFilter==3)?@"YES":@"NO", e2, (e2->collisionTestFilter==3)?@"YES":@"NO");
+	}
+#endif
+	
+	if (e1->isShip && e2->isShip)
+	{
+		if ((dist2 < PROXIMITY_WARN_DISTANCE2 * r2 * r2) || (dist2 < PROXIMITY_WARN_DISTANCE2 * r1 * r1))
+		{
+			[(ShipEntity*)e1 setProximityAlert:(ShipEntity*)e2];
+			[(ShipEntity*)e2 setProximityAlert:(ShipEntity*)e1];
+		}
+		
+		if (dist2 >= min_dist2)
+		{
+			if (e1->isStation)
+			{
+				StationEntity* se1 = (StationEntity *)e1;
+				[se1 shipIsInDockingCorridor:(ShipEntity *)e2];
+			}
+			else if (e2->isStation)
+			{
+				StationEntity* se2 = (StationEntity *)e2;
+				[se2 shipIsInDockingCorridor:(ShipEntity *)e1];
+			}
+		}
+		
+	}
+	if (dist2 < min_dist2)
+	{
+		BOOL collision = NO;
+		
+		if (e1->isStation)
+		{
+			StationEntity* se1 = (StationEntity *)e1;
+			if ([se1 shipIsInDockingCorridor:(ShipEntity *)e2])
+			{
+				collision = NO;
+			}
+			else
+			{
+				collision = [e1 checkCloseCollisionWith:e2];
+			}
+		}
+		else if (e2->isStation)
+		{
+			StationEntity* se2 = (StationEntity *)e2;
+			if ([se2 shipIsInDockingCorridor:(ShipEntity *)e1])
+			{
+				collision = NO;
+			}
+			else
+			{
+				collision = [e2 checkCloseCollisionWith:e1];
+			}
+		}
+		else
+		{
+			collision = [e1 checkCloseCollisionWith:e2];
+		}
+		
+		if (collision)
+		{
+			// now we have no need to check the e2-e1 collision
+			if (e1->collider)
+			{
+				[[e1 collisionArray] addObject:e1->collider];
+			}
+			else
+			{
+				[[e1 collisionArray] addObject:e2];
+			}
+			e1->hasCollided = YES;
+			
+			if (e2->collider)
+			{
+				[[e2 collisionArray] addObject:e2->collider];
+			}
+			else
+			{
+				[[e2 collisionArray] addObject:e1];
+			}
+			e2->hasCollided = YES;
+		}
+	}
+	
+	return YES;
+}
+
+
 - (void) findCollisions
 {
 	// test for collisions in each subregion
 	[subregions makeObjectsPerformSelector:@selector(findCollisions)];
 	
+	usedGrid = NO;
+	
 	// reject trivial cases
 	if (n_entities < 2)  return;
 	
@@ -264,8 +399,6 @@ static BOOL positionIsWithinBorders(HPVector position, CollisionRegion *region)
 	// According to Shark, when this was in Universe this was where Oolite spent most time!
 	//
 	Entity		*e1, *e2;
-	HPVector		p1;
-	double		dist2, r1, r2, r0, min_dist2;
 	unsigned	i;
 	Entity		*entities_to_test[n_entities];
 	
@@ -293,17 +426,7 @@ static BOOL positionIsWithinBorders(HPVector position, CollisionRegion *region)
 	//
 	for (i = 0; i < n_entities_to_test; i++)
 	{
-		e1 = entities_to_test[i];
-		if (e1->hasCollided)
-		{
-			[[e1 collisionArray] removeAllObjects];
-			e1->hasCollided = NO;
-		}
-		if (e1->isShip)
-		{
-			[(ShipEntity*)e1 setProximityAlert:nil];
-		}
-		e1->collider = nil;
+		ResetCollisionState(entities_to_test[i]);
 	}
 	
 	checks_this_tick = 0;
@@ -314,121 +437,14 @@ static BOOL positionIsWithinBorders(HPVector position, CollisionRegion *region)
 	for (i = 0; i < n_entities_to_test; i++)
 	{
 		e1 = entities_to_test[i];
-		p1 = e1->position;
-		r1 = e1->collision_radius;
-	
-	
-
+		
 		// check against the first in the collision chain
 		e2 = e1->collision_chain;
 		while (e2 != nil)
 		{
 			checks_this_tick++;
-			if (e1->isShip && e2->isShip && 
-				[(ShipEntity *)e1 collisionExceptedFor:(ShipEntity *)e2]) 
-			{
-				// nothing happens
-			} 
-			else
-			{
-
-				r2 = e2->collision_radius;
-				r0 = r1 + r2;
-				dist2 = HPdistance2(e2->position, p1);
-				min_dist2 = r0 * r0;
-				if (dist2 < PROXIMITY_WARN_DISTANCE2 * min_dist2)
-				{
-#ifndef NDEBUG
-					if (gDebugFlags & DEBUG_COLLISIONS)
-					{
-						OOLog(@"collisionRegion.debug", @"DEBUG Testing collision between %@ (%@) and %@ (%@)",
-							  e1, (e1->collisionTestFilter==3)?@"YES":@"NO", e2, (e2->collisionTestFilter==3)?@"YES":@"NO");
-					}
-#endif
-					checks_within_range++;
-				
-					if (e1->isShip && e2->isShip)
-					{
-						if ((dist2 < PROXIMITY_WARN_DISTANCE2 * r2 * r2) || (dist2 < PROXIMITY_WARN_DISTANCE2 * r1 * r1))
-						{
-							[(ShipEntity*)e1 setProximityAlert:(ShipEntity*)e2];
-							[(ShipEntity*)e2 setProximityAlert:(ShipEntity*)e1];
-						}
-
-						if (dist2 >= min_dist2)
-						{
-							if (e1->isStation)
-							{
-								StationEntity* se1 = (StationEntity *)e1;
-								[se1 shipIsInDockingCorridor:(ShipEntity *)e2];
-							}
-							else if (e2->isStation)
-							{
-								StationEntity* se2 = (StationEntity *)e2;
-								[se2 shipIsInDockingCorridor:(ShipEntity *)e1];
-							}
-						}
-
-					}
-					if (dist2 < min_dist2)
-					{
-						BOOL collision = NO;
-					
-						if (e1->isStation)
-						{
-							StationEntity* se1 = (StationEntity *)e1;
-							if ([se1 shipIsInDockingCorridor:(ShipEntity *)e2])
-							{
-								collision = NO;
-							}
-							else
-							{
-								collision = [e1 checkCloseCollisionWith:e2];
-							}
-						}
-						else if (e2->isStation)
-						{
-							StationEntity* se2 = (StationEntity *)e2;
-							if ([se2 shipIsInDockingCorridor:(ShipEntity *)e1])
-							{
-								collision = NO;
-							}
-							else
-							{
-								collision = [e2 checkCloseCollisionWith:e1];
-							}
-						}
-						else
-						{
-							collision = [e1 checkCloseCollisionWith:e2];
-						}
-				
-						if (collision)
-						{
-							// now we have no need to check the e2-e1 collision
-							if (e1->collider)
-							{
-								[[e1 collisionArray] addObject:e1->collider];
-							}
-							else
-							{
-								[[e1 collisionArray] addObject:e2];
-							}
-							e1->hasCollided = YES;
-						
-							if (e2->collider)
-							{
-								[[e2 collisionArray] addObject:e2->collider];
-							}
-							else
-							{
-								[[e2 collisionArray] addObject:e1];
-							}
-							e2->hasCollided = YES;
-						}
-					}
-				}
-			}
+			if (TestCollisionPair(e1, e2))  checks_within_range++;
+			
 			// check the next in the collision chain
 			e2 = e2->collision_chain;
 		}
@@ -443,6 +459,68 @@ static BOOL positionIsWithinBorders(HPVector position, CollisionRegion *region)
 }
 
 
+static void GridPairFunction(Entity *e1, Entity *e2, void *context)
+{
+	unsigned *withinRange = context;
+	if (TestCollisionPair(e1, e2))  (*withinRange)++;
+}
+
+
+- (void) findCollisionsUsingGrid:(OOSpatialGrid *)grid entities:(Entity **)entities count:(unsigned)count
+{
+	NSParameterAssert(grid != nil);
+	
+	Entity		*e1 = nil;
+	unsigned	i;
+	
+	usedGrid = YES;
+	checks_this_tick = 0;
+	checks_within_range = 0;
+	
+	/*	The grid replaces the collision chains entirely, so collisionTestFilter
+		only records whether the entity takes part, for -dumpState's benefit.
+		
+		Each entity's box reaches PROXIMITY_WARN_DISTANCE times its collision
+		radius. Any two entities within PROXIMITY_WARN_DISTANCE * (r1 + r2) of
+		each other, the furthest TestCollisionPair() looks for proximity
+		alerts, therefore have overlapping boxes and are reported. That covers
+		everything the z-axis sweep in -[Universe filterSortedLists] finds.
+		No extra padding for speed is needed, however fast the entity: the
+		grid is built from current positions and tested straight away, with
+		nothing moving in between. Like the sweep, this only sees positions
+		once per tick, so an entity that passes right through another within
+		one tick is missed either way.
+	*/
+	[grid removeAllEntities];
+	for (i = 0; i < count; i++)
+	{
+		e1 = entities[i];
+		e1->collision_chain = nil;
+		if ([e1 canCollide])
+		{
+			e1->collisionTestFilter = 0;
+			ResetCollisionState(e1);
+			[grid addEntity:e1 position:e1->position radius:PROXIMITY_WARN_DISTANCE * e1->collision_radius];
+		}
+		else
+		{
+			e1->collisionTestFilter = 3;
+		}
+	}
+	[grid build];
+	
+	checks_this_tick = (unsigned)[grid enumeratePotentialPairsWithFunction:GridPairFunction context:&checks_within_range];
+	gridCellCount = (unsigned)[grid occupiedCellCount];
+	
+#ifndef NDEBUG
+	if (gDebugFlags & DEBUG_COLLISIONS)
+	{
+		OOLog(@"collisionRegion.debug", @"Grid collision test pairs %u, within range %u, for %lu entities in %u cells", checks_this_tick, checks_within_range, (unsigned long)[grid entityCount], gridCellCount);
+	}
+#endif
+}
+
+
 // an outValue of 1 means it's just being occluded.
 static BOOL entityByEntityOcclusionToValue(Entity *e1, Entity *e2, OOSunEntity *the_sun, float *outValue)
 {
@@ -719,6 +797,10 @@ static inline BOOL testEntityOccludedByEntity(Entity *e1, Entity *e2, OOSunEntit
 
 - (NSString *) collisionDescription
 {
+	if (usedGrid)
+	{
+		return [NSString stringWithFormat:@"grid %u - p%u - c%u", gridCellCount, checks_this_tick, checks_within_range];
+	}
 	return [NSString stringWithFormat:@"p%u - c%u", checks_this_tick, checks_within_range];
 }
 
@@ -44,6 +44,7 @@ SOFTWARE.
 #import "OODebugMonitor.h"
 #import "OOProfilingStopwatch.h"
 #import "ResourceManager.h"
+#import "OOFrameTracer.h"
 
 
 @interface Entity (OODebugInspector)
@@ -80,6 +81,7 @@ static JSBool ConsoleSetDisplayMessagesInClass(JSContext *context, uintN argc, j
 static JSBool ConsoleWriteLogMarker(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleWriteMemoryStats(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleWriteJSMemoryStats(JSContext *context, uintN argc, jsval *vp);
+static JSBool ConsoleWriteFrameTrace(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleGarbageCollect(JSContext *context, uintN argc, jsval *vp);
 #if DEBUG
 static JSBool ConsoleDumpNamedRoots(JSContext *context, uintN argc, jsval *vp);
@@ -124,6 +126,9 @@ enum
 	kConsole_detailLevel,						// graphics detail level, symbolic string, read/write
 	kConsole_maximumDetailLevel,				// maximum graphics detail level, symbolic string, read-only
 	kConsole_displayFPS,						// display FPS (and related info), boolean, read/write
+	kConsole_collisionBroadphase,				// collision broadphase algorithm, symbolic string, read/write
+	kConsole_frameTracing,						// record frame phases for writeFrameTrace(), boolean, read/write
+	kConsole_splitEntityUpdate,					// run NPC ship flight models in parallel, boolean, read/write
 	kConsole_platformDescription,				// Information about system we're running on in unspecified format, string, read-only
 	kConsole_ignoreDroppedPackets,				// boolean (default false), read/write
 	kConsole_pedanticMode,						// JS pedantic mode (JS_STRICT flag, not the same as "use strict"), boolean (default true), read/write
@@ -159,6 +164,9 @@ static JSPropertySpec sConsoleProperties[] =
 	{ "detailLevel",						kConsole_detailLevel,						OOJS_PROP_READWRITE_CB },
 	{ "maximumDetailLevel",					kConsole_maximumDetailLevel,				OOJS_PROP_READONLY_CB },
 	{ "displayFPS",							kConsole_displayFPS,						OOJS_PROP_READWRITE_CB },
+	{ "collisionBroadphase",				kConsole_collisionBroadphase,				OOJS_PROP_READWRITE_CB },
+	{ "frameTracing",						kConsole_frameTracing,						OOJS_PROP_READWRITE_CB },
+	{ "splitEntityUpdate",					kConsole_splitEntityUpdate,					OOJS_PROP_READWRITE_CB },
 	{ "platformDescription",				kConsole_platformDescription,				OOJS_PROP_READONLY_CB },
 	{ "pedanticMode",						kConsole_pedanticMode,						OOJS_PROP_READWRITE_CB },
 	{ "ignoreDroppedPackets",				kConsole_ignoreDroppedPackets,				OOJS_PROP_READWRITE_CB },
@@ -205,6 +213,7 @@ static JSFunctionSpec sConsoleMethods[] =
 	{ "writeLogMarker",					ConsoleWriteLogMarker,				0 },
 	{ "writeMemoryStats",				ConsoleWriteMemoryStats,			0 },
 	{ "writeJSMemoryStats",				ConsoleWriteJSMemoryStats,			0 },
+	{ "writeFrameTrace",				ConsoleWriteFrameTrace,				0 },
 	{ "garbageCollect",					ConsoleGarbageCollect,				0 },
 #if DEBUG
 	{ "dumpNamedRoots",					ConsoleDumpNamedRoots,				0 },
@@ -331,6 +340,18 @@ static JSBool ConsoleGetProperty(JSContext *context, JSObject *this, jsid propID
 			*value = OOJSValueFromBOOL([UNIVERSE displayFPS]);
 			break;
 			
+		case kConsole_collisionBroadphase:
+			*value = [OOStringFromCollisionBroadphase([UNIVERSE collisionBroadphase]) oo_jsValueInContext:context];
+			break;
+			
+		case kConsole_frameTracing:
+			*value = OOJSValueFromBOOL(gOOFrameTracerActive);
+			break;
+			
+		case kConsole_splitEntityUpdate:
+			*value = OOJSValueFromBOOL([UNIVERSE splitEntityUpdate]);
+			break;
+			
 		case kConsole_platformDescription:
 			*value = OOJSValueFromNativeObject(context, OOPlatformDescription());
 			break;
@@ -434,6 +455,26 @@ static JSBool ConsoleSetProperty(JSContext *context, JSObject *this, jsid propID
 			}
 			break;
 			
+		case kConsole_collisionBroadphase:
+			sValue = OOStringFromJSValue(context, *value);
+			[UNIVERSE setCollisionBroadphase:OOCollisionBroadphaseFromString(sValue)];
+			break;
+			
+		case kConsole_frameTracing:
+			if (JS_ValueToBoolean(context, *value, &bValue))
+			{
+				if (bValue)  OOFrameTracerStart();
+				else  OOFrameTracerStop();
+			}
+			break;
+			
+		case kConsole_splitEntityUpdate:
+			if (JS_ValueToBoolean(context, *value, &bValue))
+			{
+				[UNIVERSE setSplitEntityUpdate:bValue];
+			}
+			break;
+			
 		case kConsole_pedanticMode:
 			if (JS_ValueToBoolean(context, *value, &bValue))
 			{
@@ -897,6 +938,23 @@ static JSBool ConsoleWriteJSMemoryStats(JSContext *context, uintN argc, jsval *v
 }
 
 
+// function writeFrameTrace() : String
+static JSBool ConsoleWriteFrameTrace(JSContext *context, uintN argc, jsval *vp)
+{
+	OOJS_NATIVE_ENTER(context)
+	
+	NSString *path = nil;
+	
+	OOJS_BEGIN_FULL_NATIVE(context)
+	path = OOFrameTracerWriteTrace();
+	OOJS_END_FULL_NATIVE
+	
+	OOJS_RETURN_OBJECT(path);
+	
+	OOJS_NATIVE_EXIT
+}
+
+
 // function garbageCollect() : string
 static JSBool ConsoleGarbageCollect(JSContext *context, uintN argc, jsval *vp)
 {
@@ -155,6 +155,14 @@ enum OOScanClass
 @private
 	NSUInteger				_sessionID;
 	
+	// Fixed timestep render interpolation; see -[Universe beginRenderInterpolation:].
+	HPVector				_interpolationPosition;
+	Quaternion				_interpolationOrientation;
+	HPVector				_renderSavedPosition;
+	Quaternion				_renderSavedOrientation;
+	NSUInteger				_interpolationStep;
+	BOOL					_renderInterpolated;
+	
 	OOWeakReference			*_owner;
 	OOEntityStatus			_status;
 }
@@ -269,6 +277,15 @@ enum OOScanClass
 - (void) update:(OOTimeDelta)delta_t;
 
 - (void) applyVelocity:(OOTimeDelta)delta_t;
+
+/*	Render interpolation for the fixed timestep game loop; called by Universe.
+	Between begin and end, the position and orientation are temporarily
+	replaced with ones interpolated from the state saved before the given
+	step, if there is one.
+*/
+- (void) saveInterpolationStateForStep:(NSUInteger)step;
+- (void) beginRenderInterpolation:(double)fraction forStep:(NSUInteger)step;
+- (void) endRenderInterpolation;
 - (BOOL) checkCloseCollisionWith:(Entity *)other;
 
 - (void) takeEnergyDamage:(double)amount from:(Entity *)ent becauseOf:(Entity *)other weaponIdentifier:(NSString *)weaponIdentifier;
@@ -39,6 +39,10 @@ MA 02110-1301, USA.
 #import "OODebugFlags.h"
 #import "NSObjectOOExtensions.h"
 
+// Entities which move further than this in one fixed step are not interpolated.
+#define MAX_INTERPOLATION_DISTANCE		5000.0
+
+
 #ifndef NDEBUG
 uint32_t gLiveEntityCount = 0;
 size_t gTotalEntityMemory = 0;
@@ -649,6 +653,7 @@ static NSString * const kOOLogEntityVerificationError		= @"entity.linkedList.ver
 {
 	position = posn;
 	[self updateCameraRelativePosition];
+	[UNIVERSE noteEntityRepositioned:self];
 }
 
 
@@ -658,6 +663,7 @@ static NSString * const kOOLogEntityVerificationError		= @"entity.linkedList.ver
 	position.y = y;
 	position.z = z;
 	[self updateCameraRelativePosition];
+	[UNIVERSE noteEntityRepositioned:self];
 }
 
 
@@ -799,7 +805,9 @@ static NSString * const kOOLogEntityVerificationError		= @"entity.linkedList.ver
 
 - (void) setScanClass:(OOScanClass)sClass
 {
+	if (sClass == scanClass)  return;
 	scanClass = sClass;
+	[UNIVERSE reindexEntity:self];
 }
 
 
@@ -963,6 +971,77 @@ static NSString * const kOOLogEntityVerificationError		= @"entity.linkedList.ver
 }
 
 
+- (void) saveInterpolationStateForStep:(NSUInteger)step
+{
+	_interpolationPosition = position;
+	_interpolationOrientation = orientation;
+	_interpolationStep = step;
+}
+
+
+- (void) beginRenderInterpolation:(double)fraction forStep:(NSUInteger)step
+{
+	if (_status == STATUS_COCKPIT_DISPLAY)  return;
+	
+	/*	Sub-entities are drawn relative to their parents, and entities which
+		didn't exist before the last step or have jumped (witchspace,
+		launching) have nothing sensible to interpolate from.
+	*/
+	if (_interpolationStep == step && ![self isSubEntity] &&
+		HPdistance2(position, _interpolationPosition) < MAX_INTERPOLATION_DISTANCE * MAX_INTERPOLATION_DISTANCE)
+	{
+		BOOL moved = !HPvector_equal(position, _interpolationPosition);
+		BOOL rotated = !quaternion_equal(orientation, _interpolationOrientation);
+		
+		if (moved || rotated)
+		{
+			_renderSavedPosition = position;
+			_renderSavedOrientation = orientation;
+			_renderInterpolated = YES;
+			
+			if (moved)  position = OOHPVectorInterpolate(_interpolationPosition, position, fraction);
+			if (rotated)
+			{
+				// Normalized linear interpolation, along the shorter arc.
+				Quaternion from = _interpolationOrientation;
+				if (quaternion_dot_product(from, orientation) < 0.0f)
+				{
+					from.w = -from.w; from.x = -from.x; from.y = -from.y; from.z = -from.z;
+				}
+				orientation.w = OOLerp(from.w, orientation.w, fraction);
+				orientation.x = OOLerp(from.x, orientation.x, fraction);
+				orientation.y = OOLerp(from.y, orientation.y, fraction);
+				orientation.z = OOLerp(from.z, orientation.z, fraction);
+				[self orientationChanged];
+			}
+		}
+	}
+	
+	[self updateCameraRelativePosition];
+}
+
+
+- (void) endRenderInterpolation
+{
+	if (_status == STATUS_COCKPIT_DISPLAY)  return;
+	
+	if (_renderInterpolated)
+	{
+		_renderInterpolated = NO;
+		position = _renderSavedPosition;
+		if (!quaternion_equal(orientation, _renderSavedOrientation))
+		{
+			orientation = _renderSavedOrientation;
+			[self orientationChanged];
+			// -orientationChanged renormalizes; keep the simulation's value exactly.
+			orientation = _renderSavedOrientation;
+		}
+	}
+	
+	[self updateCameraRelativePosition];
+}
+
+
 - (void) applyVelocity:(OOTimeDelta)delta_t
 {
 	position = HPvector_add(position, HPvector_multiply_scalar(vectorToHPVector(velocity), delta_t));
@@ -27,7 +27,7 @@ MA 02110-1301, USA.
 #import "Universe.h"
 #import "PlayerEntity.h"
 #import "OOColor.h"
-#import "OOPlasmaBurstEntity.h"
+#import "OOParticleEngine.h"
 
 
 #define kPlasmaShotSize				12.0f
@@ -105,9 +105,7 @@ MA 02110-1301, USA.
 			[UNIVERSE removeEntity:self];
 			
 			// Spawn a plasma burst.
-			OOPlasmaBurstEntity *burst = [[OOPlasmaBurstEntity alloc] initWithPosition:[self position]];
-			[UNIVERSE addEntity:burst];
-			[burst release];
+			[[UNIVERSE particleEngine] addPlasmaBurstAt:[self position]];
 		}
 	}
 	
@@ -376,6 +376,8 @@ typedef enum
 	
 	NSDictionary			*worldScripts;
 	NSDictionary			*worldScriptsRequiringTickle;
+	NSMapTable				*worldScriptEventHandlers;	// Event jsid -> NSArray of world scripts with a handler for it.
+	uint32_t				worldScriptEventHandlerGeneration;
 	NSMutableDictionary		*commodityScripts;
 	NSMutableDictionary		*mission_variables;
 	NSMutableDictionary		*localVariables;
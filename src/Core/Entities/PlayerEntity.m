@@ -85,6 +85,7 @@ MA 02110-1301, USA.
 #import "PlayerEntityStickProfile.h"
 #import "PlayerEntityKeyMapper.h"
 #import "OOSystemDescriptionManager.h"
+#import "OOFrameTracer.h"
 
 
 #define PLAYER_DEFAULT_NAME				@"Jameson"
@@ -137,6 +138,10 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 - (void) updateAlertConditionForNearbyEntities;
 - (BOOL) checkEntityForMassLock:(Entity *)ent withScanClass:(int)scanClass;
 
+// World script event dispatch
+- (void) resetWorldScriptEventHandlers;
+- (NSArray *) worldScriptsHandlingEvent:(jsid)message inContext:(JSContext *)context;
+
 
 // Shopping
 - (void) showMarketScreenHeaders;
@@ -1929,6 +1934,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	DESTROY(worldScripts);
 	DESTROY(worldScriptsRequiringTickle);
 	DESTROY(commodityScripts);
+	[self resetWorldScriptEventHandlers];
 
 #if OOLITE_WINDOWS
 	if (saveGame)
@@ -1936,6 +1942,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 		[UNIVERSE preloadSounds];
 		[self setUpSound];
 		worldScripts = [[ResourceManager loadScripts] retain];
+		[self resetWorldScriptEventHandlers];
 		[UNIVERSE loadConditionScripts];
 		commodityScripts = [[NSMutableDictionary alloc] init];
 	}
@@ -1947,6 +1954,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	if (saveGame)
 	{
 		worldScripts = [[ResourceManager loadScripts] retain];
+		[self resetWorldScriptEventHandlers];
 		[UNIVERSE loadConditionScripts];
 		commodityScripts = [[NSMutableDictionary alloc] init];
 	}
@@ -2179,7 +2187,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	forward_shield			= [self maxForwardShieldLevel];
 	aft_shield				= [self maxAftShieldLevel];
 	
-	scanClass				= CLASS_PLAYER;
+	[self setScanClass:CLASS_PLAYER];
 	
 	[UNIVERSE clearGUIs];
 	
@@ -2204,6 +2212,8 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	currentWeaponFacing		= WEAPON_FACING_FORWARD;
 	[self currentWeaponStats];
 	
+	// A save still being written would otherwise set save_path afterwards.
+	[self finishPendingSave];
 	[save_path autorelease];
 	save_path = nil;
 	
@@ -2285,6 +2295,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	[UNIVERSE setBlockJSPlayerShipProps:NO];	// full access to player.ship properties!
 	
 	if (![super setUpFromDictionary:shipDict]) return NO;
+	[UNIVERSE reindexEntity:self];		// roles and scan class may have changed
 	
 	DESTROY(cargo);
 	cargo = [[NSMutableArray alloc] initWithCapacity:max_cargo];
@@ -2397,6 +2408,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 	DESTROY(worldScripts);
 	DESTROY(worldScriptsRequiringTickle);
 	DESTROY(commodityScripts);
+	[self resetWorldScriptEventHandlers];
 	DESTROY(mission_variables);
 	
 	DESTROY(localVariables);
@@ -2604,20 +2616,25 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 #ifndef NDEBUG
 #define STAGE_TRACKING_BEGIN	{ \
 									NSString * volatile updateStage = @"initialisation"; \
+									BOOL traceStageOpen = NO; \
 									@try {
-#define STAGE_TRACKING_END			} \
+#define STAGE_TRACKING_END			OOFrameTraceStage(&traceStageOpen, nil); \
+									} \
 									@catch (NSException *exception) \
 									{ \
 										OOLog(kOOLogException, @"***** Exception during [%@] in %s : %@ : %@ *****", updateStage, __PRETTY_FUNCTION__, [exception name], [exception reason]); \
 										@throw exception; \
 									} \
 								}
-#define UPDATE_STAGE(x) do { updateStage = (x); } while (0)
+#define UPDATE_STAGE(x) do { updateStage = (x); OOFrameTraceStage(&traceStageOpen, updateStage); } while (0)
 #else
-#define STAGE_TRACKING_BEGIN	{
-#define STAGE_TRACKING_END		}
-#define UPDATE_STAGE(x) do { (void) (x); } while (0);
+#define STAGE_TRACKING_BEGIN	{ \
+									BOOL traceStageOpen = NO;
+#define STAGE_TRACKING_END			OOFrameTraceStage(&traceStageOpen, nil); \
+								}
+#define UPDATE_STAGE(x) do { OOFrameTraceStage(&traceStageOpen, (x)); } while (0);
 #endif
+#define END_STAGE_TRACKING_EARLY()	OOFrameTraceStage(&traceStageOpen, nil)
 
 
 - (void) update:(OOTimeDelta)delta_t
@@ -3844,6 +3861,7 @@ NSComparisonResult marketSorterByMassUnit(id a, id b, void *market);
 		[self setStatus:STATUS_IN_FLIGHT];
 		[self playHyperspaceAborted];
 		ShipScriptEventNoCx(self, "playerJumpFailed", OOJSSTR("malfunction"));
+		END_STAGE_TRACKING_EARLY();
 		return;
 	}
 	
@@ -12895,9 +12913,65 @@ static NSString *last_outfitting_key=nil;
 }
 
 
+- (void) resetWorldScriptEventHandlers
+{
+	if (worldScriptEventHandlers != NULL)
+	{
+		NSFreeMapTable(worldScriptEventHandlers);
+		worldScriptEventHandlers = NULL;
+	}
+	
+	// Only world scripts gaining or losing handlers invalidate the lists.
+	OOScript *theScript = nil;
+	foreach (theScript, [worldScripts allValues])
+	{
+		if ([theScript isKindOfClass:[OOJSScript class]])  [(OOJSScript *)theScript setIsWorldScript:YES];
+	}
+}
+
+
+/*	Returns the world scripts which handle message, in the same order as
+	[worldScripts allValues]. The lists are built per event on first use after
+	the scripts are loaded, and thrown away whenever a world script gains or
+	loses a property that could be a handler (see +[OOJSScript
+	eventHandlerGeneration]).
+	Event IDs are interned strings, so their bits are stable keys.
+*/
+- (NSArray *) worldScriptsHandlingEvent:(jsid)message inContext:(JSContext *)context
+{
+	uint32_t generation = [OOJSScript eventHandlerGeneration];
+	if (worldScriptEventHandlers != NULL && generation != worldScriptEventHandlerGeneration)
+	{
+		NSResetMapTable(worldScriptEventHandlers);
+	}
+	if (worldScriptEventHandlers == NULL)
+	{
+		worldScriptEventHandlers = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 64);
+	}
+	worldScriptEventHandlerGeneration = generation;
+	
+	void *key = (void *)JSID_BITS(message);
+	NSArray *result = NSMapGet(worldScriptEventHandlers, key);
+	if (result == nil)
+	{
+		NSMutableArray *handlers = [NSMutableArray array];
+		OOScript *theScript = nil;
+		foreach (theScript, [worldScripts allValues])
+		{
+			if ([theScript hasMethod:message inContext:context])  [handlers addObject:theScript];
+		}
+		result = [NSArray arrayWithArray:handlers];
+		NSMapInsertKnownAbsent(worldScriptEventHandlers, key, result);
+	}
+	
+	// A handler may invalidate the table while the caller is iterating.
+	return [[result retain] autorelease];
+}
+
+
 - (BOOL) doWorldEventUntilMissionScreen:(jsid)message
 {
-	NSEnumerator	*scriptEnum = [worldScripts objectEnumerator];
+	NSEnumerator	*scriptEnum = nil;
 	OOScript		*theScript;
 
 	// Check for the presence of report messages first.
@@ -12909,10 +12983,19 @@ static NSString *last_outfitting_key=nil;
 	}
 	
 	JSContext *context = OOJSAcquireContext();
+	NSArray *handlers = [self worldScriptsHandlingEvent:message inContext:context];
+#if OOJS_PROFILE
+	OOJSProfileNoteEventDispatch(message, [handlers count], [worldScripts count]);
+#endif
+	OOFrameTraceBeginKeyed((const void *)JSID_BITS(message), OOStringFromJSID(message));
+	scriptEnum = [handlers objectEnumerator];
 	while ((theScript = [scriptEnum nextObject]) && gui_screen != GUI_SCREEN_MISSION && [self isDocked])
 	{
+		OOFrameTraceBeginInterned([theScript name]);
 		[theScript callMethod:message inContext:context withArguments:NULL count:0 result:NULL];
+		OOFrameTraceEnd();
 	}
+	OOFrameTraceEnd();
 	OOJSRelinquishContext(context);
 	
 	if (gui_screen == GUI_SCREEN_MISSION)
@@ -12931,13 +13014,22 @@ static NSString *last_outfitting_key=nil;
 	NSParameterAssert(context != NULL && JS_IsInRequest(context));
 	
 	OOScript				*theScript = nil;
+	NSArray					*handlers = [self worldScriptsHandlingEvent:message inContext:context];
 	
-	foreach (theScript, [worldScripts allValues])
+#if OOJS_PROFILE
+	OOJSProfileNoteEventDispatch(message, [handlers count], [worldScripts count]);
+#endif
+	
+	OOFrameTraceBeginKeyed((const void *)JSID_BITS(message), OOStringFromJSID(message));
+	foreach (theScript, handlers)
 	{
+		OOFrameTraceBeginInterned([theScript name]);
 		OOJSStartTimeLimiterWithTimeLimit(limit);
 		[theScript callMethod:message inContext:context withArguments:argv count:argc result:NULL];
 		OOJSStopTimeLimiter();
+		OOFrameTraceEnd();
 	}
+	OOFrameTraceEnd();
 }
 
 
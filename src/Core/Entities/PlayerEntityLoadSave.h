@@ -85,6 +85,11 @@ MA 02110-1301, USA.
 
 - (BOOL) loadPlayerFromFile:(NSString *)fileToOpen asNew:(BOOL)asNew;
 
+/*	Saved games are encoded and written on a worker thread. Block until the
+	most recent one is on disk; called before loading and when quitting.
+*/
+- (void) finishPendingSave;
+
 @end
 
 
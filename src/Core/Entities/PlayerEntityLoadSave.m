@@ -47,6 +47,14 @@
 #import "NSStringOOExtensions.h"
 #import "NSNumberOOExtensions.h"
 #import "OOJavaScriptEngine.h"
+#import "OOAsyncWorkManager.h"
+#import "OODeepCopy.h"
+
+#if !OOLITE_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 
 // Name of modifier key used to issue commands. See also -isCommandModifierKeyDown.
@@ -92,10 +100,38 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 #endif
 
 - (void) writePlayerToPath:(NSString *)path;
+- (void) writePlayerToPath:(NSString *)path asAutosave:(BOOL)autosave;
+- (void) noteGameSavedToPath:(NSString *)path asAutosave:(BOOL)autosave;
 
 @end
 
 
+/*	Encodes a snapshot of the commander data and writes it out on a worker
+	thread. Only one is scheduled at a time; see -writePlayerToPath:. The
+	player's save path is only updated once the write has succeeded.
+*/
+@interface OOAsyncSaveGameWriter: NSObject <OOAsyncWorkTask>
+{
+@private
+	PlayerEntity			*_player;
+	NSDictionary			*_commanderData;
+	NSString				*_path;
+	BOOL					_binary;
+	BOOL					_autosave;
+	BOOL					_succeeded;
+	NSString				*_errorDescription;
+}
+
+- (id) initWithPlayer:(PlayerEntity *)player commanderData:(NSDictionary *)data path:(NSString *)path binary:(BOOL)binary autosave:(BOOL)autosave;
+
+@end
+
+
+static OOAsyncSaveGameWriter *sPendingSaveWrite = nil;
+
+static BOOL WriteDataToFileSynced(NSData *data, NSString *path);
+
+
 @implementation PlayerEntity (LoadSave)
 
 - (BOOL)loadPlayer
@@ -144,12 +180,10 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 
 - (void) autosavePlayer
 {
-	NSString		*tmp_path = nil;
 	NSString		*tmp_name = nil;
 	NSString		*dir = [[UNIVERSE gameController] playerFileDirectory];
 	
 	tmp_name = [self lastsaveName];
-	tmp_path = save_path;
 	
 	ShipScriptEventNoCx(self, "playerWillSaveGame", OOJSSTR("AUTO_SAVE"));
 	
@@ -166,18 +200,13 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 	
 	@try
 	{
-		[self writePlayerToPath:savePath];
+		[self writePlayerToPath:savePath asAutosave:YES];
 	}
 	@catch (id exception)
 	{
 		// Suppress exceptions silently. Warning the user about failed autosaves would be pretty unhelpful.
 	}
 	
-	if (tmp_path != nil)
-	{
-		[save_path autorelease];
-		save_path = [tmp_path copy];
-	}
 	[self setLastsaveName:tmp_name];
 }
 
@@ -187,6 +216,7 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 	MyOpenGLView	*gameView = [UNIVERSE gameView];
 	NSString		*path = nil;
 	
+	[self finishPendingSave];	// so that save_path is up to date
 	path = save_path;
 	if (!path)  path = [[gameView gameController] playerFileToLoad];
 	if (!path)
@@ -609,6 +639,8 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 	NSDictionary	*fileDic = nil;
 	NSString		*fail_reason = nil;
 	
+	[self finishPendingSave];
+	
 	if (fileToOpen == nil)
 	{
 		fail_reason = DESC(@"loadfailed-no-file-specified");
@@ -812,6 +844,15 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 	return loadedOK;
 }
 
+
+- (void) finishPendingSave
+{
+	if (sPendingSaveWrite == nil)  return;
+	
+	[[OOAsyncWorkManager sharedAsyncWorkManager] waitForTaskToComplete:sPendingSaveWrite];
+	DESTROY(sPendingSaveWrite);
+}
+
 @end
 
 
@@ -867,10 +908,15 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 
 
 - (void) writePlayerToPath:(NSString *)path
+{
+	[self writePlayerToPath:path asAutosave:NO];
+}
+
+
+- (void) writePlayerToPath:(NSString *)path asAutosave:(BOOL)autosave
 {
 	NSString		*errDesc = nil;
 	NSDictionary	*dict = nil;
-	BOOL			didSave = NO;
 	[[UNIVERSE gameView] resetTypedString];
 	
 	if (!path)
@@ -879,31 +925,49 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 		return;
 	}
 	
+	/*	The commander data refers to live mutable state, so the writer gets
+		an immutable snapshot. Encoding and writing it, which is the slow
+		part, happen on a worker thread. An earlier save still in progress
+		is finished first so that saves to the same file land in order.
+	*/
 	dict = [self commanderDataDictionary];
-	if (dict == nil)  errDesc = @"could not construct commander data dictionary.";
-	else  didSave = [dict writeOOXMLToFile:path atomically:YES errorDescription:&errDesc];
-	if (didSave)
-	{
-		[UNIVERSE clearPreviousMessage];	// allow this to be given time and again
-		[UNIVERSE addMessage:DESC(@"game-saved") forCount:2];
-		[save_path autorelease];
-		save_path = [path copy];
-		[[UNIVERSE gameController] setPlayerFileToLoad:save_path];
-		[[UNIVERSE gameController] setPlayerFileDirectory:save_path];
-		// no duplicated autosave immediately after a save.
-		[UNIVERSE setAutoSaveNow:NO];
-	}
-	else
+	if (dict == nil)
 	{
+		errDesc = @"could not construct commander data dictionary.";
 		OOLog(@"save.failed", @"***** SAVE ERROR: %@", errDesc);
 		[NSException raise:@"OoliteException"
 					format:@"Attempt to save game to file '%@' failed: %@", path, errDesc];
 	}
+	
+	[self finishPendingSave];
+	
+	NSDictionary *snapshot = OODeepCopy(dict);
+	BOOL binary = [[NSUserDefaults standardUserDefaults] oo_boolForKey:@"binary-save-games" defaultValue:NO];
+	sPendingSaveWrite = [[OOAsyncSaveGameWriter alloc] initWithPlayer:self commanderData:snapshot path:path binary:binary autosave:autosave];
+	[snapshot release];
+	[[OOAsyncWorkManager sharedAsyncWorkManager] addTask:sPendingSaveWrite priority:kOOAsyncPriorityHigh];
+	
 	[[UNIVERSE gameView] suppressKeysUntilKeyUp];
 	[self setGuiToStatusScreen];
 }
 
 
+// Called by OOAsyncSaveGameWriter once the file has been written.
+- (void) noteGameSavedToPath:(NSString *)path asAutosave:(BOOL)autosave
+{
+	// An autosave only becomes the save path if there wasn't one already.
+	if (!autosave || save_path == nil)
+	{
+		[save_path autorelease];
+		save_path = [path copy];
+	}
+	[[UNIVERSE gameController] setPlayerFileToLoad:path];
+	[[UNIVERSE gameController] setPlayerFileDirectory:path];
+	// no duplicated autosave immediately after a save.
+	[UNIVERSE setAutoSaveNow:NO];
+}
+
+
 - (void)nativeSavePlayer:(NSString *)cdrName
 {
 	NSString*	dir = [[UNIVERSE gameController] playerFileDirectory];
@@ -924,6 +988,8 @@ static uint16_t PersonalityForCommanderDict(NSDictionary *dict);
 	GuiDisplayGen *gui=[UNIVERSE gui];
 	NSString*	dir = [[UNIVERSE gameController] playerFileDirectory];
 	
+	[self finishPendingSave];	// so the listing is up to date
+	
 	gui_screen = GUI_SCREEN_LOAD;
 	
 	[gui clear];
@@ -1369,6 +1435,128 @@ NSComparisonResult sortCommanders(id cdr1, id cdr2, void *context)
 #endif
 
 
+@implementation OOAsyncSaveGameWriter
+
+- (id) initWithPlayer:(PlayerEntity *)player commanderData:(NSDictionary *)data path:(NSString *)path binary:(BOOL)binary autosave:(BOOL)autosave
+{
+	if ((self = [super init]))
+	{
+		_player = [player retain];
+		_commanderData = [data retain];
+		_path = [path copy];
+		_binary = !!binary;
+		_autosave = !!autosave;
+		if (_player == nil || _commanderData == nil || _path == nil)
+		{
+			[self release];
+			self = nil;
+		}
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_player);
+	DESTROY(_commanderData);
+	DESTROY(_path);
+	DESTROY(_errorDescription);
+	
+	[super dealloc];
+}
+
+
+- (void) performAsyncTask
+{
+	NSString				*errorDesc = nil;
+	NSPropertyListFormat	format = _binary ? NSPropertyListBinaryFormat_v1_0 : NSPropertyListXMLFormat_v1_0;
+	
+	NSData *data = [NSPropertyListSerialization dataFromPropertyList:_commanderData format:format errorDescription:&errorDesc];
+	if (data == nil)
+	{
+		_errorDescription = [[NSString alloc] initWithFormat:@"could not convert property list to %@: %@", _binary ? @"binary" : @"XML", errorDesc];
+#if OOLITE_RELEASE_PLIST_ERROR_STRINGS
+		[errorDesc release];
+#endif
+	}
+	else if (!WriteDataToFileSynced(data, _path))
+	{
+		_errorDescription = [[NSString alloc] initWithFormat:@"could not write data to %@.", _path];
+	}
+	else
+	{
+		_succeeded = YES;
+	}
+	
+	DESTROY(_commanderData);
+}
+
+
+- (void) completeAsyncTask
+{
+	if (_succeeded)
+	{
+		[UNIVERSE clearPreviousMessage];	// allow this to be given time and again
+		[UNIVERSE addMessage:DESC(@"game-saved") forCount:2];
+		[_player noteGameSavedToPath:_path asAutosave:_autosave];
+	}
+	else
+	{
+		OOLog(@"save.failed", @"***** SAVE ERROR: attempt to save game to file '%@' failed: %@", _path, _errorDescription);
+		if (!_autosave)
+		{
+			[UNIVERSE clearPreviousMessage];
+			[UNIVERSE addMessage:DESC(@"game-save-failed") forCount:4];
+		}
+	}
+}
+
+@end
+
+
+/*	Write data to a temporary file next to path, flush it to disk and move it
+	into place, so that a crash or power loss leaves either the old save or
+	the new one. Windows has neither fsync() nor a rename() which replaces
+	existing files, so there we settle for an ordinary atomic write.
+*/
+static BOOL WriteDataToFileSynced(NSData *data, NSString *path)
+{
+#if OOLITE_WINDOWS
+	return [data writeToFile:path atomically:YES];
+#else
+	NSString		*tempPath = [path stringByAppendingString:@".tmp"];
+	const char		*tempFile = [tempPath fileSystemRepresentation];
+	const uint8_t	*bytes = [data bytes];
+	NSUInteger		remaining = [data length];
+	BOOL			OK = YES;
+	
+	int fd = open(tempFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)  return NO;
+	
+	while (OK && remaining > 0)
+	{
+		ssize_t written = write(fd, bytes, remaining);
+		if (written < 0)
+		{
+			if (errno != EINTR)  OK = NO;
+			continue;
+		}
+		bytes += written;
+		remaining -= written;
+	}
+	
+	if (OK && fsync(fd) != 0)  OK = NO;
+	if (close(fd) != 0)  OK = NO;
+	if (OK && rename(tempFile, [path fileSystemRepresentation]) != 0)  OK = NO;
+	
+	if (!OK)  unlink(tempFile);
+	return OK;
+#endif
+}
+
+
 static uint16_t PersonalityForCommanderDict(NSDictionary *dict)
 {
 	uint16_t personality = [dict oo_unsignedShortForKey:@"entity_personality" defaultValue:ENTITY_PERSONALITY_INVALID];
@@ -93,9 +93,6 @@
 
 #define AIMS_AGGRESSOR_SWITCHED_TARGET	@"AGGRESSOR_SWITCHED_TARGET"
 
-// number of vessels considered when scanning around
-#define MAX_SCAN_NUMBER					32
-
 #define BASELINE_SHIELD_LEVEL			128.0f			// Max shield level with no boosters.
 #define INITIAL_SHOT_TIME				100.0
 
@@ -272,6 +269,7 @@ typedef enum
 							isMissile: 1,				// Whether this was launched by fireMissile (used to track submunitions).
 							_explicitlyUnpiloted: 1,	// Is meant to not have crew
 							hasScoopMessage: 1,			// suppress scoop messages when false.
+							flightModelCanBurn: 1,		// fuel injectors usable in the deferred flight model step
 							
 							// scripting
 							scripted_misjump: 1,
@@ -408,10 +406,11 @@ typedef enum
 	// from player entity moved here now we're doing more complex heat stuff
 	float					ship_temperature;
 	
-	// for advanced scanning etc.
-	ShipEntity				*scanned_ships[MAX_SCAN_NUMBER + 1];
-	GLfloat					distance2_scanned_ships[MAX_SCAN_NUMBER + 1];
+	// for advanced scanning etc.; filled in by -checkScanner, grown as needed.
+	ShipEntity				**scanned_ships;
+	GLfloat					*distance2_scanned_ships;
 	unsigned				n_scanned_ships;
+	unsigned				scanned_ships_capacity;
 	
 	// advanced navigation
 	HPVector					navpoints[32];
@@ -739,8 +738,18 @@ typedef enum
 - (void)setAutoCloak:(BOOL)automatic;
 
 - (void) applyThrust:(double) delta_t;
+- (void) applyThrust:(double)delta_t canBurn:(BOOL)canBurn;
 - (void) applyAttitudeChanges:(double) delta_t;
 
+/*	Split entity update (see -[Universe splitEntityUpdate]): the flight model
+	step of -update: is deferred, run on a worker thread with the steps of
+	other ships, then committed on the main thread. The apply step only
+	touches the ship's own flight state, and must not send messages to other
+	objects.
+*/
+- (void) applyDeferredFlightModel:(OOTimeDelta)delta_t;
+- (void) commitDeferredFlightModel;
+
 - (void) avoidCollision;
 - (void) resumePostProximityAlert;
 
@@ -944,6 +953,7 @@ typedef enum
 - (void) setTotalVelocity:(Vector)vel;	// Set velocity to vel - thrustVector, effectively setting the instanteneous velocity to vel.
 
 - (void) increase_flight_speed:(double)delta;
+- (void) increase_flight_speed:(double)delta canBurn:(BOOL)canBurn;
 - (void) decrease_flight_speed:(double)delta;
 - (void) increase_flight_roll:(double)delta;
 - (void) decrease_flight_roll:(double)delta;
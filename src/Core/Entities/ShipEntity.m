@@ -57,7 +57,6 @@ MA 02110-1301, USA.
 #import "OOColor.h"
 #import "OOPolygonSprite.h"
 
-#import "OOParticleSystem.h"
 #import "StationEntity.h"
 #import "DockEntity.h"
 #import "OOSunEntity.h"
@@ -67,11 +66,9 @@ MA 02110-1301, USA.
 #import "WormholeEntity.h"
 #import "OOFlasherEntity.h"
 #import "OOExhaustPlumeEntity.h"
-#import "OOSparkEntity.h"
 #import "OOECMBlastEntity.h"
 #import "OOPlasmaShotEntity.h"
-#import "OOFlashEffectEntity.h"
-#import "OOExplosionCloudEntity.h"
+#import "OOParticleEngine.h"
 #import "ProxyPlayerEntity.h"
 #import "OOLaserShotEntity.h"
 #import "OOQuiriumCascadeEntity.h"
@@ -141,7 +138,9 @@ static GLfloat calcFuelChargeRate (GLfloat myMass)
 - (void) rescaleBy:(GLfloat)factor writeToCache:(BOOL)writeToCache;
 
 - (BOOL) setUpOneSubentity:(NSDictionary *) subentDict;
+- (BOOL) setUpOneTemplateSubentity:(const OOShipTemplateSubentity *)subentity;
 - (BOOL) setUpOneFlasher:(NSDictionary *) subentDict;
+- (BOOL) setUpOneStandardTemplateSubentity:(const OOShipTemplateSubentity *)subentDecl;
 
 - (Entity<OOStellarBody> *) lastAegisLock;
 
@@ -164,6 +163,9 @@ static GLfloat calcFuelChargeRate (GLfloat myMass)
 
 - (BOOL) cloakPassive;
 
+- (void) scanIgnoringUnpowered:(BOOL)ignoreUnpowered;
+- (void) addScannedShip:(ShipEntity *)ship distance2:(GLfloat)d2;
+
 @end
 
 
@@ -262,22 +264,25 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	_lightsActive = YES;
 	
 
-	// set things from dictionary from here out - default values might require adjustment -- Kaks 20091130
-	_scaleFactor = [shipDict oo_floatForKey:@"model_scale_factor" defaultValue:1.0f];
+	const OOShipTemplate *t = [[OOShipRegistry sharedRegistry] shipTemplateForKey:_shipKey definition:shipDict];
+	if (EXPECT_NOT(t == NULL))  return NO;
+	
+	// set things from template from here out - default values might require adjustment -- Kaks 20091130
+	_scaleFactor = t->scaleFactor;
 
 
 	float defaultSpeed = isStation ? 0.0f : 160.0f;
-	maxFlightSpeed = [shipDict oo_floatForKey:@"max_flight_speed" defaultValue:defaultSpeed];
-	max_flight_roll = [shipDict oo_floatForKey:@"max_flight_roll" defaultValue:2.0f];
-	max_flight_pitch = [shipDict oo_floatForKey:@"max_flight_pitch" defaultValue:1.0f];
-	max_flight_yaw = [shipDict oo_floatForKey:@"max_flight_yaw" defaultValue:max_flight_pitch];	// Note by default yaw == pitch
+	maxFlightSpeed = t->hasMaxFlightSpeed ? t->maxFlightSpeed : defaultSpeed;
+	max_flight_roll = t->maxFlightRoll;
+	max_flight_pitch = t->maxFlightPitch;
+	max_flight_yaw = t->maxFlightYaw;
 	cruiseSpeed = maxFlightSpeed*0.8f;
 	
-	max_thrust = [shipDict oo_floatForKey:@"thrust" defaultValue:15.0f];
+	max_thrust = t->thrust;
 	thrust = max_thrust;
 
-	afterburner_rate = [shipDict oo_floatForKey:@"injector_burn_rate" defaultValue:AFTERBURNER_BURNRATE];
-	afterburner_speed_factor = [shipDict oo_floatForKey:@"injector_speed_factor" defaultValue:7.0f];
+	afterburner_rate = t->injectorBurnRate;
+	afterburner_speed_factor = t->injectorSpeedFactor;
 	if (afterburner_speed_factor < 1.0)
 	{
 		OOLog(@"ship.setup.injectorSpeed",@"injector_speed_factor cannot be lower than 1.0 for %@",self);
@@ -297,29 +302,25 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	}
 #endif
 
-	maxEnergy = [shipDict oo_floatForKey:@"max_energy" defaultValue:200.0f];
-	energy_recharge_rate = [shipDict oo_floatForKey:@"energy_recharge_rate" defaultValue:1.0f];
+	maxEnergy = t->maxEnergy;
+	energy_recharge_rate = t->energyRechargeRate;
 	
-	_showDamage = [shipDict oo_boolForKey:@"show_damage" defaultValue:(energy_recharge_rate > 0)];
+	_showDamage = t->showDamage;
 	// Each new ship should start in seemingly good operating condition, unless specifically told not to - this does not affect the ship's energy levels
-	[self setThrowSparks:[shipDict oo_boolForKey:@"throw_sparks" defaultValue:NO]];
-	
-	weapon_facings = [shipDict oo_intForKey:@"weapon_facings" defaultValue:VALID_WEAPON_FACINGS] & VALID_WEAPON_FACINGS;
-	if (weapon_facings & WEAPON_FACING_FORWARD)
-		forward_weapon_type = OOWeaponTypeFromString([shipDict oo_stringForKey:@"forward_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]);
-	if (weapon_facings & WEAPON_FACING_AFT)
-		aft_weapon_type = OOWeaponTypeFromString([shipDict oo_stringForKey:@"aft_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]);
-	if (weapon_facings & WEAPON_FACING_PORT)
-		port_weapon_type = OOWeaponTypeFromString([shipDict oo_stringForKey:@"port_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]);
-	if (weapon_facings & WEAPON_FACING_STARBOARD)
-		starboard_weapon_type = OOWeaponTypeFromString([shipDict oo_stringForKey:@"starboard_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]);
+	[self setThrowSparks:t->throwSparks];
+	
+	weapon_facings = t->weaponFacings;
+	if (weapon_facings & WEAPON_FACING_FORWARD)  forward_weapon_type = t->forwardWeaponType;
+	if (weapon_facings & WEAPON_FACING_AFT)  aft_weapon_type = t->aftWeaponType;
+	if (weapon_facings & WEAPON_FACING_PORT)  port_weapon_type = t->portWeaponType;
+	if (weapon_facings & WEAPON_FACING_STARBOARD)  starboard_weapon_type = t->starboardWeaponType;
 
 	cloaking_device_active = NO;
 	military_jammer_active = NO;
-	cloakPassive = [shipDict oo_boolForKey:@"cloak_passive" defaultValue:YES]; // Nikos - switched passive cloak default to YES 20120523
-	cloakAutomatic = [shipDict oo_boolForKey:@"cloak_automatic" defaultValue:YES];
+	cloakPassive = t->cloakPassive; // Nikos - switched passive cloak default to YES 20120523
+	cloakAutomatic = t->cloakAutomatic;
 
-	missiles = [shipDict oo_intForKey:@"missiles" defaultValue:0];
+	missiles = t->missiles;
 	/* TODO: The following initializes the missile list to be blank, which prevents a crash caused by hasOneEquipmentItem trying to access a missile list
 	         previously initialized but then released.  See issue #204.  We need to investigate further the cause of the missile list being released.
  			- kanthoney 10/03/2017
@@ -333,19 +334,19 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	{
 		missile_list[i] = nil;
 	}
-	max_missiles = [shipDict oo_intForKey:@"max_missiles" defaultValue:missiles];
+	max_missiles = t->maxMissiles;
 	if (max_missiles > SHIPENTITY_MAX_MISSILES) max_missiles = SHIPENTITY_MAX_MISSILES;
 	if (missiles > max_missiles) missiles = max_missiles;
-	missile_load_time = fmax(0.0, [shipDict oo_doubleForKey:@"missile_load_time" defaultValue:0.0]); // no negative load times
+	missile_load_time = t->missileLoadTime;
 	missile_launch_time = [UNIVERSE getTime] + missile_load_time;
 	
 	// upgrades:
 	equipment_weight = 0; 
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_ecm"])  [self addEquipmentItem:@"EQ_ECM" inContext:@"npc"];
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_scoop"])  [self addEquipmentItem:@"EQ_FUEL_SCOOPS" inContext:@"npc"];
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_escape_pod"])  [self addEquipmentItem:@"EQ_ESCAPE_POD" inContext:@"npc"];
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_cloaking_device"])  [self addEquipmentItem:@"EQ_CLOAKING_DEVICE" inContext:@"npc"];
-	if ([shipDict oo_floatForKey:@"has_energy_bomb"] > 0)
+	if (OOShipTemplateRoll(t->hasECM))  [self addEquipmentItem:@"EQ_ECM" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasScoop))  [self addEquipmentItem:@"EQ_FUEL_SCOOPS" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasEscapePod))  [self addEquipmentItem:@"EQ_ESCAPE_POD" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasCloakingDevice))  [self addEquipmentItem:@"EQ_CLOAKING_DEVICE" inContext:@"npc"];
+	if (t->hasEnergyBombValue > 0)
 	{
 		/*	NOTE: has_energy_bomb actually refers to QC mines.
 			
@@ -355,9 +356,9 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 			explicit, we add an extra missile slot to compensate.
 			-- Ahruman 2011-03-25
 		*/
-		if ([shipDict oo_fuzzyBooleanForKey:@"has_energy_bomb"])
+		if (OOShipTemplateRoll(t->hasEnergyBomb))
 		{
-			if (max_missiles == missiles && max_missiles < SHIPENTITY_MAX_MISSILES && [shipDict objectForKey:@"max_missiles"] == nil)
+			if (max_missiles == missiles && max_missiles < SHIPENTITY_MAX_MISSILES && !t->hasMaxMissiles)
 			{
 				max_missiles++;
 			}
@@ -365,50 +366,48 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		}
 	}
 
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_fuel_injection"])  [self addEquipmentItem:@"EQ_FUEL_INJECTION" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasFuelInjection))  [self addEquipmentItem:@"EQ_FUEL_INJECTION" inContext:@"npc"];
 
 #if USEMASC
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_military_jammer"])  [self addEquipmentItem:@"EQ_MILITARY_JAMMER" inContext:@"npc"];
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_military_scanner_filter"])  [self addEquipmentItem:@"EQ_MILITARY_SCANNER_FILTER" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasMilitaryJammer))  [self addEquipmentItem:@"EQ_MILITARY_JAMMER" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasMilitaryScannerFilter))  [self addEquipmentItem:@"EQ_MILITARY_SCANNER_FILTER" inContext:@"npc"];
 #endif
 	
 	
 	// can it be 'mined' for alloys?
-	canFragment = [shipDict oo_fuzzyBooleanForKey:@"fragment_chance" defaultValue:0.9];
+	canFragment = OOShipTemplateRoll(t->fragmentChance);
 	isWreckage = NO;
 
 	// can subentities be destroyed separately?
-	isFrangible = [shipDict oo_boolForKey:@"frangible" defaultValue:YES];
+	isFrangible = t->isFrangible;
 	
-	max_cargo = [shipDict oo_unsignedIntForKey:@"max_cargo"];
-	extra_cargo = [shipDict oo_unsignedIntForKey:@"extra_cargo" defaultValue:15];
+	max_cargo = t->maxCargo;
+	extra_cargo = t->extraCargo;
 	
-	hyperspaceMotorSpinTime = [shipDict oo_floatForKey:@"hyperspace_motor_spin_time" defaultValue:DEFAULT_HYPERSPACE_SPIN_TIME];
-	if(![shipDict oo_boolForKey:@"hyperspace_motor" defaultValue:YES]) hyperspaceMotorSpinTime = -1;
+	hyperspaceMotorSpinTime = t->hyperspaceMotorSpinTime;
 	
 	[name autorelease];
-	name = [[shipDict oo_stringForKey:@"name" defaultValue:@"?"] copy];
+	name = [t->name copy];
 	
 	[shipUniqueName autorelease];
-	shipUniqueName = [[shipDict oo_stringForKey:@"ship_name" defaultValue:@""] copy];
+	shipUniqueName = [t->shipUniqueName copy];
 
 	[shipClassName autorelease];
-	shipClassName = [[shipDict oo_stringForKey:@"ship_class_name" defaultValue:name] copy];
+	shipClassName = [t->shipClassName copy];
 
 	[displayName autorelease];
-	displayName = [[shipDict oo_stringForKey:@"display_name" defaultValue:nil] copy];
+	displayName = [t->displayName copy];
 	
 	// Load the model (must be before subentities)
-	NSString *modelName = [shipDict oo_stringForKey:@"model"];
-	if (modelName != nil)
+	if (t->modelName != nil)
 	{
 		OOMesh *mesh = nil;
 
-		mesh = [OOMesh meshWithName:modelName
-						   cacheKey:[NSString stringWithFormat:@"%@-%.3f",_shipKey,_scaleFactor]
-				 materialDictionary:[shipDict oo_dictionaryForKey:@"materials"]
-				  shadersDictionary:[shipDict oo_dictionaryForKey:@"shaders"]
-							 smooth:[shipDict oo_boolForKey:@"smooth" defaultValue:NO]
+		mesh = [OOMesh meshWithName:t->modelName
+						   cacheKey:t->meshCacheKey
+				 materialDictionary:t->materials
+				  shadersDictionary:t->shaders
+							 smooth:t->smooth
 					   shaderMacros:OODefaultShipShaderMacros()
 					   shaderBindingTarget:self
 						scaleFactor:_scaleFactor
@@ -418,11 +417,10 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		[self setMesh:mesh];
 	}
 	
-	float density = [shipDict oo_floatForKey:@"density" defaultValue:1.0f];
-	if (octree)  mass = (GLfloat)(density * 20.0f * [octree volume]);
+	if (octree)  mass = (GLfloat)(t->density * 20.0f * [octree volume]);
 	
 	DESTROY(default_laser_color);
-	default_laser_color = [[OOColor brightColorWithDescription:[shipDict objectForKey:@"laser_color"]] retain];
+	default_laser_color = [t->laserColor retain];
 	
 	if (default_laser_color == nil) 
 	{
@@ -433,17 +431,14 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		[self setLaserColor:default_laser_color];
 	}
 	// exhaust emissive color
-	OORGBAComponents defaultExhaustEmissiveColorComponents; // pale blue is exhaust default color
-	defaultExhaustEmissiveColorComponents.r = 0.7f;
-	defaultExhaustEmissiveColorComponents.g = 0.9f;
-	defaultExhaustEmissiveColorComponents.b = 1.0f;
-	defaultExhaustEmissiveColorComponents.a = 0.9f;
-	OOColor *color = [OOColor brightColorWithDescription:[shipDict objectForKey:@"exhaust_emissive_color"]];
-	if (color == nil)  color = [OOColor colorWithRGBAComponents:defaultExhaustEmissiveColorComponents];
-	[self setExhaustEmissiveColor:color];
+	[self setExhaustEmissiveColor:t->exhaustEmissiveColor];
 	
 	[self clearSubEntities];
 	[self setUpSubEntities];
+	
+	// Setting up subentities may have compiled other templates; make sure ours is current.
+	t = [[OOShipRegistry sharedRegistry] shipTemplateForKey:_shipKey definition:shipDict];
+	if (EXPECT_NOT(t == NULL))  return NO;
 
 // correctly initialise weaponRange, etc. (must be after subentity setup)
 	if (isWeaponNone(forward_weapon_type))
@@ -480,32 +475,27 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	}
 	
 	// rotating subentities
-	subentityRotationalVelocity = kIdentityQuaternion;
-	if ([shipDict objectForKey:@"rotational_velocity"])
-	{
-		subentityRotationalVelocity = [shipDict oo_quaternionForKey:@"rotational_velocity"];
-	}
+	subentityRotationalVelocity = t->rotationalVelocity;
 
 	// set weapon offsets
-	NSString *weaponMountMode = [shipDict oo_stringForKey:@"weapon_mount_mode" defaultValue:@"single"];
-	_multiplyWeapons = [weaponMountMode isEqualToString:@"multiply"];
-	forwardWeaponOffset = [[self getWeaponOffsetFrom:shipDict withKey:@"weapon_position_forward" inMode:weaponMountMode] retain];
-	aftWeaponOffset = [[self getWeaponOffsetFrom:shipDict withKey:@"weapon_position_aft" inMode:weaponMountMode] retain];
-	portWeaponOffset = [[self getWeaponOffsetFrom:shipDict withKey:@"weapon_position_port" inMode:weaponMountMode] retain];
-	starboardWeaponOffset = [[self getWeaponOffsetFrom:shipDict withKey:@"weapon_position_starboard" inMode:weaponMountMode] retain];
+	_multiplyWeapons = t->multiplyWeapons;
+	forwardWeaponOffset = [t->forwardWeaponOffset retain];
+	aftWeaponOffset = [t->aftWeaponOffset retain];
+	portWeaponOffset = [t->portWeaponOffset retain];
+	starboardWeaponOffset = [t->starboardWeaponOffset retain];
 
 	
-	tractor_position = vector_multiply_scalar([shipDict oo_vectorForKey:@"scoop_position"],_scaleFactor);
+	tractor_position = t->scoopPosition;
 	
 
 	
 	// sun glare filter - default is high filter, both for HDR and SDR
-	[self setSunGlareFilter:[shipDict oo_floatForKey:@"sun_glare_filter" defaultValue:0.97f]];
+	[self setSunGlareFilter:t->sunGlareFilter];
 	
 	// Get scriptInfo dictionary, containing arbitrary stuff scripts might be interested in.
-	scriptInfo = [[shipDict oo_dictionaryForKey:@"script_info" defaultValue:nil] retain];
+	scriptInfo = [t->scriptInfo retain];
 
-	explosionType = [[shipDict oo_arrayForKey:@"explosion_type" defaultValue:nil] retain];
+	explosionType = [t->explosionType retain];
 
 	isDemoShip = NO;
 	
@@ -522,6 +512,10 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	
 	if (![self setUpFromDictionary:shipDict]) return NO;
 	
+	// Use the same (immutable) definition as -setUpFromDictionary:, so the template is shared.
+	const OOShipTemplate *t = [[OOShipRegistry sharedRegistry] shipTemplateForKey:_shipKey definition:shipinfoDictionary];
+	if (EXPECT_NOT(t == NULL))  return NO;
+	
 	// NPC-only settings.
 	//
 	orientation = kIdentityQuaternion;
@@ -534,22 +528,16 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	isShip = YES;
 
 	// scan class settings. 'scanClass' is in common usage, but we could also have a more standard 'scan_class' key with higher precedence. Kaks 20090810 
-	// let's see if scan_class is set... 
-	scanClass = OOScanClassFromString([shipDict oo_stringForKey:@"scan_class" defaultValue:@"CLASS_NOT_SET"]);
-	
-	// if not, try 'scanClass'. NOTE: non-standard capitalization is documented and entrenched.
-	if (scanClass == CLASS_NOT_SET)
-	{
-		scanClass = OOScanClassFromString([shipDict oo_stringForKey:@"scanClass" defaultValue:@"CLASS_NOT_SET"]);
-	}
+	// NOTE: non-standard capitalization is documented and entrenched; both are resolved in the template.
+	scanClass = t->scanClass;
 
 	[scan_description autorelease];
-	scan_description = [[shipDict oo_stringForKey:@"scan_description" defaultValue:nil] copy];
+	scan_description = [t->scanDescription copy];
 
 	// FIXME: give NPCs shields instead.
 	
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_shield_booster"])  [self addEquipmentItem:@"EQ_SHIELD_BOOSTER" inContext:@"npc"];
-	if ([shipDict oo_fuzzyBooleanForKey:@"has_shield_enhancer"])  [self addEquipmentItem:@"EQ_SHIELD_ENHANCER" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasShieldBooster))  [self addEquipmentItem:@"EQ_SHIELD_BOOSTER" inContext:@"npc"];
+	if (OOShipTemplateRoll(t->hasShieldEnhancer))  [self addEquipmentItem:@"EQ_SHIELD_ENHANCER" inContext:@"npc"];
 	
 	// Start with full energy banks.
 	energy = maxEnergy;
@@ -563,32 +551,32 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	// no weapon_damage? It's a missile: set weapon_damage from shipdata!
 	if (weapon_damage == 0.0) 
 	{
-		weapon_damage_override = weapon_damage = [shipDict oo_floatForKey:@"weapon_energy" defaultValue:0]; // any damage value for missiles/bombs
+		weapon_damage_override = weapon_damage = t->weaponEnergy; // any damage value for missiles/bombs
 	}
 	else
 	{
 		weapon_damage_override = 0;
 	}
 
-	scannerRange = [shipDict oo_floatForKey:@"scanner_range" defaultValue:(float)SCANNER_MAX_RANGE];
+	scannerRange = t->scannerRange;
 	
-	fuel = [shipDict oo_unsignedShortForKey:@"fuel"];	// Does it make sense that this defaults to 0? Should it not be 70? -- Ahruman
+	fuel = t->fuel;	// Does it make sense that this defaults to 0? Should it not be 70? -- Ahruman
 	
 	fuel_accumulator = 1.0;
 	
-	[self setBounty:[shipDict oo_unsignedIntForKey:@"bounty" defaultValue:0] withReason:kOOLegalStatusReasonSetup];
+	[self setBounty:t->bounty withReason:kOOLegalStatusReasonSetup];
 	
 	[shipAI autorelease];
 	shipAI = [[AI alloc] init];
 	[shipAI setOwner:self];
-	[self setAITo:[shipDict oo_stringForKey:@"ai_type" defaultValue:@"nullAI.plist"]];
+	[self setAITo:t->aiName];
 	
-	likely_cargo = [shipDict oo_unsignedIntForKey:@"likely_cargo"];
-	noRocks = [shipDict oo_fuzzyBooleanForKey:@"no_boulders"];
+	likely_cargo = t->likelyCargo;
+	noRocks = OOShipTemplateRoll(t->noBoulders);
 	
 	commodity_amount = 0;
 	commodity_type = nil;
-	NSString *cargoString = [shipDict oo_stringForKey:@"cargo_carried"];
+	NSString *cargoString = t->cargoCarried;
 	if (cargoString != nil)
 	{
 		if ([cargoString isEqualToString:@"SCARCE_GOODS"])
@@ -626,7 +614,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 			else
 			{
 				c_amount = 1;
-				c_commodity = [shipDict oo_stringForKey:@"cargo_carried"];
+				c_commodity = cargoString;
 				if ([[UNIVERSE commodities] goodDefined:c_commodity])
 				{
 					[self setCommodityForPod:c_commodity andAmount:c_amount];
@@ -643,7 +631,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		}
 	}
 	
-	cargoString = [shipDict oo_stringForKey:@"cargo_type"];
+	cargoString = t->cargoType;
 	if (cargoString)
 	{
 		if (cargo != nil) [cargo autorelease];
@@ -659,16 +647,16 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		cargo_type = CARGO_NOT_CARGO;
 	}
 	
-	hasScoopMessage = [shipDict oo_boolForKey:@"has_scoop_message" defaultValue:YES];
+	hasScoopMessage = t->hasScoopMessage;
 
 	
 	[roleSet release];
-	roleSet = [[[OORoleSet roleSetWithString:[shipDict oo_stringForKey:@"roles"]] roleSetWithRemovedRole:@"player"] retain];
+	roleSet = [t->roleSet retain];
 	[primaryRole release];
 	primaryRole = nil;
 	
 	[self setOwner:self];
-	[self setHulk:[shipDict oo_boolForKey:@"is_hulk"]];
+	[self setHulk:t->isHulk];
 	
 	// these are the colors used for the "lollipop" of the ship. Any of the two (or both, for flash effect) can be defined. nil means use default from shipData.
 	[self setScannerDisplayColor1:nil];
@@ -679,7 +667,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 
 
 	// Populate the missiles here. Must come after scanClass.
-	_missileRole = [shipDict oo_stringForKey:@"missile_role"];
+	_missileRole = t->missileRole;
 	unsigned	i, j;
 	for (i = 0, j = 0; i < missiles; i++)
 	{
@@ -707,7 +695,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 // enables "better" AIs at +5 and above
 // police and military always have positive accuracy
 
-	accuracy = [shipDict oo_floatForKey:@"accuracy" defaultValue:-100.0f];	// Out-of-range default
+	accuracy = t->accuracy;	// Out-of-range default
 	if (accuracy < -5.0f || accuracy > 10.0f)
 	{
 		accuracy = (randf() * 10.0)-5.0;
@@ -725,9 +713,9 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	_missed_shots = 0;
 
 	//  escorts
-	_maxEscortCount = MIN([shipDict oo_unsignedCharForKey:@"escorts" defaultValue:0], (uint8_t)MAX_ESCORTS);
+	_maxEscortCount = t->escortCount;
 	_pendingEscortCount = _maxEscortCount;
-	if (_pendingEscortCount == 0 && [shipDict oo_arrayForKey:@"escort_roles" defaultValue:nil] != nil)
+	if (_pendingEscortCount == 0 && t->hasEscortRoles)
 	{
 		// mostly ignored by setUpMixedEscorts, but needs to be high
 		// enough that it doesn't end up at zero (e.g. by governmental
@@ -737,18 +725,18 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 
 	
 	// beacons
-	[self setBeaconCode:[shipDict oo_stringForKey:@"beacon"]];
-	[self setBeaconLabel:[shipDict oo_stringForKey:@"beacon_label" defaultValue:[shipDict oo_stringForKey:@"beacon"]]];
+	[self setBeaconCode:t->beaconCode];
+	[self setBeaconLabel:t->beaconLabel];
 
 	
 	// contact tracking entities
-	[self setTrackCloseContacts:[shipDict oo_boolForKey:@"track_contacts" defaultValue:NO]];
+	[self setTrackCloseContacts:t->trackContacts];
 	
 	// ship skin insulation factor (1.0 is normal)
-	[self setHeatInsulation:[shipDict oo_floatForKey:@"heat_insulation" defaultValue:[self hasHeatShield] ? 2.0 : 1.0]];
+	[self setHeatInsulation:t->hasHeatInsulation ? t->heatInsulation : ([self hasHeatShield] ? 2.0 : 1.0)];
 	
 	// unpiloted (like missiles asteroids etc.)
-	_explicitlyUnpiloted = [shipDict oo_fuzzyBooleanForKey:@"unpiloted"];
+	_explicitlyUnpiloted = OOShipTemplateRoll(t->unpiloted);
 	if (_explicitlyUnpiloted)
 	{
 		[self setCrew:nil];
@@ -756,7 +744,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	else 
 	{
 		// crew and passengers
-		NSDictionary *cdict = [[UNIVERSE characters] objectForKey:[shipDict oo_stringForKey:@"pilot"]];
+		NSDictionary *cdict = [[UNIVERSE characters] objectForKey:t->pilot];
 		if (cdict != nil)
 		{
 			OOCharacter	*pilot = [OOCharacter characterWithDictionary:cdict];
@@ -764,12 +752,12 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		}
 	}
 	
-	[self setShipScript:[shipDict oo_stringForKey:@"script"]];
+	[self setShipScript:t->scriptName];
 
 	home_system = [UNIVERSE currentSystemID];
 	destination_system = [UNIVERSE currentSystemID];
 
-	reactionTime = [shipDict oo_floatForKey: @"reaction_time" defaultValue: COMBAT_AI_STANDARD_REACTION_TIME];
+	reactionTime = t->reactionTime;
 	
 	return YES;
 	
@@ -856,27 +844,26 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 {
 	OOJS_PROFILE_ENTER
 	
-	unsigned int	i;
-	NSDictionary	*shipDict = [self shipInfoDictionary];
-	NSArray			*plumes = [shipDict oo_arrayForKey:@"exhaust"];
+	NSUInteger		i;
+	const OOShipTemplate *t = [[OOShipRegistry sharedRegistry] shipTemplateForKey:_shipKey definition:[self shipInfoDictionary]];
+	if (EXPECT_NOT(t == NULL))  return NO;
+	
+	NSArray			*plumes = t->exhaustDefinitions;
 	
 	_profileRadius = collision_radius;
 	_maxShipSubIdx = 0;
 	
 	for (i = 0; i < [plumes count]; i++)
 	{
-		NSArray *definition = ScanTokensFromString([plumes oo_stringAtIndex:i]);
-		OOExhaustPlumeEntity *exhaust = [OOExhaustPlumeEntity exhaustForShip:self withDefinition:definition andScale:_scaleFactor];
+		OOExhaustPlumeEntity *exhaust = [OOExhaustPlumeEntity exhaustForShip:self withDefinition:[plumes objectAtIndex:i] andScale:_scaleFactor];
 		[self addSubEntity:exhaust];
 	}
 	
-	NSArray *subs = [shipDict oo_arrayForKey:@"subentities"];
-	
 	totalBoundingBox = boundingBox;
 	
-	for (i = 0; i < [subs count]; i++)
+	for (i = 0; i < t->subentityCount; i++)
 	{
-		[self setUpOneSubentity:[subs oo_dictionaryAtIndex:i]];
+		[self setUpOneTemplateSubentity:&t->subentities[i]];
 	}
 	
 	no_draw_distance = _profileRadius * _profileRadius * NO_DRAW_DISTANCE_FACTOR * NO_DRAW_DISTANCE_FACTOR * 2.0;
@@ -907,19 +894,29 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 {
 	OOJS_PROFILE_ENTER
 	
-	NSString			*type = nil;
+	OOShipTemplateSubentity	subentity;
+	BOOL					OK;
+	
+	OOShipTemplateCompileSubentity(&subentity, subentDict);
+	OK = [self setUpOneTemplateSubentity:&subentity];
+	OOShipTemplateDestroySubentity(&subentity);
+	
+	return OK;
 	
-	type = [subentDict oo_stringForKey:@"type"];
-	if ([type isEqualToString:@"flasher"])
+	OOJS_PROFILE_EXIT
+}
+
+
+- (BOOL) setUpOneTemplateSubentity:(const OOShipTemplateSubentity *)subentity
+{
+	if (subentity->type == kOOShipTemplateSubentityFlasher)
 	{
-		return [self setUpOneFlasher:subentDict];
+		return [self setUpOneFlasher:subentity->definition];
 	}
 	else
 	{
-		return [self setUpOneStandardSubentity:subentDict asTurret:[type isEqualToString:@"ball_turret"]];
+		return [self setUpOneStandardTemplateSubentity:subentity];
 	}
-	
-	OOJS_PROFILE_EXIT
 }
 
 
@@ -934,19 +931,34 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 
 
 - (BOOL) setUpOneStandardSubentity:(NSDictionary *)subentDict asTurret:(BOOL)asTurret
+{
+	OOShipTemplateSubentity	subentity;
+	BOOL					OK;
+	
+	OOShipTemplateCompileSubentity(&subentity, subentDict);
+	subentity.type = asTurret ? kOOShipTemplateSubentityBallTurret : kOOShipTemplateSubentityStandard;
+	OK = [self setUpOneStandardTemplateSubentity:&subentity];
+	OOShipTemplateDestroySubentity(&subentity);
+	
+	return OK;
+}
+
+
+- (BOOL) setUpOneStandardTemplateSubentity:(const OOShipTemplateSubentity *)subentDecl
 {
 	ShipEntity			*subentity = nil;
-	NSString			*subentKey = nil;
-	HPVector				subPosition;
+	NSString			*subentKey = subentDecl->subentityKey;
+	BOOL				asTurret = (subentDecl->type == kOOShipTemplateSubentityBallTurret);
+	BOOL				isDock = !asTurret && [self isStation] && subentDecl->isDock;
+	HPVector			subPosition;
 	Quaternion			subOrientation;
 	
-	subentKey = [subentDict oo_stringForKey:@"subentity_key"];
 	if (subentKey == nil) {
-		OOLog(@"setup.ship.badEntry.subentities",@"Failed to set up entity - no subentKey in %@",subentDict);
+		OOLog(@"setup.ship.badEntry.subentities",@"Failed to set up entity - no subentKey in %@",subentDecl->definition);
 		return NO;
 	}
 	
-	if (!asTurret && [self isStation] && [subentDict oo_boolForKey:@"is_dock"])
+	if (isDock)
 	{
 		subentity = [UNIVERSE newDockWithName:subentKey andScaleFactor:_scaleFactor];
 	}
@@ -959,8 +971,8 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		return NO;
 	}
 	
-	subPosition = HPvector_multiply_scalar([subentDict oo_hpvectorForKey:@"position"],_scaleFactor);
-	subOrientation = [subentDict oo_quaternionForKey:@"orientation"];
+	subPosition = HPvector_multiply_scalar(subentDecl->position,_scaleFactor);
+	subOrientation = subentDecl->orientation;
 	
 	[subentity setPosition:subPosition];
 	[subentity setOrientation:subOrientation];
@@ -971,9 +983,9 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	if (asTurret)
 	{
 		[subentity setBehaviour:BEHAVIOUR_TRACK_AS_TURRET];
-		[subentity setWeaponRechargeRate:[subentDict oo_floatForKey:@"fire_rate" defaultValue:TURRET_SHOT_FREQUENCY]];
-		[subentity setWeaponEnergy:[subentDict oo_floatForKey:@"weapon_energy" defaultValue:TURRET_TYPICAL_ENERGY]];
-		[subentity setWeaponRange:[subentDict oo_floatForKey:@"weapon_range" defaultValue:TURRET_SHOT_RANGE]];
+		[subentity setWeaponRechargeRate:subentDecl->fireRate];
+		[subentity setWeaponEnergy:subentDecl->weaponEnergy];
+		[subentity setWeaponRange:subentDecl->weaponRange];
 		[subentity setStatus: STATUS_ACTIVE];
 	}
 	else
@@ -981,7 +993,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 		[subentity setStatus:STATUS_INACTIVE];
 	}
 	
-	[subentity overrideScriptInfo:[subentDict oo_dictionaryForKey:@"script_info"]];
+	[subentity overrideScriptInfo:subentDecl->scriptInfo];
 	
 	[self addSubEntity:subentity];
 	[subentity setSubIdx:_maxShipSubIdx];
@@ -992,20 +1004,15 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	bounding_box_add_vector(&totalBoundingBox, sebb.max);
 	bounding_box_add_vector(&totalBoundingBox, sebb.min);
 
-	if (!asTurret && [self isStation] && [subentDict oo_boolForKey:@"is_dock"])
+	if (isDock)
 	{
-		BOOL allow_docking = [subentDict oo_boolForKey:@"allow_docking" defaultValue:YES];
-		BOOL ddc = [subentDict oo_boolForKey:@"disallowed_docking_collides" defaultValue:NO];
-		BOOL allow_launching = [subentDict oo_boolForKey:@"allow_launching" defaultValue:YES];
-		// do not include this key in OOShipRegistry; should never be set by shipdata
-		BOOL virtual_dock = [subentDict oo_boolForKey:@"_is_virtual_dock" defaultValue:NO];
-		if (virtual_dock)
+		if (subentDecl->isVirtualDock)
 		{
 			[(DockEntity *)subentity setVirtual];
 		}
 		
-		[(DockEntity *)subentity setDimensionsAndCorridor:allow_docking:ddc:allow_launching];
-		[subentity setDisplayName:[subentDict oo_stringForKey:@"dock_label" defaultValue:@"the docking bay"]];
+		[(DockEntity *)subentity setDimensionsAndCorridor:subentDecl->allowDocking:subentDecl->disallowedDockingCollides:subentDecl->allowLaunching];
+		[subentity setDisplayName:subentDecl->dockLabel];
 	}
 
 	[subentity release];
@@ -1140,6 +1147,9 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	DESTROY(_beaconDrawable);
 	
 	DESTROY(explosionType);
+	
+	free(scanned_ships);
+	free(distance2_scanned_ships);
 
 	[super dealloc];
 }
@@ -1912,7 +1922,7 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 	// shouldn't happen very often, but is possible
 	if (scanClass == CLASS_NOT_SET)
 	{
-		scanClass = CLASS_NEUTRAL;
+		[self setScanClass:CLASS_NEUTRAL];
 	}
 	[escorter setScanClass:scanClass];		// you are the same as I
 		
@@ -1984,8 +1994,13 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 
 - (void)setShipDataKey:(NSString *)key
 {
-	DESTROY(_shipKey);
-	_shipKey = [key copy];
+	if (![key isEqual:_shipKey])
+	{
+		DESTROY(_shipKey);
+		_shipKey = [key copy];
+		// The data key is one of the ship's roles.
+		[UNIVERSE reindexEntity:self];
+	}
 }
 
 
@@ -2369,7 +2384,7 @@ ShipEntity* doOctreesCollide(ShipEntity* prime, ShipEntity* other)
 	{
 		if (scanClass == CLASS_NOT_SET)
 		{
-			scanClass = CLASS_NEUTRAL;
+			[self setScanClass:CLASS_NEUTRAL];
 			OOLog(@"ship.sanityCheck.failed", @"Ship %@ %@ with scanClass CLASS_NOT_SET; forced to CLASS_NEUTRAL.", self, [self primaryRole]);
 		}
 
@@ -2942,8 +2957,16 @@ ShipEntity* doOctreesCollide(ShipEntity* prime, ShipEntity* other)
 	// generally the checks above should be turning this *off* for subents
 	if (applyThrust)
 	{
-		[self applyAttitudeChanges:delta_t];
-		[self applyThrust:delta_t];
+		if (![self isSubEntity] && ![self isPlayer] && [UNIVERSE deferFlightModelForShip:self])
+		{
+			// Equipment lookups aren't thread-safe, so this is decided here.
+			flightModelCanBurn = [self hasFuelInjection] && (fuel > MIN_FUEL);
+		}
+		else
+		{
+			[self applyAttitudeChanges:delta_t];
+			[self applyThrust:delta_t];
+		}
 	}
 }
 
@@ -6732,9 +6755,14 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 
 
 - (void) applyThrust:(double) delta_t
+{
+	[self applyThrust:delta_t canBurn:[self hasFuelInjection] && (fuel > MIN_FUEL)];
+}
+
+
+- (void) applyThrust:(double)delta_t canBurn:(BOOL)canBurn
 {
 	GLfloat dt_thrust = SHIP_THRUST_FACTOR * thrust * delta_t;
-	BOOL	canBurn = [self hasFuelInjection] && (fuel > MIN_FUEL);
 	BOOL	isUsingAfterburner = (canBurn && (flightSpeed > maxFlightSpeed) && (desired_speed >= flightSpeed));
 	float	max_available_speed = maxFlightSpeed;
 	if (canBurn) max_available_speed *= [self afterburnerFactor];
@@ -6763,7 +6791,7 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 	}
 	if (flightSpeed < desired_speed)
 	{
-		[self increase_flight_speed: dt_thrust];
+		[self increase_flight_speed:dt_thrust canBurn:canBurn];
 		if (flightSpeed > desired_speed)   flightSpeed = desired_speed;
 	}
 	[self moveForward: delta_t*flightSpeed];
@@ -6830,6 +6858,36 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 }
 
 
+- (void) applyDeferredFlightModel:(OOTimeDelta)delta_t
+{
+	[self applyAttitudeChanges:delta_t];
+	[self applyThrust:delta_t canBurn:flightModelCanBurn];
+}
+
+
+- (void) commitDeferredFlightModel
+{
+	// -[Entity update:] did this before the ship moved.
+	zero_distance = HPdistance2(PLAYER->position, position);
+	cam_zero_distance = HPdistance2([PLAYER viewpointPosition], position);
+	[self updateCameraRelativePosition];
+	
+	if (!HPvector_equal(position, lastPosition))  hasMoved = YES;
+	if (!quaternion_equal(orientation, lastOrientation))  hasRotated = YES;
+	lastPosition = position;
+	lastOrientation = orientation;
+	
+	if ([self subEntityCount] > 0)
+	{
+		Entity *se = nil;
+		foreach (se, [self subEntities])
+		{
+			[se updateCameraRelativePosition];
+		}
+	}
+}
+
+
 - (void) avoidCollision
 {
 	if (scanClass == CLASS_MISSILE)
@@ -7277,6 +7335,7 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 		{
 			[roleSet release];
 			roleSet = [newRoles retain];
+			[UNIVERSE reindexEntity:self];
 		}
 	}
 }
@@ -7291,6 +7350,7 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 		{
 			[roleSet release];
 			roleSet = [newRoles retain];
+			[UNIVERSE reindexEntity:self];
 		}
 	}
 }
@@ -7317,6 +7377,7 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 	{
 		[primaryRole release];
 		primaryRole = [role copy];
+		[UNIVERSE reindexEntity:self];
 	}
 }
 
@@ -8609,9 +8670,15 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 
 
 - (void) increase_flight_speed:(double) delta
+{
+	[self increase_flight_speed:delta canBurn:[self hasFuelInjection] && fuel > MIN_FUEL];
+}
+
+
+- (void) increase_flight_speed:(double)delta canBurn:(BOOL)canBurn
 {
 	double factor = 1.0;
-	if (desired_speed > maxFlightSpeed && [self hasFuelInjection] && fuel > MIN_FUEL) factor = [self afterburnerFactor];
+	if (desired_speed > maxFlightSpeed && canBurn) factor = [self afterburnerFactor];
 
 	if (flightSpeed < maxFlightSpeed * factor)
 		flightSpeed += delta * factor;
@@ -8899,7 +8966,7 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 	// and a visual sign of the explosion
 	// "fireball" explosion effect
 	NSDictionary *explosion = [UNIVERSE explosionSetting:@"oolite-default-ship-explosion"];
-	[UNIVERSE addEntity:[OOExplosionCloudEntity explosionCloudFromEntity:self withSize:range*3.0 andSettings:explosion]];
+	[[UNIVERSE particleEngine] addExplosionCloudFromEntity:self position:[self position] size:range*3.0 settings:explosion];
 
 }
 
@@ -9230,11 +9297,11 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 					// Quick explosion effects for reduced detail mode
 					
 					// 1. fast sparks
-					[UNIVERSE addEntity:[OOSmallFragmentBurstEntity fragmentBurstFromEntity:self]];
+					[[UNIVERSE particleEngine] addSmallFragmentBurstFromEntity:self];
 					// 2. slow clouds
-					[UNIVERSE addEntity:[OOBigFragmentBurstEntity fragmentBurstFromEntity:self]];
+					[[UNIVERSE particleEngine] addBigFragmentBurstFromEntity:self];
 					// 3. flash
-					[UNIVERSE addEntity:[OOFlashEffectEntity explosionFlashFromEntity:self]];
+					[[UNIVERSE particleEngine] addExplosionFlashFromEntity:self];
 					/* This mode used to be the default for
 					 * cargo/munitions but this now must be explicitly
 					 * specified. */
@@ -9246,9 +9313,9 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 					if (explosionType == nil)
 					{
 						explosion = [UNIVERSE explosionSetting:explosionKey];
-						[UNIVERSE addEntity:[OOExplosionCloudEntity explosionCloudFromEntity:self withSettings:explosion]];
+						[[UNIVERSE particleEngine] addExplosionCloudFromEntity:self position:[self position] size:0.0f settings:explosion];
 						// 3. flash
-						[UNIVERSE addEntity:[OOFlashEffectEntity explosionFlashFromEntity:self]];
+						[[UNIVERSE particleEngine] addExplosionFlashFromEntity:self];
 					}
 					for (NSUInteger i=0;i<[explosionType count];i++)
 					{
@@ -9258,20 +9325,20 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 							// three special-case builtins
 							if ([explosionKey isEqualToString:@"oolite-builtin-flash"])
 							{
-								[UNIVERSE addEntity:[OOFlashEffectEntity explosionFlashFromEntity:self]];
+								[[UNIVERSE particleEngine] addExplosionFlashFromEntity:self];
 							}
 							else if ([explosionKey isEqualToString:@"oolite-builtin-slowcloud"])
 							{
-								[UNIVERSE addEntity:[OOBigFragmentBurstEntity fragmentBurstFromEntity:self]];
+								[[UNIVERSE particleEngine] addBigFragmentBurstFromEntity:self];
 							}
 							else if ([explosionKey isEqualToString:@"oolite-builtin-fastspark"])
 							{
-								[UNIVERSE addEntity:[OOSmallFragmentBurstEntity fragmentBurstFromEntity:self]];
+								[[UNIVERSE particleEngine] addSmallFragmentBurstFromEntity:self];
 							}
 							else
 							{
 								explosion = [UNIVERSE explosionSetting:explosionKey];
-								[UNIVERSE addEntity:[OOExplosionCloudEntity explosionCloudFromEntity:self withSettings:explosion]];
+								[[UNIVERSE particleEngine] addExplosionCloudFromEntity:self position:[self position] size:0.0f settings:explosion];
 							}
 						}
 					}
@@ -9650,14 +9717,14 @@ Vector positionOffsetForShipInRotationToAlignment(ShipEntity* ship, Quaternion q
 		float how_many = factor;
 		while (how_many > 0.5f)
 		{
-			[UNIVERSE addEntity:[OOSmallFragmentBurstEntity fragmentBurstFromEntity:self]];
+			[[UNIVERSE particleEngine] addSmallFragmentBurstFromEntity:self];
 			how_many -= 1.0f;
 		}
 		// 2. slow clouds
 		how_many = factor;
 		while (how_many > 0.5f)
 		{
-			[UNIVERSE addEntity:[OOBigFragmentBurstEntity fragmentBurstFromEntity:self]];
+			[[UNIVERSE particleEngine] addBigFragmentBurstFromEntity:self];
 			how_many -= 1.0f;
 		}
 
@@ -9810,95 +9877,78 @@ Vector positionOffsetForShipInRotationToAlignment(ShipEntity* ship, Quaternion q
 -----------------------------------------*/
 
 
-- (void) checkScanner
+typedef struct
 {
-	Entity* scan;
-	n_scanned_ships = 0;
-	//
-	scan = z_previous;	while ((scan)&&(scan->isShip == NO))	scan = scan->z_previous;	// skip non-ships
-	GLfloat scannerRange2 = scannerRange * scannerRange;
-	while ((scan)&&(scan->position.z > position.z - scannerRange)&&(n_scanned_ships < MAX_SCAN_NUMBER))
-	{
-		// can't scan cloaked ships
-		if (scan->isShip && ![(ShipEntity*)scan isCloaked] && [self isValidTarget:scan])
-		{
-			distance2_scanned_ships[n_scanned_ships] = HPdistance2(position, scan->position);
-			if (distance2_scanned_ships[n_scanned_ships] < scannerRange2)
-				scanned_ships[n_scanned_ships++] = (ShipEntity*)scan;
-		}
-		scan = scan->z_previous;	while ((scan)&&(scan->isShip == NO))	scan = scan->z_previous;
-	}
-	//
-	scan = z_next;	while ((scan)&&(scan->isShip == NO))	scan = scan->z_next;	// skip non-ships
-	while ((scan)&&(scan->position.z < position.z + scannerRange)&&(n_scanned_ships < MAX_SCAN_NUMBER))
+	ShipEntity			*scanner;
+	HPVector			position;
+	GLfloat				range2;
+	BOOL				ignoreUnpowered;
+} OOScannerContext;
+
+
+static void ScanShip(Entity *entity, void *context)
+{
+	OOScannerContext	*scan = context;
+	ShipEntity			*ship = (ShipEntity *)entity;
+	
+	if (ship == scan->scanner || [ship isCloaked])  return;	// can't scan cloaked ships
+	if (scan->ignoreUnpowered)
 	{
-		if (scan->isShip && ![(ShipEntity*)scan isCloaked] && [self isValidTarget:scan])
-		{
-			distance2_scanned_ships[n_scanned_ships] = HPdistance2(position, scan->position);
-			if (distance2_scanned_ships[n_scanned_ships] < scannerRange2)
-				scanned_ships[n_scanned_ships++] = (ShipEntity*)scan;
-		}
-		scan = scan->z_next;	while ((scan)&&(scan->isShip == NO))	scan = scan->z_next;	// skip non-ships
+		if (ship->scanClass == CLASS_ROCK || ship->scanClass == CLASS_CARGO)  return;
 	}
-	//
-	scanned_ships[n_scanned_ships] = nil;	// terminate array
+	else if (![scan->scanner isValidTarget:ship])  return;
+	
+	GLfloat d2 = HPdistance2(scan->position, ship->position);
+	if (d2 < scan->range2)  [scan->scanner addScannedShip:ship distance2:d2];
+}
+
+
+- (void) checkScanner
+{
+	[self scanIgnoringUnpowered:NO];
 }
 
 
 - (void) checkScannerIgnoringUnpowered
 {
-	Entity* scan;
+	[self scanIgnoringUnpowered:YES];
+}
+
+
+- (void) scanIgnoringUnpowered:(BOOL)ignoreUnpowered
+{
+	OOScannerContext scan = { self, position, scannerRange * scannerRange, ignoreUnpowered };
+	
 	n_scanned_ships = 0;
-	//
-	GLfloat scannerRange2 = scannerRange * scannerRange;
-	scan = z_previous;	
-	while ((scan)&&((scan->isShip == NO)||(scan->scanClass==CLASS_ROCK)||(scan->scanClass==CLASS_CARGO)))	
-	{
-		scan = scan->z_previous;	// skip non-ships
-	}
-	while ((scan)&&(scan->position.z > position.z - scannerRange)&&(n_scanned_ships < MAX_SCAN_NUMBER))
-	{
-		if (scan->isShip && ![(ShipEntity*)scan isCloaked])
-		{
-			distance2_scanned_ships[n_scanned_ships] = HPdistance2(position, scan->position);
-			if (distance2_scanned_ships[n_scanned_ships] < scannerRange2)
-				scanned_ships[n_scanned_ships++] = (ShipEntity*)scan;
-		}
-		scan = scan->z_previous;
-		while ((scan)&&((scan->isShip == NO)||(scan->scanClass==CLASS_ROCK)||(scan->scanClass==CLASS_CARGO)))	
-		{
-			scan = scan->z_previous;	// skip non-ships
-		}
-	}
-	//
-	scan = z_next;	
-	while ((scan)&&((scan->isShip == NO)||(scan->scanClass==CLASS_ROCK)||(scan->scanClass==CLASS_CARGO)))	
-	{
-		scan = scan->z_next;	// skip non-ships
-	}
+	[UNIVERSE enumerateShipsNearPosition:position range:scannerRange withFunction:ScanShip context:&scan];
+	if (scanned_ships != NULL)  scanned_ships[n_scanned_ships] = nil;	// terminate array
+}
 
-	while ((scan)&&(scan->position.z < position.z + scannerRange)&&(n_scanned_ships < MAX_SCAN_NUMBER))
+
+- (void) addScannedShip:(ShipEntity *)ship distance2:(GLfloat)d2
+{
+	// Keep room for the terminating nil.
+	if (n_scanned_ships + 1 >= scanned_ships_capacity)
 	{
-		if (scan->isShip && ![(ShipEntity*)scan isCloaked])
-		{
-			distance2_scanned_ships[n_scanned_ships] = HPdistance2(position, scan->position);
-			if (distance2_scanned_ships[n_scanned_ships] < scannerRange2)
-				scanned_ships[n_scanned_ships++] = (ShipEntity*)scan;
-		}
-		scan = scan->z_next;
-		while ((scan)&&((scan->isShip == NO)||(scan->scanClass==CLASS_ROCK)||(scan->scanClass==CLASS_CARGO)))	
-		{
-			scan = scan->z_next;	// skip non-ships
-		}
+		unsigned newCapacity = scanned_ships_capacity ? scanned_ships_capacity * 2 : 32;
+		ShipEntity **newShips = realloc(scanned_ships, newCapacity * sizeof *scanned_ships);
+		if (newShips == NULL)  return;
+		scanned_ships = newShips;
+		GLfloat *newDistances = realloc(distance2_scanned_ships, newCapacity * sizeof *distance2_scanned_ships);
+		if (newDistances == NULL)  return;
+		distance2_scanned_ships = newDistances;
+		scanned_ships_capacity = newCapacity;
 	}
-	//
-	scanned_ships[n_scanned_ships] = nil;	// terminate array
+	
+	scanned_ships[n_scanned_ships] = ship;
+	distance2_scanned_ships[n_scanned_ships] = d2;
+	n_scanned_ships++;
 }
 
 
 - (ShipEntity**) scannedShips
 {
-	scanned_ships[n_scanned_ships] = nil;	// terminate array
+	if (scanned_ships != NULL)  scanned_ships[n_scanned_ships] = nil;	// terminate array
 	return scanned_ships;
 }
 
@@ -12108,15 +12158,11 @@ Vector positionOffsetForShipInRotationToAlignment(ShipEntity* ship, Quaternion q
 	
 	OOColor *color = [OOColor colorWithHue:0.08 + 0.17 * randf() saturation:1.0 brightness:1.0 alpha:1.0];
 	
-	OOSparkEntity *spark = [[OOSparkEntity alloc] initWithPosition:origin
-														  velocity:vel
-														  duration:2.0 + 3.0 * randf()
-															  size:sz
-															 color:color];
-	
-	[spark setOwner:self];
-	[UNIVERSE addEntity:spark];
-	[spark release];
+	[[UNIVERSE particleEngine] addSparkAt:origin
+								 velocity:vel
+								 duration:2.0 + 3.0 * randf()
+									 size:sz
+									color:color];
 
 	next_spark_time = randf();
 }
@@ -1758,7 +1758,7 @@
 		}
 	}
 	// now we're just a bunch of alien artefacts!
-	scanClass = CLASS_CARGO;
+	[self setScanClass:CLASS_CARGO];
 	reportAIMessages = NO;
 	[self setAITo:@"dumbAI.plist"];
 	DESTROY(_primaryTarget);
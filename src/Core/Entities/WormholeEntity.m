@@ -679,11 +679,11 @@ static void DrawWormholeCorona(GLfloat inner_radius, GLfloat outer_radius, int s
 		no_draw_distance = collision_radius * collision_radius * NO_DRAW_DISTANCE_FACTOR * NO_DRAW_DISTANCE_FACTOR;
 	}
 
-	scanClass = (witch_mass > 0.0)? CLASS_WORMHOLE : CLASS_NO_DRAW;
+	[self setScanClass:(witch_mass > 0.0)? CLASS_WORMHOLE : CLASS_NO_DRAW];
 	
 	if (now > expiry_time)
 	{
-		scanClass = CLASS_NO_DRAW; // witch_mass not certain to be limiting factor on extremely short jumps, so make sure now
+		[self setScanClass:CLASS_NO_DRAW]; // witch_mass not certain to be limiting factor on extremely short jumps, so make sure now
 
 		// If we're a saved wormhole waiting to disgorge more ships, it's safe
 		// to remove self from UNIVERSE, but we need the current position!
@@ -38,6 +38,9 @@ MA 02110-1301, USA.
 #define MINIMUM_GAME_TICK		0.25
 // * reduced from 0.5s for tgape * //
 
+#define DEFAULT_MAX_FIXED_STEPS_PER_FRAME	5
+// catch-up limit when "fixed-timestep-rate" is set; time beyond this is dropped
+
 #define MINIMUM_ANIMATION_TICK	0.0041667
 // 1.0 / (desired framerate cap)
 
@@ -65,6 +68,11 @@ MA 02110-1301, USA.
 	NSTimeInterval			last_timeInterval;
 	double					delta_t;
 	
+	// Fixed timestep simulation; _fixedTimestep is 0 when disabled.
+	double					_fixedTimestep;
+	double					_fixedStepAccumulator;
+	unsigned				_maxFixedStepsPerFrame;
+	
 	int						my_mouse_x, my_mouse_y;
 
 	NSString				*playerFileDirectory;
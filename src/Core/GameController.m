@@ -32,6 +32,7 @@ MA 02110-1301, USA.
 #include <stdlib.h>
 #import "OOCollectionExtractors.h"
 #import "OOOXPVerifier.h"
+#import "OOSimulationBenchmark.h"
 #import "OOLoggingExtended.h"
 #import "NSFileManagerOOExtensions.h"
 #import "OOLogOutputHandler.h"
@@ -64,6 +65,7 @@ static GameController *sSharedController = nil;
 - (void)reportUnhandledStartupException:(NSException *)exception;
 
 - (void)doPerformGameTick;
+- (void)performFixedSteps;
 
 @end
 
@@ -95,6 +97,12 @@ static GameController *sSharedController = nil;
 		delta_t = 0.01; // one hundredth of a second 
 		_animationTimerInterval = [[NSUserDefaults standardUserDefaults] oo_doubleForKey:@"animation_timer_interval" defaultValue:MINIMUM_ANIMATION_TICK];
 		
+		// Optional fixed timestep simulation, with interpolated rendering in between steps.
+		double fixedRate = [[NSUserDefaults standardUserDefaults] oo_doubleForKey:@"fixed-timestep-rate" defaultValue:0.0];
+		_fixedTimestep = (fixedRate > 0.0) ? 1.0 / fixedRate : 0.0;
+		_maxFixedStepsPerFrame = [[NSUserDefaults standardUserDefaults] oo_unsignedIntForKey:@"fixed-timestep-max-steps" defaultValue:DEFAULT_MAX_FIXED_STEPS_PER_FRAME];
+		if (_maxFixedStepsPerFrame < 1)  _maxFixedStepsPerFrame = 1;
+		
 		// rather than seeding this with the date repeatedly, seed it
 		// once here at startup
 		ranrot_srand((uint32_t)[[NSDate date] timeIntervalSince1970]);   // reset randomiser with current time
@@ -283,6 +291,11 @@ static GameController *sSharedController = nil;
 		
 		[self loadPlayerIfRequired];
 		
+		if ([OOSimulationBenchmark runIfRequested])
+		{
+			[self exitAppWithContext:@"simulation benchmark run"];
+		}
+		
 		[self logProgress:@""];
 		
 		// get the run loop and add the call to performGameTick:
@@ -338,8 +351,16 @@ static GameController *sSharedController = nil;
 #if !OOLITE_MAC_OS_X
 	if(!gameView)
 	{
-		gameView = [MyOpenGLView alloc];
-		[gameView init];
+		gameView = [[MyOpenGLView alloc] init];
+		if (gameView == nil)
+		{
+			if ([OOSimulationBenchmark isRequested])
+			{
+				// -simbench runs headless; the offscreen video driver needs EGL.
+				OOLogERR(@"simbench.headless.failed", @"%@", @"Could not set up the offscreen video driver for -simbench. Set SDL_VIDEO_DRIVER to use another video driver.");
+			}
+			exit(EXIT_FAILURE);
+		}
 		[gameView setGameController:self];
 		[gameView initSplashScreen];
 	}
@@ -374,6 +395,8 @@ static GameController *sSharedController = nil;
 
 - (void) doPerformGameTick
 {
+	BOOL interpolate = NO;
+	
 	@try
 	{
 		if (gameIsPaused)
@@ -386,16 +409,24 @@ static GameController *sSharedController = nil;
 				delta_t = MINIMUM_GAME_TICK;		// peg the maximum pause (at 0.5->1.0 seconds) to protect against when the machine sleeps	
 		}
 		
-		[UNIVERSE update:delta_t];
-		if (EXPECT_NOT([PLAYER status] == STATUS_RESTART_GAME))
+		if (_fixedTimestep > 0.0 && !gameIsPaused)
 		{
-			[UNIVERSE reinitAndShowDemo:YES];
+			[self performFixedSteps];
+			interpolate = YES;
 		}
-		[OOSound update];
-		if (!gameIsPaused)
+		else
 		{
-			OOJSFrameCallbacksInvoke(delta_t);
+			[UNIVERSE update:delta_t];
+			if (EXPECT_NOT([PLAYER status] == STATUS_RESTART_GAME))
+			{
+				[UNIVERSE reinitAndShowDemo:YES];
+			}
+			if (!gameIsPaused)
+			{
+				OOJSFrameCallbacksInvoke(delta_t);
+			}
 		}
+		[OOSound update];
 	}
 	@catch (id exception) 
 	{
@@ -404,9 +435,46 @@ static GameController *sSharedController = nil;
 	
 	@try
 	{
+		if (interpolate)  [UNIVERSE beginRenderInterpolation:_fixedStepAccumulator / _fixedTimestep];
 		[gameView display];
 	}
 	@catch (id exception) {}
+	
+	if (interpolate)  [UNIVERSE endRenderInterpolation];
+}
+
+
+/*	Run as many fixed steps as have accumulated, up to the catch-up limit.
+	Whatever is left over is used to interpolate between the last two states
+	when drawing.
+*/
+- (void) performFixedSteps
+{
+	unsigned steps = 0;
+	
+	_fixedStepAccumulator += delta_t;
+	while (_fixedStepAccumulator >= _fixedTimestep)
+	{
+		if (steps == _maxFixedStepsPerFrame)
+		{
+			// Too far behind to catch up; drop the backlog rather than spiral.
+			_fixedStepAccumulator = fmod(_fixedStepAccumulator, _fixedTimestep);
+			break;
+		}
+		
+		_fixedStepAccumulator -= _fixedTimestep;
+		steps++;
+		
+		[UNIVERSE saveEntityStatesForInterpolation];
+		[UNIVERSE update:_fixedTimestep];
+		if (EXPECT_NOT([PLAYER status] == STATUS_RESTART_GAME))
+		{
+			[UNIVERSE reinitAndShowDemo:YES];
+			_fixedStepAccumulator = 0.0;
+			break;
+		}
+		OOJSFrameCallbacksInvoke(_fixedTimestep);
+	}
 }
 
 
@@ -858,6 +926,7 @@ static NSMutableArray *sMessageStack;
 
 - (NSApplicationTerminateReply)applicationShouldTerminate:(NSApplication *)sender
 {
+	[PLAYER finishPendingSave];
 	[[OOCacheManager sharedCache] finishOngoingFlush];
 	OOLoggingTerminate();
 	return NSTerminateNow;
@@ -881,6 +950,7 @@ static NSMutableArray *sMessageStack;
 		ChangeDisplaySettingsEx(NULL, NULL, NULL, 0, NULL);
 	}
 #endif
+	[PLAYER finishPendingSave];
 	[[NSUserDefaults standardUserDefaults] synchronize];
 	OOLog(@"gameController.exitApp", @"%@", @".GNUstepDefaults synchronized.");
 	OOLoggingTerminate();
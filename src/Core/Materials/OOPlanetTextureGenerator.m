@@ -43,6 +43,7 @@
 #ifndef TEXGEN_TEST_RIG
 #import "OOTexture.h"
 #import "Universe.h"
+#import "OOAsyncWorkManager.h"
 #endif
 
 #if DEBUG_DUMP
@@ -118,6 +119,14 @@ enum
 
 static FloatRGB FloatRGBFromDictColor(NSDictionary *dictionary, NSString *key);
 
+/*	Each pass of the generator works on one row at a time, with every row
+	independent of the others, so the rows are spread across the async work
+	manager's threads. Per-row results are exactly the same as generating
+	the whole texture in order.
+*/
+typedef void (*RowFunction)(NSUInteger row, void *context);
+static void ForEachRow(unsigned height, RowFunction function, void *context);
+
 static BOOL FillFBMBuffer(OOPlanetTextureGeneratorInfo *info);
 
 static float QFactor(float *accbuffer, int x, int y, unsigned width, float polar_y_value, float bias, float polar_y);
@@ -129,6 +138,19 @@ static void SetMixConstants(OOPlanetTextureGeneratorInfo *info, float temperatur
 static FloatRGBA CloudMix(OOPlanetTextureGeneratorInfo *info, float q, float nearPole);
 static FloatRGBA PlanetMix(OOPlanetTextureGeneratorInfo *info, float q, float nearPole);
 
+typedef struct
+{
+	OOPlanetTextureGeneratorInfo	*info;
+	float							fHeight, rHeight;
+	float							poleValue, seaBias;
+	float							paleClouds;
+	float							normalScale;
+	uint8_t							*buffer, *nBuffer, *aBuffer;	// nBuffer and aBuffer are NULL if not generated.
+} PlanetPassContext;
+
+static void QFactorRow(NSUInteger row, void *context);
+static void PlanetColorRow(NSUInteger row, void *context);
+
 
 enum
 {
@@ -392,9 +414,9 @@ enum
 	BOOL generateNormalMap = (_nMapGenerator != nil);
 	BOOL generateAtmosphere = (_atmoGenerator != nil);
 	
-	uint8_t		*buffer = NULL, *px = NULL;
-	uint8_t		*nBuffer = NULL, *npx = NULL;
-	uint8_t		*aBuffer = NULL, *apx = NULL;
+	uint8_t		*buffer = NULL;
+	uint8_t		*nBuffer = NULL;
+	uint8_t		*aBuffer = NULL;
 	float		*randomBuffer = NULL;
 	
 	_height = _info.height = 1 << (_planetScale + _info.planetScaleOffset);
@@ -405,20 +427,17 @@ enum
 	
 	buffer = malloc(4 * _width * _height);
 	FAIL_IF_NULL(buffer);
-	px = buffer;
 	
 	if (generateNormalMap)
 	{
 		nBuffer = malloc(4 * _width * _height);
 		FAIL_IF_NULL(nBuffer);
-		npx = nBuffer;
 	}
 	
 	if (generateAtmosphere)
 	{
 		aBuffer = malloc(4 * _width * _height);
 		FAIL_IF_NULL(aBuffer);
-		apx = aBuffer;
 	}
 	
 	FAIL_IF(!FillFBMBuffer(&_info));
@@ -442,13 +461,6 @@ enum
 	// Deep sea colour: sea darker past the continental shelf.
 	_info.deepSeaColor = Blend(0.85f, _info.seaColor, (FloatRGB){ 0, 0, 0 });
 	
-	int x, y;
-	FloatRGBA color;
-	Vector norm;
-	float q, yN, yS, yW, yE, nearPole;
-	GLfloat shade;
-	float rHeight = 1.0f / _height;
-	float fy, fHeight = _height;
 	// The second parameter is the temperature fraction. Most favourable: 1.0f,  little ice. Most unfavourable: 0.0f, frozen planet. TODO: make it dependent on ranrot / planetinfo key...
 	SetMixConstants(&_info, 1.0f-_info.polarFraction);	// no need to recalculate them inside each loop!
 	
@@ -456,82 +468,23 @@ enum
 	_info.qBuffer = malloc(_width * _height * sizeof (float));
 	FAIL_IF_NULL(_info.qBuffer);
 	
-	for (y = (int)_height - 1, fy = (float)y; y >=0; y--, fy--)
+	PlanetPassContext context =
 	{
-		nearPole = (2.0f * fy - fHeight) * rHeight;
-		nearPole *= nearPole;
-		
-		for (x = (int)_width - 1; x >=0; x--)
-		{
-			_info.qBuffer[y * _width + x] = QFactor(_info.fbmBuffer, x, y, _width, poleValue, seaBias, nearPole);
-		}
-	}
+		.info = &_info,
+		.fHeight = _height,
+		.rHeight = 1.0f / _height,
+		.poleValue = poleValue,
+		.seaBias = seaBias,
+		.paleClouds = paleClouds,
+		.normalScale = normalScale,
+		.buffer = buffer,
+		.nBuffer = nBuffer,
+		.aBuffer = aBuffer
+	};
+	ForEachRow(_height, QFactorRow, &context);
 	
 	// second pass, use q.
-	float cloudFraction = _info.cloudFraction;
-	unsigned widthMask = _width - 1;
-	unsigned heightMask = _height - 1;
-	
-	for (y = (int)_height - 1, fy = (float)y; y >= 0; y--, fy--)
-	{
-		nearPole = (2.0f * fy - fHeight) * rHeight;
-		nearPole *= nearPole;
-		
-		for (x = (int)_width - 1; x >= 0; x--)
-		{
-			q = _info.qBuffer[y * _width + x];	// no need to use GetQ, x and y are always within bounds.
-			yN = GetQ(_info.qBuffer, x, y - 1, _width, _height, widthMask, heightMask);	// recalculates x & y if they go out of bounds.
-			yS = GetQ(_info.qBuffer, x, y + 1, _width, _height, widthMask, heightMask);
-			yW = GetQ(_info.qBuffer, x - 1, y, _width, _height, widthMask, heightMask);
-			yE = GetQ(_info.qBuffer, x + 1, y, _width, _height, widthMask, heightMask);
-			
-			color = PlanetMix(&_info, q, nearPole);
-			
-			norm = vector_normal(make_vector(normalScale * (yE - yW), normalScale * (yN - yS), 1.0f));
-			if (generateNormalMap)
-			{
-				shade = 1.0f;
-				
-				// Flatten the sea.
-				norm = OOVectorInterpolate(norm, kBasisZVector, color.a);
-				
-				// Put norm in normal map, scaled from [-1..1] to [0..255].
-				*npx++ = 127.5f * (norm.y + 1.0f);
-				*npx++ = 127.5f * (-norm.x + 1.0f);
-				*npx++ = 127.5f * (norm.z + 1.0f);
-				
-				*npx++ = 255.0f * color.a;	// Specular channel.
-			}
-			else
-			{
-				//	Terrain shading - lambertian lighting from straight above.
-				shade = norm.z;
-				
-				/*	We don't want terrain shading in the sea. The alpha channel
-					of color is a measure of "seaishness" for the specular map,
-					so we can recycle that to avoid branching.
-					-- Ahruman
-				*/
-				shade += color.a - color.a * shade;	// equivalent to - but slightly faster than - previous implementation.
-			}
-			
-			*px++ = 255.0f * color.r * shade;
-			*px++ = 255.0f * color.g * shade;
-			*px++ = 255.0f * color.b * shade;
-			
-			*px++ = 0;	// FIXME: light map goes here.
-			
-			if (generateAtmosphere)
-			{
-				q = QFactor(_info.fbmBuffer, x, y, _width, paleClouds, cloudFraction, nearPole);
-				color = CloudMix(&_info, q, nearPole);
-				*apx++ = 255.0f * color.r;
-				*apx++ = 255.0f * color.g;
-				*apx++ = 255.0f * color.b;
-				*apx++ = 255.0f * color.a * _info.cloudAlpha;
-			}
-		}
-	}
+	ForEachRow(_height, PlanetColorRow, &context);
 	
 	success = YES;
 	_format = kOOTextureDataRGBA;
@@ -979,9 +932,65 @@ static BOOL MakePermutationTable(OOPlanetTextureGeneratorInfo *info)
 }
 
 
+typedef struct
+{
+	OOPlanetTextureGeneratorInfo	*info;
+	float							*lonSin, *lonCos;	// Per column.
+	float							*latSin, *latCos;	// Per row.
+} FBMNoise3DContext;
+
+
+static void GenerateFBMNoise3DRow(NSUInteger y, void *context)
+{
+	FBMNoise3DContext *ctx = context;
+	OOPlanetTextureGeneratorInfo *info = ctx->info;
+	unsigned x, width = info->width, height = info->height;
+	float las = ctx->latSin[y];
+	float lac = ctx->latCos[y];
+	float *px = info->fbmBuffer + y * width;
+	
+	for (x = 0; x < width; x++)
+	{
+		// Convert spherical coordinates to vector.
+		Vector p =
+		{
+			ctx->lonSin[x] * lac,
+			las,
+			ctx->lonCos[x] * lac
+		};
+		
+#if 1
+		// fBM
+		unsigned octaveMask = 4;
+		float octave = octaveMask;
+		octaveMask -= 1;
+		float scale = 0.4f;
+		float sum = 0;
+		
+		while ((octaveMask + 1) < height)
+		{
+			Vector ps = vector_multiply_scalar(p, octave);
+			sum += scale * SampleNoise3D(info, ps);
+			
+			octave *= 2.0f;
+			octaveMask = (octaveMask << 1) | 1;
+			scale *= 0.5f;
+		}
+#else
+		// Single octave
+		p = vector_multiply_scalar(p, 4.0f);
+		float sum = 0.5f * SampleNoise3D(info, p);
+#endif
+		
+		*px++ = sum + 0.5f;
+	}
+}
+
+
 static BOOL GenerateFBMNoise3D(OOPlanetTextureGeneratorInfo *info)
 {
 	BOOL OK = NO;
+	float *trig = NULL;
 	
 	FAIL_IF(!MakePermutationTable(info));
 	
@@ -989,55 +998,31 @@ static BOOL GenerateFBMNoise3D(OOPlanetTextureGeneratorInfo *info)
 	float lon, lat;	// Longitude and latitude in radians.
 	float dlon = 2.0f * M_PI / width;
 	float dlat = M_PI / height;
-	float *px = info->fbmBuffer;
 	
+	/*	Sines and cosines of longitude and latitude, calculated once per
+		column and row rather than per pixel. The angles are accumulated
+		step by step, as they always have been, so that the results are
+		unchanged.
+	*/
+	trig = malloc(2 * (width + height) * sizeof *trig);
+	FAIL_IF_NULL(trig);
+	FBMNoise3DContext context = { info, trig, trig + width, trig + 2 * width, trig + 2 * width + height };
+	
+	for (x = 0, lon = -M_PI; x < width; x++, lon += dlon)
+	{
+		context.lonSin[x] = sin(lon);
+		context.lonCos[x] = cos(lon);
+	}
 	for (y = 0, lat = -M_PI_2; y < height; y++, lat += dlat)
 	{
-		float las = sin(lat);
-		float lac = cos(lat);
-		
-		for (x = 0, lon = -M_PI; x < width; x++, lon += dlon)
-		{
-			// FIXME: in real life, we really don't want sin and cos per pixel.
-			// Convert spherical coordinates to vector.
-			float los = sin(lon);
-			float loc = cos(lon);
-			
-			Vector p =
-			{
-				los * lac,
-				las,
-				loc * lac
-			};
-			
-#if 1
-			// fBM
-			unsigned octaveMask = 4;
-			float octave = octaveMask;
-			octaveMask -= 1;
-			float scale = 0.4f;
-			float sum = 0;
-			
-			while ((octaveMask + 1) < height)
-			{
-				Vector ps = vector_multiply_scalar(p, octave);
-				sum += scale * SampleNoise3D(info, ps);
-				
-				octave *= 2.0f;
-				octaveMask = (octaveMask << 1) | 1;
-				scale *= 0.5f;
-			}
-#else
-			// Single octave
-			p = vector_multiply_scalar(p, 4.0f);
-			float sum = 0.5f * SampleNoise3D(info, p);
-#endif
-			
-			*px++ = sum + 0.5f;
-		}
+		context.latSin[y] = sin(lat);
+		context.latCos[y] = cos(lat);
 	}
 	
+	ForEachRow(height, GenerateFBMNoise3DRow, &context);
+	
 END:
+	FREE(trig);
 	FREE(info->permutations);
 	return OK;
 }
@@ -1055,56 +1040,77 @@ static void FillRandomBuffer(float *randomBuffer, RANROTSeed seed)
 }
 
 
-static void AddNoise(OOPlanetTextureGeneratorInfo *info, float *randomBuffer, float octave, unsigned octaveMask, float scale, float *qxBuffer, int *ixBuffer)
+typedef struct
 {
-	unsigned	x, y;
-	unsigned	width = info->width, height = info->height;
+	OOPlanetTextureGeneratorInfo	*info;
+	float							*randomBuffer;
+	float							rr;
+	unsigned						octaveMask;
+	float							scale;
+	float							*qxBuffer;
+	int								*ixBuffer;
+} AddNoiseContext;
+
+
+static void AddNoiseRow(NSUInteger y, void *context)
+{
+	AddNoiseContext *ctx = context;
+	unsigned	x, width = ctx->info->width;
+	unsigned	octaveMask = ctx->octaveMask;
+	float		*randomBuffer = ctx->randomBuffer;
+	float		scale = ctx->scale;
 	int			ix, jx, iy, jy;
-	float		rr = octave / width;
-	float		fx, fy, qx, qy, rix, rjx, rfinal;
-	float		*dst = info->fbmBuffer;
+	float		qx, qy, rix, rjx, rfinal;
+	float		*dst = ctx->info->fbmBuffer + y * width;
 	
-	for (fy = 0, y = 0; y < height; fy++, y++)
+	qy = (float)y * ctx->rr;
+	iy = fast_floor(qy);
+	jy = (iy + 1) & octaveMask;
+	qy = Hermite(qy - iy);
+	iy &= (kRandomBufferSize - 1);
+	jy &= (kRandomBufferSize - 1);
+	
+	for (x = 0; x < width; x++)
 	{
-		qy = fy * rr;
-		iy = fast_floor(qy);
-		jy = (iy + 1) & octaveMask;
-		qy = Hermite(qy - iy);
-		iy &= (kRandomBufferSize - 1);
-		jy &= (kRandomBufferSize - 1);
+		ix = ctx->ixBuffer[x];
+		qx = ctx->qxBuffer[x];
 		
-		for (fx = 0, x = 0; x < width; fx++, x++)
-		{
-			if (y == 0)
-			{
-				// first pass: initialise buffers.
-				qx = fx * rr;
-				ix = fast_floor(qx);
-				qx -= ix;
-				ix &= (kRandomBufferSize - 1);
-				ixBuffer[x] = ix;
-				qxBuffer[x] = Hermite(qx);
-			}
-			else
-			{
-				// later passes: grab the stored values.
-				ix = ixBuffer[x];
-				qx = qxBuffer[x];
-			}
-			
-			jx = (ix + 1) & octaveMask;
-			jx &= (kRandomBufferSize - 1);
-			
-			rix = Lerp(randomBuffer[iy * kRandomBufferSize + ix], randomBuffer[iy * kRandomBufferSize + jx], qx);
-			rjx = Lerp(randomBuffer[jy * kRandomBufferSize + ix], randomBuffer[jy * kRandomBufferSize + jx], qx);
-			rfinal = Lerp(rix, rjx, qy);
-			
-			*dst++ += scale * rfinal;
-		}
+		jx = (ix + 1) & octaveMask;
+		jx &= (kRandomBufferSize - 1);
+		
+		rix = Lerp(randomBuffer[iy * kRandomBufferSize + ix], randomBuffer[iy * kRandomBufferSize + jx], qx);
+		rjx = Lerp(randomBuffer[jy * kRandomBufferSize + ix], randomBuffer[jy * kRandomBufferSize + jx], qx);
+		rfinal = Lerp(rix, rjx, qy);
+		
+		*dst++ += scale * rfinal;
 	}
 }
 
 
+static void AddNoise(OOPlanetTextureGeneratorInfo *info, float *randomBuffer, float octave, unsigned octaveMask, float scale, float *qxBuffer, int *ixBuffer)
+{
+	unsigned	x;
+	unsigned	width = info->width;
+	int			ix;
+	float		rr = octave / width;
+	float		fx, qx;
+	
+	// Column coordinates are the same for every row.
+	for (fx = 0, x = 0; x < width; fx++, x++)
+	{
+		qx = fx * rr;
+		ix = fast_floor(qx);
+		qx -= ix;
+		ix &= (kRandomBufferSize - 1);
+		ixBuffer[x] = ix;
+		qxBuffer[x] = Hermite(qx);
+	}
+	
+	AddNoiseContext context = { info, randomBuffer, rr, octaveMask, scale, qxBuffer, ixBuffer };
+	ForEachRow(info->height, AddNoiseRow, &context);
+}
+
+
 static BOOL GenerateFBMNoise(OOPlanetTextureGeneratorInfo *info)
 {
 	// Allocate the temporary buffers we need in one fell swoop, to avoid administrative overhead.
@@ -1171,6 +1177,120 @@ static float GetQ(float *qbuffer, int x, int y, unsigned width, unsigned height,
 }
 
 
+static void ForEachRow(unsigned height, RowFunction function, void *context)
+{
+#ifndef TEXGEN_TEST_RIG
+	[[OOAsyncWorkManager sharedAsyncWorkManager] performBatchWithFunction:function context:context count:height];
+#else
+	NSUInteger y;
+	for (y = 0; y < height; y++)  function(y, context);
+#endif
+}
+
+
+OOINLINE float NearPole(int y, float fHeight, float rHeight)
+{
+	float nearPole = (2.0f * (float)y - fHeight) * rHeight;
+	return nearPole * nearPole;
+}
+
+
+static void QFactorRow(NSUInteger row, void *context)
+{
+	PlanetPassContext *ctx = context;
+	OOPlanetTextureGeneratorInfo *info = ctx->info;
+	int y = (int)row;
+	float nearPole = NearPole(y, ctx->fHeight, ctx->rHeight);
+	float *q = info->qBuffer + y * info->width;
+	int x;
+	
+	for (x = (int)info->width - 1; x >= 0; x--)
+	{
+		q[x] = QFactor(info->fbmBuffer, x, y, info->width, ctx->poleValue, ctx->seaBias, nearPole);
+	}
+}
+
+
+static void PlanetColorRow(NSUInteger row, void *context)
+{
+	PlanetPassContext *ctx = context;
+	OOPlanetTextureGeneratorInfo *info = ctx->info;
+	int y = (int)row;
+	unsigned width = info->width, height = info->height;
+	unsigned widthMask = width - 1;
+	unsigned heightMask = height - 1;
+	float cloudFraction = info->cloudFraction;
+	float normalScale = ctx->normalScale;
+	float nearPole = NearPole(y, ctx->fHeight, ctx->rHeight);
+	float q, yN, yS, yW, yE;
+	FloatRGBA color;
+	Vector norm;
+	GLfloat shade;
+	int x;
+	
+	// Rows and columns are written in reverse order, bottom row first.
+	size_t offset = 4 * (size_t)width * (height - 1 - y);
+	uint8_t *px = ctx->buffer + offset;
+	uint8_t *npx = (ctx->nBuffer != NULL) ? ctx->nBuffer + offset : NULL;
+	uint8_t *apx = (ctx->aBuffer != NULL) ? ctx->aBuffer + offset : NULL;
+	
+	for (x = (int)width - 1; x >= 0; x--)
+	{
+		q = info->qBuffer[y * width + x];	// no need to use GetQ, x and y are always within bounds.
+		yN = GetQ(info->qBuffer, x, y - 1, width, height, widthMask, heightMask);	// recalculates x & y if they go out of bounds.
+		yS = GetQ(info->qBuffer, x, y + 1, width, height, widthMask, heightMask);
+		yW = GetQ(info->qBuffer, x - 1, y, width, height, widthMask, heightMask);
+		yE = GetQ(info->qBuffer, x + 1, y, width, height, widthMask, heightMask);
+		
+		color = PlanetMix(info, q, nearPole);
+		
+		norm = vector_normal(make_vector(normalScale * (yE - yW), normalScale * (yN - yS), 1.0f));
+		if (npx != NULL)
+		{
+			shade = 1.0f;
+			
+			// Flatten the sea.
+			norm = OOVectorInterpolate(norm, kBasisZVector, color.a);
+			
+			// Put norm in normal map, scaled from [-1..1] to [0..255].
+			*npx++ = 127.5f * (norm.y + 1.0f);
+			*npx++ = 127.5f * (-norm.x + 1.0f);
+			*npx++ = 127.5f * (norm.z + 1.0f);
+			
+			*npx++ = 255.0f * color.a;	// Specular channel.
+		}
+		else
+		{
+			//	Terrain shading - lambertian lighting from straight above.
+			shade = norm.z;
+			
+			/*	We don't want terrain shading in the sea. The alpha channel
+				of color is a measure of "seaishness" for the specular map,
+				so we can recycle that to avoid branching.
+				-- Ahruman
+			*/
+			shade += color.a - color.a * shade;	// equivalent to - but slightly faster than - previous implementation.
+		}
+		
+		*px++ = 255.0f * color.r * shade;
+		*px++ = 255.0f * color.g * shade;
+		*px++ = 255.0f * color.b * shade;
+		
+		*px++ = 0;	// FIXME: light map goes here.
+		
+		if (apx != NULL)
+		{
+			q = QFactor(info->fbmBuffer, x, y, width, ctx->paleClouds, cloudFraction, nearPole);
+			color = CloudMix(info, q, nearPole);
+			*apx++ = 255.0f * color.r;
+			*apx++ = 255.0f * color.g;
+			*apx++ = 255.0f * color.b;
+			*apx++ = 255.0f * color.a * info->cloudAlpha;
+		}
+	}
+}
+
+
 static void SetMixConstants(OOPlanetTextureGeneratorInfo *info, float temperatureFraction)
 {
 	info->mix_hi = 0.66667f * info->landFraction;
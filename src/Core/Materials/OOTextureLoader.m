@@ -56,6 +56,7 @@ enum
 static unsigned				sGLMaxSize;
 static uint32_t				sUserMaxSize;
 static BOOL					sReducedDetail;
+static BOOL					sSRGBMipMaps;
 static BOOL					sHaveNPOTTextures = NO;	// TODO: support "true" non-power-of-two textures.
 static BOOL					sHaveSetUp = NO;
 
@@ -304,6 +305,8 @@ static BOOL					sHaveSetUp = NO;
 	sUserMaxSize = OORoundUpToPowerOf2_32(sUserMaxSize);
 	sUserMaxSize = MAX(sUserMaxSize, 64U);
 	
+	// Average sRGB textures' mip-maps in linear space, as GL would.
+	sSRGBMipMaps = [[NSUserDefaults standardUserDefaults] oo_boolForKey:@"gamma-correct-mipmaps" defaultValue:YES];
 	
 	sHaveSetUp = YES;
 }
@@ -472,7 +475,14 @@ static BOOL					sHaveSetUp = NO;
 	}
 	if (_generateMipMaps)
 	{
-		OOGenerateMipMaps(_data, _width, _height, _format);
+		if ((_options & kOOTextureSRGBA) && sSRGBMipMaps)
+		{
+			OOGenerateMipMapsSRGB(_data, _width, _height, _format);
+		}
+		else
+		{
+			OOGenerateMipMaps(_data, _width, _height, _format);
+		}
 	}
 	
 	// All done.
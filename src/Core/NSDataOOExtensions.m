@@ -28,9 +28,7 @@ SOFTWARE.
 */
 
 #import "OOCocoa.h"
-#import "unzip.h"
-
-#define ZIP_BUFFER_SIZE 8192
+#import "OOOXZArchive.h"
 
 @implementation NSData (OOExtensions)
 
@@ -87,82 +85,7 @@ SOFTWARE.
 	range.location = i+1; range.length = cl-(i+1);
 	NSString *containedFile = [NSString pathWithComponents:[components subarrayWithRange:range]];
 
-	unzFile uf = NULL;
-	const char* zipname = [zipFile UTF8String];
-	if (zipname != NULL)
-	{
-		uf = unzOpen64(zipname);
-	}
-	if (uf == NULL)
-	{
-		// This is not necessarily an error - the OXZ manager tries to
-		// do this as a test for the presence of managed OXZs
-//		OOLog(kOOLogFileNotFound, @"Could not unzip OXZ at %@", zipFile);
-		return nil;
-	}
-	const char* filename = [containedFile UTF8String];
-	// unzLocateFile(*, *, 1) = case-sensitive extract
-	if (unzLocateFile(uf, filename, 1) != UNZ_OK)
-    {
-		unzClose(uf);
-		/* Much of the time this function is called with the
-		 * expectation that the file may not necessarily exist -
-		 * e.g. on plist merges, config scans, etc. So don't add log
-		 * entries for this failure mode */
-//		OOLog(kOOLogFileNotFound, @"Could not find %@ within OXZ at %@", containedFile, zipFile);
-		return nil;
-	}
-	
-	int err = UNZ_OK;
-	unz_file_info64 file_info = {0};
-	err = unzGetCurrentFileInfo64(uf, &file_info, NULL, 0, NULL, 0, NULL, 0);
-    if (err != UNZ_OK)
-    {
-		unzClose(uf);
-		OOLog(kOOLogFileNotFound, @"Could not get properties of %@ within OXZ at %@", containedFile, zipFile);
-		return nil;
-	}
-
-	err = unzOpenCurrentFile(uf);
-	if (err != UNZ_OK)
-	{
-		unzClose(uf);
-		OOLog(kOOLogFileNotFound, @"Could not read %@ within OXZ at %@", containedFile, zipFile);
-		return nil;
-	}
-	
-	
-
-	NSMutableData *tmp = [NSMutableData dataWithCapacity:file_info.uncompressed_size];
-	void *buf = (void*)malloc(ZIP_BUFFER_SIZE);
-	do
-	{
-		err = unzReadCurrentFile(uf, buf, ZIP_BUFFER_SIZE);
-		if (err < 0)
-		{
-			OOLog(kOOLogFileNotFound, @"Could not read %@ within OXZ at %@ (err %d)", containedFile, zipFile, err);
-			break;
-		}
-		if (err == 0)
-		{
-			break;
-		}
-		[tmp appendBytes:buf length:err];
-	}
-	while (err > 0);
-	free(buf);
-
-	err = unzCloseCurrentFile(uf);
-	if (err != UNZ_OK)
-	{
-		unzClose(uf);
-		OOLog(kOOLogFileNotFound, @"Could not close %@ within OXZ at %@", containedFile, zipFile);
-		return nil;
-	}
-	
-	unzClose(uf);
-	return [[tmp retain] autorelease];
-
+	return [[OOOXZArchive archiveWithPath:zipFile] dataForEntry:containedFile];
 }
 
 @end
@@ -361,16 +361,10 @@ static int OOCloseOXZVorbis (void *datasource);
 		remaining = (int)MIN(frameSize * sizeInFrames, (size_t)INT_MAX);
 		dst = buffer;
 		
-		char pcmout[4096];
-
 		do
 		{
-			int toRead = sizeof(pcmout);
-			if (remaining < toRead)
-			{
-				toRead = remaining;
-			}
-			framesRead = ov_read(&_vf, pcmout, toRead, 0, 2, 1, NULL);
+			// Decode straight into the result.
+			framesRead = ov_read(&_vf, dst, MIN(remaining, 4096), 0, 2, 1, NULL);
 			if (framesRead <= 0)
 			{
 				if (OV_HOLE == framesRead) continue;
@@ -378,13 +372,11 @@ static int OOCloseOXZVorbis (void *datasource);
 				break;
 			}
 			
-			memcpy(dst, &pcmout, sizeof (char) * framesRead);
-			
 			remaining -= framesRead;
 			dst += framesRead;
 		} while (0 < remaining);
 		
-		sizeInFrames -= remaining;	// In case we stopped at an error
+		sizeInFrames -= remaining / frameSize;	// In case we stopped at an error
 	}
 	
 	if (OK)
@@ -408,26 +400,20 @@ static int OOCloseOXZVorbis (void *datasource);
 	long framesRead;
 
 	char *dst = buffer;
-	char pcmout[4096];
 	_readStarted = YES;
 	do
 	{
-		int toRead = sizeof(pcmout);
-		if (remaining < toRead)
-		{
-			toRead = remaining;
-		}
-		framesRead = ov_read(&_vf, pcmout, toRead, 0, 2, 1, NULL);
+		// Decode straight into the caller's buffer.
+		framesRead = ov_read(&_vf, dst, MIN(remaining, 4096), 0, 2, 1, NULL);
 		if (framesRead <= 0)
 		{
 			if (OV_HOLE == framesRead) continue;
 			//else:
 			break;
 		}
-		memcpy(dst, &pcmout, sizeof (char) * framesRead);
-		remaining -= sizeof(char) * framesRead;
-		dst += sizeof(char) * framesRead;
-		streamed += sizeof(char) * framesRead;
+		remaining -= framesRead;
+		dst += framesRead;
+		streamed += framesRead;
 	} while (0 < remaining);
 
 	return streamed;
@@ -501,14 +487,10 @@ static size_t OOReadOXZVorbis (void *ptr, size_t size, size_t nmemb, void *datas
 {
 	OOALSoundVorbisCodec *src = (OOALSoundVorbisCodec *)datasource;
 	size_t toRead = size*nmemb;
-	void *buf = (void*)malloc(toRead);
-	int err = UNZ_OK;
-	err = unzReadCurrentFile(src->uf, buf, toRead);
+	if (toRead > INT_MAX)  toRead = INT_MAX;
+	// Inflate straight into libvorbisfile's buffer.
+	int err = unzReadCurrentFile(src->uf, ptr, (unsigned)toRead);
 //	OOLog(@"sound.replay",@"Read %d blocks, got %d",toRead,err);
-	if (err > 0)
-	{
-		memcpy(ptr, buf, err);
-	}
 	if (err < 0)
 	{
 		return OV_EREAD;
@@ -27,16 +27,29 @@ SOFTWARE.
 #import "OOSound.h"
 #import "OOALSoundDecoder.h"
 
+@class OOALStreamRing;
+
+
+/*	Streamed sounds are decoded ahead of playback on a shared background
+	thread, into a small ring of PCM chunks. Only the first chunk is decoded
+	until the sound is played. The decoder belongs to the ring, and is only
+	touched by the decode thread once the sound is set up. When the end of
+	the stream is reached, decoding carries on from the start, so looping or
+	replaying a sound doesn't stall on rewinding the decoder. If playback
+	catches up with decoding, a short buffer of silence is played instead of
+	waiting.
+*/
 @interface OOALStreamedSound: OOSound
 {
 @private
-	char				*_buffer;
-	size_t				_size;
 	double				_sampleRate;
 	NSString			*_name;
 	BOOL				_stereo;
-	OOALSoundDecoder	*decoder;
+	OOALStreamRing		*_ring;
+	uint32_t			_epoch;
 	BOOL				_reachedEnd;
+	BOOL				_atStart;
+	BOOL				_underrun;
 }
 
 - (id)initWithDecoder:(OOALSoundDecoder *)inDecoder;
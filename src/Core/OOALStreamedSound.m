@@ -28,14 +28,92 @@ SOFTWARE.
 
 #import "OOALStreamedSound.h"
 #import "OOALSoundDecoder.h"
+#import "OOLogging.h"
+
+
+enum
+{
+	kStreamRingSize			= 3,		// Chunks decoded ahead while playing, about 2.3 s each for 44.1 kHz stereo.
+	kIdleRingSize			= 1,		// Chunks decoded ahead before the sound is first played.
+	kSilenceSamples			= 4096,		// Played when the decode thread falls behind; about 50 ms of 44.1 kHz stereo.
+	kConditionNoWork		= 0,
+	kConditionWorkPending	= 1
+};
+
+
+typedef struct
+{
+	char				*data;
+	size_t				length;
+	uint32_t			epoch;
+	BOOL				endOfStream;
+} OOALStreamChunk;
+
+
+/*	Single-producer, single-consumer ring of decoded chunks. The decode
+	thread writes at _writeCount, the sound reads at _readCount; both are
+	free-running counters and each is only modified by its own side, so no
+	lock is needed to move data, and the reader never waits for the writer.
+	Rewinding is requested by bumping _requestedEpoch; the decode thread
+	resets the decoder when it notices, and the reader drops chunks from
+	older epochs.
+	
+	Until the sound is first played (_playing), only the first chunk is
+	decoded, and the buffers for the others aren't allocated.
+*/
+@interface OOALStreamRing: NSObject
+{
+@public
+	OOALSoundDecoder	*_decoder;
+	OOALStreamChunk		_chunks[kStreamRingSize];
+	volatile uint32_t	_writeCount;
+	volatile uint32_t	_readCount;
+	volatile uint32_t	_requestedEpoch;
+	uint32_t			_decoderEpoch;
+	volatile BOOL		_playing;
+	volatile BOOL		_abandoned;
+}
+
+- (id) initWithDecoder:(OOALSoundDecoder *)decoder;
+
+// Decode thread only.
+- (void) fill;
+
+@end
+
+
+static NSMutableArray		*sStreamRings = nil;
+static NSConditionLock		*sDecodeWorkLock = nil;
+static const int16_t		sSilence[kSilenceSamples] = { 0 };
+
+
+static void WakeDecodeThread(void)
+{
+	[sDecodeWorkLock lock];
+	[sDecodeWorkLock unlockWithCondition:kConditionWorkPending];
+}
+
+
+@interface OOALStreamedSound (Private)
+
++ (void) decodeThread;
++ (void) addStreamRing:(OOALStreamRing *)ring;
+
+@end
+
 
 @implementation OOALStreamedSound
 
 - (void)dealloc
 {
-	free(_buffer);
-	_buffer = NULL;
-	[decoder release];
+	// The decode thread drops abandoned rings, and the decoder with them.
+	if (_ring != nil)
+	{
+		_ring->_abandoned = YES;
+		[_ring release];
+		WakeDecodeThread();
+	}
+	[_name release];
 
 	[super dealloc];
 }
@@ -66,9 +144,15 @@ SOFTWARE.
 		_sampleRate = [inDecoder sampleRate];
 		_stereo = [inDecoder isStereo];
 		_reachedEnd = NO;
-		_buffer = malloc(OOAL_STREAM_CHUNK_SIZE);
-		decoder = [inDecoder retain];
-		[self rewind];
+		_atStart = YES;
+		_ring = [[OOALStreamRing alloc] initWithDecoder:inDecoder];
+		if (_ring == nil)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		// Start decoding right away, so the first chunk is ready by the time it's played.
+		[OOALStreamedSound addStreamRing:_ring];
 	}
 	
 	if (!OK)
@@ -82,7 +166,16 @@ SOFTWARE.
 
 - (void) rewind
 {
-	[decoder reset];
+	/*	The decode thread wraps around at the end of the stream, so if we
+		are at the start or have just played the last chunk, the next chunk
+		is already the beginning of the sound.
+	*/
+	if (!_atStart)
+	{
+		_epoch = __sync_add_and_fetch(&_ring->_requestedEpoch, 1);
+		_atStart = YES;
+		WakeDecodeThread();
+	}
 	_reachedEnd = NO;
 }
 
@@ -95,32 +188,193 @@ SOFTWARE.
 
 - (ALuint) soundBuffer
 {
-	size_t transferred = [decoder streamToBuffer:_buffer];
-	if (transferred < OOAL_STREAM_CHUNK_SIZE)
+	OOALStreamChunk			*chunk = NULL;
+	
+	if (!_ring->_playing)
 	{
-		// otherwise keep going
-		_reachedEnd = YES;
+		// Now it's being played, decode the rest of the ring ahead.
+		_ring->_playing = YES;
+		WakeDecodeThread();
 	}
+	
+	while (_ring->_readCount != _ring->_writeCount)
+	{
+		__sync_synchronize();
+		chunk = &_ring->_chunks[_ring->_readCount % kStreamRingSize];
+		if (chunk->epoch == _epoch)  break;
+		
+		// Decoded before the last rewind; drop it.
+		chunk = NULL;
+		__sync_synchronize();
+		_ring->_readCount++;
+		WakeDecodeThread();
+	}
+	
+	/*	If the decode thread has fallen behind, queue a little silence
+		rather than stalling the game; the channel asks again once it has
+		been played.
+	*/
+	const char *data = (const char *)sSilence;
+	size_t transferred = sizeof sSilence;
+	if (chunk != NULL)
+	{
+		data = chunk->data;
+		transferred = chunk->length;
+		_reachedEnd = chunk->endOfStream;
+		_atStart = chunk->endOfStream;
+	}
+	else if (!_underrun)
+	{
+		OOLog(@"sound.streaming.underrun", @"Streamed sound %@ is not decoded yet, playing silence.", _name);
+	}
+	_underrun = (chunk == NULL);
 
-	ALuint buffer;
+	ALuint buffer = 0;
 	ALint error;
 	OOAL(alGenBuffers(1,&buffer));
 	if ((error = alGetError()) != AL_NO_ERROR)
 	{
 		OOLog(kOOLogSoundLoadingError, @"%@", @"Could not create OpenAL buffer");
-		return 0;
+		buffer = 0;
 	}
 	else
 	{
 		if (!_stereo)
 		{
-			alBufferData(buffer, AL_FORMAT_MONO16, _buffer, (ALsizei)transferred, _sampleRate);
+			alBufferData(buffer, AL_FORMAT_MONO16, data, (ALsizei)transferred, _sampleRate);
 		}
 		else
 		{
-			alBufferData(buffer, AL_FORMAT_STEREO16, _buffer, (ALsizei)transferred, _sampleRate);
+			alBufferData(buffer, AL_FORMAT_STEREO16, data, (ALsizei)transferred, _sampleRate);
+		}
+	}
+	
+	if (chunk != NULL)
+	{
+		// Hand the slot back to the decode thread.
+		__sync_synchronize();
+		_ring->_readCount++;
+		WakeDecodeThread();
+	}
+	
+	return buffer;
+}
+
+@end
+
+
+@implementation OOALStreamedSound (Private)
+
++ (void) addStreamRing:(OOALStreamRing *)ring
+{
+	if (sStreamRings == nil)
+	{
+		sStreamRings = [[NSMutableArray alloc] init];
+		sDecodeWorkLock = [[NSConditionLock alloc] initWithCondition:kConditionNoWork];
+		[NSThread detachNewThreadSelector:@selector(decodeThread) toTarget:self withObject:nil];
+	}
+	
+	[sDecodeWorkLock lock];
+	[sStreamRings addObject:ring];
+	[sDecodeWorkLock unlockWithCondition:kConditionWorkPending];
+}
+
+
++ (void) decodeThread
+{
+	NSAutoreleasePool		*rootPool = [[NSAutoreleasePool alloc] init];
+	
+	for (;;)
+	{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSArray *rings = nil;
+		OOALStreamRing *ring = nil;
+		
+		[sDecodeWorkLock lockWhenCondition:kConditionWorkPending];
+		NSMutableArray *liveRings = [NSMutableArray arrayWithCapacity:[sStreamRings count]];
+		foreach (ring, sStreamRings)
+		{
+			if (!ring->_abandoned)  [liveRings addObject:ring];
+		}
+		[sStreamRings setArray:liveRings];
+		rings = [[sStreamRings copy] autorelease];
+		[sDecodeWorkLock unlockWithCondition:kConditionNoWork];
+		
+		foreach (ring, rings)
+		{
+			if (!ring->_abandoned)  [ring fill];
+		}
+		
+		[pool release];
+	}
+	
+	[rootPool release];
+}
+
+@end
+
+
+@implementation OOALStreamRing
+
+- (id) initWithDecoder:(OOALSoundDecoder *)decoder
+{
+	if ((self = [super init]))
+	{
+		// The other chunks are allocated by the decode thread once they're needed.
+		_chunks[0].data = malloc(OOAL_STREAM_CHUNK_SIZE);
+		if (_chunks[0].data == NULL)
+		{
+			[self release];
+			return nil;
+		}
+		
+		_decoder = [decoder retain];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	unsigned i;
+	for (i = 0; i < kStreamRingSize; i++)
+	{
+		free(_chunks[i].data);
+	}
+	DESTROY(_decoder);
+	
+	[super dealloc];
+}
+
+
+- (void) fill
+{
+	while (!_abandoned && _writeCount - _readCount < (_playing ? kStreamRingSize : kIdleRingSize))
+	{
+		uint32_t epoch = _requestedEpoch;
+		if (epoch != _decoderEpoch)
+		{
+			[_decoder reset];
+			_decoderEpoch = epoch;
+		}
+		
+		OOALStreamChunk *chunk = &_chunks[_writeCount % kStreamRingSize];
+		if (chunk->data == NULL)
+		{
+			chunk->data = malloc(OOAL_STREAM_CHUNK_SIZE);
+			// Out of memory: play from the chunks we have.
+			if (chunk->data == NULL)  break;
 		}
-		return buffer;
+		chunk->length = [_decoder streamToBuffer:chunk->data];
+		chunk->endOfStream = chunk->length < OOAL_STREAM_CHUNK_SIZE;
+		chunk->epoch = epoch;
+		
+		// Carry on from the start, ready for a loop or replay.
+		if (chunk->endOfStream)  [_decoder reset];
+		
+		__sync_synchronize();
+		_writeCount++;
 	}
 }
 
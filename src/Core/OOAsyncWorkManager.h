@@ -43,6 +43,9 @@ typedef enum
 } OOAsyncWorkPriority;
 
 
+typedef void (*OOAsyncBatchFunction)(NSUInteger index, void *context);
+
+
 @interface OOAsyncWorkManager: NSObject
 
 + (OOAsyncWorkManager *) sharedAsyncWorkManager;
@@ -62,6 +65,18 @@ typedef enum
 */
 - (void) waitForTaskToComplete:(id<OOAsyncWorkTask>)task;
 
+/*	Call function(i, context) for every i in [0, count), spread across the
+	worker threads and the calling thread, and return when all calls have
+	finished. Items are handed out dynamically, so the calling thread will do
+	all the work itself if the workers are busy with other tasks; small
+	batches are run inline.
+	
+	function must be thread-safe. Each call is wrapped in its own
+	autorelease pool, but should avoid allocating anyway. Exceptions are
+	caught and logged, not propagated.
+*/
+- (void) performBatchWithFunction:(OOAsyncBatchFunction)function context:(void *)context count:(NSUInteger)count;
+
 @end
 
 
@@ -31,6 +31,7 @@ SOFTWARE.
 #import "OOCollectionExtractors.h"
 #import "NSThreadOOExtensions.h"
 #import "OONSOperation.h"
+#import "OOFrameTracer.h"
 
 #define USE_PTHREAD_ONCE (!OOLITE_WINDOWS)
 
@@ -97,6 +98,50 @@ static OOAsyncWorkManager *sSingleton = nil;
 @end
 
 
+/*	OOAsyncBatch: shared state for -performBatchWithFunction:context:count:.
+	Each worker task retains the batch, so a task which only gets to run after
+	the batch is finished can safely find there is nothing left to do; it
+	never touches the caller's context in that case.
+*/
+@interface OOAsyncBatch: NSObject
+{
+@public
+	OOAsyncBatchFunction	_function;
+	void					*_context;
+	NSUInteger				_count;
+	volatile NSUInteger		_nextIndex;
+	volatile NSUInteger		_completedCount;
+	NSConditionLock			*_doneLock;
+}
+
+- (id) initWithFunction:(OOAsyncBatchFunction)function context:(void *)context count:(NSUInteger)count;
+
+// Process items until none are left to claim.
+- (void) work;
+
+- (void) waitUntilDone;
+
+@end
+
+
+@interface OOAsyncBatchTask: NSObject <OOAsyncWorkTask>
+{
+@private
+	OOAsyncBatch			*_batch;
+}
+
+- (id) initWithBatch:(OOAsyncBatch *)batch;
+
+@end
+
+
+enum
+{
+	kBatchDoneCondition		= 1,
+	kMinBatchItemsPerThread	= 16
+};
+
+
 #if !USE_PTHREAD_ONCE
 static NSLock *sInitLock = nil;
 #endif
@@ -216,6 +261,132 @@ static void InitAsyncWorkManager(void)
 	[NSException raise:NSInternalInconsistencyException format:@"%s called.", __PRETTY_FUNCTION__];
 }
 
+
+- (void) performBatchWithFunction:(OOAsyncBatchFunction)function context:(void *)context count:(NSUInteger)count
+{
+	NSParameterAssert(function != NULL);
+	if (count == 0)  return;
+	
+	NSUInteger i, helpers = MIN(OOCPUCount(), count / kMinBatchItemsPerThread);
+	if (helpers > 0)  helpers--;	// The calling thread does its share.
+	
+	if (helpers == 0)
+	{
+		for (i = 0; i < count; i++)  function(i, context);
+		return;
+	}
+	
+	OOAsyncBatch *batch = [[OOAsyncBatch alloc] initWithFunction:function context:context count:count];
+	for (i = 0; i < helpers; i++)
+	{
+		OOAsyncBatchTask *task = [[OOAsyncBatchTask alloc] initWithBatch:batch];
+		[self addTask:task priority:kOOAsyncPriorityHigh];
+		[task release];
+	}
+	
+	[batch work];
+	[batch waitUntilDone];
+	[batch release];
+}
+
+@end
+
+
+@implementation OOAsyncBatch
+
+- (id) initWithFunction:(OOAsyncBatchFunction)function context:(void *)context count:(NSUInteger)count
+{
+	if ((self = [super init]))
+	{
+		_function = function;
+		_context = context;
+		_count = count;
+		_doneLock = [[NSConditionLock alloc] initWithCondition:0];
+		if (_doneLock == nil)
+		{
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+
+- (void) dealloc
+{
+	[_doneLock release];
+	
+	[super dealloc];
+}
+
+
+- (void) work
+{
+	for (;;)
+	{
+		NSUInteger index = __sync_fetch_and_add(&_nextIndex, 1);
+		if (index >= _count)  break;
+		
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		@try
+		{
+			_function(index, _context);
+		}
+		@catch (NSException *exception)
+		{
+			OOLog(@"asyncWorkManager.batch.exception", @"***** Exception in batch work item %lu: %@: %@", (unsigned long)index, [exception name], [exception reason]);
+		}
+		[pool release];
+		
+		if (__sync_add_and_fetch(&_completedCount, 1) == _count)
+		{
+			[_doneLock lock];
+			[_doneLock unlockWithCondition:kBatchDoneCondition];
+		}
+	}
+}
+
+
+- (void) waitUntilDone
+{
+	[_doneLock lockWhenCondition:kBatchDoneCondition];
+	[_doneLock unlock];
+}
+
+@end
+
+
+@implementation OOAsyncBatchTask
+
+- (id) initWithBatch:(OOAsyncBatch *)batch
+{
+	if ((self = [super init]))
+	{
+		_batch = [batch retain];
+	}
+	return self;
+}
+
+
+- (void) dealloc
+{
+	[_batch release];
+	
+	[super dealloc];
+}
+
+
+- (void) performAsyncTask
+{
+	[_batch work];
+}
+
+
+- (void) completeAsyncTask
+{
+	// Nothing to do, but implementing this lets the manager release us.
+}
+
 @end
 
 
@@ -381,11 +552,13 @@ enum
 		pool = [[NSAutoreleasePool alloc] init];
 		
 		id<OOAsyncWorkTask> task = [_taskQueue dequeue];
+		OOFrameTraceBeginKeyed([task class], NSStringFromClass([task class]));
 		@try
 		{
 			[task performAsyncTask];
 		}
 		@catch (id exception) {}
+		OOFrameTraceEnd();
 		[self queueResult:task];
 		
 		[pool release];
@@ -457,11 +630,13 @@ enum
 
 - (void) dispatchTask:(id<OOAsyncWorkTask>)task
 {
+	OOFrameTraceBeginKeyed([task class], NSStringFromClass([task class]));
 	@try
 	{
 		[task performAsyncTask];
 	}
 	@catch (id exception) {}
+	OOFrameTraceEnd();
 	[self queueResult:task];
 }
 
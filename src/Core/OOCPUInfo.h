@@ -41,6 +41,20 @@ void OOCPUInfoInit(void);
 NSUInteger OOCPUCount(void);
 
 
+/*	SIMD instruction sets which are both supported by the CPU and compiled
+	into this build, for selecting optimized code paths at run time (see
+	OOTextureScaling.m).
+*/
+enum
+{
+	kOOCPUFeatureSSE2		= 0x00000001,
+	kOOCPUFeatureNEON		= 0x00000002
+};
+typedef uint32_t OOCPUFeatures;
+
+OOCPUFeatures OOCPUGetFeatures(void);
+
+
 /*
 	Returns the CPU identifier string. Currently Windows and Linux only.
 */
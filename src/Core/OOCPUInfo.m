@@ -59,6 +59,10 @@ static BOOL				sInited = NO;
 
 
 static NSUInteger		sNumberOfCPUs = 0;	// Yes, really 0.
+static OOCPUFeatures	sCPUFeatures = 0;
+
+
+static OOCPUFeatures DetectCPUFeatures(void);
 
 
 void OOCPUInfoInit(void)
@@ -98,6 +102,8 @@ void OOCPUInfoInit(void)
 	#warning Do not know how to find number of CPUs on this architecture.
 #endif	// OS selection
 	
+	sCPUFeatures = DetectCPUFeatures();
+	
 	sInited = YES;
 }
 
@@ -109,6 +115,37 @@ NSUInteger OOCPUCount(void)
 }
 
 
+OOCPUFeatures OOCPUGetFeatures(void)
+{
+	if (!sInited)  OOCPUInfoInit();
+	return sCPUFeatures;
+}
+
+
+static OOCPUFeatures DetectCPUFeatures(void)
+{
+	OOCPUFeatures features = 0;
+	
+#if defined(__SSE2__)
+	#if defined(__x86_64__) || defined(__amd64__) || OOLITE_MAC_OS_X
+	// SSE2 is part of x86-64, and every Intel Mac has it.
+	features |= kOOCPUFeatureSSE2;
+	#elif (OOLITE_WINDOWS || OOLITE_LINUX)
+	int CPUInfo[4] = {0};
+	OOCPUID(CPUInfo, 1);
+	if (CPUInfo[3] & (1 << 26))  features |= kOOCPUFeatureSSE2;
+	#endif
+#endif
+	
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	// Builds targeting NEON can't run without it.
+	features |= kOOCPUFeatureNEON;
+#endif
+	
+	return features;
+}
+
+
 #if (OOLITE_WINDOWS || OOLITE_LINUX)
 	#if OOLITE_LINUX
 		#define OO_GNU_INLINE	__attribute__((gnu_inline))
@@ -9,6 +9,14 @@ The cache manager stores arbitrary property lists in separate namespaces
 different verison of Oolite, or if it was created on a system with a different
 byte sex.
 
+Binary caches hold flat data blobs rather than property lists. Each entry is
+stored in its own file and returned memory-mapped, so that large arrays (such
+as mesh geometry) can be used directly without parsing or copying. Binary
+entries are written along with the property list cache, and are discarded
+whenever it is. The blob contents are opaque to the cache manager; clients
+are responsible for versioning them and for checking that a blob was stored
+for the key they expect, since keys are escaped to form file names.
+
 Oolite
 Copyright (C) 2004-2013 Giles C Williams and contributors
 
@@ -36,9 +44,13 @@ MA 02110-1301, USA.
 {
 @private
 	NSMutableDictionary		*_caches;
+	NSMutableDictionary		*_binaryData;			// Binary entries set this session.
+	NSMutableDictionary		*_pendingBinaryData;	// Subset of _binaryData not yet written.
 	id						_scheduledWrite;
 	BOOL					_permitWrites;
 	BOOL					_dirty;
+	BOOL					_ignoreBinaryFiles;
+	BOOL					_clearBinaryFilesOnWrite;
 }
 
 + (OOCacheManager *)sharedCache;
@@ -47,6 +59,10 @@ MA 02110-1301, USA.
 - (void)setObject:(id)inElement forKey:(NSString *)inKey inCache:(NSString *)inCacheKey;
 - (void)removeObjectForKey:(NSString *)inKey inCache:(NSString *)inCacheKey;
 - (void)clearCache:(NSString *)inCacheKey;
+
+- (NSData *)dataForKey:(NSString *)inKey inBinaryCache:(NSString *)inCacheKey;
+- (void)setData:(NSData *)inData forKey:(NSString *)inKey inBinaryCache:(NSString *)inCacheKey;
+
 - (void)clearAllCaches;
 - (void) reloadAllCaches;
 
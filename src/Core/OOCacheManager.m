@@ -69,11 +69,13 @@ static NSString * const kCacheKeyEndianTag					= @"endian tag";
 static NSString * const kCacheKeyFormatVersion				= @"format version";
 static NSString * const kCacheKeyCaches						= @"caches";
 
+static NSString * const kBinaryCacheFolderName				= @"Binary Cache";
+
 
 enum
 {
 	kEndianTagValue			= 0x0123456789ABCDEFULL,
-	kFormatVersionValue		= 219
+	kFormatVersionValue		= 220
 };
 
 
@@ -90,11 +92,13 @@ static OOCacheManager *sSingleton = nil;
 
 - (NSDictionary *)loadDict;
 - (BOOL)writeDict:(NSDictionary *)inDict;
+- (BOOL)writeBinaryData:(NSDictionary *)inData clearingExisting:(BOOL)clear;
 
 - (void)buildCachesFromDictionary:(NSDictionary *)inDict;
 - (NSDictionary *)dictionaryOfCaches;
 
 - (BOOL)directoryExists:(NSString *)inPath create:(BOOL)inCreate;
+- (NSString *)binaryCachePathCreatingIfNecessary:(BOOL)create;
 
 @end
 
@@ -111,9 +115,11 @@ static OOCacheManager *sSingleton = nil;
 {
 @private
 	NSDictionary			*_cacheContents;
+	NSDictionary			*_binaryData;
+	BOOL					_clearBinaryFiles;
 }
 
-- (id) initWithCacheContents:(NSDictionary *)cacheContents;
+- (id) initWithCacheContents:(NSDictionary *)cacheContents binaryData:(NSDictionary *)binaryData clearBinaryFiles:(BOOL)clear;
 
 @end
 #endif
@@ -259,6 +265,79 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
+static NSString *BinaryCacheFileName(NSString *key)
+{
+	NSMutableString *result = [NSMutableString stringWithString:key];
+	[result replaceOccurrencesOfString:@"/" withString:@"_" options:0 range:NSMakeRange(0, [result length])];
+	[result replaceOccurrencesOfString:@"\\" withString:@"_" options:0 range:NSMakeRange(0, [result length])];
+	[result replaceOccurrencesOfString:@":" withString:@"_" options:0 range:NSMakeRange(0, [result length])];
+	return [result stringByAppendingPathExtension:@"bin"];
+}
+
+
+- (NSData *)dataForKey:(NSString *)inKey inBinaryCache:(NSString *)inCacheKey
+{
+	NSData					*result = nil;
+	
+	NSParameterAssert(inKey != nil && inCacheKey != nil);
+	
+	result = [[_binaryData objectForKey:inCacheKey] objectForKey:inKey];
+	if (result == nil && !_ignoreBinaryFiles)
+	{
+		NSString *path = [self binaryCachePathCreatingIfNecessary:NO];
+		path = [[path stringByAppendingPathComponent:inCacheKey] stringByAppendingPathComponent:BinaryCacheFileName(inKey)];
+		if (path != nil && [[NSFileManager defaultManager] fileExistsAtPath:path])
+		{
+			result = [[[NSData alloc] initWithContentsOfMappedFile:path] autorelease];
+		}
+	}
+	
+	if (result != nil)
+	{
+		OODebugLog(kOOLogDataCacheRetrieveSuccess, @"Retrieved \"%@\" binary cache object %@.", inCacheKey, inKey);
+	}
+	else
+	{
+		OODebugLog(kOOLogDataCacheRetrieveFailed, @"Failed to retrieve \"%@\" binary cache object %@ -- no such entry.", inCacheKey, inKey);
+	}
+	
+	return result;
+}
+
+
+- (void)setData:(NSData *)inData forKey:(NSString *)inKey inBinaryCache:(NSString *)inCacheKey
+{
+	NSMutableDictionary		*cache = nil;
+	
+	NSParameterAssert(inData != nil && inKey != nil && inCacheKey != nil);
+	
+	if (EXPECT_NOT(_caches == nil))  return;
+	
+	inData = [[inData copy] autorelease];
+	
+	if (_binaryData == nil)  _binaryData = [[NSMutableDictionary alloc] init];
+	cache = [_binaryData objectForKey:inCacheKey];
+	if (cache == nil)
+	{
+		cache = [NSMutableDictionary dictionary];
+		[_binaryData setObject:cache forKey:inCacheKey];
+	}
+	[cache setObject:inData forKey:inKey];
+	
+	if (_pendingBinaryData == nil)  _pendingBinaryData = [[NSMutableDictionary alloc] init];
+	cache = [_pendingBinaryData objectForKey:inCacheKey];
+	if (cache == nil)
+	{
+		cache = [NSMutableDictionary dictionary];
+		[_pendingBinaryData setObject:cache forKey:inCacheKey];
+	}
+	[cache setObject:inData forKey:inKey];
+	
+	_dirty = YES;
+	OODebugLog(kOOLogDataCacheSetSuccess, @"Updated entry %@ in binary cache \"%@\".", inKey, inCacheKey);
+}
+
+
 - (void)clearAllCaches
 {
 	[self clear];
@@ -384,6 +463,10 @@ static OOCacheManager *sSingleton = nil;
 		{
 			// We have a cache, and it's the right format.
 			[self buildCachesFromDictionary:[cache objectForKey:kCacheKeyCaches]];
+			
+			// Binary cache files were written alongside it, so they're valid too.
+			_ignoreBinaryFiles = NO;
+			_clearBinaryFilesOnWrite = NO;
 		}
 		
 		OOLogOutdentIf(kOOLogDataCacheFound);
@@ -445,7 +528,11 @@ static OOCacheManager *sSingleton = nil;
 	
 #if WRITE_ASYNC
 	NSDictionary *cacheData = newCache;
-	_scheduledWrite = [[OOAsyncCacheWriter alloc] initWithCacheContents:cacheData];
+	_scheduledWrite = [[OOAsyncCacheWriter alloc] initWithCacheContents:cacheData
+															  binaryData:_pendingBinaryData
+														clearBinaryFiles:_clearBinaryFilesOnWrite];
+	DESTROY(_pendingBinaryData);
+	_clearBinaryFilesOnWrite = NO;
 	
 #if PROFILE_WRITES
 	OOTimeDelta endT = [stopwatch reset];
@@ -458,6 +545,10 @@ static OOCacheManager *sSingleton = nil;
 	OOLog(@"dataCache.profile", @"Time to prepare cache data: %g seconds.", prepareT);
 #endif
 	
+	[self writeBinaryData:_pendingBinaryData clearingExisting:_clearBinaryFilesOnWrite];
+	DESTROY(_pendingBinaryData);
+	_clearBinaryFilesOnWrite = NO;
+	
 	if ([self writeDict:newCache])
 	{
 		[self markClean];
@@ -475,6 +566,12 @@ static OOCacheManager *sSingleton = nil;
 {
 	[_caches release];
 	_caches = nil;
+	DESTROY(_binaryData);
+	DESTROY(_pendingBinaryData);
+	
+	// Any binary cache files on disk belong to the discarded cache.
+	_ignoreBinaryFiles = YES;
+	_clearBinaryFilesOnWrite = YES;
 }
 
 
@@ -572,6 +669,49 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
+- (BOOL)writeBinaryData:(NSDictionary *)inData clearingExisting:(BOOL)clear
+{
+	NSString			*path = nil;
+	NSString			*cacheKey = nil;
+	NSString			*key = nil;
+	NSFileManager		*fmgr = [NSFileManager defaultManager];
+	BOOL				result = YES;
+	
+	if (clear)
+	{
+		path = [self binaryCachePathCreatingIfNecessary:NO];
+		if (path != nil)  [fmgr oo_removeItemAtPath:path];
+	}
+	if ([inData count] == 0)  return YES;
+	
+	path = [self binaryCachePathCreatingIfNecessary:YES];
+	if (path == nil)  return NO;
+	
+	foreachkey (cacheKey, inData)
+	{
+		NSDictionary *cache = [inData objectForKey:cacheKey];
+		NSString *cachePath = [path stringByAppendingPathComponent:cacheKey];
+		if (![self directoryExists:cachePath create:YES])
+		{
+			result = NO;
+			continue;
+		}
+		
+		foreachkey (key, cache)
+		{
+			NSString *filePath = [cachePath stringByAppendingPathComponent:BinaryCacheFileName(key)];
+			if (![[cache objectForKey:key] writeToFile:filePath atomically:YES])
+			{
+				OOLog(kOOLogDataCacheWriteFailed, @"Failed to write binary cache entry %@ in cache \"%@\".", key, cacheKey);
+				result = NO;
+			}
+		}
+	}
+	
+	return result;
+}
+
+
 - (void)buildCachesFromDictionary:(NSDictionary *)inDict
 {
 	id							key = nil;
@@ -630,6 +770,16 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
+- (NSString *)binaryCachePathCreatingIfNecessary:(BOOL)create
+{
+	NSString *cachePath = [self cacheDirectoryPathCreatingIfNecessary:create];
+	if (cachePath == nil)  return nil;
+	cachePath = [cachePath stringByAppendingPathComponent:kBinaryCacheFolderName];
+	if (![self directoryExists:cachePath create:create])  return nil;
+	return cachePath;
+}
+
+
 #if OOLITE_MAC_OS_X
 
 - (NSString *)cachePathCreatingIfNecessary:(BOOL)create
@@ -704,11 +854,13 @@ static OOCacheManager *sSingleton = nil;
 #if WRITE_ASYNC
 @implementation OOAsyncCacheWriter
 
-- (id) initWithCacheContents:(NSDictionary *)cacheContents
+- (id) initWithCacheContents:(NSDictionary *)cacheContents binaryData:(NSDictionary *)binaryData clearBinaryFiles:(BOOL)clear
 {
 	if ((self = [super init]))
 	{
 		_cacheContents = [cacheContents copy];
+		_binaryData = [binaryData copy];
+		_clearBinaryFiles = clear;
 		if (_cacheContents == nil)
 		{
 			[self release];
@@ -723,6 +875,7 @@ static OOCacheManager *sSingleton = nil;
 - (void) dealloc
 {
 	DESTROY(_cacheContents);
+	DESTROY(_binaryData);
 	
 	[super dealloc];
 }
@@ -730,6 +883,9 @@ static OOCacheManager *sSingleton = nil;
 
 - (void) performAsyncTask
 {
+	[[OOCacheManager sharedCache] writeBinaryData:_binaryData clearingExisting:_clearBinaryFiles];
+	DESTROY(_binaryData);
+	
 	if ([[OOCacheManager sharedCache] writeDict:_cacheContents])
 	{
 		OOLog(kOOLogDataCacheWriteSuccess, @"%@", @"Wrote data cache.");
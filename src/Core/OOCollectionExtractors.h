@@ -374,6 +374,11 @@ BOOL OOBooleanFromObject(id object, BOOL defaultValue);
 	a yes (between 0 and 1).
 */
 BOOL OOFuzzyBooleanFromObject(id object, float defaultValue);
+
+/*	The probability of a yes which OOFuzzyBooleanFromObject() rolls against,
+	for callers which interpret the object once and roll many times.
+*/
+float OOFuzzyBooleanProbabilityFromObject(id object, float defaultValue);
 #endif
 
 
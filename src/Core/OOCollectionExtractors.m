@@ -1315,6 +1315,16 @@ BOOL OOBooleanFromObject(id object, BOOL defaultValue)
 
 #ifndef OOCOLLECTIONEXTRACTORS_SIMPLE
 BOOL OOFuzzyBooleanFromObject(id object, float defaultValue)
+{
+	/*	This will always be NO for negative values and YES for values
+		greater than 1, as expected. randf() is always less than 1, so
+		< is the correct operator here.
+	*/
+	return randf() < OOFuzzyBooleanProbabilityFromObject(object, defaultValue);
+}
+
+
+float OOFuzzyBooleanProbabilityFromObject(id object, float defaultValue)
 {
 	float probability;
 	
@@ -1334,11 +1344,7 @@ BOOL OOFuzzyBooleanFromObject(id object, float defaultValue)
 		probability = OOFloatFromObject(object, defaultValue);
 	}
 	
-	/*	This will always be NO for negative values and YES for values
-		greater than 1, as expected. randf() is always less than 1, so
-		< is the correct operator here.
-	*/
-	return randf() < probability;
+	return probability;
 }
 #endif
 
@@ -118,6 +118,9 @@ NSString *DockingClearanceStatusToString(OODockingClearanceStatus dockingClearan
 NSString *OOStringFromGraphicsDetail(OOGraphicsDetail detail);
 OOGraphicsDetail OOGraphicsDetailFromString(NSString *string);
 
+NSString *OOStringFromCollisionBroadphase(OOCollisionBroadphase broadphase);
+OOCollisionBroadphase OOCollisionBroadphaseFromString(NSString *string);
+
 NSString *OOStringFromHDRToneMapper(OOHDRToneMapper toneMapper);
 OOHDRToneMapper OOHDRToneMapperFromString( NSString *string);
 
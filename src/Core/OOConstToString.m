@@ -585,6 +585,27 @@ OOGraphicsDetail OOGraphicsDetailFromString(NSString *string)
 }
 
 
+NSString *OOStringFromCollisionBroadphase(OOCollisionBroadphase broadphase)
+{
+	switch (broadphase)
+	{
+		CASE(COLLISION_BROADPHASE_SWEEP);
+		CASE(COLLISION_BROADPHASE_GRID);
+	}
+	
+	return @"COLLISION_BROADPHASE_UNKNOWN";
+}
+
+
+OOCollisionBroadphase OOCollisionBroadphaseFromString(NSString *string)
+{
+	REVERSE_CASE(COLLISION_BROADPHASE_SWEEP);
+	REVERSE_CASE(COLLISION_BROADPHASE_GRID);
+	
+	return COLLISION_BROADPHASE_SWEEP;
+}
+
+
 NSString *OOStringFromHDRToneMapper(OOHDRToneMapper toneMapper)
 {
 	switch (toneMapper)
@@ -0,0 +1,115 @@
+/*
+
+OOFrameTracer.h
+
+Low-overhead recorder for frame phases, written out in the Chrome trace event
+format (chrome://tracing, Perfetto UI) for finding the cause of frame hitches.
+
+While tracing is enabled, begin and end events with a timestamp and thread ID
+are written into a fixed-size ring buffer, so only the most recent events are
+kept. Nothing is allocated or locked on the recording path, except the first
+time a non-constant name is seen (see OOFrameTraceBeginInterned() and
+OOFrameTraceBeginKeyed()). When tracing is off, each trace point costs a test
+of gOOFrameTracerActive.
+
+Traced phases include the stages of Universe -update: and PlayerEntity
+-update:, the passes of Universe -drawUniverse, world script event dispatch,
+frame callbacks and async work tasks. In builds with OOJS_PROFILE, every
+function using OOJS_PROFILE_ENTER is traced as well.
+
+Tracing is controlled from the debug console with console.frameTracing and
+console.writeFrameTrace(). The buffer size (in events) is taken from the
+"frame-trace-buffer-size" preference.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOFunctionAttributes.h"
+
+
+extern BOOL gOOFrameTracerActive;
+
+
+/*	Start recording, discarding anything previously recorded. Stopping leaves
+	the recorded events in place so they can be written out.
+*/
+void OOFrameTracerStart(void);
+void OOFrameTracerStop(void);
+
+/*	Write the contents of the ring buffer to a JSON file in the diagnostic
+	file location, and return its path (or nil on failure). Recording is
+	suspended while writing.
+*/
+NSString *OOFrameTracerWriteTrace(void);
+
+
+/*	Trace points. Names passed to OOFrameTraceBegin() must remain valid for
+	the rest of the session, which in practice means constant strings; other
+	names should go through OOFrameTraceBeginInterned(), which keeps a copy.
+	C-string names must also be constant.
+	
+	Where a name is made from something with a fixed address, such as a class
+	or an interned jsid, OOFrameTraceBeginKeyed() looks it up by that key and
+	only evaluates the name expression the first time the key is seen. The
+	key must not stand for anything with a different name later on.
+*/
+void OOFrameTraceBegin_(NSString *name);
+void OOFrameTraceBeginInterned_(NSString *name);
+NSString *OOFrameTraceNameForKey_(const void *key);
+NSString *OOFrameTraceInternNameForKey_(const void *key, NSString *name);
+void OOFrameTraceBeginCString_(const char *name);
+void OOFrameTraceEnd_(void);
+void OOFrameTraceStage_(BOOL *ioStageOpen, NSString *stage);
+
+OOINLINE void OOFrameTraceBegin(NSString *name)
+{
+	if (EXPECT_NOT(gOOFrameTracerActive))  OOFrameTraceBegin_(name);
+}
+
+// A macro so that the name expression is only evaluated while tracing.
+#define OOFrameTraceBeginInterned(name)  do { if (EXPECT_NOT(gOOFrameTracerActive))  OOFrameTraceBeginInterned_(name); } while (0)
+
+#define OOFrameTraceBeginKeyed(key, name)  do { if (EXPECT_NOT(gOOFrameTracerActive)) { \
+		const void *oo_traceKey_ = (key); \
+		NSString *oo_traceName_ = OOFrameTraceNameForKey_(oo_traceKey_); \
+		if (oo_traceName_ == nil)  oo_traceName_ = OOFrameTraceInternNameForKey_(oo_traceKey_, (name)); \
+		OOFrameTraceBegin_(oo_traceName_); \
+	}} while (0)
+
+OOINLINE void OOFrameTraceBeginCString(const char *name)
+{
+	if (EXPECT_NOT(gOOFrameTracerActive))  OOFrameTraceBeginCString_(name);
+}
+
+OOINLINE void OOFrameTraceEnd(void)
+{
+	if (EXPECT_NOT(gOOFrameTracerActive))  OOFrameTraceEnd_();
+}
+
+/*	For code that marks the start of successive stages rather than bracketing
+	them: ends the current stage, if any, and begins the named one. Pass nil
+	to just end the current stage. ioStageOpen tracks whether a stage is open
+	and should start out NO.
+*/
+OOINLINE void OOFrameTraceStage(BOOL *ioStageOpen, NSString *stage)
+{
+	if (EXPECT_NOT(gOOFrameTracerActive))  OOFrameTraceStage_(ioStageOpen, stage);
+}
@@ -0,0 +1,368 @@
+/*
+
+OOFrameTracer.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOFrameTracer.h"
+#import "OOProfilingStopwatch.h"
+#import "OOCollectionExtractors.h"
+#import "ResourceManager.h"
+#include <pthread.h>
+
+
+#define kDefaultBufferSize		(1 << 18)
+#define kMinBufferSize			1024
+#define kMaxThreads				64
+#define kNameCacheSize			1024	// Must be a power of two.
+#define kNameCacheProbes		8
+
+
+enum
+{
+	kEventBegin,
+	kEventBeginCString,
+	kEventEnd
+};
+
+
+typedef struct
+{
+	volatile NSUInteger		sequence;	// Index + 1 once the event has been completely written.
+	OOTimeDelta				time;		// Seconds since the trace was started.
+	uint64_t				thread;
+	const void				*name;		// NSString * or const char *, depending on kind.
+	uint8_t					kind;
+} OOFrameTraceEvent;
+
+
+BOOL gOOFrameTracerActive = NO;
+
+
+static OOFrameTraceEvent	*sEvents = NULL;
+static NSUInteger			sCapacity = 0;
+static volatile NSUInteger	sNextEvent = 0;
+static OOHighResTimeValue	sStartTime;
+static uint64_t				sMainThread = 0;
+
+static NSMutableSet			*sInternedNames = nil;
+static NSLock				*sInternLock = nil;
+
+
+/*	Lock-free map from a key to an interned name, so that names which have
+	been seen before are found without locking or allocating. Slots are only
+	ever filled in, under sInternLock, with the key written after the name.
+	Names are kept alive by sInternedNames.
+*/
+typedef struct
+{
+	const void * volatile	key;
+	NSString * volatile		name;
+} OOFrameTraceNameSlot;
+
+static OOFrameTraceNameSlot	sNameCache[kNameCacheSize];
+
+
+static void Record(uint8_t kind, const void *name);
+static NSString *CachedName(const void *key);
+static NSString *InternName(const void *key, NSString *name);
+static BOOL WriteTrace(FILE *file);
+static void WriteJSONString(FILE *file, const char *string);
+
+
+OOINLINE uint64_t CurrentThreadID(void)
+{
+	return (uint64_t)(uintptr_t)pthread_self();
+}
+
+
+void OOFrameTracerStart(void)
+{
+	gOOFrameTracerActive = NO;
+
+	if (sEvents == NULL)
+	{
+		/*	The buffer is never freed or resized, since a thread which has
+			just passed the gOOFrameTracerActive test may still write to it.
+		*/
+		NSUInteger size = [[NSUserDefaults standardUserDefaults] oo_unsignedIntegerForKey:@"frame-trace-buffer-size" defaultValue:kDefaultBufferSize];
+		sCapacity = MAX(size, (NSUInteger)kMinBufferSize);
+		sEvents = calloc(sCapacity, sizeof *sEvents);
+		if (sEvents == NULL)
+		{
+			OOLog(@"frameTrace.start.failed", @"***** ERROR: could not allocate %lu events for frame tracing.", (unsigned long)sCapacity);
+			return;
+		}
+		sInternedNames = [[NSMutableSet alloc] init];
+		sInternLock = [[NSLock alloc] init];
+	}
+
+	NSUInteger i;
+	for (i = 0; i < sCapacity; i++)  sEvents[i].sequence = 0;
+	sNextEvent = 0;
+
+	OODisposeHighResTime(sStartTime);
+	sStartTime = OOGetHighResTime();
+	sMainThread = CurrentThreadID();
+
+	__sync_synchronize();
+	gOOFrameTracerActive = YES;
+	OOLog(@"frameTrace.start", @"Frame tracing started, buffer size %lu events.", (unsigned long)sCapacity);
+}
+
+
+void OOFrameTracerStop(void)
+{
+	if (!gOOFrameTracerActive)  return;
+
+	gOOFrameTracerActive = NO;
+	OOLog(@"frameTrace.stop", @"Frame tracing stopped after %lu events.", (unsigned long)sNextEvent);
+}
+
+
+NSString *OOFrameTracerWriteTrace(void)
+{
+	if (sEvents == NULL)  return nil;
+
+	BOOL wasActive = gOOFrameTracerActive;
+	gOOFrameTracerActive = NO;
+	__sync_synchronize();
+
+	NSString *name = [NSString stringWithFormat:@"frame-trace-%lu.json", (unsigned long)time(NULL)];
+	NSString *path = [[ResourceManager diagnosticFileLocation] stringByAppendingPathComponent:name];
+	FILE *file = fopen([path fileSystemRepresentation], "w");
+	BOOL OK = NO;
+	if (file != NULL)
+	{
+		OK = WriteTrace(file);
+		if (fclose(file) != 0)  OK = NO;
+	}
+
+	gOOFrameTracerActive = wasActive;
+
+	if (!OK)
+	{
+		OOLog(@"frameTrace.write.failed", @"***** ERROR: could not write frame trace to %@.", path);
+		return nil;
+	}
+	OOLog(@"frameTrace.write", @"Wrote frame trace to %@.", path);
+	return path;
+}
+
+
+void OOFrameTraceBegin_(NSString *name)
+{
+	Record(kEventBegin, name);
+}
+
+
+void OOFrameTraceBeginInterned_(NSString *name)
+{
+	if (name == nil)  name = @"<unnamed>";
+
+	/*	Keyed by the string itself. Its address may since have been reused
+		for a different string, so a cached name is only used if it matches.
+	*/
+	NSString *interned = CachedName(name);
+	if (interned != name && ![interned isEqualToString:name])
+	{
+		interned = InternName(name, name);
+	}
+
+	Record(kEventBegin, interned);
+}
+
+
+NSString *OOFrameTraceNameForKey_(const void *key)
+{
+	return CachedName(key);
+}
+
+
+NSString *OOFrameTraceInternNameForKey_(const void *key, NSString *name)
+{
+	if (name == nil)  name = @"<unnamed>";
+	return InternName(key, name);
+}
+
+
+void OOFrameTraceBeginCString_(const char *name)
+{
+	Record(kEventBeginCString, name);
+}
+
+
+void OOFrameTraceEnd_(void)
+{
+	Record(kEventEnd, NULL);
+}
+
+
+void OOFrameTraceStage_(BOOL *ioStageOpen, NSString *stage)
+{
+	if (*ioStageOpen)  Record(kEventEnd, NULL);
+	*ioStageOpen = (stage != nil);
+	if (stage != nil)  Record(kEventBegin, stage);
+}
+
+
+static void Record(uint8_t kind, const void *name)
+{
+	OOHighResTimeValue now = OOGetHighResTime();
+	NSUInteger index = __sync_fetch_and_add(&sNextEvent, 1);
+	OOFrameTraceEvent *event = &sEvents[index % sCapacity];
+
+	// Mark the slot as incomplete while we fill it in, in case it's being written out.
+	event->sequence = 0;
+	__sync_synchronize();
+	event->time = OOHighResTimeDeltaInSeconds(sStartTime, now);
+	event->thread = CurrentThreadID();
+	event->name = name;
+	event->kind = kind;
+	__sync_synchronize();
+	event->sequence = index + 1;
+
+	OODisposeHighResTime(now);
+}
+
+
+OOINLINE NSUInteger NameCacheIndex(const void *key)
+{
+	uintptr_t bits = (uintptr_t)key;
+	return (NSUInteger)((bits >> 4) ^ (bits >> 14));
+}
+
+
+static NSString *CachedName(const void *key)
+{
+	NSUInteger i, index = NameCacheIndex(key);
+
+	if (key == NULL)  return nil;
+
+	for (i = 0; i < kNameCacheProbes; i++)
+	{
+		OOFrameTraceNameSlot *slot = &sNameCache[(index + i) & (kNameCacheSize - 1)];
+		const void *slotKey = slot->key;
+		if (slotKey == key)
+		{
+			__sync_synchronize();
+			return slot->name;
+		}
+		if (slotKey == NULL)  break;
+	}
+
+	return nil;
+}
+
+
+static NSString *InternName(const void *key, NSString *name)
+{
+	NSUInteger i, index = NameCacheIndex(key);
+
+	[sInternLock lock];
+
+	NSString *interned = [sInternedNames member:name];
+	if (interned == nil)
+	{
+		interned = [[name copy] autorelease];
+		[sInternedNames addObject:interned];
+	}
+
+	// If the probe window is full, the name just isn't cached.
+	for (i = 0; key != NULL && i < kNameCacheProbes; i++)
+	{
+		OOFrameTraceNameSlot *slot = &sNameCache[(index + i) & (kNameCacheSize - 1)];
+		if (slot->key == key)  break;
+		if (slot->key == NULL)
+		{
+			slot->name = interned;
+			__sync_synchronize();
+			slot->key = key;
+			break;
+		}
+	}
+
+	[sInternLock unlock];
+
+	return interned;
+}
+
+
+static BOOL WriteTrace(FILE *file)
+{
+	uint64_t		threads[kMaxThreads];
+	NSUInteger		threadCount = 0;
+	NSUInteger		i, t, end = sNextEvent;
+	NSUInteger		start = (end > sCapacity) ? end - sCapacity : 0;
+
+	/*	Thread IDs are opaque and may be too large for a JSON number to hold
+		precisely, so they're renumbered in order of appearance, with the
+		thread that started the trace first.
+	*/
+	threads[threadCount++] = sMainThread;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Main thread\"}}", file);
+
+	for (i = start; i < end; i++)
+	{
+		OOFrameTraceEvent event = sEvents[i % sCapacity];
+		if (event.sequence != i + 1)  continue;	// Overwritten or still being written.
+
+		for (t = 0; t < threadCount; t++)
+		{
+			if (threads[t] == event.thread)  break;
+		}
+		if (t == threadCount && threadCount < kMaxThreads)  threads[threadCount++] = event.thread;
+
+		fputs(",\n", file);
+		if (event.kind == kEventEnd)
+		{
+			fprintf(file, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}", event.time * 1e6, (unsigned long)t + 1);
+		}
+		else
+		{
+			const char *name = (event.kind == kEventBeginCString) ? event.name : [(NSString *)event.name UTF8String];
+			fputs("{\"name\":", file);
+			WriteJSONString(file, name);
+			fprintf(file, ",\"cat\":\"oolite\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}", event.time * 1e6, (unsigned long)t + 1);
+		}
+	}
+
+	fputs("\n]}\n", file);
+	return !ferror(file);
+}
+
+
+static void WriteJSONString(FILE *file, const char *string)
+{
+	if (string == NULL)  string = "<unnamed>";
+
+	fputc('"', file);
+	for (; *string != '\0'; string++)
+	{
+		unsigned char c = *string;
+		if (c == '"' || c == '\\')  fprintf(file, "\\%c", c);
+		else if (c < 0x20)  fprintf(file, "\\u%04x", c);
+		else  fputc(c, file);
+	}
+	fputc('"', file);
+}
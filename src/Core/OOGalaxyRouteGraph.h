@@ -0,0 +1,85 @@
+/*
+
+OOGalaxyRouteGraph.h
+
+Jump graph of one galaxy, used to plan routes for the charts, the advanced
+navigation array and scripts.
+
+The graph is stored in compressed sparse row form: for each system, a run of
+neighbouring system IDs and the jump distance to each. Systems concealed
+so that they don't appear on the chart have no edges. Routes are found with
+Dijkstra's algorithm over a binary heap (A* when optimizing for jumps), and
+the most recent results are kept in a small LRU cache. Optionally, routes
+between every pair of systems can be worked out up front.
+
+A graph is a snapshot: it has to be replaced when the coordinates or
+concealment of any system in the galaxy change. Universe does this by
+watching -[OOSystemDescriptionManager routeGraphGeneration].
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOTypes.h"
+#import "OOSystemDescriptionManager.h"
+
+
+#define OO_ROUTE_CACHE_SIZE			32
+
+
+@interface OOGalaxyRouteGraph: NSObject
+{
+@private
+	OOGalaxyID				_galaxy;
+	NSPoint					_coordinates[OO_SYSTEMS_PER_GALAXY];
+	uint32_t				_edgeStarts[OO_SYSTEMS_PER_GALAXY + 1];	// Edges of system s are [_edgeStarts[s], _edgeStarts[s + 1])
+	uint8_t					*_edgeTargets;
+	float					*_edgeDistances;
+
+	int16_t					*_allPairsParents[2];	// [source * OO_SYSTEMS_PER_GALAXY + goal], per route type
+
+	struct OORouteCacheEntry
+	{
+		OOSystemID			start;
+		OOSystemID			goal;
+		unsigned			typeIndex;
+		NSDictionary		*route;			// NSNull if there is no route.
+	}						_cache[OO_ROUTE_CACHE_SIZE];	// Most recently used first.
+	unsigned				_cacheCount;
+}
+
+- (id) initWithSystemManager:(OOSystemDescriptionManager *)manager galaxy:(OOGalaxyID)galaxy;
+
+- (OOGalaxyID) galaxy;
+
+/*	Returns a dictionary with the keys route (array of system IDs, from start
+	to goal inclusive), distance, time and jumps, or nil if goal can't be
+	reached. OPTIMIZED_BY_TIME minimizes the sum of squared jump distances;
+	anything else minimizes the number of jumps, then the total distance.
+*/
+- (NSDictionary *) routeFromSystem:(OOSystemID)start toSystem:(OOSystemID)goal optimizedBy:(OORouteType)optimizeBy;
+
+/*	Find the best route from every system to every other, for both route
+	types, so that later queries only have to walk the results. This takes a
+	few milliseconds and 256 KiB per galaxy.
+*/
+- (void) precomputeAllRoutes;
+
+@end
@@ -0,0 +1,390 @@
+/*
+
+OOGalaxyRouteGraph.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+/*	IMPLEMENTATION NOTES
+	Route costs are the same as they have always been:
+
+	time_cost = distance * distance
+	jump_cost = 7 * 256 + distance
+
+	so that optimizing for jumps minimizes the number of jumps first and the
+	distance travelled second. Routes costing more than 256 of the most
+	expensive jumps are rejected.
+
+	When optimizing for jumps, the search is directed towards the goal with
+	a lower bound on the number of jumps still needed. Jump distances are
+	calculated from truncated coordinate differences, so a jump within
+	MAX_JUMP_RANGE can cover up to 0.6 LY more than that in real terms; the
+	bound allows for this so that it never overestimates. Nothing useful of
+	this kind can be said about the sum of squared distances, so routes
+	optimized for time use plain Dijkstra.
+*/
+
+#import "OOGalaxyRouteGraph.h"
+#import "OOCollectionExtractors.h"
+#import "ShipEntity.h"
+#import "legacy_random.h"
+
+
+#define kJumpCostBase			(7 * 256)
+#define kMaxJumpsCost			(256 * (7 * 256 + 7))
+#define kMaxTimeCost			(256 * (7 * 7))
+#define kJumpRangeAllowance		0.6
+
+
+enum
+{
+	kRouteTypeJumps,
+	kRouteTypeTime,
+	kRouteTypeCount
+};
+
+
+typedef struct
+{
+	double					priority;
+	OOSystemID				system;
+} OORouteHeapEntry;
+
+
+OOINLINE unsigned RouteTypeIndex(OORouteType type)
+{
+	return (type == OPTIMIZED_BY_TIME) ? kRouteTypeTime : kRouteTypeJumps;
+}
+
+
+static void HeapPush(OORouteHeapEntry *heap, NSUInteger *count, OORouteHeapEntry entry)
+{
+	NSUInteger i = (*count)++;
+	while (i > 0)
+	{
+		NSUInteger parent = (i - 1) / 2;
+		if (heap[parent].priority <= entry.priority)  break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = entry;
+}
+
+
+static OORouteHeapEntry HeapPop(OORouteHeapEntry *heap, NSUInteger *count)
+{
+	OORouteHeapEntry	result = heap[0];
+	OORouteHeapEntry	last = heap[--(*count)];
+	NSUInteger			i = 0, n = *count;
+
+	for (;;)
+	{
+		NSUInteger child = 2 * i + 1;
+		if (child >= n)  break;
+		if (child + 1 < n && heap[child + 1].priority < heap[child].priority)  child++;
+		if (last.priority <= heap[child].priority)  break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	if (n > 0)  heap[i] = last;
+
+	return result;
+}
+
+
+@interface OOGalaxyRouteGraph (Private)
+
+/*	Fill in parents (OO_SYSTEMS_PER_GALAXY entries, -1 for the start and
+	for unreachable systems) with the best route tree from start. If goal is
+	not -1, the search may stop as soon as the route to goal is known.
+*/
+- (void) findRoutesFrom:(OOSystemID)start goal:(OOSystemID)goal typeIndex:(unsigned)typeIndex parents:(int16_t *)parents;
+
+- (NSDictionary *) routeDictionaryFrom:(OOSystemID)start to:(OOSystemID)goal parents:(const int16_t *)parents;
+
+- (NSDictionary *) cachedRouteFrom:(OOSystemID)start to:(OOSystemID)goal typeIndex:(unsigned)typeIndex;
+- (void) cacheRoute:(NSDictionary *)route from:(OOSystemID)start to:(OOSystemID)goal typeIndex:(unsigned)typeIndex;
+
+@end
+
+
+@implementation OOGalaxyRouteGraph
+
+- (id) initWithSystemManager:(OOSystemDescriptionManager *)manager galaxy:(OOGalaxyID)galaxy
+{
+	if ((self = [super init]))
+	{
+		BOOL				concealed[OO_SYSTEMS_PER_GALAXY];
+		NSArray				*neighbours[OO_SYSTEMS_PER_GALAXY];
+		NSUInteger			edgeCount = 0;
+		OOSystemID			s;
+
+		_galaxy = galaxy;
+
+		for (s = 0; s < OO_SYSTEMS_PER_GALAXY; s++)
+		{
+			NSInteger concealment = [[manager getPropertiesForSystem:s inGalaxy:galaxy] oo_intForKey:@"concealment" defaultValue:OO_SYSTEMCONCEALMENT_NONE];
+			concealed[s] = (concealment >= OO_SYSTEMCONCEALMENT_NOTHING);
+			_coordinates[s] = [manager getCoordinatesForSystem:s inGalaxy:galaxy];
+			neighbours[s] = concealed[s] ? nil : [manager getNeighbourIDsForSystem:s inGalaxy:galaxy];
+			edgeCount += [neighbours[s] count];
+		}
+
+		_edgeTargets = malloc(MAX(edgeCount, 1U) * sizeof *_edgeTargets);
+		_edgeDistances = malloc(MAX(edgeCount, 1U) * sizeof *_edgeDistances);
+		if (_edgeTargets == NULL || _edgeDistances == NULL)
+		{
+			[self release];
+			return nil;
+		}
+
+		// Concealed systems are left out at both ends of each edge.
+		edgeCount = 0;
+		for (s = 0; s < OO_SYSTEMS_PER_GALAXY; s++)
+		{
+			NSUInteger i, count = [neighbours[s] count];
+
+			_edgeStarts[s] = (uint32_t)edgeCount;
+			for (i = 0; i < count; i++)
+			{
+				OOSystemID n = [neighbours[s] oo_intAtIndex:i];
+				if (n < 0 || n > kOOMaximumSystemID || concealed[n])  continue;
+
+				_edgeTargets[edgeCount] = n;
+				_edgeDistances[edgeCount] = distanceBetweenPlanetPositions(_coordinates[n].x, _coordinates[n].y, _coordinates[s].x, _coordinates[s].y);
+				edgeCount++;
+			}
+		}
+		_edgeStarts[OO_SYSTEMS_PER_GALAXY] = (uint32_t)edgeCount;
+	}
+
+	return self;
+}
+
+
+- (void) dealloc
+{
+	unsigned i;
+
+	free(_edgeTargets);
+	free(_edgeDistances);
+	for (i = 0; i < kRouteTypeCount; i++)  free(_allPairsParents[i]);
+	for (i = 0; i < _cacheCount; i++)  [_cache[i].route release];
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"galaxy %u, %u jumps", _galaxy, _edgeStarts[OO_SYSTEMS_PER_GALAXY]];
+}
+
+
+- (OOGalaxyID) galaxy
+{
+	return _galaxy;
+}
+
+
+- (NSDictionary *) routeFromSystem:(OOSystemID)start toSystem:(OOSystemID)goal optimizedBy:(OORouteType)optimizeBy
+{
+	if (start < 0 || start > kOOMaximumSystemID || goal < 0 || goal > kOOMaximumSystemID)  return nil;
+
+	unsigned		typeIndex = RouteTypeIndex(optimizeBy);
+	NSDictionary	*result = [self cachedRouteFrom:start to:goal typeIndex:typeIndex];
+
+	if (result == nil)
+	{
+		if (_allPairsParents[typeIndex] != NULL)
+		{
+			result = [self routeDictionaryFrom:start to:goal parents:_allPairsParents[typeIndex] + start * OO_SYSTEMS_PER_GALAXY];
+		}
+		else
+		{
+			int16_t parents[OO_SYSTEMS_PER_GALAXY];
+			[self findRoutesFrom:start goal:goal typeIndex:typeIndex parents:parents];
+			result = [self routeDictionaryFrom:start to:goal parents:parents];
+		}
+
+		// Failures are cached too, as NSNull.
+		if (result == nil)  result = (NSDictionary *)[NSNull null];
+		[self cacheRoute:result from:start to:goal typeIndex:typeIndex];
+	}
+
+	if (result == (NSDictionary *)[NSNull null])  return nil;
+	return result;
+}
+
+
+- (void) precomputeAllRoutes
+{
+	unsigned		typeIndex;
+	OOSystemID		s;
+
+	for (typeIndex = 0; typeIndex < kRouteTypeCount; typeIndex++)
+	{
+		if (_allPairsParents[typeIndex] != NULL)  continue;
+
+		int16_t *table = malloc(OO_SYSTEMS_PER_GALAXY * OO_SYSTEMS_PER_GALAXY * sizeof *table);
+		if (table == NULL)  return;
+
+		for (s = 0; s < OO_SYSTEMS_PER_GALAXY; s++)
+		{
+			[self findRoutesFrom:s goal:-1 typeIndex:typeIndex parents:table + s * OO_SYSTEMS_PER_GALAXY];
+		}
+		_allPairsParents[typeIndex] = table;
+	}
+}
+
+@end
+
+
+@implementation OOGalaxyRouteGraph (Private)
+
+- (void) findRoutesFrom:(OOSystemID)start goal:(OOSystemID)goal typeIndex:(unsigned)typeIndex parents:(int16_t *)parents
+{
+	double				costs[OO_SYSTEMS_PER_GALAXY];
+	BOOL				done[OO_SYSTEMS_PER_GALAXY];
+	// Each edge is relaxed at most once, so this is enough for every push.
+	NSUInteger			heapCapacity = _edgeStarts[OO_SYSTEMS_PER_GALAXY] + 1, heapCount = 0;
+	OORouteHeapEntry	*heap = malloc(heapCapacity * sizeof *heap);
+	BOOL				byTime = (typeIndex == kRouteTypeTime);
+	BOOL				directed = !byTime && goal >= 0;
+	double				maxCost = byTime ? kMaxTimeCost : kMaxJumpsCost;
+	double				jumpsPerLY = 1.0 / (MAX_JUMP_RANGE + kJumpRangeAllowance);
+	OOSystemID			s;
+
+	for (s = 0; s < OO_SYSTEMS_PER_GALAXY; s++)
+	{
+		costs[s] = INFINITY;
+		parents[s] = -1;
+		done[s] = NO;
+	}
+	if (EXPECT_NOT(heap == NULL))  return;
+
+	costs[start] = 0.0;
+	HeapPush(heap, &heapCount, (OORouteHeapEntry){ 0.0, start });
+
+	while (heapCount > 0)
+	{
+		OOSystemID current = HeapPop(heap, &heapCount).system;
+		if (done[current])  continue;
+		done[current] = YES;
+		if (current == goal)  break;
+
+		uint32_t i, end = _edgeStarts[current + 1];
+		for (i = _edgeStarts[current]; i < end; i++)
+		{
+			OOSystemID	n = _edgeTargets[i];
+			double		distance = _edgeDistances[i];
+			double		cost = costs[current] + (byTime ? distance * distance : kJumpCostBase + distance);
+
+			if (cost >= maxCost || cost >= costs[n] || done[n])  continue;
+
+			costs[n] = cost;
+			parents[n] = current;
+
+			double priority = cost;
+			if (directed)
+			{
+				double remaining = accurateDistanceBetweenPlanetPositions(_coordinates[n].x, _coordinates[n].y, _coordinates[goal].x, _coordinates[goal].y);
+				priority += ceil(remaining * jumpsPerLY - 1e-6) * kJumpCostBase;
+			}
+			HeapPush(heap, &heapCount, (OORouteHeapEntry){ priority, n });
+		}
+	}
+
+	free(heap);
+}
+
+
+- (NSDictionary *) routeDictionaryFrom:(OOSystemID)start to:(OOSystemID)goal parents:(const int16_t *)parents
+{
+	OOSystemID		systems[OO_SYSTEMS_PER_GALAXY];
+	NSUInteger		i, count = 0;
+	OOSystemID		s;
+
+	if (goal != start && parents[goal] < 0)  return nil;
+
+	for (s = goal; s != start; s = parents[s])
+	{
+		// Parent links always lead back to start, but don't trust that blindly.
+		if (EXPECT_NOT(s < 0 || count == OO_SYSTEMS_PER_GALAXY - 1))  return nil;
+		systems[count++] = s;
+	}
+	systems[count++] = start;
+
+	NSMutableArray	*route = [NSMutableArray arrayWithCapacity:count];
+	double			distance = 0.0, time = 0.0;
+
+	for (i = count; i-- > 0; )
+	{
+		[route addObject:[NSNumber numberWithInt:systems[i]]];
+		if (i + 1 < count)
+		{
+			NSPoint from = _coordinates[systems[i + 1]], to = _coordinates[systems[i]];
+			double jump = distanceBetweenPlanetPositions(to.x, to.y, from.x, from.y);
+			distance += jump;
+			time += jump * jump;
+		}
+	}
+
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			route, @"route",
+			[NSNumber numberWithDouble:distance], @"distance",
+			[NSNumber numberWithDouble:time], @"time",
+			[NSNumber numberWithInt:(int)count - 1], @"jumps",
+			nil];
+}
+
+
+- (NSDictionary *) cachedRouteFrom:(OOSystemID)start to:(OOSystemID)goal typeIndex:(unsigned)typeIndex
+{
+	unsigned i;
+
+	for (i = 0; i < _cacheCount; i++)
+	{
+		if (_cache[i].start == start && _cache[i].goal == goal && _cache[i].typeIndex == typeIndex)
+		{
+			// Move to front.
+			struct OORouteCacheEntry entry = _cache[i];
+			memmove(&_cache[1], &_cache[0], i * sizeof *_cache);
+			_cache[0] = entry;
+			return entry.route;
+		}
+	}
+
+	return nil;
+}
+
+
+- (void) cacheRoute:(NSDictionary *)route from:(OOSystemID)start to:(OOSystemID)goal typeIndex:(unsigned)typeIndex
+{
+	if (_cacheCount == OO_ROUTE_CACHE_SIZE)
+	{
+		[_cache[--_cacheCount].route release];
+	}
+	memmove(&_cache[1], &_cache[0], _cacheCount * sizeof *_cache);
+	_cache[0] = (struct OORouteCacheEntry){ start, goal, typeIndex, [route retain] };
+	_cacheCount++;
+}
+
+@end
@@ -85,8 +85,8 @@ SOFTWARE.
 	OOLogWillDisplayMessagesInClass().
 */
 #if OOLOG_SHORT_CIRCUIT
-	#define OOLog(class, format, ...)				do { if (OOLogWillDisplayMessagesInClass(class)) { OOLogWithFunctionFileAndLine(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, ## __VA_ARGS__); }} while (0)
-	#define OOLogWithArguments(class, format, args)	do { if (OOLogWillDisplayMessagesInClass(class)) { OOLogWithFunctionFileAndLineAndArguments(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, args); }} while (0)
+	#define OOLog(class, format, ...)				do { static OOLogCallSiteCache oolog_cache_; if (OOLogWillDisplayMessagesInClassCached(class, &oolog_cache_)) { OOLogWithFunctionFileAndLine(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, ## __VA_ARGS__); }} while (0)
+	#define OOLogWithArguments(class, format, args)	do { static OOLogCallSiteCache oolog_cache_; if (OOLogWillDisplayMessagesInClassCached(class, &oolog_cache_)) { OOLogWithFunctionFileAndLineAndArguments(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, args); }} while (0)
 #else
 	#define OOLog(class, format, ...)				OOLogWithFunctionFileAndLine(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, ## __VA_ARGS__)
 	#define OOLogWithArguments(class, format, args)	OOLogWithFunctionFileAndLineAndArguments(class, OOLOG_FUNCTION_NAME, OOLOG_FILE_NAME, __LINE__, format, args)
@@ -94,12 +94,42 @@ SOFTWARE.
 
 BOOL OOLogWillDisplayMessagesInClass(NSString *inMessageClass);
 
+
+/*	Per-call-site cache used by the OOLog() macros.
+	
+	Each call site remembers the result of the last lookup together with the
+	settings generation it was made in. Any change to the log settings bumps
+	the generation, so a cached result is valid exactly as long as its
+	generation is current, and testing a disabled message class costs a
+	couple of loads and compares with no locking.
+	
+	A cache is bound to the first message class it sees, and only if that is
+	a constant string (whose address can never be reused). Call sites with
+	varying or computed classes simply don't benefit.
+*/
+typedef struct OOLogCallSiteCache
+{
+	NSString * volatile		messageClass;
+	volatile uint32_t		state;			// (generation << 1) | enabled; 0 if unset.
+} OOLogCallSiteCache;
+
+extern volatile uint32_t gOOLogSettingsGeneration;
+
+BOOL OOLogWillDisplayMessagesInClassUpdatingCache(NSString *inMessageClass, OOLogCallSiteCache *ioCache);
+
+OOINLINE BOOL OOLogWillDisplayMessagesInClassCached(NSString *inMessageClass, OOLogCallSiteCache *ioCache)
+{
+	uint32_t state = ioCache->state;
+	if (EXPECT(ioCache->messageClass == inMessageClass && (state >> 1) == gOOLogSettingsGeneration))  return state & 1;
+	return OOLogWillDisplayMessagesInClassUpdatingCache(inMessageClass, ioCache);
+}
+
 void OOLogIndent(void);
 void OOLogOutdent(void);
 
 #if OOLOG_SHORT_CIRCUIT
-#define OOLogIndentIf(class)		do { if (OOLogWillDisplayMessagesInClass(class)) OOLogIndent(); } while (0)
-#define OOLogOutdentIf(class)		do { if (OOLogWillDisplayMessagesInClass(class)) OOLogOutdent(); } while (0)
+#define OOLogIndentIf(class)		do { static OOLogCallSiteCache oolog_cache_; if (OOLogWillDisplayMessagesInClassCached(class, &oolog_cache_)) OOLogIndent(); } while (0)
+#define OOLogOutdentIf(class)		do { static OOLogCallSiteCache oolog_cache_; if (OOLogWillDisplayMessagesInClassCached(class, &oolog_cache_)) OOLogOutdent(); } while (0)
 #else
 void OOLogIndentIf(NSString *inMessageClass);
 void OOLogOutdentIf(NSString *inMessageClass);
@@ -95,6 +95,10 @@ static BOOL						sShowClass = NO;	// Ditto.
 static BOOL						sDefaultDisplay = YES;
 static BOOL						sOverrideInEffect = NO;
 static BOOL						sOverrideValue = NO;
+static Class					sConstantStringClass = Nil;
+
+// Bumped whenever anything that affects OOLogWillDisplayMessagesInClass() changes. Starts at 1 so that a zeroed call-site cache is never valid.
+volatile uint32_t				gOOLogSettingsGeneration = 1;
 
 // These specific values are used for true, false and inherit in the cache and explicitSettings dictionaries so we can use pointer comparison.
 static NSString * const			kTrueToken = @"on";
@@ -109,6 +113,7 @@ static void OOLogInternal_(const char *inFunction, NSString *inFormat, ...);
 
 // Functions used internally
 static void LoadExplicitSettings(void);
+static void InvalidateCallSiteCaches(void);
 static void LoadExplicitSettingsFromDictionary(NSDictionary *inDict);
 static id ResolveDisplaySetting(NSString *inMessageClass);
 static id ResolveMetaClassReference(NSString *inMetaClass, NSMutableSet *ioSeenMetaClasses);
@@ -179,6 +184,29 @@ BOOL OOLogWillDisplayMessagesInClass(NSString *inMessageClass)
 }
 
 
+BOOL OOLogWillDisplayMessagesInClassUpdatingCache(NSString *inMessageClass, OOLogCallSiteCache *ioCache)
+{
+	/*	Read the generation before resolving, so that a settings change made
+		while we're working leaves the cache entry stale rather than wrong.
+	*/
+	uint32_t generation = gOOLogSettingsGeneration;
+	BOOL result = OOLogWillDisplayMessagesInClass(inMessageClass);
+	
+	if (EXPECT_NOT(!sInited) || inMessageClass == nil)  return result;
+	
+	if (ioCache->messageClass == nil && [inMessageClass class] == sConstantStringClass)
+	{
+		__sync_bool_compare_and_swap((void * volatile *)&ioCache->messageClass, NULL, (void *)inMessageClass);
+	}
+	if (ioCache->messageClass == inMessageClass)
+	{
+		ioCache->state = (generation << 1) | (result ? 1 : 0);
+	}
+	
+	return result;
+}
+
+
 void OOLogSetDisplayMessagesInClass(NSString *inClass, BOOL inFlag)
 {
 	id				value = nil;
@@ -195,6 +223,7 @@ void OOLogSetDisplayMessagesInClass(NSString *inClass, BOOL inFlag)
 		
 		// Clear cache and let it be rebuilt as needed.
 		DESTROY(sDerivedSettingsCache);
+		InvalidateCallSiteCaches();
 	}
 	else
 	{
@@ -594,6 +623,8 @@ void OOLoggingInit(void)
 	[sLock setName:@"OOLogging lock"];
 	if (sLock == nil) exit(EXIT_FAILURE);
 	
+	sConstantStringClass = [@"" class];
+	
 #ifndef OOLOG_NO_FILE_NAME
 	sFileNamesCache = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100);
 #endif
@@ -766,11 +797,25 @@ static void LoadExplicitSettings(void)
 	
 	// Invalidate cache.
 	DESTROY(sDerivedSettingsCache);
+	InvalidateCallSiteCaches();
 	
 	OOLogInternal(OOLOG_SETTING_SET, @"Settings: %@", sExplicitSettings);
 }
 
 
+/*	InvalidateCallSiteCaches()
+	Make every OOLog() call site look its setting up again on next use.
+*/
+static void InvalidateCallSiteCaches(void)
+{
+	// Generations are 31 bits wide, and zero is skipped since a zeroed cache would match it.
+	uint32_t generation = (gOOLogSettingsGeneration + 1) & 0x7FFFFFFF;
+	if (EXPECT_NOT(generation == 0))  generation = 1;
+	__sync_synchronize();
+	gOOLogSettingsGeneration = generation;
+}
+
+
 /*	LoadExplicitSettingsFromDictionary()
 	Helper for LoadExplicitSettings().
 */
@@ -39,7 +39,7 @@ MA 02110-1301, USA.
 #import "OOWeakReference.h"
 #import "OOOpenGLExtensionManager.h"
 
-@class OOMaterial, Octree;
+@class OOMaterial, Octree, OOMeshVertexBuffers;
 
 
 #define OOMESH_PROFILE	0
@@ -109,6 +109,10 @@ typedef struct
 	// Redundancy! Needs fixing.
 	OOMeshDisplayLists		_displayLists;
 	
+	// GPU copy of _displayLists, shared by all meshes with the same geometry.
+	NSString				*_geometryKey;
+	OOMeshVertexBuffers		*_vertexBuffers;
+	
 	NSRange					triangle_range[kOOMeshMaxMaterials];
 	NSString				*materialKeys[kOOMeshMaxMaterials];
 	OOMaterial				*materials[kOOMeshMaxMaterials];
@@ -163,6 +167,14 @@ typedef struct
 
 + (OOMaterial *) placeholderMaterial;
 
+/*	Parse the named models and store the resulting geometry, normals,
+	tangents and octrees in the mesh cache, without setting up materials or
+	touching OpenGL. Models already in the cache are skipped. Parsing is
+	spread across the async work manager's threads; must be called on the
+	main thread. Returns the number of meshes added to the cache.
+*/
++ (NSUInteger) preloadCacheForModels:(NSArray *)modelNames smooth:(BOOL)smooth;
+
 - (NSString *) modelName;
 
 - (void) rebindMaterials;
@@ -188,9 +200,3 @@ typedef struct
 
 
 #import "OOCacheManager.h"
-@interface OOCacheManager (Octree)
-
-+ (Octree *)octreeForModel:(NSString *)inKey;
-+ (void)setOctree:(Octree *)inOctree forModel:(NSString *)inKey;
-
-@end
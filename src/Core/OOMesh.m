@@ -55,6 +55,8 @@ MA 02110-1301, USA.
 
 #import "OOJavaScriptEngine.h"
 #import "OODebugStandards.h"
+#import "OOAsyncWorkManager.h"
+#import "NSStringOOExtensions.h"
 
 // If set, collision octree depth varies depending on the size of the mesh.
 #define ADAPTIVE_OCTREE_DEPTH		1
@@ -139,7 +141,7 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object
 	   scaleFactor:(float)scale
 	cacheWriteable:(BOOL)cacheWriteable;
 
-- (BOOL) loadData:(NSString *)filename scaleFactor:(float)scale;
+- (BOOL) loadData:(NSString *)filename scaleFactor:(float)scale source:(NSString *)source;
 - (void) checkNormalsAndAdjustWinding;
 - (void) generateFaceTangents;
 - (void) calculateVertexNormalsAndTangentsWithFaceRefs:(VertexFaceRef *)faceRefs;
@@ -147,8 +149,8 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object
 
 - (void) deleteDisplayLists;
 
-- (NSDictionary*) modelData;
-- (BOOL) setModelFromModelData:(NSDictionary*) dict name:(NSString *)fileName;
+- (NSData *) cacheBlob;
+- (BOOL) setModelFromCacheBlob:(NSData *)blob name:(NSString *)fileName cacheKey:(NSString *)cacheKey;
 
 - (void) getNormal:(Vector *)outNormal andTangent:(Vector *)outTangent forVertex:(OOMeshVertexCount)v_index inSmoothGroup:(OOMeshSmoothGroup)smoothGroup;
 
@@ -179,8 +181,84 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object
 
 @interface OOCacheManager (OOMesh)
 
-+ (NSDictionary *)meshDataForName:(NSString *)inShipName;
-+ (void)setMeshData:(NSDictionary *)inData forName:(NSString *)inShipName;
++ (NSData *)meshDataForName:(NSString *)inShipName;
++ (void)setMeshData:(NSData *)inData forName:(NSString *)inShipName;
+
+@end
+
+
+/*	Binary mesh cache format.
+	A cached mesh is a header followed by flat arrays of vertices, normals,
+	tangents and faces exactly as OOMesh uses them, a string table holding
+	the cache key and material keys, and optionally the collision octree.
+	All sections are aligned so that the arrays can be used in place when the
+	blob is memory-mapped. Values are in native byte order; blobs written by
+	an incompatible build are rejected by the endian tag and struct sizes.
+*/
+enum
+{
+	kMeshCacheMagic					= 0x424D4F4F,	// "OOMB" in little-endian order
+	kMeshCacheVersion				= 1,
+	kMeshCacheAlignment				= 16
+};
+
+
+typedef struct
+{
+	uint32_t				magic;
+	uint32_t				version;
+	uint64_t				endianTag;
+	uint32_t				totalSize;
+	uint32_t				vectorSize;			// sizeof (Vector)
+	uint32_t				faceSize;			// sizeof (OOMeshFace)
+	uint32_t				normalMode;
+	uint32_t				vertexCount;
+	uint32_t				faceCount;
+	uint32_t				materialCount;
+	uint32_t				vertexOffset;
+	uint32_t				normalOffset;		// 0 if normals are per-face
+	uint32_t				tangentOffset;		// 0 if normals are per-face
+	uint32_t				faceOffset;
+	uint32_t				stringsOffset;		// NUL-terminated UTF-8: cache key, then material keys
+	uint32_t				stringsSize;
+	uint32_t				octreeOffset;		// 0 if octree has not been built
+	uint32_t				octreeSize;
+	GLfloat					octreeRadius;
+} OOMeshCacheHeader;
+
+#define kMeshCacheEndianTag		0x0123456789ABCDEFULL
+
+
+/*	OOMeshVertexBuffers
+	A vertex buffer object holding the vertices, normals, tangents and texture
+	coordinates of a mesh. One instance is shared by every OOMesh with the same
+	geometry key (the mesh data cache key), so the geometry of a model is only
+	uploaded once no matter how many ships use it. The buffer is filled lazily
+	from the first mesh to be drawn, and again after a graphics reset.
+*/
+@interface OOMeshVertexBuffers: NSObject <OOGraphicsResetClient>
+{
+@private
+	NSString				*_key;
+	GLuint					_buffer;
+	GLuint					_count;
+	size_t					_normalOffset;
+	size_t					_tangentOffset;
+	size_t					_textureUVOffset;
+}
+
++ (BOOL) vertexBuffersAvailable;
++ (instancetype) vertexBuffersForKey:(NSString *)key;
+
+// Bind the buffer as GL_ARRAY_BUFFER, uploading lists if necessary.
+- (BOOL) bindWithDisplayLists:(const OOMeshDisplayLists *)lists;
++ (void) unbind;
+
+// Offsets for gl*Pointer() while bound.
+- (const GLvoid *) vertexPointer;
+- (const GLvoid *) normalPointer;
+- (const GLvoid *) tangentPointer;
+- (const GLvoid *) textureUVPointer;
 
 @end
 
@@ -228,6 +306,29 @@ static BOOL IsPerVertexNormalMode(OOMeshNormalMode mode)
 }
 
 
+static NSString *GeometryCacheKey(NSString *name, OOMeshNormalMode normalMode, float scale)
+{
+	return [NSString stringWithFormat:@"%@:%u:%.3f", name, normalMode, scale];
+}
+
+
+static NSCharacterSet *NewlineCharacterSet(void)
+{
+#if OOLITE_MAC_OS_X
+	return [NSCharacterSet newlineCharacterSet];
+#else
+	static NSCharacterSet *newlineCharSet = nil;
+	if (newlineCharSet == nil)
+	{
+		NSMutableCharacterSet *temp = [[[NSCharacterSet whitespaceAndNewlineCharacterSet] mutableCopy] autorelease];
+		[temp formIntersectionWithCharacterSet:[[NSCharacterSet whitespaceCharacterSet] invertedSet]];
+		newlineCharSet = [temp copy];
+	}
+	return newlineCharSet;
+#endif
+}
+
+
 @implementation OOMesh
 
 + (instancetype) meshWithName:(NSString *)name
@@ -284,6 +385,94 @@ static BOOL IsPerVertexNormalMode(OOMeshNormalMode mode)
 }
 
 
+typedef struct
+{
+	NSArray				*names;
+	NSArray				*paths;
+	OOMesh				**meshes;
+	BOOL				*loaded;
+} OOMeshPreloadContext;
+
+
+static void PreloadMesh(NSUInteger index, void *context)
+{
+	OOMeshPreloadContext *preload = context;
+	OOMesh *mesh = preload->meshes[index];
+	
+	NSString *source = [NSString stringWithContentsOfUnicodeFile:[preload->paths objectAtIndex:index]];
+	if (source != nil && [mesh loadData:[preload->names objectAtIndex:index] scaleFactor:1.0f source:source])
+	{
+		// Build the octree now too, so it's in the cache blob.
+		[mesh octree];
+		preload->loaded[index] = YES;
+	}
+}
+
+
++ (NSUInteger) preloadCacheForModels:(NSArray *)modelNames smooth:(BOOL)smooth
+{
+	OOMeshNormalMode		normalMode = smooth ? kNormalModeSmooth : kNormalModePerFace;
+	NSMutableArray			*names = [NSMutableArray arrayWithCapacity:[modelNames count]];
+	NSMutableArray			*paths = [NSMutableArray arrayWithCapacity:[modelNames count]];
+	NSString				*name = nil;
+	NSUInteger				i, count, loaded = 0;
+	
+	// The cache manager and resource manager aren't thread-safe, so look up everything here.
+	foreach (name, modelNames)
+	{
+		if ([OOCacheManager meshDataForName:GeometryCacheKey(name, normalMode, 1.0f)] != nil)  continue;
+		
+		NSString *path = [ResourceManager pathForFileNamed:name inFolder:@"Models"];
+		if (path == nil)  continue;	// Reported when a ship actually tries to use it.
+		
+		[names addObject:name];
+		[paths addObject:path];
+	}
+	
+	count = [names count];
+	if (count == 0)  return 0;
+	
+	OOMesh **meshes = calloc(count, sizeof *meshes);
+	BOOL *loadedFlags = calloc(count, sizeof *loadedFlags);
+	if (meshes == NULL || loadedFlags == NULL)
+	{
+		free(meshes);
+		free(loadedFlags);
+		return 0;
+	}
+	for (i = 0; i < count; i++)
+	{
+		meshes[i] = [[OOMesh alloc] init];
+		meshes[i]->_normalMode = normalMode;
+		meshes[i]->_cacheWriteable = NO;
+	}
+	(void) NewlineCharacterSet();	// Make sure it's set up before going multithreaded.
+	
+	OOLog(@"mesh.preload", @"Preloading %lu %s meshes.", (unsigned long)count, smooth ? "smooth" : "flat");
+	OOMeshPreloadContext context = { names, paths, meshes, loadedFlags };
+	[[OOAsyncWorkManager sharedAsyncWorkManager] performBatchWithFunction:PreloadMesh context:&context count:count];
+	
+	// Meshes are released here because OOMesh's -dealloc isn't thread-safe.
+	for (i = 0; i < count; i++)
+	{
+		if (loadedFlags[i])
+		{
+			NSData *blob = [meshes[i] cacheBlob];
+			if (blob != nil)
+			{
+				[OOCacheManager setMeshData:blob forName:meshes[i]->_geometryKey];
+				loaded++;
+			}
+		}
+		[meshes[i] release];
+	}
+	free(meshes);
+	free(loadedFlags);
+	
+	return loaded;
+}
+
+
 - (id)init
 {
 	self = [super init];
@@ -313,6 +502,8 @@ static BOOL IsPerVertexNormalMode(OOMeshNormalMode mode)
 	DESTROY(octree);
 	
 	[self deleteDisplayLists];
+	DESTROY(_vertexBuffers);
+	DESTROY(_geometryKey);
 	
 	for (i = 0; i != kOOMeshMaxMaterials; ++i)
 	{
@@ -390,8 +581,27 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 	
 	OOSetOpenGLState(OPENGL_STATE_OPAQUE);
 	
-	OOGL(glVertexPointer(3, GL_FLOAT, 0, _displayLists.vertexArray));
-	OOGL(glNormalPointer(GL_FLOAT, 0, _displayLists.normalArray));
+	const GLvoid *vertexPointer = _displayLists.vertexArray;
+	const GLvoid *normalPointer = _displayLists.normalArray;
+	const GLvoid *tangentPointer = _displayLists.tangentArray;
+	const GLvoid *textureUVPointer = _displayLists.textureUVArray;
+	BOOL usingVertexBuffers = NO;
+	
+	if (_vertexBuffers == nil && _geometryKey != nil && [OOMeshVertexBuffers vertexBuffersAvailable])
+	{
+		_vertexBuffers = [[OOMeshVertexBuffers vertexBuffersForKey:_geometryKey] retain];
+	}
+	if (_vertexBuffers != nil && [_vertexBuffers bindWithDisplayLists:&_displayLists])
+	{
+		usingVertexBuffers = YES;
+		vertexPointer = [_vertexBuffers vertexPointer];
+		normalPointer = [_vertexBuffers normalPointer];
+		tangentPointer = [_vertexBuffers tangentPointer];
+		textureUVPointer = [_vertexBuffers textureUVPointer];
+	}
+	
+	OOGL(glVertexPointer(3, GL_FLOAT, 0, vertexPointer));
+	OOGL(glNormalPointer(GL_FLOAT, 0, normalPointer));
 	
 	// for visual effects enable blending. This will allow use of alpha
 	// channel in shaders - note, this is a bit of cheating the system,
@@ -406,7 +616,7 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 	if ([[OOOpenGLExtensionManager sharedManager] shadersSupported])
 	{
 		OOGL(glEnableVertexAttribArrayARB(kTangentAttributeIndex));
-		OOGL(glVertexAttribPointerARB(kTangentAttributeIndex, 3, GL_FLOAT, GL_FALSE, 0, _displayLists.tangentArray));
+		OOGL(glVertexAttribPointerARB(kTangentAttributeIndex, 3, GL_FLOAT, GL_FALSE, 0, tangentPointer));
 	}
 #endif
 	
@@ -484,7 +694,7 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 					if (!wantsNormalsAsTextureCoordinates)
 					{
 						OOGL(glDisable(GL_TEXTURE_CUBE_MAP));
-						OOGL(glTexCoordPointer(2, GL_FLOAT, 0, _displayLists.textureUVArray));
+						OOGL(glTexCoordPointer(2, GL_FLOAT, 0, textureUVPointer));
 						/*	FIXME: Not including the line below breaks multitexturing in no-shaders mode.
 							However, the OpenGL state manager should probably be handling this;
 							TEXTURE_2D is part of OPENGL_STATE_OPAQUE, which has already been set.
@@ -495,7 +705,7 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 					else
 					{
 						OOGL(glDisable(GL_TEXTURE_2D));
-						OOGL(glTexCoordPointer(3, GL_FLOAT, 0, _displayLists.vertexArray));
+						OOGL(glTexCoordPointer(3, GL_FLOAT, 0, vertexPointer));
 						OOGL(glEnable(GL_TEXTURE_CUBE_MAP));
 					}
 #if OO_MULTITEXTURE
@@ -519,9 +729,15 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 			brokenInRender = YES;
 		}
 		if ([[exception name] hasPrefix:@"Oolite"])  [UNIVERSE handleOoliteException:exception];	// handle these ourself
-		else  @throw exception;	// pass these on
+		else
+		{
+			if (usingVertexBuffers)  [OOMeshVertexBuffers unbind];
+			@throw exception;	// pass these on
+		}
 	}
 	
+	if (usingVertexBuffers)  [OOMeshVertexBuffers unbind];
+	
 #if OO_SHADERS
 	if ([[OOOpenGLExtensionManager sharedManager] shadersSupported])
 	{
@@ -671,38 +887,32 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 
 - (Octree *)octree
 {
+	// If the mesh was loaded from the cache, the octree may already be set.
 	if (octree == nil)
 	{
-		octree = [[OOCacheManager octreeForModel:baseFileOctreeCacheRef] retain];
-		if (octree == nil)
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		
+		OOMeshToOctreeConverter *converter = [OOMeshToOctreeConverter converterWithCapacity:faceCount];
+		OOMeshFaceCount i;
+		for (i = 0; i < faceCount; i++)
 		{
-			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-			
-			OOMeshToOctreeConverter *converter = [OOMeshToOctreeConverter converterWithCapacity:faceCount];
-			OOMeshFaceCount i;
-			for (i = 0; i < faceCount; i++)
-			{
-				// Somewhat surprisingly, this method doesn't even show up in profiles. -- Ahruman 2012-09-22
-				Triangle tri;
-				tri.v[0] = _vertices[_faces[i].vertex[0]];
-				tri.v[1] = _vertices[_faces[i].vertex[1]];
-				tri.v[2] = _vertices[_faces[i].vertex[2]];
-				[converter addTriangle:tri];
-			}
-			
-			octree = [converter findOctreeToDepth:[self octreeDepth]];
-			[octree retain];
-			if (EXPECT(_cacheWriteable))
-			{
-				[OOCacheManager setOctree:octree forModel:baseFileOctreeCacheRef];
-			}
-			
-			[pool release];
+			// Somewhat surprisingly, this method doesn't even show up in profiles. -- Ahruman 2012-09-22
+			Triangle tri;
+			tri.v[0] = _vertices[_faces[i].vertex[0]];
+			tri.v[1] = _vertices[_faces[i].vertex[1]];
+			tri.v[2] = _vertices[_faces[i].vertex[2]];
+			[converter addTriangle:tri];
 		}
-		else
+		
+		octree = [converter findOctreeToDepth:[self octreeDepth]];
+		[octree retain];
+		if (EXPECT(_cacheWriteable))
 		{
-			OOLog(@"mesh.load.octreeCached", @"Retrieved octree \"%@\" from cache.", baseFileOctreeCacheRef);
+			// Re-store the mesh with the octree baked in.
+			[OOCacheManager setMeshData:[self cacheBlob] forName:_geometryKey];
 		}
+		
+		[pool release];
 	}
 	
 	return octree;
@@ -893,7 +1103,7 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 	_stopwatch = [[OOProfilingStopwatch alloc] init];
 #endif
 	
-	if ([self loadData:name scaleFactor:scale])
+	if ([self loadData:name scaleFactor:scale source:nil])
 	{
 		[self calculateBoundingVolumes];
 		PROFILE(@"finished calculateBoundingVolumes (again\?\?)");
@@ -956,6 +1166,8 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 		[result->_cacheKey retain];
 		[result->_shaderMacros retain];
 		[result->_shaderBindingTarget retain];
+		[result->_geometryKey retain];
+		[result->_vertexBuffers retain];
 		
 		for (i = 0; i != kOOMeshMaxMaterials; ++i)
 		{
@@ -993,146 +1205,172 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 }
 
 
-- (NSDictionary *)modelData
+static uint32_t AppendMeshCacheSection(NSMutableData *blob, const void *bytes, size_t size)
+{
+	NSUInteger offset = [blob length];
+	NSUInteger padding = (kMeshCacheAlignment - offset % kMeshCacheAlignment) % kMeshCacheAlignment;
+	[blob increaseLengthBy:padding];
+	offset += padding;
+	[blob appendBytes:bytes length:size];
+	return (uint32_t)offset;
+}
+
+
+- (NSData *) cacheBlob
 {
 	OOJS_PROFILE_ENTER
 	
-	NSNumber			*vertCnt = nil,
-						*faceCnt = nil;
-	NSData				*vertData = nil,
-						*normData = nil,
-						*tanData = nil,
-						*faceData = nil;
-	NSArray				*mtlKeys = nil;
-	NSNumber			*normMode = nil;
+	OOMeshCacheHeader	header = {0};
+	NSMutableData		*blob = nil;
+	NSMutableData		*strings = nil;
+	OOMeshMaterialCount	i;
 	
-	BOOL includeNormals = IsPerVertexNormalMode(_normalMode);
+	if (_geometryKey == nil || _vertices == NULL || _faces == NULL)  return nil;
 	
-	// Prepare cache data elements.
-	vertCnt = [NSNumber numberWithUnsignedInt:vertexCount];
-	faceCnt = [NSNumber numberWithUnsignedInt:faceCount];
+	BOOL includeNormals = IsPerVertexNormalMode(_normalMode);
+	if (includeNormals && (_normals == NULL || _tangents == NULL))  return nil;
 	
-	vertData = [_retainedObjects objectForKey:@"vertices"];
-	faceData = [_retainedObjects objectForKey:@"faces"];
-	if (includeNormals)
+	strings = [NSMutableData data];
+	const char *utf8 = [_geometryKey UTF8String];
+	[strings appendBytes:utf8 length:strlen(utf8) + 1];
+	for (i = 0; i < materialCount; i++)
 	{
-		normData = [_retainedObjects objectForKey:@"normals"];
-		tanData = [_retainedObjects objectForKey:@"tangents"];
+		utf8 = [materialKeys[i] UTF8String];
+		if (utf8 == NULL)  return nil;
+		[strings appendBytes:utf8 length:strlen(utf8) + 1];
 	}
 	
-	if (materialCount != 0)
-	{
-		mtlKeys = [NSArray arrayWithObjects:materialKeys count:materialCount];
-	}
-	else
+	blob = [NSMutableData dataWithLength:sizeof header];
+	header.vertexOffset = AppendMeshCacheSection(blob, _vertices, sizeof *_vertices * vertexCount);
+	if (includeNormals)
 	{
-		mtlKeys = [NSArray array];
+		header.normalOffset = AppendMeshCacheSection(blob, _normals, sizeof *_normals * vertexCount);
+		header.tangentOffset = AppendMeshCacheSection(blob, _tangents, sizeof *_tangents * vertexCount);
 	}
-	normMode = [NSNumber numberWithUnsignedChar:_normalMode];
+	header.faceOffset = AppendMeshCacheSection(blob, _faces, sizeof *_faces * faceCount);
+	header.stringsSize = [strings length];
+	header.stringsOffset = AppendMeshCacheSection(blob, [strings bytes], header.stringsSize);
 	
-	// Ensure we have all the required data elements.
-	if (vertCnt == nil ||
-		faceCnt == nil ||
-		vertData == nil ||
-		faceData == nil ||
-		mtlKeys == nil ||
-		normMode == nil)
+	if (octree != nil)
 	{
-		return nil;
+		NSDictionary *octreeDict = [octree dictionaryRepresentation];
+		NSData *octreeData = [octreeDict oo_dataForKey:@"octree"];
+		if (octreeData != nil)
+		{
+			header.octreeSize = [octreeData length];
+			header.octreeOffset = AppendMeshCacheSection(blob, [octreeData bytes], header.octreeSize);
+			header.octreeRadius = [octreeDict oo_floatForKey:@"radius"];
+		}
 	}
 	
-	if (includeNormals)
-	{
-		if (normData == nil || tanData == nil)  return nil;
-	}
+	header.magic = kMeshCacheMagic;
+	header.version = kMeshCacheVersion;
+	header.endianTag = kMeshCacheEndianTag;
+	header.totalSize = [blob length];
+	header.vectorSize = sizeof (Vector);
+	header.faceSize = sizeof (OOMeshFace);
+	header.normalMode = _normalMode;
+	header.vertexCount = vertexCount;
+	header.faceCount = faceCount;
+	header.materialCount = materialCount;
+	[blob replaceBytesInRange:NSMakeRange(0, sizeof header) withBytes:&header];
 	
-	// All OK; stick 'em in a dictionary.
-	return [NSDictionary dictionaryWithObjectsAndKeys:
-						vertCnt, @"vertex count",
-						vertData, @"vertex data",
-						faceCnt, @"face count",
-						faceData, @"face data",
-						mtlKeys, @"material keys",
-						normMode, @"normal mode",
-						/*	NOTE: order matters. Since normData and tanData
-							are last, if they're nil the dictionary will be
-							built without them, which is desired behaviour.
-						*/
-						normData, @"normal data",
-						tanData, @"tangent data",
-						nil];
+	return blob;
 	
 	OOJS_PROFILE_EXIT
 }
 
 
-- (BOOL)setModelFromModelData:(NSDictionary *)dict name:(NSString *)fileName
+static BOOL MeshCacheSectionIsValid(const OOMeshCacheHeader *header, uint32_t offset, size_t size)
+{
+	if (offset % kMeshCacheAlignment != 0)  return NO;
+	if (offset < sizeof *header)  return NO;
+	return size <= header->totalSize && offset <= header->totalSize - size;
+}
+
+
+- (BOOL) setModelFromCacheBlob:(NSData *)blob name:(NSString *)fileName cacheKey:(NSString *)cacheKey
 {
 	OOJS_PROFILE_ENTER
 	
-	NSData				*vertData = nil,
-						*normData = nil,
-						*tanData = nil,
-						*faceData = nil;
-	NSArray				*mtlKeys = nil;
-	NSString			*key = nil;
-	unsigned			i;
-	
-	if (dict == nil || ![dict isKindOfClass:[NSDictionary class]])  return NO;
+	const OOMeshCacheHeader	*header = NULL;
+	const uint8_t			*bytes = NULL;
+	NSString				*keys[kOOMeshMaxMaterials + 1];
+	unsigned				i, keyCount = 0;
 	
-	vertexCount = [dict oo_unsignedIntForKey:@"vertex count"];
-	faceCount = [dict oo_unsignedIntForKey:@"face count"];
+	if ([blob length] < sizeof *header)  return NO;
+	bytes = [blob bytes];
+	header = (const OOMeshCacheHeader *)bytes;
 	
-	if (vertexCount == 0 || faceCount == 0)  return NO;
+	if (header->magic != kMeshCacheMagic ||
+		header->version != kMeshCacheVersion ||
+		header->endianTag != kMeshCacheEndianTag ||
+		header->totalSize != [blob length] ||
+		header->vectorSize != sizeof (Vector) ||
+		header->faceSize != sizeof (OOMeshFace))
+	{
+		OOLog(@"mesh.load.error.badCacheData", @"Ignoring cache data in unknown format for mesh \"%@\".", fileName);
+		return NO;
+	}
 	
-	// Read data elements from dictionary.
-	vertData = [dict oo_dataForKey:@"vertex data"];
-	faceData = [dict oo_dataForKey:@"face data"];
+	if (header->normalMode > kNormalModeExplicit)
+	{
+		OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
+		return NO;
+	}
 	
-	mtlKeys = [dict oo_arrayForKey:@"material keys"];
-	_normalMode = [dict oo_unsignedCharForKey:@"normal mode"];
-	BOOL includeNormals = IsPerVertexNormalMode(_normalMode);
+	OOMeshNormalMode normalMode = header->normalMode;
+	BOOL includeNormals = IsPerVertexNormalMode(normalMode);
+	size_t vectorsSize = sizeof (Vector) * header->vertexCount;
 	
-	// Ensure we have all the required data elements.
-	if (vertData == nil ||
-		faceData == nil ||
-		mtlKeys == nil)
+	if (header->vertexCount == 0 || header->faceCount == 0 ||
+		header->materialCount > kOOMeshMaxMaterials ||
+		!MeshCacheSectionIsValid(header, header->vertexOffset, vectorsSize) ||
+		!MeshCacheSectionIsValid(header, header->faceOffset, sizeof (OOMeshFace) * header->faceCount) ||
+		!MeshCacheSectionIsValid(header, header->stringsOffset, header->stringsSize) ||
+		(includeNormals && (!MeshCacheSectionIsValid(header, header->normalOffset, vectorsSize) ||
+							!MeshCacheSectionIsValid(header, header->tangentOffset, vectorsSize))) ||
+		(header->octreeOffset != 0 && (!MeshCacheSectionIsValid(header, header->octreeOffset, header->octreeSize) ||
+									   header->octreeSize % sizeof (int) != 0)))
 	{
 		OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
 		return NO;
 	}
 	
-	if (includeNormals)
+	// Unpack string table: the cache key, followed by the material keys.
+	const char *string = (const char *)bytes + header->stringsOffset;
+	const char *stringsEnd = string + header->stringsSize;
+	while (string < stringsEnd && keyCount < header->materialCount + 1)
 	{
-		normData = [dict oo_dataForKey:@"normal data"];
-		tanData = [dict oo_dataForKey:@"tangent data"];
-		if (normData == nil || tanData == nil)
-		{
-			OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad normal/tangent cache data for mesh \"%@\".", fileName);
-			return NO;
-		}
+		size_t length = strnlen(string, stringsEnd - string);
+		if (string + length == stringsEnd)  break;	// Unterminated.
+		keys[keyCount] = [[[NSString alloc] initWithBytes:string length:length encoding:NSUTF8StringEncoding] autorelease];
+		if (keys[keyCount] == nil)  break;
+		keyCount++;
+		string += length + 1;
 	}
-	
-	// Ensure data objects are of correct size.
-	if ([vertData length] != sizeof *_vertices * vertexCount)  return NO;
-	if ([faceData length] != sizeof *_faces * faceCount)  return NO;
-	if (includeNormals)
+	if (keyCount != header->materialCount + 1)
 	{
-		if ([normData length] != sizeof *_normals * vertexCount)  return NO;
-		if ([tanData length] != sizeof *_tangents * vertexCount)  return NO;
+		OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
+		return NO;
+	}
+	if (![keys[0] isEqualToString:cacheKey])
+	{
+		// Different mesh whose key escaped to the same file name.
+		return NO;
 	}
 	
-	// Retain data.
-	_vertices = (Vector *)[vertData bytes];
-	[self setRetainedObject:vertData forKey:@"vertices"];
-	_faces = (OOMeshFace *)[faceData bytes];
-	[self setRetainedObject:faceData forKey:@"faces"];
+	// All OK. Point buffers directly into the blob, which we retain.
+	[self setRetainedObject:blob forKey:@"cache blob"];
+	_normalMode = normalMode;
+	vertexCount = header->vertexCount;
+	faceCount = header->faceCount;
+	_vertices = (Vector *)(bytes + header->vertexOffset);
+	_faces = (OOMeshFace *)(bytes + header->faceOffset);
 	if (includeNormals)
 	{
-		_normals = (Vector *)[normData bytes];
-		[self setRetainedObject:normData forKey:@"normals"];
-		_tangents = (Vector *)[tanData bytes];
-		[self setRetainedObject:tanData forKey:@"tangents"];
+		_normals = (Vector *)(bytes + header->normalOffset);
+		_tangents = (Vector *)(bytes + header->tangentOffset);
 	}
 	else
 	{
@@ -1140,17 +1378,19 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 		_tangents = NULL;
 	}
 	
-	// Copy material keys.
-	materialCount = [mtlKeys count];
+	materialCount = header->materialCount;
 	for (i = 0; i != materialCount; ++i)
 	{
-		key = [mtlKeys oo_stringAtIndex:i];
-		if (key != nil)  materialKeys[i] = [key copy];
-		else
-		{
-			OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
-			return NO;
-		}
+		materialKeys[i] = [keys[i + 1] copy];
+	}
+	
+	if (header->octreeOffset != 0 && octree == nil)
+	{
+		// Like the geometry, the octree nodes are used in place and keep the blob alive.
+		octree = [[Octree alloc] initWithBytes:bytes + header->octreeOffset
+										length:header->octreeSize
+										radius:header->octreeRadius
+										 owner:blob];
 	}
 	
 	return YES;
@@ -1159,12 +1399,16 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 }
 
 
-- (BOOL)loadData:(NSString *)filename scaleFactor:(float)scale
+/*	If source is not nil, it is parsed instead of reading filename, and the
+	mesh cache is not used. This is safe off the main thread provided
+	_cacheWriteable is NO.
+*/
+- (BOOL) loadData:(NSString *)filename scaleFactor:(float)scale source:(NSString *)source
 {
 	OOJS_PROFILE_ENTER
 	
 	NSScanner			*scanner;
-	NSDictionary		*cacheData = nil;
+	NSData				*cacheData = nil;
 	BOOL				failFlag = NO;
 	NSString			*failString = @"***** ";
 	unsigned			i, j;
@@ -1172,11 +1416,13 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 	NSString			*cacheKey = nil;
 	BOOL				using_preloaded = NO;
 	
-	cacheKey = [NSString stringWithFormat:@"%@:%u:%.3f", filename, _normalMode, scale];
-	cacheData = [OOCacheManager meshDataForName:cacheKey];
+	cacheKey = GeometryCacheKey(filename, _normalMode, scale);
+	[_geometryKey release];
+	_geometryKey = [cacheKey copy];
+	if (source == nil)  cacheData = [OOCacheManager meshDataForName:cacheKey];
 	if (cacheData != nil)
 	{
-		if ([self setModelFromModelData:cacheData name:filename])
+		if ([self setModelFromCacheBlob:cacheData name:filename cacheKey:cacheKey])
 		{
 			using_preloaded = YES;
 			PROFILE(@"loaded from cache");
@@ -1190,23 +1436,14 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 		
 		NSCharacterSet	*whitespaceCharSet = [NSCharacterSet whitespaceCharacterSet];
 		NSCharacterSet	*whitespaceAndNewlineCharSet = [NSCharacterSet whitespaceAndNewlineCharacterSet];
-#if OOLITE_MAC_OS_X
-		NSCharacterSet	*newlineCharSet = [NSCharacterSet newlineCharacterSet];
-#else
-		static NSCharacterSet *newlineCharSet = nil;
-		if (newlineCharSet == nil)
-		{
-			NSMutableCharacterSet *temp = [[whitespaceAndNewlineCharSet mutableCopy] autorelease];
-			[temp formIntersectionWithCharacterSet:[whitespaceCharSet invertedSet]];
-			newlineCharSet = [temp copy];
-		}
-#endif
+		NSCharacterSet	*newlineCharSet = NewlineCharacterSet();
 		
 		texFileName2Idx = [NSMutableDictionary dictionary];
 		
 		{
 			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-			NSString *data = [ResourceManager stringFromFilesNamed:filename inFolder:@"Models" cache:NO];
+			NSString *data = source;
+			if (data == nil)  data = [ResourceManager stringFromFilesNamed:filename inFolder:@"Models" cache:NO];
 			if (data == nil)
 			{
 				// Model not found
@@ -1621,7 +1858,7 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 		// save the resulting data for possible reuse
 		if (EXPECT(_cacheWriteable))
 		{
-			[OOCacheManager setMeshData:[self modelData] forName:cacheKey];
+			[OOCacheManager setMeshData:[self cacheBlob] forName:cacheKey];
 			PROFILE(@"saved to cache");
 		}
 		
@@ -2024,6 +2261,35 @@ static float FaceAreaCorrect(GLuint *vertIndices, Vector *vertices)
 	// Rescale base vertices used for geometry calculations.
 	OOMeshVertexCount	i;
 	Vector				*vertex = NULL;
+	Vector				*vertices = NULL;
+	Vector				*displayVertices = NULL;
+	
+	/*	The vertex arrays are shared with the mesh we were copied from, and
+		may be mapped read-only from the cache, so make private copies first.
+	*/
+	NSMutableDictionary *retainedObjects = [_retainedObjects mutableCopy];
+	[_retainedObjects release];
+	_retainedObjects = retainedObjects;
+	vertices = [self allocateBytesWithSize:sizeof *_vertices count:vertexCount key:@"vertices"];
+	displayVertices = [self allocateBytesWithSize:sizeof *_displayLists.vertexArray count:_displayLists.count key:@"vertexArray"];
+	if (vertices == NULL || displayVertices == NULL)
+	{
+		[NSException raise:NSMallocException format:@"Not enough memory to rescale mesh %@.", baseFile];
+	}
+	memcpy(vertices, _vertices, sizeof *_vertices * vertexCount);
+	memcpy(displayVertices, _displayLists.vertexArray, sizeof *_displayLists.vertexArray * _displayLists.count);
+	_vertices = vertices;
+	_displayLists.vertexArray = displayVertices;
+	
+	// The geometry no longer matches other meshes with the same key.
+	DESTROY(_vertexBuffers);
+	_cacheWriteable = NO;
+	if (_geometryKey != nil)
+	{
+		NSString *rescaledKey = [[NSString alloc] initWithFormat:@"%@*%.3f", _geometryKey, factor];
+		[_geometryKey release];
+		_geometryKey = rescaledKey;
+	}
 	
 	for (i = 0; i < vertexCount; i++)
 	{
@@ -2211,57 +2477,167 @@ static void Scribble(void *bytes, size_t size)
 @end
 
 
-static NSString * const kOOCacheMeshes = @"OOMesh";
+static NSMutableDictionary *sMeshVertexBuffers = nil;
 
-@implementation OOCacheManager (OOMesh)
 
-+ (NSDictionary *)meshDataForName:(NSString *)inShipName
+@implementation OOMeshVertexBuffers
+
++ (BOOL) vertexBuffersAvailable
 {
-	return [[self sharedCache] objectForKey:inShipName inCache:kOOCacheMeshes];
+	static int available = -1;
+	if (EXPECT_NOT(available == -1))
+	{
+		OOOpenGLExtensionManager *extMgr = [OOOpenGLExtensionManager sharedManager];
+		available = [[NSUserDefaults standardUserDefaults] oo_boolForKey:@"mesh-vertex-buffers" defaultValue:YES] &&
+					[extMgr fboSupported] &&	// on Windows, buffer functions are loaded with the FBO functions.
+					[extMgr versionIsAtLeastMajor:1 minor:5];
+		OOLog(@"mesh.vertexBuffers", @"Mesh vertex buffer objects %@.", available ? @"enabled" : @"disabled");
+	}
+	return available;
 }
 
 
-+ (void)setMeshData:(NSDictionary *)inData forName:(NSString *)inShipName
++ (instancetype) vertexBuffersForKey:(NSString *)key
 {
-	if (inData != nil && inShipName != nil)
+	NSParameterAssert(key != nil);
+	
+	OOMeshVertexBuffers *result = [[sMeshVertexBuffers objectForKey:key] pointerValue];
+	if (result == nil)
 	{
-		[[self sharedCache] setObject:inData forKey:inShipName inCache:kOOCacheMeshes];
+		result = [[[self alloc] init] autorelease];
+		result->_key = [key copy];
+		
+		if (sMeshVertexBuffers == nil)  sMeshVertexBuffers = [[NSMutableDictionary alloc] init];
+		[sMeshVertexBuffers setObject:[NSValue valueWithPointer:result] forKey:key];
+		[[OOGraphicsResetManager sharedManager] registerClient:result];
 	}
+	return result;
 }
 
-@end
+
+- (void) dealloc
+{
+	[[OOGraphicsResetManager sharedManager] unregisterClient:self];
+	[sMeshVertexBuffers removeObjectForKey:_key];
+	[self resetGraphicsState];
+	DESTROY(_key);
+	
+	[super dealloc];
+}
 
 
-static NSString * const kOOCacheOctrees = @"octrees";
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"\"%@\", %u vertices%@", _key, _count, _buffer != 0 ? @", uploaded" : @""];
+}
 
-@implementation OOCacheManager (Octree)
 
-+ (Octree *)octreeForModel:(NSString *)inKey
+- (BOOL) bindWithDisplayLists:(const OOMeshDisplayLists *)lists
 {
-	NSDictionary		*dict = nil;
-	Octree				*result = nil;
+	NSParameterAssert(lists != NULL);
 	
-	if (inKey == nil)  return nil;
+	OO_ENTER_OPENGL();
 	
-	dict = [[self sharedCache] objectForKey:inKey inCache:kOOCacheOctrees];
-	if (dict != nil)
+	if (_buffer == 0)
 	{
-		result = [[Octree alloc] initWithDictionary:dict];
-		[result autorelease];
+		if (lists->count == 0)  return NO;
+		
+		size_t vectorSize = sizeof (Vector) * lists->count;
+		size_t uvSize = sizeof (GLfloat) * 2 * lists->count;
+		size_t totalSize = vectorSize * 3 + uvSize;
+		uint8_t *data = malloc(totalSize);
+		if (EXPECT_NOT(data == NULL))  return NO;
+		
+		_count = lists->count;
+		_normalOffset = vectorSize;
+		_tangentOffset = vectorSize * 2;
+		_textureUVOffset = vectorSize * 3;
+		memcpy(data, lists->vertexArray, vectorSize);
+		memcpy(data + _normalOffset, lists->normalArray, vectorSize);
+		memcpy(data + _tangentOffset, lists->tangentArray, vectorSize);
+		memcpy(data + _textureUVOffset, lists->textureUVArray, uvSize);
+		
+		OOGL(glGenBuffers(1, &_buffer));
+		if (_buffer != 0)
+		{
+			OOGL(glBindBuffer(GL_ARRAY_BUFFER, _buffer));
+			OOGL(glBufferData(GL_ARRAY_BUFFER, totalSize, data, GL_STATIC_DRAW));
+		}
+		free(data);
+		
+		return _buffer != 0;
 	}
 	
-	return result;
+	NSAssert2(lists->count == _count, @"Mesh vertex count mismatch for shared vertex buffer %@ (%u)", self, lists->count);
+	OOGL(glBindBuffer(GL_ARRAY_BUFFER, _buffer));
+	return YES;
+}
+
+
++ (void) unbind
+{
+	OO_ENTER_OPENGL();
+	OOGL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+
+- (const GLvoid *) vertexPointer
+{
+	return (const GLvoid *)0;
 }
 
 
-+ (void)setOctree:(Octree *)inOctree forModel:(NSString *)inKey
+- (const GLvoid *) normalPointer
 {
-	if (inOctree != nil && inKey != nil)
+	return (const GLvoid *)_normalOffset;
+}
+
+
+- (const GLvoid *) tangentPointer
+{
+	return (const GLvoid *)_tangentOffset;
+}
+
+
+- (const GLvoid *) textureUVPointer
+{
+	return (const GLvoid *)_textureUVOffset;
+}
+
+
+- (void) resetGraphicsState
+{
+	if (_buffer != 0)
 	{
-		[[self sharedCache] setObject:[inOctree dictionaryRepresentation] forKey:inKey inCache:kOOCacheOctrees];
+		OO_ENTER_OPENGL();
+		OOGL(glDeleteBuffers(1, &_buffer));
+		_buffer = 0;
 	}
 }
 
+@end
+
+
+static NSString * const kOOCacheMeshes = @"OOMesh";
+
+@implementation OOCacheManager (OOMesh)
+
++ (NSData *)meshDataForName:(NSString *)inShipName
+{
+	return [[self sharedCache] dataForKey:inShipName inBinaryCache:kOOCacheMeshes];
+}
+
+
++ (void)setMeshData:(NSData *)inData forName:(NSString *)inShipName
+{
+	if (inData != nil && inShipName != nil)
+	{
+		[[self sharedCache] setData:inData forKey:inShipName inBinaryCache:kOOCacheMeshes];
+	}
+}
+
+@end
+
 
 static void VFRAddFace(VertexFaceRef *vfr, NSUInteger index)
 {
@@ -54,6 +54,7 @@ typedef enum
 	OOMusicMode				_mode;
 	NSString				*_missionMusic;
 	OOMusic					*_current;
+	OOMusic					*_prefetched;
 	uint8_t					_special;
 }
 
@@ -62,6 +63,11 @@ typedef enum
 - (void) playMusicNamed:(NSString *)name loop:(BOOL)loop;
 - (void) playMusicNamed:(NSString *)name loop:(BOOL)loop gain:(float)gain;
 
+/*	Load a track that is likely to be played next, so that its first chunk
+	is decoded in the background before it is needed. Only one track is kept.
+*/
+- (void) prefetchMusicNamed:(NSString *)name;
+
 - (void) playThemeMusic;
 - (void) playDockingMusic;
 - (void) playDockedMusic;
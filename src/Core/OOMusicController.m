@@ -97,7 +97,16 @@ enum
 	
 	if (_mode == kOOMusicOn || (_mode == kOOMusicITunes && [name isEqualToString:@"OoliteTheme.ogg"]))
 	{
-		OOMusic *music = [ResourceManager ooMusicNamed:name inFolder:@"Music"];
+		OOMusic *music = nil;
+		if ([name isEqual:[_prefetched name]])
+		{
+			music = [[_prefetched retain] autorelease];
+			DESTROY(_prefetched);
+		}
+		else
+		{
+			music = [ResourceManager ooMusicNamed:name inFolder:@"Music"];
+		}
 		if (music != nil)
 		{
 			[_current stop];
@@ -112,10 +121,22 @@ enum
 }
 
 
+- (void) prefetchMusicNamed:(NSString *)name
+{
+	if (_mode != kOOMusicOn || name == nil)  return;
+	if ([name isEqual:[_prefetched name]] || [name isEqual:[self playingMusic]])  return;
+	
+	[_prefetched release];
+	_prefetched = [[ResourceManager ooMusicNamed:name inFolder:@"Music"] retain];
+}
+
+
 - (void) playThemeMusic
 {
 	_special = kSpecialTheme;
 	[self playMusicNamed:@"OoliteTheme.ogg" loop:YES];
+	// The theme is followed by the docked music when the game starts.
+	[self prefetchMusicNamed:@"OoliteDocked.ogg"];
 }
 
 
@@ -153,6 +174,7 @@ enum
 {
 	[_missionMusic autorelease];
 	_missionMusic = [missionMusicName copy];
+	[self prefetchMusicNamed:_missionMusic];
 }
 
 
@@ -0,0 +1,72 @@
+/*
+
+OOOXZArchive.h
+
+Shared read access to OXZ (zip) archives. Each archive is opened once and
+kept open, and its central directory is read into a name -> entry table the
+first time it is used, so looking up a file costs one hash lookup and one
+seek rather than a reopen and a linear directory scan.
+
+Archives are shared between callers and may be used from any thread; each
+archive serialises access to its underlying zip handle.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+
+@interface OOOXZArchive: NSObject
+{
+@private
+	NSString				*_path;
+	void					*_zipFile;
+	NSLock					*_lock;
+
+	struct OOOXZArchiveEntry *_entries;
+	NSUInteger				_entryCount;
+	NSDictionary			*_entryIndex;		// Name -> NSNumber index into _entries
+
+	void					*_storedFile;		// Opened on first read of a stored entry.
+}
+
+/*	Returns the shared archive object for the OXZ at path, opening it if
+	necessary, or nil if it isn't a readable zip file.
+*/
++ (instancetype) archiveWithPath:(NSString *)path;
+
+/*	Close all cached archives. Must be called before OXZ files are replaced
+	or removed, and when the set of search paths changes. Archive objects
+	still held by callers remain usable.
+*/
++ (void) closeAllArchives;
+
+- (NSString *) path;
+- (NSUInteger) entryCount;
+
+- (BOOL) hasEntry:(NSString *)name;
+
+/*	Returns the contents of the named entry, or nil if there is no such
+	entry. Uncompressed entries are read straight from the archive file
+	into the result instead of through the zip library.
+*/
+- (NSData *) dataForEntry:(NSString *)name;
+
+@end
@@ -0,0 +1,364 @@
+/*
+
+OOOXZArchive.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOOXZArchive.h"
+#import "unzip.h"
+
+
+// Maximum entry name length we index; longer names can't be looked up.
+#define kMaxEntryNameLength		1024
+
+// Largest single read passed to unzReadCurrentFile(), which takes an unsigned.
+#define kMaxReadChunk			(1U << 30)
+
+
+typedef struct OOOXZArchiveEntry
+{
+	unz64_file_pos			position;
+	uint64_t				uncompressedSize;
+	uint64_t				dataOffset;			// Offset of stored data in archive; 0 if not yet known.
+	uint16_t				compressionMethod;
+	uint16_t				flags;
+} OOOXZArchiveEntry;
+
+
+enum
+{
+	kZipMethodStored		= 0,
+	kZipFlagEncrypted		= 0x0001
+};
+
+
+@interface OOOXZArchive (Private)
+
+- (id) initWithPath:(NSString *)path;
+- (BOOL) buildIndex;
+
+- (NSData *) readEntry:(OOOXZArchiveEntry *)entry;
+- (NSData *) readStoredEntry:(OOOXZArchiveEntry *)entry;
+
+@end
+
+
+static NSMutableDictionary	*sArchives = nil;
+static NSLock				*sArchivesLock = nil;
+
+// The zip library's own 64-bit stdio wrappers, used to read stored entries directly.
+static zlib_filefunc64_def	sFileFuncs;
+
+
+@implementation OOOXZArchive
+
++ (void) initialize
+{
+	if (self == [OOOXZArchive class])
+	{
+		sArchives = [[NSMutableDictionary alloc] init];
+		sArchivesLock = [[NSLock alloc] init];
+		fill_fopen64_filefunc(&sFileFuncs);
+	}
+}
+
+
++ (instancetype) archiveWithPath:(NSString *)path
+{
+	id						result = nil;
+
+	if (path == nil)  return nil;
+
+	[sArchivesLock lock];
+	@try
+	{
+		result = [sArchives objectForKey:path];
+		if (result == nil)
+		{
+			result = [[[self alloc] initWithPath:path] autorelease];
+			// Remember failures too, so that probing for absent OXZs stays cheap.
+			[sArchives setObject:(result != nil) ? result : [NSNull null] forKey:path];
+		}
+		if (result == [NSNull null])  result = nil;
+		[[result retain] autorelease];
+	}
+	@finally
+	{
+		[sArchivesLock unlock];
+	}
+
+	return result;
+}
+
+
++ (void) closeAllArchives
+{
+	[sArchivesLock lock];
+	[sArchives removeAllObjects];
+	[sArchivesLock unlock];
+}
+
+
+- (void) dealloc
+{
+	if (_zipFile != NULL)  unzClose(_zipFile);
+	if (_storedFile != NULL)  sFileFuncs.zclose_file(sFileFuncs.opaque, _storedFile);
+	free(_entries);
+	DESTROY(_entryIndex);
+	DESTROY(_lock);
+	DESTROY(_path);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"\"%@\", %lu entries", _path, (unsigned long)_entryCount];
+}
+
+
+- (NSString *) path
+{
+	return _path;
+}
+
+
+- (NSUInteger) entryCount
+{
+	return _entryCount;
+}
+
+
+- (BOOL) hasEntry:(NSString *)name
+{
+	// _entryIndex is immutable after init, so no locking is needed.
+	return name != nil && [_entryIndex objectForKey:name] != nil;
+}
+
+
+- (NSData *) dataForEntry:(NSString *)name
+{
+	NSNumber				*index = nil;
+	NSData					*result = nil;
+
+	if (name == nil)  return nil;
+
+	/*	Much of the time this is called with the expectation that the file
+		may not necessarily exist - e.g. on plist merges, config scans, etc.
+		So don't log this failure mode.
+	*/
+	index = [_entryIndex objectForKey:name];
+	if (index == nil)  return nil;
+
+	OOOXZArchiveEntry *entry = &_entries[[index unsignedIntegerValue]];
+
+	[_lock lock];
+	@try
+	{
+		if (entry->compressionMethod == kZipMethodStored && !(entry->flags & kZipFlagEncrypted))
+		{
+			result = [self readStoredEntry:entry];
+		}
+		if (result == nil)  result = [self readEntry:entry];
+	}
+	@finally
+	{
+		[_lock unlock];
+	}
+
+	return result;
+}
+
+@end
+
+
+@implementation OOOXZArchive (Private)
+
+- (id) initWithPath:(NSString *)path
+{
+	if ((self = [super init]))
+	{
+		const char *zipName = [path UTF8String];
+		if (zipName != NULL)  _zipFile = unzOpen64(zipName);
+		if (_zipFile == NULL)
+		{
+			// This is not necessarily an error - the OXZ manager tries to
+			// do this as a test for the presence of managed OXZs
+			[self release];
+			return nil;
+		}
+
+		_path = [path copy];
+		_lock = [[NSLock alloc] init];
+
+		if (![self buildIndex])
+		{
+			OOLog(@"oxz.archive.error", @"Could not read the contents of OXZ at %@", path);
+			[self release];
+			return nil;
+		}
+	}
+
+	return self;
+}
+
+
+- (BOOL) buildIndex
+{
+	unz_global_info64		globalInfo;
+	unz_file_info64			fileInfo;
+	char					name[kMaxEntryNameLength];
+	NSMutableDictionary		*index = nil;
+	NSUInteger				i = 0;
+	int						err;
+
+	if (unzGetGlobalInfo64(_zipFile, &globalInfo) != UNZ_OK)  return NO;
+
+	if (globalInfo.number_entry > 0)
+	{
+		if (globalInfo.number_entry > NSUIntegerMax / sizeof *_entries)  return NO;
+		_entries = calloc((size_t)globalInfo.number_entry, sizeof *_entries);
+		if (_entries == NULL)  return NO;
+	}
+	index = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)globalInfo.number_entry];
+
+	for (err = unzGoToFirstFile(_zipFile); err == UNZ_OK && i < globalInfo.number_entry; err = unzGoToNextFile(_zipFile))
+	{
+		if (unzGetCurrentFileInfo64(_zipFile, &fileInfo, name, sizeof name, NULL, 0, NULL, 0) != UNZ_OK)  return NO;
+		if (fileInfo.size_filename >= sizeof name)  continue;
+
+		NSString *key = [NSString stringWithUTF8String:name];
+		// Like unzLocateFile(), the first entry with a given name wins.
+		if (key == nil || [index objectForKey:key] != nil)  continue;
+
+		OOOXZArchiveEntry *entry = &_entries[i];
+		if (unzGetFilePos64(_zipFile, &entry->position) != UNZ_OK)  return NO;
+		entry->uncompressedSize = fileInfo.uncompressed_size;
+		entry->compressionMethod = fileInfo.compression_method;
+		entry->flags = fileInfo.flag;
+
+		[index setObject:[NSNumber numberWithUnsignedInteger:i] forKey:key];
+		i++;
+	}
+	if (err != UNZ_OK && err != UNZ_END_OF_LIST_OF_FILE)  return NO;
+
+	_entryCount = i;
+	_entryIndex = [index copy];
+	return YES;
+}
+
+
+- (NSData *) readEntry:(OOOXZArchiveEntry *)entry
+{
+	NSMutableData			*result = nil;
+	uint8_t					*bytes = NULL;
+	uint64_t				remaining;
+	int						err;
+
+	if (entry->uncompressedSize > NSUIntegerMax)  return nil;
+
+	if (unzGoToFilePos64(_zipFile, &entry->position) != UNZ_OK ||
+		unzOpenCurrentFile(_zipFile) != UNZ_OK)
+	{
+		OOLog(kOOLogFileNotFound, @"Could not read entry in OXZ at %@", _path);
+		return nil;
+	}
+
+	// Decompress straight into the result; the size is known up front.
+	result = [NSMutableData dataWithLength:(NSUInteger)entry->uncompressedSize];
+	bytes = [result mutableBytes];
+	remaining = entry->uncompressedSize;
+	while (remaining > 0)
+	{
+		unsigned chunk = (unsigned)MIN(remaining, (uint64_t)kMaxReadChunk);
+		err = unzReadCurrentFile(_zipFile, bytes, chunk);
+		if (err <= 0)
+		{
+			OOLog(kOOLogFileNotFound, @"Could not read entry in OXZ at %@ (err %d)", _path, err);
+			result = nil;
+			break;
+		}
+		bytes += err;
+		remaining -= err;
+	}
+
+	err = unzCloseCurrentFile(_zipFile);
+	if (err != UNZ_OK && result != nil)
+	{
+		OOLog(kOOLogFileNotFound, @"Could not close entry in OXZ at %@ (err %d)", _path, err);
+		result = nil;
+	}
+
+	return result;
+}
+
+
+- (NSData *) readStoredEntry:(OOOXZArchiveEntry *)entry
+{
+	NSMutableData			*result = nil;
+	uint8_t					*bytes = NULL;
+	uint64_t				remaining;
+
+	if (entry->uncompressedSize > NSUIntegerMax)  return nil;
+
+	if (entry->dataOffset == 0)
+	{
+		// Opening the entry parses its local header, which gives us the data offset.
+		if (unzGoToFilePos64(_zipFile, &entry->position) != UNZ_OK ||
+			unzOpenCurrentFile(_zipFile) != UNZ_OK)
+		{
+			return nil;
+		}
+		entry->dataOffset = unzGetCurrentFileZStreamPos64(_zipFile);
+		unzCloseCurrentFile(_zipFile);
+		if (entry->dataOffset == 0)  return nil;
+	}
+
+	/*	Stored data is read straight from the archive file into the result,
+		without going through the zip library's read buffer. A plain file
+		is used rather than a memory mapping, since the result may outlive
+		the archive (see +closeAllArchives) and would otherwise have to be
+		copied out of the mapping anyway.
+	*/
+	if (_storedFile == NULL)
+	{
+		_storedFile = sFileFuncs.zopen64_file(sFileFuncs.opaque, [_path UTF8String], ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+		if (_storedFile == NULL)  return nil;
+	}
+	if (sFileFuncs.zseek64_file(sFileFuncs.opaque, _storedFile, entry->dataOffset, ZLIB_FILEFUNC_SEEK_SET) != 0)  return nil;
+
+	result = [NSMutableData dataWithLength:(NSUInteger)entry->uncompressedSize];
+	bytes = [result mutableBytes];
+	remaining = entry->uncompressedSize;
+	while (remaining > 0)
+	{
+		uLong chunk = (uLong)MIN(remaining, (uint64_t)kMaxReadChunk);
+		uLong count = sFileFuncs.zread_file(sFileFuncs.opaque, _storedFile, bytes, chunk);
+		if (count == 0)  return nil;
+		bytes += count;
+		remaining -= count;
+	}
+
+	return result;
+}
+
+@end
@@ -36,6 +36,7 @@ MA 02110-1301, USA.
 #import "OOCollectionExtractors.h"
 #import "NSFileManagerOOExtensions.h"
 #import "NSDataOOExtensions.h"
+#import "OOOXZArchive.h"
 #import "NSStringOOExtensions.h"
 #import "OOColor.h"
 #import "OOStringExpander.h"
@@ -833,6 +834,7 @@ static OOOXZManager *sSingleton = nil;
 
 	// delete filename if it exists from OXZ folder
 	NSString *destination = [[self installPath] stringByAppendingPathComponent:filename];
+	[OOOXZArchive closeAllArchives];
 	[[NSFileManager defaultManager] oo_removeItemAtPath:destination];
 
 	// move the temp file on to it
@@ -1966,6 +1968,7 @@ static OOOXZManager *sSingleton = nil;
 		return NO;
 	}
 
+	[OOOXZArchive closeAllArchives];
 	if (![[NSFileManager defaultManager] oo_removeItemAtPath:filename])
 	{
 		OOLog(kOOOXZErrorLog, @"Unable to remove file %@", filename);
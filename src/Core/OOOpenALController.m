@@ -54,7 +54,7 @@ static id sSingleton = nil;
 		arguments = [[NSProcessInfo processInfo] arguments];
 		for (argEnum = [arguments objectEnumerator]; (arg = [argEnum nextObject]); )
 		{
-			if ([arg isEqual:@"-nosound"] || [arg isEqual:@"--nosound"])  
+			if ([arg isEqual:@"-nosound"] || [arg isEqual:@"--nosound"] || [arg isEqual:@"-simbench"])  
 			{
 				[self release];
 				return nil;
@@ -0,0 +1,114 @@
+/*
+
+OOParticleEngine.h
+
+Short-lived billboard effects: sparks thrown by damaged ships, laser hit,
+explosion and plasma burst flashes, fragment bursts and explosion clouds.
+
+These used to be entities in their own right, so every explosion added
+several entities to Universe, each sorted, updated, drawn and removed
+individually. Instead, particles are now kept in preallocated structure-of-
+arrays pools, one pool per texture. The whole engine is advanced once per
+tick by branch-free loops over those arrays, and each pool is drawn with a
+single glDrawArrays() during the translucent part of each depth pass of
+-[Universe drawUniverse].
+
+Every particle follows the same rules: it moves in a straight line; its
+size grows linearly; its opacity is the lesser of a fade-in ramp and a
+fade-out ramp, clamped to [0, 1]; and it disappears at the end of its
+lifetime. Sparks also shift towards red as they fade, explosion cloud
+particles lose colour channels one by one, and sparks and flashes fade out
+with distance like other light particles. The effect-specific emitters below
+set up particles so that each effect looks as it did as an entity.
+
+Particles don't collide, have no scripts and aren't visible to entity
+searches or the entity count. The engine is only used on the main thread.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOMaths.h"
+#import "OOTypes.h"
+
+@class Entity, OOColor, OOTexture;
+
+
+typedef struct OOParticlePool OOParticlePool;
+
+
+@interface OOParticleEngine: NSObject
+{
+@private
+	OOParticlePool			*_pools;
+	NSUInteger				_poolCount;
+	NSUInteger				_poolCapacity;
+
+	OOTexture				*_blurTexture;
+	OOTexture				*_flashTexture;
+
+	OOTimeDelta				_lastDeltaT;
+	OOTimeDelta				_renderLag;			// Time to step particles back by while render interpolation is in effect.
+
+	// Vertex arrays for drawing a pool, grown as needed.
+	GLfloat					*_vertices;
+	GLfloat					*_colors;
+	GLfloat					*_texCoords;
+	NSUInteger				_vertexCapacity;	// In particles.
+}
+
+- (void) update:(OOTimeDelta)delta_t;
+
+- (void) removeAllParticles;
+- (NSUInteger) particleCount;
+
+/*	Render interpolation for the fixed timestep game loop, like the entity
+	methods of the same names; particles are drawn where they were a fraction
+	of the way through the last update.
+*/
+- (void) beginRenderInterpolation:(double)fraction;
+- (void) endRenderInterpolation;
+
+/*	Draw the particles whose near edge is at least minRange and less than
+	maxRange from the viewpoint. viewMatrix must be the current modelview
+	matrix, which is expected to rotate into eye space but not translate (as
+	in -[Universe drawUniverse] between entities).
+*/
+- (void) drawFromViewpoint:(HPVector)viewpoint viewMatrix:(OOMatrix)viewMatrix minRange:(GLfloat)minRange maxRange:(GLfloat)maxRange;
+
+
+// Emitters.
+- (void) addSparkAt:(HPVector)position velocity:(Vector)velocity duration:(OOTimeDelta)duration size:(float)size color:(OOColor *)color;
+
+- (void) addLaserFlashAt:(HPVector)position velocity:(Vector)velocity color:(OOColor *)color;
+- (void) addExplosionFlashFromEntity:(Entity *)entity;
+- (void) addPlasmaBurstAt:(HPVector)position;
+
+// Fast sparks, and slow clouds, as used by reduced detail explosions.
+- (void) addSmallFragmentBurstFromEntity:(Entity *)entity;
+- (void) addBigFragmentBurstFromEntity:(Entity *)entity;
+
+/*	A cloud configured by an explosion setting from explosions.plist, centred
+	on position. If size is 0, it is derived from the entity's collision
+	radius and the setting's size.
+*/
+- (void) addExplosionCloudFromEntity:(Entity *)entity position:(HPVector)position size:(float)size settings:(NSDictionary *)settings;
+
+@end
@@ -0,0 +1,938 @@
+/*
+
+OOParticleEngine.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOParticleEngine.h"
+#import "Universe.h"
+#import "Entity.h"
+#import "OOTexture.h"
+#import "OOColor.h"
+#import "OOLightParticleEntity.h"
+#import "OOCollectionExtractors.h"
+#import "OOMacroOpenGL.h"
+#include <stddef.h>
+
+
+#define kParticlePoolInitialCapacity	256
+#define kParticlePoolMaxCapacity		16384
+
+// Light particles (sparks, flashes and plasma bursts) fade out with distance.
+#define kParticleDistanceScaleLow		12.0
+#define kParticleDistanceScaleHigh		36.0
+
+#define kSmallFragmentBurstMaxParticles	64
+#define kBigFragmentBurstMaxParticles	16
+
+#define kLaserFlashDuration				0.3f
+#define kExplosionFlashDuration			0.4f
+#define kFlashGrowthRateFactor			150.0f	// if average flashSize is 80 then this is 12000
+#define kMinExplosionFlashGrowth		600.0f
+#define kLaserFlashInitialSize			1.0f
+#define kExplosionFlashAlpha			0.5f
+
+#define kPlasmaBurstInitialSize			64.0f
+#define kPlasmaBurstGrowthRate			64.0f
+#define kPlasmaBurstDuration			2.0f
+
+#define kExplosionCloudDuration			0.9
+#define kExplosionCloudGrowthRateFactor	1.5f
+#define kExplosionCloudAlpha			0.85f
+#define	kExplosionBrightnessMult		1.0f
+#define kExplosionDefaultSize			2.5f
+
+// keys for explosions.plist
+static NSString * const kExplosionAlpha			= @"alpha";
+static NSString * const kExplosionBrightness	= @"brightness";
+static NSString * const kExplosionColors		= @"color_order";
+static NSString * const kExplosionCount			= @"count";
+static NSString * const kExplosionDuration		= @"duration";
+static NSString * const kExplosionGrowth		= @"growth_rate";
+static NSString * const kExplosionSize			= @"size";
+static NSString * const kExplosionSpread		= @"spread";
+static NSString * const kExplosionTexture		= @"texture";
+
+
+/*	Explosion cloud colour orders, as primary, secondary and tertiary colour
+	channel. Particles start out with primary >= secondary >= tertiary, and
+	fade by losing the tertiary channel, then the secondary, then the primary.
+*/
+static NSString * const kColorOrderNames[] = { @"rgb", @"rbg", @"grb", @"gbr", @"brg", @"bgr" };
+static const uint8_t kColorOrders[][3] =
+{
+	{ 0, 1, 2 },
+	{ 0, 2, 1 },
+	{ 1, 0, 2 },
+	{ 1, 2, 0 },
+	{ 2, 0, 1 },
+	{ 2, 1, 0 }
+};
+
+
+struct OOParticlePool
+{
+	OOTexture				*texture;
+	BOOL					fadesColors;		// Holds explosion cloud particles.
+	NSUInteger				count;
+	NSUInteger				capacity;
+
+	double					*x, *y, *z;
+	float					*vx, *vy, *vz;
+	float					*age;
+	float					*lifetime;
+	float					*size;				// Half the width of the quad.
+	float					*growth;
+	float					*fadeInBase, *fadeInRate;
+	float					*fadeOutBase, *fadeOutRate;
+	float					*fade;				// Opacity factor, calculated from the above by each update.
+	float					*r, *g, *b, *a;
+	float					*redShift;			// 1 for sparks, which turn red as they fade, otherwise 0.
+	float					*attenuation;		// Reciprocal of the squared distance at which the particle disappears, or 0.
+	float					*colorFadeRate;		// Explosion clouds only.
+	uint8_t					*colorOrder;		// Explosion clouds only; index into kColorOrders.
+};
+
+
+#define POOL_ARRAY(field)  { offsetof(OOParticlePool, field), sizeof *((OOParticlePool *)NULL)->field }
+
+static const struct
+{
+	size_t					offset;
+	size_t					size;
+} kPoolArrays[] =
+{
+	POOL_ARRAY(x), POOL_ARRAY(y), POOL_ARRAY(z),
+	POOL_ARRAY(vx), POOL_ARRAY(vy), POOL_ARRAY(vz),
+	POOL_ARRAY(age), POOL_ARRAY(lifetime),
+	POOL_ARRAY(size), POOL_ARRAY(growth),
+	POOL_ARRAY(fadeInBase), POOL_ARRAY(fadeInRate),
+	POOL_ARRAY(fadeOutBase), POOL_ARRAY(fadeOutRate),
+	POOL_ARRAY(fade),
+	POOL_ARRAY(r), POOL_ARRAY(g), POOL_ARRAY(b), POOL_ARRAY(a),
+	POOL_ARRAY(redShift), POOL_ARRAY(attenuation),
+	POOL_ARRAY(colorFadeRate), POOL_ARRAY(colorOrder)
+};
+
+enum
+{
+	kPoolArrayCount = sizeof kPoolArrays / sizeof *kPoolArrays
+};
+
+
+OOINLINE char **PoolArray(OOParticlePool *pool, unsigned index)
+{
+	return (char **)((char *)pool + kPoolArrays[index].offset);
+}
+
+
+/*	Everything needed to emit one particle. The opacity of a particle at age t
+	is the lesser of t / fadeInTime (or 1 if fadeInTime is 0) and
+	(fadeOutEnd - t) / fadeOutTime (or 1 if fadeOutTime is 0), clamped to
+	[0, 1], times color[3].
+*/
+typedef struct
+{
+	HPVector				position;
+	Vector					velocity;
+	float					lifetime;
+	float					size;
+	float					growth;
+	float					fadeInTime;
+	float					fadeOutEnd;
+	float					fadeOutTime;
+	GLfloat					color[4];
+	float					redShift;
+	float					drawDistance2;		// 0 for no distance fade.
+	float					colorFadeRate;
+	uint8_t					colorOrder;
+} OOParticleSpec;
+
+
+static BOOL PoolInit(OOParticlePool *pool, OOTexture *texture);
+static void PoolDestroy(OOParticlePool *pool);
+static BOOL PoolReserve(OOParticlePool *pool, NSUInteger needed);
+static void PoolAddParticle(OOParticlePool *pool, const OOParticleSpec *spec);
+static void PoolMoveParticle(OOParticlePool *pool, NSUInteger from, NSUInteger to);
+static void PoolUpdate(OOParticlePool *pool, OOTimeDelta delta_t);
+static void MoveParticles(NSUInteger count, double delta_t, double * restrict x, double * restrict y, double * restrict z, const float * restrict vx, const float * restrict vy, const float * restrict vz);
+static void AgeParticles(NSUInteger count, float dt, float * restrict age, float * restrict size, const float * restrict growth, const float * restrict fadeInBase, const float * restrict fadeInRate, const float * restrict fadeOutBase, const float * restrict fadeOutRate, float * restrict fade);
+static void PoolFadeColors(OOParticlePool *pool, float dt);
+static NSUInteger PoolFillVertices(OOParticlePool *pool, HPVector viewpoint, double lag, Vector right, Vector up, Vector back, GLfloat minRange, GLfloat maxRange, GLfloat *vertices, GLfloat *colors);
+
+static OOParticleSpec ParticleSpec(HPVector position, Vector velocity, float size, float lifetime);
+static float LightParticleDrawDistance2(float diameter);
+static float RandomSpeed(float minSpeed, float maxSpeed);
+static void JitterColor(const GLfloat baseColor[4], GLfloat outColor[4]);
+
+
+@interface OOParticleEngine (OOPrivate)
+
+- (OOParticlePool *) poolForTexture:(OOTexture *)texture;
+- (BOOL) reserveVertexCapacity:(NSUInteger)count;
+
+@end
+
+
+@implementation OOParticleEngine
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_blurTexture = [[OOLightParticleEntity defaultParticleTexture] retain];
+		_flashTexture = [[OOTexture textureWithName:@"oolite-particle-flash.png"
+										   inFolder:@"Textures"
+											options:kOOTextureMinFilterMipMap | kOOTextureMagFilterLinear | kOOTextureAlphaMask
+										 anisotropy:kOOTextureDefaultAnisotropy
+											lodBias:0.0] retain];
+
+		// Set up the pools used by most effects in advance.
+		[self poolForTexture:_blurTexture];
+		[self poolForTexture:_flashTexture];
+	}
+
+	return self;
+}
+
+
+- (void) dealloc
+{
+	NSUInteger i;
+	for (i = 0; i < _poolCount; i++)
+	{
+		PoolDestroy(&_pools[i]);
+	}
+	free(_pools);
+
+	free(_vertices);
+	free(_colors);
+	free(_texCoords);
+
+	DESTROY(_blurTexture);
+	DESTROY(_flashTexture);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%lu particles in %lu pools", (unsigned long)[self particleCount], (unsigned long)_poolCount];
+}
+
+
+- (void) update:(OOTimeDelta)delta_t
+{
+	NSUInteger i;
+
+	_lastDeltaT = delta_t;
+	for (i = 0; i < _poolCount; i++)
+	{
+		if (_pools[i].count != 0)  PoolUpdate(&_pools[i], delta_t);
+	}
+}
+
+
+- (void) removeAllParticles
+{
+	NSUInteger i;
+	for (i = 0; i < _poolCount; i++)
+	{
+		_pools[i].count = 0;
+	}
+}
+
+
+- (NSUInteger) particleCount
+{
+	NSUInteger i, count = 0;
+	for (i = 0; i < _poolCount; i++)
+	{
+		count += _pools[i].count;
+	}
+	return count;
+}
+
+
+- (void) beginRenderInterpolation:(double)fraction
+{
+	_renderLag = (1.0 - OOClamp_0_1_d(fraction)) * _lastDeltaT;
+}
+
+
+- (void) endRenderInterpolation
+{
+	_renderLag = 0.0;
+}
+
+
+- (void) drawFromViewpoint:(HPVector)viewpoint viewMatrix:(OOMatrix)viewMatrix minRange:(GLfloat)minRange maxRange:(GLfloat)maxRange
+{
+	OO_ENTER_OPENGL();
+
+	NSUInteger	i;
+	BOOL		began = NO;
+
+	/*	The world space directions of the eye space axes are the rows of the
+		view rotation. Quads are built from these, so that they face the
+		screen, and pulled towards the viewer by half their size so that
+		sparks and flashes on a hull aren't cut off by it.
+	*/
+	Vector right = make_vector(viewMatrix.m[0][0], viewMatrix.m[1][0], viewMatrix.m[2][0]);
+	Vector up = make_vector(viewMatrix.m[0][1], viewMatrix.m[1][1], viewMatrix.m[2][1]);
+	Vector back = make_vector(viewMatrix.m[0][2], viewMatrix.m[1][2], viewMatrix.m[2][2]);
+
+	for (i = 0; i < _poolCount; i++)
+	{
+		OOParticlePool *pool = &_pools[i];
+		if (pool->count == 0)  continue;
+		if (![self reserveVertexCapacity:pool->count])  continue;
+
+		NSUInteger quadCount = PoolFillVertices(pool, viewpoint, _renderLag, right, up, back, minRange, maxRange, _vertices, _colors);
+		if (quadCount == 0)  continue;
+
+		if (!began)
+		{
+			OOSetOpenGLState(OPENGL_STATE_ADDITIVE_BLENDING);
+			OOGL(glEnable(GL_TEXTURE_2D));
+			OOGL(glEnableClientState(GL_COLOR_ARRAY));
+			OOGL(glEnableClientState(GL_TEXTURE_COORD_ARRAY));
+			began = YES;
+		}
+
+		[pool->texture apply];
+		OOGL(glVertexPointer(3, GL_FLOAT, 0, _vertices));
+		OOGL(glColorPointer(4, GL_FLOAT, 0, _colors));
+		OOGL(glTexCoordPointer(2, GL_FLOAT, 0, _texCoords));
+		OOGL(glDrawArrays(GL_QUADS, 0, quadCount * 4));
+	}
+
+	if (began)
+	{
+		OOGL(glDisableClientState(GL_TEXTURE_COORD_ARRAY));
+		OOGL(glDisableClientState(GL_COLOR_ARRAY));
+		OOGL(glDisable(GL_TEXTURE_2D));
+		[OOTexture applyNone];
+
+		OOVerifyOpenGLState();
+		OOCheckOpenGLErrors(@"OOParticleEngine after drawing");
+	}
+}
+
+
+- (void) addSparkAt:(HPVector)position velocity:(Vector)velocity duration:(OOTimeDelta)duration size:(float)size color:(OOColor *)color
+{
+	OOParticlePool *pool = [self poolForTexture:_blurTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	OOParticleSpec spec = ParticleSpec(position, velocity, size, duration);
+	[color getRed:&spec.color[0] green:&spec.color[1] blue:&spec.color[2] alpha:&spec.color[3]];
+	spec.redShift = 1.0f;
+	spec.drawDistance2 = LightParticleDrawDistance2(size);
+	PoolAddParticle(pool, &spec);
+}
+
+
+- (void) addLaserFlashAt:(HPVector)position velocity:(Vector)velocity color:(OOColor *)color
+{
+	OOParticlePool *pool = [self poolForTexture:_flashTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	OOParticleSpec spec = ParticleSpec(position, velocity, kLaserFlashInitialSize, kLaserFlashDuration);
+	spec.growth = kFlashGrowthRateFactor * kLaserFlashInitialSize;
+	spec.fadeInTime = kLaserFlashDuration * 0.667f;
+	spec.fadeOutTime = kLaserFlashDuration - spec.fadeInTime;
+	[color getRed:&spec.color[0] green:&spec.color[1] blue:&spec.color[2] alpha:&spec.color[3]];
+	spec.color[3] = 1.0f;
+	spec.drawDistance2 = LightParticleDrawDistance2(kLaserFlashInitialSize);
+	PoolAddParticle(pool, &spec);
+}
+
+
+- (void) addExplosionFlashFromEntity:(Entity *)entity
+{
+	OOParticlePool *pool = [self poolForTexture:_flashTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	float size = [entity collisionRadius];
+	OOParticleSpec spec = ParticleSpec([entity position], [entity velocity], size, kExplosionFlashDuration);
+	spec.growth = fmax(kFlashGrowthRateFactor * size, kMinExplosionFlashGrowth);
+	spec.fadeInTime = kExplosionFlashDuration * 0.667f;
+	spec.fadeOutTime = kExplosionFlashDuration - spec.fadeInTime;
+	spec.color[3] = kExplosionFlashAlpha;
+	spec.drawDistance2 = LightParticleDrawDistance2(size);
+	PoolAddParticle(pool, &spec);
+}
+
+
+- (void) addPlasmaBurstAt:(HPVector)position
+{
+	OOParticlePool *pool = [self poolForTexture:_blurTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	OOParticleSpec spec = ParticleSpec(position, kZeroVector, kPlasmaBurstInitialSize, kPlasmaBurstDuration);
+	spec.growth = kPlasmaBurstGrowthRate;
+	spec.color[1] = spec.color[2] = 0.0f;
+	spec.drawDistance2 = LightParticleDrawDistance2(kPlasmaBurstInitialSize);
+	PoolAddParticle(pool, &spec);
+}
+
+
+- (void) addSmallFragmentBurstFromEntity:(Entity *)entity
+{
+	enum
+	{
+		kMinSpeed = 100, kMaxSpeed = 400
+	};
+
+	OOParticlePool *pool = [self poolForTexture:_blurTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	unsigned i, count = 0.4f * [entity collisionRadius];
+	count = MIN(count | 12, (unsigned)kSmallFragmentBurstMaxParticles);
+	PoolReserve(pool, pool->count + count);
+
+	// Select base colour
+	// yellow/orange (0.12) through yellow (0.1667) to yellow/slightly green (0.20)
+	OOColor *hsvColor = [OOColor colorWithHue:0.12f + 0.08f * randf() saturation:1.0f brightness:1.0f alpha:1.0f];
+	GLfloat baseColor[4];
+	[hsvColor getRed:&baseColor[0] green:&baseColor[1] blue:&baseColor[2] alpha:&baseColor[3]];
+
+	HPVector position = [entity position];
+	Vector velocity = [entity velocity];
+
+	for (i = 0; i < count; i++)
+	{
+		float speed = RandomSpeed(kMinSpeed, kMaxSpeed);
+
+		OOParticleSpec spec = ParticleSpec(position, vector_add(velocity, vector_multiply_scalar(OORandomUnitVector(), speed)), 32.0f * kMinSpeed / speed, 1.5f);
+		JitterColor(baseColor, spec.color);
+
+		/*	The first 33 particles fade out at staggered times, 0.5 + (32 - i)
+			/ 32 seconds. Any beyond that stay fully bright for the life of
+			the burst.
+		*/
+		if (i <= 32)
+		{
+			float fadeTime = (48.0f - i) / 32.0f;
+			spec.fadeOutEnd = spec.fadeOutTime = fadeTime;
+			if (fadeTime < spec.lifetime)  spec.lifetime = fadeTime;
+		}
+		else
+		{
+			spec.fadeOutTime = 0.0f;
+		}
+		PoolAddParticle(pool, &spec);
+	}
+}
+
+
+- (void) addBigFragmentBurstFromEntity:(Entity *)entity
+{
+	OOParticlePool *pool = [self poolForTexture:_blurTexture];
+	if (EXPECT_NOT(pool == NULL))  return;
+
+	const float		duration = 1.0f;
+	float			radius = [entity collisionRadius];
+	float			minSpeed = 1.0f + radius * 0.5f;
+	float			maxSpeed = minSpeed * 4.0f;
+	float			size = radius * 2.0f;	// Account for margins in particle texture.
+
+	unsigned i, count = 0.2f * radius;
+	count = MIN(count | 3, (unsigned)kBigFragmentBurstMaxParticles);
+	PoolReserve(pool, pool->count + count);
+
+	GLfloat baseColor[4] = { 1.0f, 1.0f, 0.5f, 1.0f };
+	HPVector position = [entity position];
+	Vector velocity = vector_multiply_scalar([entity velocity], 0.85);
+
+	for (i = 0; i < count; i++)
+	{
+		float speed = RandomSpeed(minSpeed, maxSpeed);
+		float fadeTime = duration * (0.5f + (float)i / (count - 1));
+
+		OOParticleSpec spec = ParticleSpec(position, vector_add(velocity, vector_multiply_scalar(OORandomUnitVector(), speed)), size, fmin(fadeTime, duration));
+		spec.growth = size;		// The burst grows to twice its size over one second.
+		JitterColor(baseColor, spec.color);
+		spec.fadeOutEnd = spec.fadeOutTime = fadeTime;
+		PoolAddParticle(pool, &spec);
+	}
+}
+
+
+- (void) addExplosionCloudFromEntity:(Entity *)entity position:(HPVector)position size:(float)size settings:(NSDictionary *)settings
+{
+	unsigned i, maxCount = [UNIVERSE detailLevel] <= DETAIL_LEVEL_SHADERS ? 10 : 25;
+
+	if (settings == nil)  settings = [NSDictionary dictionary];
+
+	unsigned count = [settings oo_unsignedIntForKey:kExplosionCount defaultValue:25];
+	if (count > maxCount)  count = maxCount;
+
+	if (size == 0.0f)
+	{
+		size = [entity collisionRadius] * [settings oo_floatForKey:kExplosionSize defaultValue:kExplosionDefaultSize];
+	}
+
+	float growthRate = [settings oo_floatForKey:kExplosionGrowth defaultValue:kExplosionCloudGrowthRateFactor] * size;
+	float alpha = [settings oo_floatForKey:kExplosionAlpha defaultValue:kExplosionCloudAlpha];
+	float brightness = [settings oo_floatForKey:kExplosionBrightness defaultValue:kExplosionBrightnessMult];
+	if (brightness < 1.0f)  brightness = 1.0f;
+	float duration = [settings oo_doubleForKey:kExplosionDuration defaultValue:kExplosionCloudDuration];
+	float spread = [settings oo_floatForKey:kExplosionSpread defaultValue:1.0];
+
+	NSString *textureFile = [settings oo_stringForKey:kExplosionTexture defaultValue:@"oolite-particle-cloud2.png"];
+	OOTexture *texture = [OOTexture textureWithName:textureFile
+										   inFolder:@"Textures"
+											options:kOOTextureMinFilterMipMap | kOOTextureMagFilterLinear | kOOTextureAlphaMask
+										 anisotropy:kOOTextureDefaultAnisotropy
+											lodBias:0.0];
+	if (texture == nil)  return;
+
+	OOParticlePool *pool = [self poolForTexture:texture];
+	if (EXPECT_NOT(pool == NULL))  return;
+	PoolReserve(pool, pool->count + count);
+
+	Vector velocity = [entity velocity];
+	if (magnitude2(velocity) > 1000000)
+	{
+		// slow down rapidly translating explosions
+		velocity = vector_multiply_scalar(vector_normal(velocity), 1000);
+	}
+
+	// Find the colour order; anything unrecognised gets the default colour, faded as rgb.
+	NSString	*colorOrderName = [settings oo_stringForKey:kExplosionColors defaultValue:@"rgb"];
+	BOOL		white = [colorOrderName isEqualToString:@"white"];
+	int			colorOrder = -1;
+	for (i = 0; i < sizeof kColorOrderNames / sizeof *kColorOrderNames; i++)
+	{
+		if ([colorOrderName isEqualToString:kColorOrderNames[i]])  colorOrder = i;
+	}
+
+	float colorFadeRate = white ? 0.0f : count * brightness / 25.0f;
+	if (colorFadeRate != 0.0f)  pool->fadesColors = YES;
+
+	for (i = 0; i < count; i++)
+	{
+		float speed = RandomSpeed(size * 0.8f * spread, size * 1.2f * spread);
+
+		// Particles start out as big as their speed.
+		OOParticleSpec spec = ParticleSpec(position, vector_add(velocity, vector_multiply_scalar(OORandomUnitVector(), speed)), speed, duration);
+		spec.growth = growthRate;
+
+		if (white)
+		{
+			// grey
+			spec.color[0] = spec.color[1] = spec.color[2] = randf();
+		}
+		else if (colorOrder >= 0)
+		{
+			float c1 = randf();
+			float c2 = randf();
+			float c3 = randf();
+			if (c2 > c1)  c2 = c1;
+			if (c3 > c2)  c3 = c2;
+
+			const uint8_t *order = kColorOrders[colorOrder];
+			spec.color[order[0]] = c1;
+			spec.color[order[1]] = c2;
+			spec.color[order[2]] = c3;
+			spec.colorOrder = colorOrder;
+		}
+		else
+		{
+			GLfloat defaultColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			JitterColor(defaultColor, spec.color);
+		}
+
+		spec.color[0] *= brightness;
+		spec.color[1] *= brightness;
+		spec.color[2] *= brightness;
+		spec.color[3] = alpha;
+		spec.colorFadeRate = colorFadeRate;
+
+		PoolAddParticle(pool, &spec);
+	}
+}
+
+@end
+
+
+@implementation OOParticleEngine (OOPrivate)
+
+- (OOParticlePool *) poolForTexture:(OOTexture *)texture
+{
+	NSUInteger i;
+	for (i = 0; i < _poolCount; i++)
+	{
+		if (_pools[i].texture == texture)  return &_pools[i];
+	}
+
+	if (_poolCount == _poolCapacity)
+	{
+		NSUInteger newCapacity = _poolCapacity ? _poolCapacity * 2 : 4;
+		OOParticlePool *newPools = realloc(_pools, sizeof *newPools * newCapacity);
+		if (EXPECT_NOT(newPools == NULL))  return NULL;
+		_pools = newPools;
+		_poolCapacity = newCapacity;
+	}
+
+	OOParticlePool *pool = &_pools[_poolCount];
+	if (EXPECT_NOT(!PoolInit(pool, texture)))  return NULL;
+	_poolCount++;
+
+	return pool;
+}
+
+
+- (BOOL) reserveVertexCapacity:(NSUInteger)count
+{
+	if (count <= _vertexCapacity)  return YES;
+
+	NSUInteger newCapacity = _vertexCapacity ? _vertexCapacity : kParticlePoolInitialCapacity;
+	while (newCapacity < count)  newCapacity *= 2;
+
+	GLfloat *vertices = realloc(_vertices, sizeof *vertices * 12 * newCapacity);
+	if (EXPECT_NOT(vertices == NULL))  return NO;
+	_vertices = vertices;
+	GLfloat *colors = realloc(_colors, sizeof *colors * 16 * newCapacity);
+	if (EXPECT_NOT(colors == NULL))  return NO;
+	_colors = colors;
+	GLfloat *texCoords = realloc(_texCoords, sizeof *texCoords * 8 * newCapacity);
+	if (EXPECT_NOT(texCoords == NULL))  return NO;
+	_texCoords = texCoords;
+
+	// Every quad has the same texture coordinates.
+	NSUInteger i;
+	for (i = _vertexCapacity; i < newCapacity; i++)
+	{
+		GLfloat *tc = &_texCoords[i * 8];
+		tc[0] = 0.0f;	tc[1] = 1.0f;
+		tc[2] = 1.0f;	tc[3] = 1.0f;
+		tc[4] = 1.0f;	tc[5] = 0.0f;
+		tc[6] = 0.0f;	tc[7] = 0.0f;
+	}
+
+	_vertexCapacity = newCapacity;
+	return YES;
+}
+
+@end
+
+
+static BOOL PoolInit(OOParticlePool *pool, OOTexture *texture)
+{
+	memset(pool, 0, sizeof *pool);
+	if (!PoolReserve(pool, kParticlePoolInitialCapacity))
+	{
+		PoolDestroy(pool);
+		return NO;
+	}
+	pool->texture = [texture retain];
+	return YES;
+}
+
+
+static void PoolDestroy(OOParticlePool *pool)
+{
+	unsigned i;
+	for (i = 0; i < kPoolArrayCount; i++)
+	{
+		free(*PoolArray(pool, i));
+		*PoolArray(pool, i) = NULL;
+	}
+	DESTROY(pool->texture);
+	pool->count = pool->capacity = 0;
+}
+
+
+static BOOL PoolReserve(OOParticlePool *pool, NSUInteger needed)
+{
+	if (needed <= pool->capacity)  return YES;
+	if (needed > kParticlePoolMaxCapacity)  needed = kParticlePoolMaxCapacity;
+	if (needed <= pool->capacity)  return NO;
+
+	NSUInteger newCapacity = pool->capacity ? pool->capacity : kParticlePoolInitialCapacity;
+	while (newCapacity < needed)  newCapacity *= 2;
+	if (newCapacity > kParticlePoolMaxCapacity)  newCapacity = kParticlePoolMaxCapacity;
+
+	/*	If an allocation fails, the arrays that were grown are merely bigger
+		than necessary.
+	*/
+	unsigned i;
+	for (i = 0; i < kPoolArrayCount; i++)
+	{
+		char **array = PoolArray(pool, i);
+		char *newArray = realloc(*array, kPoolArrays[i].size * newCapacity);
+		if (EXPECT_NOT(newArray == NULL))  return NO;
+		*array = newArray;
+	}
+
+	pool->capacity = newCapacity;
+	return YES;
+}
+
+
+static void PoolAddParticle(OOParticlePool *pool, const OOParticleSpec *spec)
+{
+	// When a pool is full, new particles are dropped.
+	if (EXPECT_NOT(pool->count == pool->capacity) && !PoolReserve(pool, pool->count + 1))  return;
+
+	NSUInteger i = pool->count++;
+
+	pool->x[i] = spec->position.x;
+	pool->y[i] = spec->position.y;
+	pool->z[i] = spec->position.z;
+	pool->vx[i] = spec->velocity.x;
+	pool->vy[i] = spec->velocity.y;
+	pool->vz[i] = spec->velocity.z;
+	pool->age[i] = 0.0f;
+	pool->lifetime[i] = spec->lifetime;
+	pool->size[i] = spec->size;
+	pool->growth[i] = spec->growth;
+
+	if (spec->fadeInTime > 0.0f)
+	{
+		pool->fadeInBase[i] = 0.0f;
+		pool->fadeInRate[i] = 1.0f / spec->fadeInTime;
+	}
+	else
+	{
+		pool->fadeInBase[i] = 1.0f;
+		pool->fadeInRate[i] = 0.0f;
+	}
+	if (spec->fadeOutTime > 0.0f)
+	{
+		pool->fadeOutBase[i] = spec->fadeOutEnd / spec->fadeOutTime;
+		pool->fadeOutRate[i] = 1.0f / spec->fadeOutTime;
+	}
+	else
+	{
+		pool->fadeOutBase[i] = 1.0f;
+		pool->fadeOutRate[i] = 0.0f;
+	}
+	pool->fade[i] = OOClamp_0_1_f(fmin(pool->fadeInBase[i], pool->fadeOutBase[i]));
+
+	pool->r[i] = spec->color[0];
+	pool->g[i] = spec->color[1];
+	pool->b[i] = spec->color[2];
+	pool->a[i] = spec->color[3];
+	pool->redShift[i] = spec->redShift;
+	pool->attenuation[i] = (spec->drawDistance2 > 0.0f) ? 1.0f / spec->drawDistance2 : 0.0f;
+	pool->colorFadeRate[i] = spec->colorFadeRate;
+	pool->colorOrder[i] = spec->colorOrder;
+}
+
+
+static void PoolMoveParticle(OOParticlePool *pool, NSUInteger from, NSUInteger to)
+{
+	unsigned i;
+	for (i = 0; i < kPoolArrayCount; i++)
+	{
+		char *array = *PoolArray(pool, i);
+		size_t size = kPoolArrays[i].size;
+		memcpy(array + to * size, array + from * size, size);
+	}
+}
+
+
+static void PoolUpdate(OOParticlePool *pool, OOTimeDelta delta_t)
+{
+	NSUInteger	i, count = pool->count;
+	float		dt = delta_t;
+
+	MoveParticles(count, delta_t, pool->x, pool->y, pool->z, pool->vx, pool->vy, pool->vz);
+	AgeParticles(count, dt, pool->age, pool->size, pool->growth, pool->fadeInBase, pool->fadeInRate, pool->fadeOutBase, pool->fadeOutRate, pool->fade);
+	if (pool->fadesColors)  PoolFadeColors(pool, dt);
+
+	// Remove expired particles, filling each gap with the last particle.
+	for (i = count; i-- > 0; )
+	{
+		if (pool->age[i] >= pool->lifetime[i])
+		{
+			count--;
+			if (i != count)  PoolMoveParticle(pool, count, i);
+		}
+	}
+	pool->count = count;
+}
+
+
+/*	MoveParticles() and AgeParticles() are the bulk of the work. They take
+	their arrays as restrict parameters and have no branches, so that the
+	compiler can vectorise them.
+*/
+static void MoveParticles(NSUInteger count, double delta_t, double * restrict x, double * restrict y, double * restrict z, const float * restrict vx, const float * restrict vy, const float * restrict vz)
+{
+	NSUInteger i;
+	for (i = 0; i < count; i++)
+	{
+		x[i] += vx[i] * delta_t;
+		y[i] += vy[i] * delta_t;
+		z[i] += vz[i] * delta_t;
+	}
+}
+
+
+static void AgeParticles(NSUInteger count, float dt, float * restrict age, float * restrict size, const float * restrict growth, const float * restrict fadeInBase, const float * restrict fadeInRate, const float * restrict fadeOutBase, const float * restrict fadeOutRate, float * restrict fade)
+{
+	NSUInteger i;
+	for (i = 0; i < count; i++)
+	{
+		float t = age[i] + dt;
+		age[i] = t;
+		size[i] += growth[i] * dt;
+
+		float fadeIn = fadeInBase[i] + t * fadeInRate[i];
+		float fadeOut = fadeOutBase[i] - t * fadeOutRate[i];
+		float f = (fadeIn < fadeOut) ? fadeIn : fadeOut;
+		f = (f > 0.0f) ? f : 0.0f;
+		fade[i] = (f < 1.0f) ? f : 1.0f;
+	}
+}
+
+
+static void PoolFadeColors(OOParticlePool *pool, float dt)
+{
+	NSUInteger	i, count = pool->count;
+	float		*channels[3] = { pool->r, pool->g, pool->b };
+
+	for (i = 0; i < count; i++)
+	{
+		float rate = pool->colorFadeRate[i] * dt;
+		if (rate == 0.0f)  continue;
+
+		const uint8_t *order = kColorOrders[pool->colorOrder[i]];
+		float *primary = &channels[order[0]][i];
+		float *secondary = &channels[order[1]][i];
+		float *tertiary = &channels[order[2]][i];
+
+		if (*tertiary > 0.0f)		// fade blue (white to yellow)
+		{
+			*tertiary = fmax(*tertiary - 0.5f * rate, 0.0f);
+		}
+		else if (*secondary > 0.0f)	// fade green (yellow to red)
+		{
+			*secondary = fmax(*secondary - rate, 0.0f);
+		}
+		else if (*primary > 0.0f)	// fade red (red to black)
+		{
+			*primary = fmax(*primary - 2.0f * rate, 0.0f);
+		}
+	}
+}
+
+
+static NSUInteger PoolFillVertices(OOParticlePool *pool, HPVector viewpoint, double lag, Vector right, Vector up, Vector back, GLfloat minRange, GLfloat maxRange, GLfloat *vertices, GLfloat *colors)
+{
+	NSUInteger	i, count = pool->count, quadCount = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		Vector relative =
+		{
+			pool->x[i] - pool->vx[i] * lag - viewpoint.x,
+			pool->y[i] - pool->vy[i] * lag - viewpoint.y,
+			pool->z[i] - pool->vz[i] * lag - viewpoint.z
+		};
+		float distance2 = magnitude2(relative);
+		float fade = pool->fade[i];
+		float alpha = pool->a[i] * fade * (1.0f - distance2 * pool->attenuation[i]);
+		if (alpha <= 0.0f)  continue;
+
+		float size = pool->size[i];
+		float range = sqrt(distance2) - size;
+		if (range < 0.0f)  range = 0.0f;
+		if (range < minRange || range >= maxRange)  continue;
+
+		Vector centre = vector_add(relative, vector_multiply_scalar(back, size * 0.5f));
+		Vector ri = vector_multiply_scalar(right, size);
+		Vector uj = vector_multiply_scalar(up, size);
+
+		GLfloat *v = &vertices[quadCount * 12];
+		v[0] = centre.x - ri.x - uj.x;	v[1] = centre.y - ri.y - uj.y;	v[2] = centre.z - ri.z - uj.z;
+		v[3] = centre.x + ri.x - uj.x;	v[4] = centre.y + ri.y - uj.y;	v[5] = centre.z + ri.z - uj.z;
+		v[6] = centre.x + ri.x + uj.x;	v[7] = centre.y + ri.y + uj.y;	v[8] = centre.z + ri.z + uj.z;
+		v[9] = centre.x - ri.x + uj.x;	v[10] = centre.y - ri.y + uj.y;	v[11] = centre.z - ri.z + uj.z;
+
+		// Sparks fade towards red.
+		float shift = pool->redShift[i] * (1.0f - fade);
+		GLfloat r = pool->r[i] + shift * (1.0f - pool->r[i]);
+		GLfloat g = pool->g[i] * (1.0f - shift);
+		GLfloat b = pool->b[i] * (1.0f - shift);
+
+		GLfloat *c = &colors[quadCount * 16];
+		unsigned j;
+		for (j = 0; j < 4; j++)
+		{
+			c[j * 4 + 0] = r;
+			c[j * 4 + 1] = g;
+			c[j * 4 + 2] = b;
+			c[j * 4 + 3] = alpha;
+		}
+
+		quadCount++;
+	}
+
+	return quadCount;
+}
+
+
+static OOParticleSpec ParticleSpec(HPVector position, Vector velocity, float size, float lifetime)
+{
+	OOParticleSpec spec =
+	{
+		.position = position,
+		.velocity = velocity,
+		.lifetime = lifetime,
+		.size = size,
+		.fadeOutEnd = lifetime,
+		.fadeOutTime = lifetime,
+		.color = { 1.0f, 1.0f, 1.0f, 1.0f }
+	};
+	return spec;
+}
+
+
+static float LightParticleDrawDistance2(float diameter)
+{
+	float result = pow(diameter / 2.0, M_SQRT2) * NO_DRAW_DISTANCE_FACTOR * NO_DRAW_DISTANCE_FACTOR;
+	return result * ([UNIVERSE reducedDetail] ? kParticleDistanceScaleLow : kParticleDistanceScaleHigh);
+}
+
+
+static float RandomSpeed(float minSpeed, float maxSpeed)
+{
+	// speed tends toward middle of range
+	return minSpeed + 0.5f * (randf() + randf()) * (maxSpeed - minSpeed);
+}
+
+
+static void JitterColor(const GLfloat baseColor[4], GLfloat outColor[4])
+{
+	Vector color = make_vector(baseColor[0] * 0.1f * (9.5f + randf()), baseColor[1] * 0.1f * (9.5f + randf()), baseColor[2] * 0.1f * (9.5f + randf()));
+	color = vector_normal(color);
+	outColor[0] = color.x;
+	outColor[1] = color.y;
+	outColor[2] = color.z;
+	outColor[3] = baseColor[3];
+}
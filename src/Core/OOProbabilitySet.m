@@ -36,8 +36,14 @@ two parallel arrays, one of objects and one of cumulative weights. The
 weight of the entry to the left (i.e., with a lower index), with the implicit
 entry -1 having a cumulative weight of 0. Since weight cannot be negative,
 this means that cumulative weights increase to the right (not strictly
-increasing, though, since weights may be zero). We can thus find an object
-with a given cumulative weight through a binary search.
+increasing, though, since weights may be zero). The cumulative weights are
+used to recover individual weights and for property list conversion.
+
+Random selection uses Walker's alias method (as set up by Vose's algorithm),
+so it takes constant time regardless of the number of objects. Each index has
+a probability and an alias: a random draw picks an index uniformly, then
+picks either that index or its alias according to the probability. Objects
+with zero weight are never chosen.
 
 OOConcreteMutableProbabilitySet is a naïve implementation using arrays. It
 could be optimized, but isn't expected to be used much except for building
@@ -95,8 +101,13 @@ static NSString * const	kWeightsKey = @"weights";
 	NSUInteger			_count;
 	id					*_objects;
 	float				*_cumulativeWeights;	// Each cumulative weight is weight of object at this index + weight of all objects to left.
+	float				*_aliasProbabilities;	// Probability of choosing the object at this index rather than its alias.
+	NSUInteger			*_aliases;
 	float				_sumOfWeights;
 }
+
+- (BOOL) privBuildAliasTableWithWeights:(float *)weights;
+
 @end
 
 
@@ -543,12 +554,107 @@ static OOEmptyProbabilitySet *sOOEmptyProbabilitySetSingleton = nil;
 		}
 		_count = count;
 		_sumOfWeights = cuWeight;
+		
+		if (![self privBuildAliasTableWithWeights:weights])
+		{
+			[self release];
+			return nil;
+		}
 	}
 	
 	return self;
 }
 
 
+- (BOOL) privBuildAliasTableWithWeights:(float *)weights
+{
+	/*	Vose's algorithm: scale the weights so that they average 1, then
+		repeatedly fill up an underfull column with the excess from an
+		overfull one. Scaling is done in double precision so that rounding
+		errors are unlikely to leave stragglers.
+	*/
+	NSUInteger				i, heaviest = 0;
+	NSUInteger				*small = NULL, *large = NULL;
+	NSUInteger				smallCount = 0, largeCount = 0;
+	double					*scaled = NULL;
+	BOOL					OK = YES;
+	
+	_aliasProbabilities = malloc(sizeof *_aliasProbabilities * _count);
+	_aliases = malloc(sizeof *_aliases * _count);
+	scaled = malloc(sizeof *scaled * _count);
+	small = malloc(sizeof *small * _count);
+	large = malloc(sizeof *large * _count);
+	if (_aliasProbabilities == NULL || _aliases == NULL || scaled == NULL || small == NULL || large == NULL)
+	{
+		OK = NO;
+		goto END;
+	}
+	
+	if (_sumOfWeights <= 0.0f)
+	{
+		// randomObject always returns nil, so the table is never used.
+		for (i = 0; i < _count; ++i)
+		{
+			_aliasProbabilities[i] = 0.0f;
+			_aliases[i] = i;
+		}
+		goto END;
+	}
+	
+	for (i = 0; i < _count; ++i)
+	{
+		scaled[i] = (double)weights[i] * _count / _sumOfWeights;
+		if (weights[i] > weights[heaviest])  heaviest = i;
+		if (scaled[i] < 1.0)  small[smallCount++] = i;
+		else  large[largeCount++] = i;
+	}
+	
+	while (smallCount != 0 && largeCount != 0)
+	{
+		NSUInteger less = small[--smallCount];
+		NSUInteger more = large[largeCount - 1];
+		
+		_aliasProbabilities[less] = scaled[less];
+		_aliases[less] = more;
+		
+		scaled[more] -= 1.0 - scaled[less];
+		if (scaled[more] < 1.0)
+		{
+			--largeCount;
+			small[smallCount++] = more;
+		}
+	}
+	
+	// Whatever is left over is full, give or take rounding error.
+	while (largeCount != 0)
+	{
+		i = large[--largeCount];
+		_aliasProbabilities[i] = 1.0f;
+		_aliases[i] = i;
+	}
+	while (smallCount != 0)
+	{
+		i = small[--smallCount];
+		if (weights[i] > 0.0f)
+		{
+			_aliasProbabilities[i] = 1.0f;
+			_aliases[i] = i;
+		}
+		else
+		{
+			_aliasProbabilities[i] = 0.0f;
+			_aliases[i] = heaviest;
+		}
+	}
+	
+END:
+	free(scaled);
+	free(small);
+	free(large);
+	return OK;
+}
+
+
 - (void) dealloc
 {
 	NSUInteger				i = 0;
@@ -569,6 +675,11 @@ static OOEmptyProbabilitySet *sOOEmptyProbabilitySetSingleton = nil;
 		_cumulativeWeights = NULL;
 	}
 	
+	free(_aliasProbabilities);
+	_aliasProbabilities = NULL;
+	free(_aliases);
+	_aliases = NULL;
+	
 	[super dealloc];
 }
 
@@ -601,49 +712,20 @@ static OOEmptyProbabilitySet *sOOEmptyProbabilitySetSingleton = nil;
 }
 
 
-- (id) privObjectForWeight:(float)target
+- (id) randomObject
 {
-	/*	Select an object at random. This is a binary search in the cumulative
-		weights array. Since weights of zero are allowed, there may be several
-		objects with the same cumulative weight, in which case we select the
-		leftmost, i.e. the one where the delta is non-zero.
-	*/
-	
-	NSUInteger					low = 0, high = _count - 1, idx = 0;
-	float						weight = 0.0f;
-	
-	while (low < high)
-	{
-		idx = (low + high) / 2;
-		weight = _cumulativeWeights[idx];
-		if (weight > target)
-		{
-			if (EXPECT_NOT(idx == 0))  break;
-			high = idx - 1;
-		}
-		else if (weight < target)  low = idx + 1;
-		else break;
-	}
+	if (_sumOfWeights <= 0.0f)  return nil;
 	
-	if (weight > target)
-	{
-		while (idx > 0 && _cumulativeWeights[idx - 1] >= target)  --idx;
-	}
-	else
-	{
-		while (idx < (_count - 1) && _cumulativeWeights[idx] < target)  ++idx;
-	}
+	/*	A single 31-bit random number provides both the column (high part of
+		the product) and the position within the column (low part).
+	*/
+	uint64_t				scaled = (uint64_t)(Ranrot() & 0x7FFFFFFF) * _count;
+	NSUInteger				idx = (NSUInteger)(scaled >> 31);
+	float					fraction = (float)(scaled & 0x7FFFFFFF) * (1.0f / 2147483648.0f);
 	
 	assert(idx < _count);
-	id result = _objects[idx];
-	return result;
-}
-
-
-- (id) randomObject
-{
-	if (_sumOfWeights <= 0.0f)  return nil;
-	return [self privObjectForWeight:randf() * _sumOfWeights];
+	if (fraction < _aliasProbabilities[idx])  return _objects[idx];
+	return _objects[_aliases[idx]];
 }
 
 
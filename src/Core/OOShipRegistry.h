@@ -28,6 +28,7 @@ SOFTWARE.
 */
 
 #import "OOCocoa.h"
+#import "OOShipTemplate.h"
 
 @class OOProbabilitySet;
 
@@ -40,6 +41,8 @@ SOFTWARE.
 	NSArray					*_demoShips;
 	NSArray					*_playerShips;
 	NSDictionary			*_probabilitySets;
+	NSMutableDictionary		*_shipTemplates;
+	id						_adHocShipTemplate;
 }
 
 + (OOShipRegistry *) sharedRegistry;
@@ -52,6 +55,15 @@ SOFTWARE.
 - (NSDictionary *) shipyardInfoForKey:(NSString *)key;
 - (OOProbabilitySet *) probabilitySetForRole:(NSString *)role;
 
+/*	Compiled template for setting up a ship from definition, which would
+	usually be [self shipInfoForKey:key]. Templates for registry entries are
+	cached; for any other definition, a template is compiled on the spot and
+	the most recent one is kept, since a ship's set-up methods ask for it
+	more than once. The returned template remains valid at least until the
+	current autorelease pool is drained.
+*/
+- (const OOShipTemplate *) shipTemplateForKey:(NSString *)key definition:(NSDictionary *)definition;
+
 - (NSArray *) demoShipKeys;
 - (NSArray *) playerShipKeys;
 
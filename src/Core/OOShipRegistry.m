@@ -45,8 +45,6 @@ SOFTWARE.
 
 #import "OODebugStandards.h"
 
-#define PRELOAD 0
-
 
 static void DumpStringAddrs(NSDictionary *dict, NSString *context);
 static NSComparisonResult SortDemoShipsByName (id a, id b, void* context);
@@ -65,8 +63,25 @@ static NSString * const	kVisualEffectRegistryCacheName = @"visual effect registr
 static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 
 
+/*	Owner of a compiled OOShipTemplate, so that templates can be kept in
+	collections and outlive their replacement until the current autorelease
+	pool is drained.
+*/
+@interface OOShipTemplateHolder: NSObject
+{
+@public
+	OOShipTemplate			_template;
+	NSString				*_key;
+}
+
+- (id) initWithKey:(NSString *)key definition:(NSDictionary *)definition;
+
+@end
+
+
 @interface OOShipRegistry (OODataLoader)
 
+- (void) discardShipTemplates;
 - (void) loadShipData;
 - (void) loadDemoShipConditions;
 - (void) loadDemoShips;
@@ -82,9 +97,7 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 - (BOOL) removeUnusableEntries:(NSMutableDictionary *)ioData shipMode:(BOOL)shipMode;
 - (BOOL) sanitizeConditions:(NSMutableDictionary *)ioData;
 
-#if PRELOAD
 - (BOOL) preloadShipMeshes:(NSMutableDictionary *)ioData;
-#endif
 
 - (NSMutableDictionary *) mergeShip:(NSDictionary *)child withParent:(NSDictionary *)parent;
 - (void) mergeShipRoles:(NSString *)roles forShipKey:(NSString *)shipKey intoProbabilityMap:(NSMutableDictionary *)probabilitySets;
@@ -139,6 +152,7 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 		/* CIM: 'release' doesn't work - the class definition
 		 * overrides it, so this leaks memory. Needs a proper reset
 		 * method for reloading the ship registry data instead */
+		[sSingleton discardShipTemplates];
 		[sSingleton release];
 		sSingleton = nil;
 		
@@ -199,6 +213,8 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 	[_demoShips release];
 	[_playerShips release];
 	[_probabilitySets release];
+	[_shipTemplates release];
+	[_adHocShipTemplate release];
 	
 	[super dealloc];
 }
@@ -216,6 +232,58 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 	[mutableDict setObject:OODeepCopy(newShipData) forKey:key];
 	DESTROY(_shipData);
 	_shipData = [[NSDictionary dictionaryWithDictionary:mutableDict] retain];
+	
+	// Ships being set up may still be using the old template.
+	[[[_shipTemplates objectForKey:key] retain] autorelease];
+	[_shipTemplates removeObjectForKey:key];
+}
+
+
+- (const OOShipTemplate *) shipTemplateForKey:(NSString *)key definition:(NSDictionary *)definition
+{
+	OOShipTemplateHolder	*holder = nil;
+	
+	if (definition == nil)  return NULL;
+	
+	if (key != nil && definition == [_shipData objectForKey:key])
+	{
+		holder = [_shipTemplates objectForKey:key];
+		if (holder == nil)
+		{
+			holder = [[OOShipTemplateHolder alloc] initWithKey:key definition:definition];
+			if (holder == nil)  return NULL;
+			if (_shipTemplates == nil)  _shipTemplates = [[NSMutableDictionary alloc] init];
+			[_shipTemplates setObject:holder forKey:key];
+			[holder release];
+		}
+		return &holder->_template;
+	}
+	
+	/*	Ad-hoc definitions are compiled from an immutable copy, so a mutable
+		definition never matches the previous template and is always
+		recompiled, while an immutable one is found again by identity.
+	*/
+	holder = _adHocShipTemplate;
+	if (holder == nil || holder->_template.shipInfo != definition || !(key == holder->_key || [key isEqualToString:holder->_key]))
+	{
+		NSDictionary *frozen = [definition copy];
+		holder = [[OOShipTemplateHolder alloc] initWithKey:key definition:frozen];
+		[frozen release];
+		if (holder == nil)  return NULL;
+		
+		[_adHocShipTemplate autorelease];
+		_adHocShipTemplate = holder;
+	}
+	return &holder->_template;
+}
+
+
+- (void) discardShipTemplates
+{
+	[_shipTemplates autorelease];
+	_shipTemplates = nil;
+	[_adHocShipTemplate autorelease];
+	_adHocShipTemplate = nil;
 }
 
 
@@ -281,6 +349,34 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 @end
 
 
+@implementation OOShipTemplateHolder
+
+- (id) initWithKey:(NSString *)key definition:(NSDictionary *)definition
+{
+	if ((self = [super init]))
+	{
+		_key = [key copy];
+		if (!OOShipTemplateCompile(&_template, key, definition))
+		{
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+
+- (void) dealloc
+{
+	OOShipTemplateDestroy(&_template);
+	[_key release];
+	
+	[super dealloc];
+}
+
+@end
+
+
 @implementation OOShipRegistry (OODataLoader)
 
 /*	-loadShipData
@@ -343,11 +439,9 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 	if (![self sanitizeConditions:result])  return;
 	OOLog(@"shipData.load.progress", @"%@", @"Finished validating data...");
 	
-#if PRELOAD
 	// Preload and cache meshes.
 	if (![self preloadShipMeshes:result])  return;
 	OOLog(@"shipData.load.progress", @"%@", @"Finished loading meshes...");
-#endif
 	
 	_shipData = OODeepCopy(result);
 	[[OOCacheManager sharedCache] setObject:_shipData forKey:kShipDataCacheKey inCache:kShipRegistryCacheName];
@@ -1157,53 +1251,40 @@ static NSString * const	kVisualEffectDataCacheKey = @"visual effect data";
 }
 
 
-#if PRELOAD
+/*	Parse all ship models into the mesh cache, in parallel. This only warms
+	the cache: materials are set up, on the main thread, when a ship is
+	actually created. Since ship data is only rebuilt when the set of OXPs
+	changes, this is only done on the first run with a new set of OXPs.
+*/
 - (BOOL) preloadShipMeshes:(NSMutableDictionary *)ioData
 {
-	NSEnumerator			*shipKeyEnum = nil;
 	NSString				*shipKey = nil;
-	NSMutableDictionary		*shipEntry = nil;
-	BOOL					remove;
+	NSDictionary			*shipEntry = nil;
 	NSString				*modelName = nil;
-	OOMesh					*mesh = nil;
-	NSAutoreleasePool		*pool = nil;
-	NSUInteger				i = 0, count;
+	NSMutableSet			*smoothModels = nil;
+	NSMutableSet			*flatModels = nil;
+	NSUInteger				loaded;
 	
-	count = [ioData count];
+	if (![[NSUserDefaults standardUserDefaults] oo_boolForKey:@"preload-ship-meshes" defaultValue:YES])  return YES;
 	
-	// Preload ship meshes. (Iterates over a copy of keys since it mutates the dictionary.)
-	for (shipKeyEnum = [[ioData allKeys] objectEnumerator]; (shipKey = [shipKeyEnum nextObject]); )
+	smoothModels = [NSMutableSet set];
+	flatModels = [NSMutableSet set];
+	foreachkey (shipKey, ioData)
 	{
-		pool = [[NSAutoreleasePool alloc] init];
-		
-		[[GameController sharedController] setProgressBarValue:(float)i++ / (float)count];
-		
 		shipEntry = [ioData objectForKey:shipKey];
-		remove = NO;
-		
 		modelName = [shipEntry oo_stringForKey:@"model"];
-		mesh = [OOMesh meshWithName:modelName
-				 materialDictionary:[shipEntry oo_dictionaryForKey:@"materials"]
-				  shadersDictionary:[shipEntry oo_dictionaryForKey:@"shaders"]
-							 smooth:[shipEntry oo_boolForKey:@"smooth"]
-					   shaderMacros:nil
-				shaderBindingTarget:nil];
-		
-		[pool release];	// NOTE: mesh is now invalid, but pointer nil check is OK.
+		if (modelName == nil)  continue;
 		
-		if (mesh == nil)
-		{
-			// FIXME: what if it's a subentity? Need to rearrange things.
-			OOLogERR(@"shipData.load.error", @"model \"%@\" could not be loaded for ship \"%@\", removing.", modelName, shipKey);
-			[ioData removeObjectForKey:shipKey];
-		}
+		if ([shipEntry oo_boolForKey:@"smooth"])  [smoothModels addObject:modelName];
+		else  [flatModels addObject:modelName];
 	}
 	
-	[[GameController sharedController] setProgressBarValue:-1.0f];
+	loaded = [OOMesh preloadCacheForModels:[smoothModels allObjects] smooth:YES];
+	loaded += [OOMesh preloadCacheForModels:[flatModels allObjects] smooth:NO];
+	OOLog(@"shipData.load.meshes", @"Preloaded %lu meshes into the cache.", (unsigned long)loaded);
 	
 	return YES;
 }
-#endif
 
 
 - (void) mergeShipRoles:(NSString *)roles
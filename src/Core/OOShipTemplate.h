@@ -0,0 +1,219 @@
+/*
+
+OOShipTemplate.h
+
+Compiled form of a shipdata.plist entry.
+
+Setting up a ship used to mean looking up and converting several dozen keys
+of its shipdata dictionary, and re-parsing its subentity and exhaust
+declarations, every time one was spawned. An OOShipTemplate holds the result
+of doing that once: numeric fields are converted and defaulted, strings,
+colours, role sets, weapon types and weapon offsets are resolved to the
+objects the ship will hold, and subentity declarations are flattened into an
+array. ShipEntity's set-up methods read from a template and copy out of it.
+
+Templates for unmodified registry entries are built on first use and cached
+by OOShipRegistry (see -shipTemplateForKey:definition:). Ships set up from
+any other dictionary - scaled subentities, the player's ship, script-supplied
+definitions - get a template compiled for the occasion.
+
+Fuzzy booleans are stored as probabilities and are still rolled per ship, so
+spawned ships vary exactly as before.
+
+Templates are immutable once compiled and are only used on the main thread.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOMaths.h"
+#import "OOTypes.h"
+#import "Entity.h"
+#import "legacy_random.h"
+
+@class OOColor, OORoleSet, OOEquipmentType;
+
+
+typedef enum
+{
+	kOOShipTemplateSubentityStandard,
+	kOOShipTemplateSubentityBallTurret,
+	kOOShipTemplateSubentityFlasher
+} OOShipTemplateSubentityType;
+
+
+typedef struct OOShipTemplateSubentity
+{
+	OOShipTemplateSubentityType	type;
+	NSDictionary				*definition;		// Canonical subentity dictionary, for flashers and error messages.
+	NSString					*subentityKey;
+	HPVector					position;			// Unscaled.
+	Quaternion					orientation;
+	float						fireRate;			// Turrets only.
+	float						weaponEnergy;
+	float						weaponRange;
+	NSDictionary				*scriptInfo;
+	BOOL						isDock;
+	BOOL						allowDocking;
+	BOOL						disallowedDockingCollides;
+	BOOL						allowLaunching;
+	BOOL						isVirtualDock;
+	NSString					*dockLabel;
+} OOShipTemplateSubentity;
+
+
+typedef struct OOShipTemplate
+{
+	NSDictionary				*shipInfo;			// The dictionary the template was compiled from.
+
+	BOOL						isStation;			// As per -[Universe shipClassForShipDictionary:].
+
+	// Flight characteristics.
+	float						scaleFactor;
+	float						maxFlightSpeed;		// Only valid if hasMaxFlightSpeed; default depends on class.
+	BOOL						hasMaxFlightSpeed;
+	float						maxFlightRoll;
+	float						maxFlightPitch;
+	float						maxFlightYaw;
+	float						thrust;
+	float						injectorBurnRate;
+	float						injectorSpeedFactor;
+	float						hyperspaceMotorSpinTime;	// -1 if no hyperspace motor.
+	float						reactionTime;
+	float						accuracy;			// Out of range if not specified.
+
+	// Energy and damage.
+	float						maxEnergy;
+	float						energyRechargeRate;
+	BOOL						showDamage;
+	BOOL						throwSparks;
+	BOOL						isFrangible;
+	float						heatInsulation;		// Only valid if hasHeatInsulation; default depends on equipment.
+	BOOL						hasHeatInsulation;
+	float						density;
+	float						sunGlareFilter;
+
+	// Weapons.
+	OOWeaponFacingSet			weaponFacings;
+	OOEquipmentType				*forwardWeaponType;
+	OOEquipmentType				*aftWeaponType;
+	OOEquipmentType				*portWeaponType;
+	OOEquipmentType				*starboardWeaponType;
+	float						weaponEnergy;
+	BOOL						multiplyWeapons;
+	NSArray						*forwardWeaponOffset;	// Scaled.
+	NSArray						*aftWeaponOffset;
+	NSArray						*portWeaponOffset;
+	NSArray						*starboardWeaponOffset;
+	OOColor						*laserColor;		// nil for default.
+
+	unsigned					missiles;
+	unsigned					maxMissiles;
+	BOOL						hasMaxMissiles;		// Explicitly set in shipdata.
+	double						missileLoadTime;
+	NSString					*missileRole;
+
+	// Equipment probabilities, rolled per ship as fuzzy booleans.
+	float						hasECM;
+	float						hasScoop;
+	float						hasEscapePod;
+	float						hasCloakingDevice;
+	float						hasEnergyBombValue;	// has_energy_bomb as a plain float, which gates the roll.
+	float						hasEnergyBomb;
+	float						hasFuelInjection;
+	float						hasMilitaryJammer;
+	float						hasMilitaryScannerFilter;
+	float						hasShieldBooster;
+	float						hasShieldEnhancer;
+	float						fragmentChance;
+	float						noBoulders;
+	float						unpiloted;
+
+	BOOL						cloakPassive;
+	BOOL						cloakAutomatic;
+
+	// Cargo.
+	OOCargoQuantity				maxCargo;
+	OOCargoQuantity				extraCargo;
+	OOCargoQuantity				likelyCargo;
+	NSString					*cargoCarried;
+	NSString					*cargoType;
+	BOOL						hasScoopMessage;
+
+	// Identity.
+	NSString					*name;
+	NSString					*shipUniqueName;
+	NSString					*shipClassName;
+	NSString					*displayName;
+	NSString					*scanDescription;
+	OOScanClass					scanClass;
+	OORoleSet					*roleSet;			// Without "player".
+	NSString					*beaconCode;
+	NSString					*beaconLabel;
+	NSString					*pilot;
+	NSString					*scriptName;
+	NSString					*aiName;
+	NSDictionary				*scriptInfo;
+	NSArray						*explosionType;
+
+	float						scannerRange;
+	OOFuelQuantity				fuel;
+	OOCreditsQuantity			bounty;
+	uint8_t						escortCount;		// Clamped to MAX_ESCORTS.
+	BOOL						hasEscortRoles;
+	BOOL						isHulk;
+	BOOL						trackContacts;
+
+	// Appearance.
+	NSString					*modelName;
+	NSString					*meshCacheKey;
+	NSDictionary				*materials;
+	NSDictionary				*shaders;
+	BOOL						smooth;
+	OOColor						*exhaustEmissiveColor;
+	Quaternion					rotationalVelocity;
+	Vector						scoopPosition;		// Scaled.
+
+	NSArray						*exhaustDefinitions;	// Tokenized exhaust declarations.
+	NSUInteger					subentityCount;
+	OOShipTemplateSubentity		*subentities;
+} OOShipTemplate;
+
+
+/*	Fill in a template from a ship dictionary, retaining everything it
+	refers to. Fails only if memory can't be allocated.
+*/
+BOOL OOShipTemplateCompile(OOShipTemplate *outTemplate, NSString *shipKey, NSDictionary *shipInfo);
+
+// Release everything a compiled template holds.
+void OOShipTemplateDestroy(OOShipTemplate *shipTemplate);
+
+/*	The same for a single subentity declaration, for subentities which are
+	added outside shipdata (such as stations' virtual docks).
+*/
+void OOShipTemplateCompileSubentity(OOShipTemplateSubentity *outSubentity, NSDictionary *declaration) NONNULL_FUNC;
+void OOShipTemplateDestroySubentity(OOShipTemplateSubentity *subentity);
+
+
+// Roll a fuzzy boolean the same way -oo_fuzzyBooleanForKey: does.
+OOINLINE BOOL OOShipTemplateRoll(float probability)
+{
+	return randf() < probability;
+}
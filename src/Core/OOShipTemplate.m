@@ -0,0 +1,356 @@
+/*
+
+OOShipTemplate.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOShipTemplate.h"
+#import "ShipEntity.h"
+#import "OOCollectionExtractors.h"
+#import "OOConstToString.h"
+#import "OOStringParsing.h"
+#import "OORoleSet.h"
+#import "OOColor.h"
+
+
+static NSArray *CompileWeaponOffset(NSDictionary *shipInfo, NSString *key, BOOL multiply, float scaleFactor);
+static float FuzzyProbability(NSDictionary *shipInfo, NSString *key, float defaultValue);
+
+
+BOOL OOShipTemplateCompile(OOShipTemplate *outTemplate, NSString *shipKey, NSDictionary *shipInfo)
+{
+	OOShipTemplate		*t = outTemplate;
+	NSString			*string = nil;
+	NSArray				*array = nil;
+	NSUInteger			i, count;
+
+	memset(t, 0, sizeof *t);
+	t->shipInfo = [shipInfo retain];
+
+	// Class selection; note priority: is_carrier overrides isCarrier which overrides roles.
+	string = [shipInfo oo_stringForKey:@"roles"];
+	if (string != nil)
+	{
+		t->isStation = [string rangeOfString:@"station"].location != NSNotFound ||
+		[string rangeOfString:@"carrier"].location != NSNotFound;
+	}
+	t->isStation = [shipInfo oo_boolForKey:@"isCarrier" defaultValue:t->isStation];
+	t->isStation = [shipInfo oo_boolForKey:@"is_carrier" defaultValue:t->isStation];
+
+	// Flight characteristics.
+	t->scaleFactor = [shipInfo oo_floatForKey:@"model_scale_factor" defaultValue:1.0f];
+	t->hasMaxFlightSpeed = [shipInfo objectForKey:@"max_flight_speed"] != nil;
+	t->maxFlightSpeed = [shipInfo oo_floatForKey:@"max_flight_speed" defaultValue:0.0f];
+	t->maxFlightRoll = [shipInfo oo_floatForKey:@"max_flight_roll" defaultValue:2.0f];
+	t->maxFlightPitch = [shipInfo oo_floatForKey:@"max_flight_pitch" defaultValue:1.0f];
+	t->maxFlightYaw = [shipInfo oo_floatForKey:@"max_flight_yaw" defaultValue:t->maxFlightPitch];	// Note by default yaw == pitch
+	t->thrust = [shipInfo oo_floatForKey:@"thrust" defaultValue:15.0f];
+	t->injectorBurnRate = [shipInfo oo_floatForKey:@"injector_burn_rate" defaultValue:AFTERBURNER_BURNRATE];
+	t->injectorSpeedFactor = [shipInfo oo_floatForKey:@"injector_speed_factor" defaultValue:7.0f];
+	t->hyperspaceMotorSpinTime = [shipInfo oo_floatForKey:@"hyperspace_motor_spin_time" defaultValue:DEFAULT_HYPERSPACE_SPIN_TIME];
+	if (![shipInfo oo_boolForKey:@"hyperspace_motor" defaultValue:YES])  t->hyperspaceMotorSpinTime = -1;
+	t->reactionTime = [shipInfo oo_floatForKey:@"reaction_time" defaultValue:COMBAT_AI_STANDARD_REACTION_TIME];
+	t->accuracy = [shipInfo oo_floatForKey:@"accuracy" defaultValue:-100.0f];	// Out-of-range default
+
+	// Energy and damage.
+	t->maxEnergy = [shipInfo oo_floatForKey:@"max_energy" defaultValue:200.0f];
+	t->energyRechargeRate = [shipInfo oo_floatForKey:@"energy_recharge_rate" defaultValue:1.0f];
+	t->showDamage = [shipInfo oo_boolForKey:@"show_damage" defaultValue:(t->energyRechargeRate > 0)];
+	t->throwSparks = [shipInfo oo_boolForKey:@"throw_sparks" defaultValue:NO];
+	t->isFrangible = [shipInfo oo_boolForKey:@"frangible" defaultValue:YES];
+	t->hasHeatInsulation = [shipInfo objectForKey:@"heat_insulation"] != nil;
+	t->heatInsulation = [shipInfo oo_floatForKey:@"heat_insulation" defaultValue:1.0f];
+	t->density = [shipInfo oo_floatForKey:@"density" defaultValue:1.0f];
+	t->sunGlareFilter = [shipInfo oo_floatForKey:@"sun_glare_filter" defaultValue:0.97f];
+
+	// Weapons.
+	t->weaponFacings = [shipInfo oo_intForKey:@"weapon_facings" defaultValue:VALID_WEAPON_FACINGS] & VALID_WEAPON_FACINGS;
+	if (t->weaponFacings & WEAPON_FACING_FORWARD)
+	{
+		t->forwardWeaponType = [OOWeaponTypeFromString([shipInfo oo_stringForKey:@"forward_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]) retain];
+	}
+	if (t->weaponFacings & WEAPON_FACING_AFT)
+	{
+		t->aftWeaponType = [OOWeaponTypeFromString([shipInfo oo_stringForKey:@"aft_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]) retain];
+	}
+	if (t->weaponFacings & WEAPON_FACING_PORT)
+	{
+		t->portWeaponType = [OOWeaponTypeFromString([shipInfo oo_stringForKey:@"port_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]) retain];
+	}
+	if (t->weaponFacings & WEAPON_FACING_STARBOARD)
+	{
+		t->starboardWeaponType = [OOWeaponTypeFromString([shipInfo oo_stringForKey:@"starboard_weapon_type" defaultValue:@"EQ_WEAPON_NONE"]) retain];
+	}
+	t->weaponEnergy = [shipInfo oo_floatForKey:@"weapon_energy" defaultValue:0];
+
+	string = [shipInfo oo_stringForKey:@"weapon_mount_mode" defaultValue:@"single"];
+	t->multiplyWeapons = [string isEqualToString:@"multiply"];
+	BOOL singleWeapons = [string isEqualToString:@"single"];
+	t->forwardWeaponOffset = [CompileWeaponOffset(shipInfo, @"weapon_position_forward", !singleWeapons, t->scaleFactor) retain];
+	t->aftWeaponOffset = [CompileWeaponOffset(shipInfo, @"weapon_position_aft", !singleWeapons, t->scaleFactor) retain];
+	t->portWeaponOffset = [CompileWeaponOffset(shipInfo, @"weapon_position_port", !singleWeapons, t->scaleFactor) retain];
+	t->starboardWeaponOffset = [CompileWeaponOffset(shipInfo, @"weapon_position_starboard", !singleWeapons, t->scaleFactor) retain];
+	t->laserColor = [[OOColor brightColorWithDescription:[shipInfo objectForKey:@"laser_color"]] retain];
+
+	t->missiles = [shipInfo oo_intForKey:@"missiles" defaultValue:0];
+	t->hasMaxMissiles = [shipInfo objectForKey:@"max_missiles"] != nil;
+	t->maxMissiles = [shipInfo oo_intForKey:@"max_missiles" defaultValue:t->missiles];
+	t->missileLoadTime = fmax(0.0, [shipInfo oo_doubleForKey:@"missile_load_time" defaultValue:0.0]); // no negative load times
+	t->missileRole = [[shipInfo oo_stringForKey:@"missile_role"] retain];
+
+	// Equipment probabilities.
+	t->hasECM = FuzzyProbability(shipInfo, @"has_ecm", 0.0f);
+	t->hasScoop = FuzzyProbability(shipInfo, @"has_scoop", 0.0f);
+	t->hasEscapePod = FuzzyProbability(shipInfo, @"has_escape_pod", 0.0f);
+	t->hasCloakingDevice = FuzzyProbability(shipInfo, @"has_cloaking_device", 0.0f);
+	t->hasEnergyBombValue = [shipInfo oo_floatForKey:@"has_energy_bomb"];
+	t->hasEnergyBomb = FuzzyProbability(shipInfo, @"has_energy_bomb", 0.0f);
+	t->hasFuelInjection = FuzzyProbability(shipInfo, @"has_fuel_injection", 0.0f);
+	t->hasMilitaryJammer = FuzzyProbability(shipInfo, @"has_military_jammer", 0.0f);
+	t->hasMilitaryScannerFilter = FuzzyProbability(shipInfo, @"has_military_scanner_filter", 0.0f);
+	t->hasShieldBooster = FuzzyProbability(shipInfo, @"has_shield_booster", 0.0f);
+	t->hasShieldEnhancer = FuzzyProbability(shipInfo, @"has_shield_enhancer", 0.0f);
+	t->fragmentChance = FuzzyProbability(shipInfo, @"fragment_chance", 0.9f);
+	t->noBoulders = FuzzyProbability(shipInfo, @"no_boulders", 0.0f);
+	t->unpiloted = FuzzyProbability(shipInfo, @"unpiloted", 0.0f);
+
+	t->cloakPassive = [shipInfo oo_boolForKey:@"cloak_passive" defaultValue:YES];
+	t->cloakAutomatic = [shipInfo oo_boolForKey:@"cloak_automatic" defaultValue:YES];
+
+	// Cargo.
+	t->maxCargo = [shipInfo oo_unsignedIntForKey:@"max_cargo"];
+	t->extraCargo = [shipInfo oo_unsignedIntForKey:@"extra_cargo" defaultValue:15];
+	t->likelyCargo = [shipInfo oo_unsignedIntForKey:@"likely_cargo"];
+	t->cargoCarried = [[shipInfo oo_stringForKey:@"cargo_carried"] retain];
+	t->cargoType = [[shipInfo oo_stringForKey:@"cargo_type"] retain];
+	t->hasScoopMessage = [shipInfo oo_boolForKey:@"has_scoop_message" defaultValue:YES];
+
+	// Identity.
+	t->name = [[shipInfo oo_stringForKey:@"name" defaultValue:@"?"] copy];
+	t->shipUniqueName = [[shipInfo oo_stringForKey:@"ship_name" defaultValue:@""] copy];
+	t->shipClassName = [[shipInfo oo_stringForKey:@"ship_class_name" defaultValue:t->name] copy];
+	t->displayName = [[shipInfo oo_stringForKey:@"display_name" defaultValue:nil] copy];
+	t->scanDescription = [[shipInfo oo_stringForKey:@"scan_description" defaultValue:nil] copy];
+
+	// 'scanClass' is in common usage, but the more standard 'scan_class' takes precedence.
+	t->scanClass = OOScanClassFromString([shipInfo oo_stringForKey:@"scan_class" defaultValue:@"CLASS_NOT_SET"]);
+	if (t->scanClass == CLASS_NOT_SET)
+	{
+		t->scanClass = OOScanClassFromString([shipInfo oo_stringForKey:@"scanClass" defaultValue:@"CLASS_NOT_SET"]);
+	}
+
+	t->roleSet = [[[OORoleSet roleSetWithString:[shipInfo oo_stringForKey:@"roles"]] roleSetWithRemovedRole:@"player"] retain];
+	t->beaconCode = [[shipInfo oo_stringForKey:@"beacon"] retain];
+	t->beaconLabel = [[shipInfo oo_stringForKey:@"beacon_label" defaultValue:t->beaconCode] retain];
+	t->pilot = [[shipInfo oo_stringForKey:@"pilot"] retain];
+	t->scriptName = [[shipInfo oo_stringForKey:@"script"] retain];
+	t->aiName = [[shipInfo oo_stringForKey:@"ai_type" defaultValue:@"nullAI.plist"] retain];
+	t->scriptInfo = [[shipInfo oo_dictionaryForKey:@"script_info" defaultValue:nil] retain];
+	t->explosionType = [[shipInfo oo_arrayForKey:@"explosion_type" defaultValue:nil] retain];
+
+	t->scannerRange = [shipInfo oo_floatForKey:@"scanner_range" defaultValue:(float)SCANNER_MAX_RANGE];
+	t->fuel = [shipInfo oo_unsignedShortForKey:@"fuel"];
+	t->bounty = [shipInfo oo_unsignedIntForKey:@"bounty" defaultValue:0];
+	t->escortCount = MIN([shipInfo oo_unsignedCharForKey:@"escorts" defaultValue:0], (uint8_t)MAX_ESCORTS);
+	t->hasEscortRoles = [shipInfo oo_arrayForKey:@"escort_roles" defaultValue:nil] != nil;
+	t->isHulk = [shipInfo oo_boolForKey:@"is_hulk"];
+	t->trackContacts = [shipInfo oo_boolForKey:@"track_contacts" defaultValue:NO];
+
+	// Appearance.
+	t->modelName = [[shipInfo oo_stringForKey:@"model"] retain];
+	if (t->modelName != nil)
+	{
+		t->meshCacheKey = [[NSString alloc] initWithFormat:@"%@-%.3f", shipKey, t->scaleFactor];
+	}
+	t->materials = [[shipInfo oo_dictionaryForKey:@"materials"] retain];
+	t->shaders = [[shipInfo oo_dictionaryForKey:@"shaders"] retain];
+	t->smooth = [shipInfo oo_boolForKey:@"smooth" defaultValue:NO];
+
+	OOColor *color = [OOColor brightColorWithDescription:[shipInfo objectForKey:@"exhaust_emissive_color"]];
+	if (color == nil)
+	{
+		// pale blue is exhaust default color
+		OORGBAComponents defaultComponents = { 0.7f, 0.9f, 1.0f, 0.9f };
+		color = [OOColor colorWithRGBAComponents:defaultComponents];
+	}
+	t->exhaustEmissiveColor = [color retain];
+
+	t->rotationalVelocity = [shipInfo oo_quaternionForKey:@"rotational_velocity" defaultValue:kIdentityQuaternion];
+	t->scoopPosition = vector_multiply_scalar([shipInfo oo_vectorForKey:@"scoop_position"], t->scaleFactor);
+
+	// Exhausts and subentities.
+	array = [shipInfo oo_arrayForKey:@"exhaust"];
+	count = [array count];
+	if (count != 0)
+	{
+		NSMutableArray *exhausts = [NSMutableArray arrayWithCapacity:count];
+		for (i = 0; i < count; i++)
+		{
+			[exhausts addObject:ScanTokensFromString([array oo_stringAtIndex:i])];
+		}
+		t->exhaustDefinitions = [exhausts copy];
+	}
+
+	array = [shipInfo oo_arrayForKey:@"subentities"];
+	count = [array count];
+	if (count != 0)
+	{
+		t->subentities = calloc(count, sizeof *t->subentities);
+		if (t->subentities == NULL)
+		{
+			OOShipTemplateDestroy(t);
+			return NO;
+		}
+		t->subentityCount = count;
+		for (i = 0; i < count; i++)
+		{
+			OOShipTemplateCompileSubentity(&t->subentities[i], [array oo_dictionaryAtIndex:i]);
+		}
+	}
+
+	return YES;
+}
+
+
+void OOShipTemplateDestroy(OOShipTemplate *t)
+{
+	NSUInteger i;
+
+	if (t == NULL)  return;
+
+	for (i = 0; i < t->subentityCount; i++)
+	{
+		OOShipTemplateDestroySubentity(&t->subentities[i]);
+	}
+	free(t->subentities);
+
+	[t->shipInfo release];
+	[t->forwardWeaponType release];
+	[t->aftWeaponType release];
+	[t->portWeaponType release];
+	[t->starboardWeaponType release];
+	[t->forwardWeaponOffset release];
+	[t->aftWeaponOffset release];
+	[t->portWeaponOffset release];
+	[t->starboardWeaponOffset release];
+	[t->laserColor release];
+	[t->missileRole release];
+	[t->cargoCarried release];
+	[t->cargoType release];
+	[t->name release];
+	[t->shipUniqueName release];
+	[t->shipClassName release];
+	[t->displayName release];
+	[t->scanDescription release];
+	[t->roleSet release];
+	[t->beaconCode release];
+	[t->beaconLabel release];
+	[t->pilot release];
+	[t->scriptName release];
+	[t->aiName release];
+	[t->scriptInfo release];
+	[t->explosionType release];
+	[t->modelName release];
+	[t->meshCacheKey release];
+	[t->materials release];
+	[t->shaders release];
+	[t->exhaustEmissiveColor release];
+	[t->exhaustDefinitions release];
+
+	memset(t, 0, sizeof *t);
+}
+
+
+static NSArray *CompileWeaponOffset(NSDictionary *shipInfo, NSString *key, BOOL multiple, float scaleFactor)
+{
+	Vector		offset;
+
+	if (!multiple)
+	{
+		offset = vector_multiply_scalar([shipInfo oo_vectorForKey:key defaultValue:kZeroVector], scaleFactor);
+		return [NSArray arrayWithObject:[[[OONativeVector alloc] initWithVector:offset] autorelease]];
+	}
+
+	NSArray *offsets = [shipInfo oo_arrayForKey:key defaultValue:nil];
+	if (offsets == nil)
+	{
+		return [NSArray arrayWithObject:[[[OONativeVector alloc] initWithVector:kZeroVector] autorelease]];
+	}
+
+	NSMutableArray *output = [NSMutableArray arrayWithCapacity:[offsets count]];
+	NSUInteger i;
+	for (i = 0; i < [offsets count]; i++)
+	{
+		offset = vector_multiply_scalar([offsets oo_vectorAtIndex:i defaultValue:kZeroVector], scaleFactor);
+		[output addObject:[[[OONativeVector alloc] initWithVector:offset] autorelease]];
+	}
+	return [NSArray arrayWithArray:output];
+}
+
+
+void OOShipTemplateCompileSubentity(OOShipTemplateSubentity *sub, NSDictionary *declaration)
+{
+	NSString *type = [declaration oo_stringForKey:@"type"];
+
+	memset(sub, 0, sizeof *sub);
+	sub->definition = [declaration retain];
+	sub->position = [declaration oo_hpvectorForKey:@"position"];
+
+	if ([type isEqualToString:@"flasher"])
+	{
+		sub->type = kOOShipTemplateSubentityFlasher;
+		return;
+	}
+
+	sub->type = [type isEqualToString:@"ball_turret"] ? kOOShipTemplateSubentityBallTurret : kOOShipTemplateSubentityStandard;
+	sub->subentityKey = [[declaration oo_stringForKey:@"subentity_key"] retain];
+	sub->orientation = [declaration oo_quaternionForKey:@"orientation"];
+	sub->fireRate = [declaration oo_floatForKey:@"fire_rate" defaultValue:TURRET_SHOT_FREQUENCY];
+	sub->weaponEnergy = [declaration oo_floatForKey:@"weapon_energy" defaultValue:TURRET_TYPICAL_ENERGY];
+	sub->weaponRange = [declaration oo_floatForKey:@"weapon_range" defaultValue:TURRET_SHOT_RANGE];
+	sub->scriptInfo = [[declaration oo_dictionaryForKey:@"script_info"] retain];
+
+	sub->isDock = [declaration oo_boolForKey:@"is_dock"];
+	sub->allowDocking = [declaration oo_boolForKey:@"allow_docking" defaultValue:YES];
+	sub->disallowedDockingCollides = [declaration oo_boolForKey:@"disallowed_docking_collides" defaultValue:NO];
+	sub->allowLaunching = [declaration oo_boolForKey:@"allow_launching" defaultValue:YES];
+	// do not include this key in OOShipRegistry; should never be set by shipdata
+	sub->isVirtualDock = [declaration oo_boolForKey:@"_is_virtual_dock" defaultValue:NO];
+	sub->dockLabel = [[declaration oo_stringForKey:@"dock_label" defaultValue:@"the docking bay"] retain];
+}
+
+
+void OOShipTemplateDestroySubentity(OOShipTemplateSubentity *sub)
+{
+	if (sub == NULL)  return;
+
+	[sub->definition release];
+	[sub->subentityKey release];
+	[sub->scriptInfo release];
+	[sub->dockLabel release];
+	memset(sub, 0, sizeof *sub);
+}
+
+
+static float FuzzyProbability(NSDictionary *shipInfo, NSString *key, float defaultValue)
+{
+	return OOFuzzyBooleanProbabilityFromObject([shipInfo objectForKey:key], defaultValue);
+}
@@ -0,0 +1,79 @@
+/*
+
+OOSimulationBenchmark.h
+
+Command-line simulation benchmark and soak test.
+
+When Oolite is started with -simbench <seconds>, start-up proceeds as normal
+(including loading any commander passed with -load), but instead of starting
+the animation timer the game runs Universe -update: at a fixed timestep for
+the requested amount of simulated time, as fast as it can. Nothing is drawn,
+the HUD is not updated and sound is disabled. When the run is over, the tick
+rate and the time spent in each stage of -update: are written to the log and
+the game exits.
+
+Further options:
+	-simbench-rate <ticks per second>	Fixed timestep rate (default 60).
+	-simbench-seed <integer>			Random seed used for the run, so that
+										runs are as repeatable as possible
+										(default 0).
+	-simbench-combat <ships>			Start a fight between this many
+										pirates and police in front of the
+										player, for a tick with lots of
+										laser fire. The log then shows how
+										often the entity search index was
+										built, which should be at most once
+										per tick.
+
+Resource loading and material set-up need an OpenGL context, so one is still
+created, but on SDL builds it belongs to a hidden window on SDL's offscreen
+video driver and no display is needed. (Set SDL_VIDEO_DRIVER to use another
+driver.) OpenAL is not initialised at all.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+
+@interface OOSimulationBenchmark: NSObject
+
+/*	Returns YES if -simbench was passed on the command line. Safe to call
+	before anything else is set up; used to decide whether to run headless.
+*/
++ (BOOL) isRequested;
+
+/*	Returns YES if -simbench was passed on the command line, in which case
+	the benchmark has been run (or rejected with an error) and the caller
+	should exit. Must be called once the universe and player are set up.
+*/
++ (BOOL) runIfRequested;
+
+@end
+
+
+/*	Stage timing hook for Universe -update:. Each call ends the stage
+	currently being timed (if any) and starts timing the named stage; nil
+	just ends the current stage. Only call when
+	gOOSimulationBenchmarkActive is set.
+*/
+void OOSimulationBenchmarkNoteStage(NSString *stage);
+
+extern BOOL gOOSimulationBenchmarkActive;
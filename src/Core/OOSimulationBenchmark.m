@@ -0,0 +1,308 @@
+/*
+
+OOSimulationBenchmark.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOSimulationBenchmark.h"
+#import "OOProfilingStopwatch.h"
+#import "OOJSFrameCallbacks.h"
+#import "Universe.h"
+#import "PlayerEntity.h"
+#import "StationEntity.h"
+#import "legacy_random.h"
+
+
+#define kDefaultTickRate		60.0
+#define kMaxStages				32
+#define kCombatDistance			15000.0
+#define kCombatRadius			3000.0
+
+
+BOOL gOOSimulationBenchmarkActive = NO;
+
+
+typedef struct
+{
+	NSString				*name;
+	OOTimeDelta				total;
+	OOTimeDelta				worst;
+} OOSimulationBenchmarkStage;
+
+
+static OOSimulationBenchmarkStage	sStages[kMaxStages];
+static NSUInteger					sStageCount = 0;
+static NSInteger					sCurrentStage = -1;
+static OOHighResTimeValue			sStageStart;
+
+
+static NSString *ArgumentAfter(NSArray *arguments, NSString *option);
+static void ResetStages(void);
+static void StartCombat(PlayerEntity *player, unsigned shipsPerSide);
+static void LogResults(OOTimeDelta simulatedTime, NSUInteger ticks, OOTimeDelta wallTime, OOTimeDelta worstTick, NSUInteger laserRays, NSUInteger gridRebuilds);
+
+
+@implementation OOSimulationBenchmark
+
++ (BOOL) isRequested
+{
+	return [[[NSProcessInfo processInfo] arguments] containsObject:@"-simbench"];
+}
+
+
++ (BOOL) runIfRequested
+{
+	NSArray				*arguments = [[NSProcessInfo processInfo] arguments];
+	NSString			*arg = nil;
+	OOTimeDelta			duration, rate = kDefaultTickRate;
+	uint64_t			seed = 0;
+	int					combatShips = 0;
+
+	if (![self isRequested])  return NO;
+
+	arg = ArgumentAfter(arguments, @"-simbench");
+	duration = [arg doubleValue];
+	if (duration <= 0.0)
+	{
+		OOLog(@"simbench.badArguments", @"***** ERROR: -simbench must be followed by a positive number of simulated seconds.");
+		return YES;
+	}
+
+	arg = ArgumentAfter(arguments, @"-simbench-rate");
+	if (arg != nil)  rate = [arg doubleValue];
+	if (rate <= 0.0)
+	{
+		OOLog(@"simbench.badArguments", @"***** ERROR: -simbench-rate must be followed by a positive number of ticks per second.");
+		return YES;
+	}
+
+	arg = ArgumentAfter(arguments, @"-simbench-seed");
+	if (arg != nil)  seed = (uint64_t)[arg longLongValue];
+
+	arg = ArgumentAfter(arguments, @"-simbench-combat");
+	if (arg != nil)  combatShips = [arg intValue];
+	if (combatShips < 0)
+	{
+		OOLog(@"simbench.badArguments", @"***** ERROR: -simbench-combat must be followed by a number of ships per side.");
+		return YES;
+	}
+
+	OOTimeDelta			tickLength = 1.0 / rate;
+	NSUInteger			tick, tickCount = (NSUInteger)ceil(duration * rate);
+	OOTimeDelta			worstTick = 0.0;
+	PlayerEntity		*player = PLAYER;
+
+	OOLog(@"simbench.start", @"Running simulation benchmark: %g simulated seconds at %g ticks per second (%lu ticks), seed %llu.", duration, rate, (unsigned long)tickCount, seed);
+
+	OOInitReallyRandom(seed);
+	OOSetReallyRandomRANROTAndRndSeeds();
+
+	// A docked player would leave little to simulate.
+	if ([player status] == STATUS_DOCKED && [player dockedStation] != nil)
+	{
+		[player leaveDock:[player dockedStation]];
+	}
+	if (combatShips > 0)  StartCombat(player, combatShips);
+
+	ResetStages();
+	NSUInteger laserRaysAtStart = [UNIVERSE totalLaserRayCount];
+	NSUInteger gridRebuildsAtStart = [UNIVERSE entityQueryGridRebuildCount];
+	gOOSimulationBenchmarkActive = YES;
+
+	OOHighResTimeValue startTime = OOGetHighResTime();
+	OOHighResTimeValue tickStart = OOCopyHighResTime(startTime);
+
+	for (tick = 0; tick < tickCount; tick++)
+	{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+		@try
+		{
+			[UNIVERSE update:tickLength];
+			OOSimulationBenchmarkNoteStage(nil);
+			if (EXPECT_NOT([PLAYER status] == STATUS_RESTART_GAME))
+			{
+				OOLog(@"simbench.restart", @"Game restarted after %g simulated seconds.", tick * tickLength);
+				[UNIVERSE reinitAndShowDemo:YES];
+			}
+
+			OOSimulationBenchmarkNoteStage(@"frame callbacks");
+			OOJSFrameCallbacksInvoke(tickLength);
+			OOSimulationBenchmarkNoteStage(nil);
+		}
+		@catch (id exception)
+		{
+			OOSimulationBenchmarkNoteStage(nil);
+			OOLog(@"exception.backtrace", @"%@", [exception callStackSymbols]);
+		}
+
+		[pool release];
+
+		OOHighResTimeValue tickEnd = OOGetHighResTime();
+		OOTimeDelta thisTick = OOHighResTimeDeltaInSeconds(tickStart, tickEnd);
+		if (thisTick > worstTick)  worstTick = thisTick;
+		OODisposeHighResTime(tickStart);
+		tickStart = tickEnd;
+	}
+
+	gOOSimulationBenchmarkActive = NO;
+
+	OOTimeDelta wallTime = OOHighResTimeDeltaInSeconds(startTime, tickStart);
+	OODisposeHighResTime(startTime);
+	OODisposeHighResTime(tickStart);
+
+	LogResults(tickCount * tickLength, tickCount, wallTime, worstTick,
+			   [UNIVERSE totalLaserRayCount] - laserRaysAtStart,
+			   [UNIVERSE entityQueryGridRebuildCount] - gridRebuildsAtStart);
+
+	return YES;
+}
+
+@end
+
+
+void OOSimulationBenchmarkNoteStage(NSString *stage)
+{
+	OOHighResTimeValue now = OOGetHighResTime();
+
+	if (sCurrentStage >= 0)
+	{
+		OOTimeDelta elapsed = OOHighResTimeDeltaInSeconds(sStageStart, now);
+		sStages[sCurrentStage].total += elapsed;
+		if (elapsed > sStages[sCurrentStage].worst)  sStages[sCurrentStage].worst = elapsed;
+		sCurrentStage = -1;
+	}
+	OODisposeHighResTime(sStageStart);
+	sStageStart = now;
+
+	if (stage == nil)  return;
+
+	// Stage names are almost always constant strings, so try identity first.
+	NSUInteger i;
+	for (i = 0; i < sStageCount; i++)
+	{
+		if (sStages[i].name == stage)  break;
+	}
+	if (i == sStageCount)
+	{
+		for (i = 0; i < sStageCount; i++)
+		{
+			if ([sStages[i].name isEqualToString:stage])  break;
+		}
+	}
+	if (i == sStageCount)
+	{
+		if (sStageCount == kMaxStages)  return;
+		sStages[i].name = [stage copy];
+		sStages[i].total = 0.0;
+		sStages[i].worst = 0.0;
+		sStageCount++;
+	}
+
+	sCurrentStage = i;
+}
+
+
+static NSString *ArgumentAfter(NSArray *arguments, NSString *option)
+{
+	NSUInteger index = [arguments indexOfObject:option];
+	if (index == NSNotFound || index + 1 >= [arguments count])  return nil;
+	return [arguments objectAtIndex:index + 1];
+}
+
+
+static void ResetStages(void)
+{
+	NSUInteger i;
+	for (i = 0; i < sStageCount; i++)
+	{
+		DESTROY(sStages[i].name);
+	}
+	sStageCount = 0;
+	sCurrentStage = -1;
+}
+
+
+/*	Two groups of ships fighting each other in front of the player, so that
+	lots of laser shots are added and removed every tick.
+*/
+static void StartCombat(PlayerEntity *player, unsigned shipsPerSide)
+{
+	HPVector	centre = HPvector_add([player position], vectorToHPVector(vector_multiply_scalar([player forwardVector], kCombatDistance)));
+	NSArray		*pirates = [UNIVERSE addShipsAt:centre withRole:@"pirate" quantity:shipsPerSide withinRadius:kCombatRadius asGroup:YES];
+	NSArray		*police = [UNIVERSE addShipsAt:centre withRole:@"police" quantity:shipsPerSide withinRadius:kCombatRadius asGroup:YES];
+	NSUInteger	i, pirateCount = [pirates count], policeCount = [police count];
+
+	if (pirateCount == 0 || policeCount == 0)
+	{
+		OOLog(@"simbench.combat.failed", @"***** ERROR: could not set up the combat scenario (%lu pirates, %lu police).", (unsigned long)pirateCount, (unsigned long)policeCount);
+		return;
+	}
+
+	for (i = 0; i < MAX(pirateCount, policeCount); i++)
+	{
+		ShipEntity *pirate = [pirates objectAtIndex:i % pirateCount];
+		ShipEntity *cop = [police objectAtIndex:i % policeCount];
+		[pirate respondToAttackFrom:cop becauseOf:cop];
+		[cop respondToAttackFrom:pirate becauseOf:pirate];
+	}
+
+	OOLog(@"simbench.combat", @"Started combat between %lu pirates and %lu police.", (unsigned long)pirateCount, (unsigned long)policeCount);
+}
+
+
+static void LogResults(OOTimeDelta simulatedTime, NSUInteger ticks, OOTimeDelta wallTime, OOTimeDelta worstTick, NSUInteger laserRays, NSUInteger gridRebuilds)
+{
+	NSUInteger		i;
+	OOTimeDelta		staged = 0.0;
+
+	if (wallTime <= 0.0)  wallTime = 1e-9;
+
+	OOLog(@"simbench.results", @"Simulated %g seconds in %g seconds of real time: %.1f ticks per second, %.1fx real time. Mean tick %.3f ms, worst tick %.3f ms; %lu entities at end of run.",
+		  simulatedTime, wallTime, ticks / wallTime, simulatedTime / wallTime,
+		  wallTime * 1000.0 / MAX(ticks, 1U), worstTick * 1000.0, (unsigned long)[UNIVERSE entityCount]);
+
+	// The entity search index should be built at most once per tick, however many laser shots there are.
+	OOLog(@"simbench.results.entityQuery", @"%lu laser rays (%.2f per tick), %lu entity search index builds (%.2f per tick).",
+		  (unsigned long)laserRays, (double)laserRays / MAX(ticks, 1U),
+		  (unsigned long)gridRebuilds, (double)gridRebuilds / MAX(ticks, 1U));
+	if (gridRebuilds > ticks)
+	{
+		OOLog(@"simbench.results.entityQuery.regression", @"***** ERROR: the entity search index was built more than once per tick.");
+	}
+
+	OOLogIndent();
+	OOLog(@"simbench.results.stages", @"%-40s %12s %12s %12s %7s", "STAGE", "TOTAL (ms)", "MEAN (us)", "WORST (ms)", "%");
+	for (i = 0; i < sStageCount; i++)
+	{
+		OOSimulationBenchmarkStage *stage = &sStages[i];
+		staged += stage->total;
+		OOLog(@"simbench.results.stages", @"%-40s %12.2f %12.2f %12.3f %7.2f",
+			  [stage->name UTF8String], stage->total * 1000.0, stage->total * 1e6 / MAX(ticks, 1U),
+			  stage->worst * 1000.0, stage->total * 100.0 / wallTime);
+	}
+	OOLog(@"simbench.results.stages", @"%-40s %12.2f %12.2f %12s %7.2f",
+		  "(other)", (wallTime - staged) * 1000.0, (wallTime - staged) * 1e6 / MAX(ticks, 1U),
+		  "", (wallTime - staged) * 100.0 / wallTime);
+	OOLogOutdent();
+
+	ResetStages();
+}
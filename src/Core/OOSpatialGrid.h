@@ -0,0 +1,160 @@
+/*
+
+OOSpatialGrid.h
+
+Uniform spatial hash grid used as a collision broadphase and to speed up
+range-limited entity searches and ray casts. Each tick the grid is rebuilt from scratch
+from the entity list: every entity is entered into each cell overlapped by
+its (padded) bounding box, and potentially colliding pairs or entities near
+a point are reported once each. Entities too large to be sensibly binned
+(planets, suns, very large stations) are kept on a separate list and tested
+against everything.
+
+Entities are not retained; the grid is only valid for the tick in which it
+was built.
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOMaths.h"
+
+@class Entity;
+
+
+#define OO_SPATIAL_GRID_DEFAULT_CELL_SIZE		1000.0f
+// Entities spanning more than this many cells per axis go on the oversized list.
+#define OO_SPATIAL_GRID_MAX_CELL_SPAN			4
+
+
+typedef void (*OOSpatialGridPairFunction)(Entity *e1, Entity *e2, void *context);
+typedef void (*OOSpatialGridEntityFunction)(Entity *entity, void *context);
+/*	Ray query callback. Returns the distance along the ray beyond which the
+	caller is no longer interested, normally the nearest hit found so far.
+*/
+typedef OOHPScalar (*OOSpatialGridRayFunction)(Entity *entity, void *context);
+
+
+typedef struct OOSpatialGridItem
+{
+	Entity					*entity;
+	HPVector				boundsMin;
+	HPVector				boundsMax;
+	int32_t					cellMin[3];
+	int32_t					cellMax[3];
+	BOOL					oversized;
+} OOSpatialGridItem;
+
+
+typedef struct OOSpatialGridEntry
+{
+	uint64_t				key;
+	uint32_t				item;
+} OOSpatialGridEntry;
+
+
+typedef struct OOSpatialGridRayStatistics
+{
+	NSUInteger				rays;
+	NSUInteger				cells;				// Cells stepped through, occupied or not.
+	NSUInteger				entities;			// Entities passed to ray functions.
+} OOSpatialGridRayStatistics;
+
+
+@interface OOSpatialGrid: NSObject
+{
+@private
+	OOHPScalar				_cellSize;
+	OOHPScalar				_inverseCellSize;
+
+	OOSpatialGridItem		*_items;
+	NSUInteger				_itemCount;
+	NSUInteger				_itemCapacity;
+
+	OOSpatialGridEntry		*_entries;
+	NSUInteger				_entryCount;
+	NSUInteger				_entryCapacity;
+
+	uint32_t				*_oversized;
+	NSUInteger				_oversizedCount;
+	NSUInteger				_oversizedCapacity;
+
+	uint64_t				*_cellKeys;
+	uint32_t				*_cellStarts;		// _cellCount + 1 entries; cell i is [_cellStarts[i], _cellStarts[i + 1])
+	NSUInteger				_cellCount;
+	NSUInteger				_cellCapacity;
+
+	uint32_t				*_rayStamps;		// Per item, last ray query to visit it.
+	NSUInteger				_rayStampCapacity;
+	uint32_t				_rayStamp;
+	OOSpatialGridRayStatistics _rayStatistics;
+
+	BOOL					_built;
+}
+
+- (id) initWithCellSize:(GLfloat)cellSize;
+
+- (GLfloat) cellSize;
+
+/*	Building. Call -removeAllEntities, -addEntity:position:radius: for each
+	entity of interest, then -build before running any queries.
+
+	radius is the entity's collision radius plus whatever padding the caller
+	wants. The grid never looks inside the entity, which is only handed back
+	to query functions.
+*/
+- (void) removeAllEntities;
+- (void) addEntity:(Entity *)entity position:(HPVector)position radius:(OOHPScalar)radius;
+- (void) build;
+
+- (NSUInteger) entityCount;
+- (NSUInteger) occupiedCellCount;
+- (NSUInteger) oversizedEntityCount;
+
+/*	Call function once for every pair of entities whose padded bounds
+	overlap. Returns the number of pairs reported.
+*/
+- (NSUInteger) enumeratePotentialPairsWithFunction:(OOSpatialGridPairFunction)function context:(void *)context;
+
+/*	Call function once for every entity whose padded bounds overlap the box
+	from boxMin to boxMax. Entities are reported in no particular order.
+	Returns the number of entities reported.
+	
+	function must not modify the grid.
+*/
+- (NSUInteger) enumerateEntitiesInBoxFrom:(HPVector)boxMin to:(HPVector)boxMax withFunction:(OOSpatialGridEntityFunction)function context:(void *)context;
+
+/*	Call function once for every entity whose padded bounds are crossed by
+	the ray from origin along direction (which must be normalized), walking
+	the cells along the ray front to back. The value returned by function
+	becomes the new length of the ray, so the walk stops at the first cell
+	beyond the nearest hit. Entities within a cell, and oversized entities,
+	are reported in no particular order. Returns the number of entities
+	reported.
+	
+	function must not modify the grid.
+*/
+- (NSUInteger) enumerateEntitiesAlongRayFrom:(HPVector)origin direction:(Vector)direction length:(OOHPScalar)length withFunction:(OOSpatialGridRayFunction)function context:(void *)context;
+
+// Totals for ray queries since the last reset. These survive rebuilding.
+- (OOSpatialGridRayStatistics) rayStatistics;
+- (void) resetRayStatistics;
+
+@end
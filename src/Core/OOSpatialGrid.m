@@ -0,0 +1,604 @@
+/*
+
+OOSpatialGrid.m
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+/*	IMPLEMENTATION NOTES
+	Rather than maintaining a real hash table, the grid is built by emitting
+	one (cell key, item) entry for every cell an entity overlaps and sorting
+	the entries by key. Entries for the same cell then form a contiguous run,
+	and a table of distinct keys plus run start indices is built from them.
+	For the few thousand entries a busy system produces this is both simpler
+	and faster than hashing, and it leaves everything in flat arrays.
+
+	An entity overlapping several cells will meet another such entity in
+	every cell they share. To report each pair exactly once, a pair is only
+	reported from the cell containing the minimum corner of the intersection
+	of the two entities' cell ranges.
+
+	Box queries use the same rule: an entity is reported from the cell at the
+	minimum corner of the intersection of its cell range and the query's.
+	Because the x and y coordinates are the most significant parts of a cell
+	key, the cells of one (x, y) column of the query box form a contiguous
+	range of keys, which is found with one binary search. If the query box
+	spans more columns than there are occupied cells, the occupied cells are
+	scanned instead.
+	
+	Ray queries step from cell to cell along the ray (as in Amanatides and
+	Woo's voxel traversal), finding each occupied cell with a binary search
+	of the cell table. Since the cells are visited in order of distance, the
+	walk can stop as soon as the next cell starts beyond the nearest hit the
+	caller has found. An entity may be met in several cells along the way;
+	each item carries the number of the last ray query that saw it so it is
+	only reported once.
+	
+	Cell coordinates are packed into 21 bits each, which with the default
+	1 km cells covers about a million kilometres in each direction; anything
+	beyond that is clamped to the outermost cells. This is harmless as the
+	bounds are checked again before a pair is reported.
+*/
+
+#import "OOSpatialGrid.h"
+
+
+#define kCellCoordBits		21
+#define kCellCoordBias		(1 << (kCellCoordBits - 1))
+#define kCellCoordMask		((1 << kCellCoordBits) - 1)
+
+
+static inline int32_t CellCoordinate(OOHPScalar value, OOHPScalar inverseCellSize)
+{
+	OOHPScalar c = floor(value * inverseCellSize);
+	if (c < -kCellCoordBias)  return -kCellCoordBias;
+	if (c > kCellCoordBias - 1)  return kCellCoordBias - 1;
+	return (int32_t)c;
+}
+
+
+static inline uint64_t CellKey(int32_t x, int32_t y, int32_t z)
+{
+	return ((uint64_t)((x + kCellCoordBias) & kCellCoordMask) << (2 * kCellCoordBits)) |
+		   ((uint64_t)((y + kCellCoordBias) & kCellCoordMask) << kCellCoordBits) |
+		   (uint64_t)((z + kCellCoordBias) & kCellCoordMask);
+}
+
+
+static inline void CellKeyCoordinates(uint64_t key, int32_t *x, int32_t *y, int32_t *z)
+{
+	*x = (int32_t)((key >> (2 * kCellCoordBits)) & kCellCoordMask) - kCellCoordBias;
+	*y = (int32_t)((key >> kCellCoordBits) & kCellCoordMask) - kCellCoordBias;
+	*z = (int32_t)(key & kCellCoordMask) - kCellCoordBias;
+}
+
+
+static inline BOOL ItemBoundsOverlap(const OOSpatialGridItem *a, const OOSpatialGridItem *b)
+{
+	return a->boundsMin.x <= b->boundsMax.x && b->boundsMin.x <= a->boundsMax.x &&
+		   a->boundsMin.y <= b->boundsMax.y && b->boundsMin.y <= a->boundsMax.y &&
+		   a->boundsMin.z <= b->boundsMax.z && b->boundsMin.z <= a->boundsMax.z;
+}
+
+
+static inline BOOL ItemOverlapsBox(const OOSpatialGridItem *item, HPVector boxMin, HPVector boxMax)
+{
+	return item->boundsMin.x <= boxMax.x && boxMin.x <= item->boundsMax.x &&
+		   item->boundsMin.y <= boxMax.y && boxMin.y <= item->boundsMax.y &&
+		   item->boundsMin.z <= boxMax.z && boxMin.z <= item->boundsMax.z;
+}
+
+
+/*	Slab test of the ray from origin along direction, between 0 and length,
+	against an item's bounds.
+*/
+static BOOL ItemCrossesRay(const OOSpatialGridItem *item, const OOHPScalar origin[3], const OOHPScalar direction[3], OOHPScalar length)
+{
+	const OOHPScalar	boundsMin[3] = { item->boundsMin.x, item->boundsMin.y, item->boundsMin.z };
+	const OOHPScalar	boundsMax[3] = { item->boundsMax.x, item->boundsMax.y, item->boundsMax.z };
+	OOHPScalar			tNear = 0.0, tFar = length;
+	unsigned			axis;
+	
+	for (axis = 0; axis < 3; axis++)
+	{
+		if (direction[axis] == 0.0)
+		{
+			if (origin[axis] < boundsMin[axis] || origin[axis] > boundsMax[axis])  return NO;
+			continue;
+		}
+		
+		OOHPScalar inverse = 1.0 / direction[axis];
+		OOHPScalar t0 = (boundsMin[axis] - origin[axis]) * inverse;
+		OOHPScalar t1 = (boundsMax[axis] - origin[axis]) * inverse;
+		if (t0 > t1)
+		{
+			OOHPScalar temp = t0;
+			t0 = t1;
+			t1 = temp;
+		}
+		if (t0 > tNear)  tNear = t0;
+		if (t1 < tFar)  tFar = t1;
+		if (tNear > tFar)  return NO;
+	}
+	
+	return YES;
+}
+
+
+static int CompareEntries(const void *a, const void *b)
+{
+	const OOSpatialGridEntry *ea = a, *eb = b;
+	if (ea->key < eb->key)  return -1;
+	if (ea->key > eb->key)  return 1;
+	if (ea->item < eb->item)  return -1;
+	if (ea->item > eb->item)  return 1;
+	return 0;
+}
+
+
+static void *GrowArray(void *array, NSUInteger *capacity, NSUInteger required, size_t elementSize)
+{
+	if (required <= *capacity)  return array;
+
+	NSUInteger newCapacity = *capacity ? *capacity : 64;
+	while (newCapacity < required)  newCapacity *= 2;
+
+	void *result = realloc(array, newCapacity * elementSize);
+	if (result == NULL)
+	{
+		[NSException raise:NSMallocException format:@"Not enough memory to grow spatial grid."];
+	}
+	*capacity = newCapacity;
+	return result;
+}
+
+
+@implementation OOSpatialGrid
+
+- (id) init
+{
+	return [self initWithCellSize:OO_SPATIAL_GRID_DEFAULT_CELL_SIZE];
+}
+
+
+- (id) initWithCellSize:(GLfloat)cellSize	// Designated initializer.
+{
+	if ((self = [super init]))
+	{
+		if (cellSize <= 0.0f)  cellSize = OO_SPATIAL_GRID_DEFAULT_CELL_SIZE;
+		_cellSize = cellSize;
+		_inverseCellSize = 1.0 / _cellSize;
+	}
+	return self;
+}
+
+
+- (void) dealloc
+{
+	free(_items);
+	free(_entries);
+	free(_oversized);
+	free(_cellKeys);
+	free(_cellStarts);
+	free(_rayStamps);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"cell size: %g, %lu entities, %lu cells, %lu oversized", _cellSize, (unsigned long)_itemCount, (unsigned long)_cellCount, (unsigned long)_oversizedCount];
+}
+
+
+- (GLfloat) cellSize
+{
+	return _cellSize;
+}
+
+
+- (void) removeAllEntities
+{
+	_itemCount = 0;
+	_entryCount = 0;
+	_oversizedCount = 0;
+	_cellCount = 0;
+	_built = NO;
+}
+
+
+- (void) addEntity:(Entity *)entity position:(HPVector)pos radius:(OOHPScalar)extent
+{
+	NSParameterAssert(entity != nil);
+
+	_items = GrowArray(_items, &_itemCapacity, _itemCount + 1, sizeof *_items);
+	OOSpatialGridItem *item = &_items[_itemCount];
+
+	item->entity = entity;
+	item->boundsMin = make_HPvector(pos.x - extent, pos.y - extent, pos.z - extent);
+	item->boundsMax = make_HPvector(pos.x + extent, pos.y + extent, pos.z + extent);
+	item->cellMin[0] = CellCoordinate(item->boundsMin.x, _inverseCellSize);
+	item->cellMin[1] = CellCoordinate(item->boundsMin.y, _inverseCellSize);
+	item->cellMin[2] = CellCoordinate(item->boundsMin.z, _inverseCellSize);
+	item->cellMax[0] = CellCoordinate(item->boundsMax.x, _inverseCellSize);
+	item->cellMax[1] = CellCoordinate(item->boundsMax.y, _inverseCellSize);
+	item->cellMax[2] = CellCoordinate(item->boundsMax.z, _inverseCellSize);
+	item->oversized = (item->cellMax[0] - item->cellMin[0] >= OO_SPATIAL_GRID_MAX_CELL_SPAN ||
+					   item->cellMax[1] - item->cellMin[1] >= OO_SPATIAL_GRID_MAX_CELL_SPAN ||
+					   item->cellMax[2] - item->cellMin[2] >= OO_SPATIAL_GRID_MAX_CELL_SPAN);
+
+	_itemCount++;
+	_built = NO;
+}
+
+
+- (void) build
+{
+	NSUInteger		i, entryRequired = 0;
+	int32_t			x, y, z;
+
+	// Count entries so the arrays only grow once.
+	for (i = 0; i < _itemCount; i++)
+	{
+		OOSpatialGridItem *item = &_items[i];
+		if (!item->oversized)
+		{
+			entryRequired += (NSUInteger)(item->cellMax[0] - item->cellMin[0] + 1) *
+							 (NSUInteger)(item->cellMax[1] - item->cellMin[1] + 1) *
+							 (NSUInteger)(item->cellMax[2] - item->cellMin[2] + 1);
+		}
+	}
+	_entries = GrowArray(_entries, &_entryCapacity, entryRequired, sizeof *_entries);
+
+	_oversized = GrowArray(_oversized, &_oversizedCapacity, _itemCount, sizeof *_oversized);
+
+	_entryCount = 0;
+	_oversizedCount = 0;
+	for (i = 0; i < _itemCount; i++)
+	{
+		OOSpatialGridItem *item = &_items[i];
+		if (item->oversized)
+		{
+			_oversized[_oversizedCount++] = (uint32_t)i;
+			continue;
+		}
+
+		for (x = item->cellMin[0]; x <= item->cellMax[0]; x++)
+		{
+			for (y = item->cellMin[1]; y <= item->cellMax[1]; y++)
+			{
+				for (z = item->cellMin[2]; z <= item->cellMax[2]; z++)
+				{
+					_entries[_entryCount].key = CellKey(x, y, z);
+					_entries[_entryCount].item = (uint32_t)i;
+					_entryCount++;
+				}
+			}
+		}
+	}
+
+	if (_entryCount > 1)  qsort(_entries, _entryCount, sizeof *_entries, CompareEntries);
+
+	// Build distinct cell table.
+	_cellCount = 0;
+	_cellKeys = GrowArray(_cellKeys, &_cellCapacity, _entryCount + 1, sizeof *_cellKeys);
+	// _cellStarts is always sized in step with _cellKeys.
+	_cellStarts = realloc(_cellStarts, _cellCapacity * sizeof *_cellStarts);
+	if (_cellStarts == NULL)  [NSException raise:NSMallocException format:@"Not enough memory to grow spatial grid."];
+
+	for (i = 0; i < _entryCount; i++)
+	{
+		if (i == 0 || _entries[i].key != _entries[i - 1].key)
+		{
+			_cellKeys[_cellCount] = _entries[i].key;
+			_cellStarts[_cellCount] = (uint32_t)i;
+			_cellCount++;
+		}
+	}
+	_cellStarts[_cellCount] = (uint32_t)_entryCount;
+
+	_rayStamps = GrowArray(_rayStamps, &_rayStampCapacity, _itemCount, sizeof *_rayStamps);
+	if (_itemCount != 0)  memset(_rayStamps, 0, _itemCount * sizeof *_rayStamps);
+	_rayStamp = 0;
+
+	_built = YES;
+}
+
+
+- (NSUInteger) entityCount
+{
+	return _itemCount;
+}
+
+
+- (NSUInteger) occupiedCellCount
+{
+	return _cellCount;
+}
+
+
+- (NSUInteger) oversizedEntityCount
+{
+	return _oversizedCount;
+}
+
+
+- (NSUInteger) enumeratePotentialPairsWithFunction:(OOSpatialGridPairFunction)function context:(void *)context
+{
+	NSParameterAssert(function != NULL);
+	if (!_built)  [self build];
+
+	NSUInteger		cell, i, j, pairs = 0;
+
+	for (cell = 0; cell < _cellCount; cell++)
+	{
+		uint64_t	key = _cellKeys[cell];
+		uint32_t	start = _cellStarts[cell], end = _cellStarts[cell + 1];
+
+		for (i = start; i + 1 < end; i++)
+		{
+			OOSpatialGridItem *a = &_items[_entries[i].item];
+			for (j = i + 1; j < end; j++)
+			{
+				OOSpatialGridItem *b = &_items[_entries[j].item];
+
+				// Only report from the first cell the two entities share.
+				uint64_t ownerKey = CellKey(MAX(a->cellMin[0], b->cellMin[0]),
+											MAX(a->cellMin[1], b->cellMin[1]),
+											MAX(a->cellMin[2], b->cellMin[2]));
+				if (ownerKey != key)  continue;
+				if (!ItemBoundsOverlap(a, b))  continue;
+
+				function(a->entity, b->entity, context);
+				pairs++;
+			}
+		}
+	}
+
+	// Oversized entities are tested against everything else.
+	for (i = 0; i < _oversizedCount; i++)
+	{
+		OOSpatialGridItem *a = &_items[_oversized[i]];
+		for (j = 0; j < _itemCount; j++)
+		{
+			OOSpatialGridItem *b = &_items[j];
+			if (b == a || (b->oversized && b < a))  continue;	// oversized pairs are reported once
+			if (!ItemBoundsOverlap(a, b))  continue;
+
+			function(a->entity, b->entity, context);
+			pairs++;
+		}
+	}
+
+	return pairs;
+}
+
+
+- (NSUInteger) enumerateEntitiesInBoxFrom:(HPVector)boxMin to:(HPVector)boxMax withFunction:(OOSpatialGridEntityFunction)function context:(void *)context
+{
+	NSParameterAssert(function != NULL);
+	if (!_built)  [self build];
+	
+	NSUInteger		i, cell, found = 0;
+	int32_t			queryMin[3], queryMax[3];
+	int32_t			x, y, z;
+	
+	queryMin[0] = CellCoordinate(boxMin.x, _inverseCellSize);
+	queryMin[1] = CellCoordinate(boxMin.y, _inverseCellSize);
+	queryMin[2] = CellCoordinate(boxMin.z, _inverseCellSize);
+	queryMax[0] = CellCoordinate(boxMax.x, _inverseCellSize);
+	queryMax[1] = CellCoordinate(boxMax.y, _inverseCellSize);
+	queryMax[2] = CellCoordinate(boxMax.z, _inverseCellSize);
+	
+	uint64_t columns = (uint64_t)(queryMax[0] - queryMin[0] + 1) * (uint64_t)(queryMax[1] - queryMin[1] + 1);
+	BOOL scanAllCells = columns > _cellCount;
+	
+	x = queryMin[0];
+	y = queryMin[1];
+	cell = 0;
+	for (;;)
+	{
+		NSUInteger	endCell;
+		
+		if (scanAllCells)
+		{
+			if (cell >= _cellCount)  break;
+			CellKeyCoordinates(_cellKeys[cell], &x, &y, &z);
+			if (x < queryMin[0] || x > queryMax[0] || y < queryMin[1] || y > queryMax[1] || z < queryMin[2] || z > queryMax[2])
+			{
+				cell++;
+				continue;
+			}
+			endCell = cell + 1;
+		}
+		else
+		{
+			if (x > queryMax[0])  break;
+			
+			// Binary search for the first occupied cell in this column.
+			uint64_t	lowKey = CellKey(x, y, queryMin[2]), highKey = CellKey(x, y, queryMax[2]);
+			NSUInteger	low = 0, high = _cellCount;
+			while (low < high)
+			{
+				NSUInteger mid = (low + high) / 2;
+				if (_cellKeys[mid] < lowKey)  low = mid + 1;
+				else  high = mid;
+			}
+			cell = low;
+			endCell = cell;
+			while (endCell < _cellCount && _cellKeys[endCell] <= highKey)  endCell++;
+			
+			if (++y > queryMax[1])
+			{
+				y = queryMin[1];
+				x++;
+			}
+		}
+		
+		for (; cell < endCell; cell++)
+		{
+			uint64_t	key = _cellKeys[cell];
+			uint32_t	start = _cellStarts[cell], end = _cellStarts[cell + 1];
+			
+			for (i = start; i < end; i++)
+			{
+				OOSpatialGridItem *item = &_items[_entries[i].item];
+				
+				// Only report from the first cell the entity shares with the query.
+				uint64_t ownerKey = CellKey(MAX(item->cellMin[0], queryMin[0]),
+											MAX(item->cellMin[1], queryMin[1]),
+											MAX(item->cellMin[2], queryMin[2]));
+				if (ownerKey != key)  continue;
+				if (!ItemOverlapsBox(item, boxMin, boxMax))  continue;
+				
+				function(item->entity, context);
+				found++;
+			}
+		}
+	}
+	
+	for (i = 0; i < _oversizedCount; i++)
+	{
+		OOSpatialGridItem *item = &_items[_oversized[i]];
+		if (!ItemOverlapsBox(item, boxMin, boxMax))  continue;
+		
+		function(item->entity, context);
+		found++;
+	}
+	
+	return found;
+}
+
+
+- (NSUInteger) enumerateEntitiesAlongRayFrom:(HPVector)origin direction:(Vector)direction length:(OOHPScalar)length withFunction:(OOSpatialGridRayFunction)function context:(void *)context
+{
+	NSParameterAssert(function != NULL && isfinite(length));
+	if (!_built)  [self build];
+	
+	NSUInteger			i, found = 0;
+	const OOHPScalar	start[3] = { origin.x, origin.y, origin.z };
+	const OOHPScalar	dir[3] = { direction.x, direction.y, direction.z };
+	int32_t				cell[3], step[3];
+	OOHPScalar			tNext[3], tDelta[3];
+	unsigned			axis;
+	
+	_rayStatistics.rays++;
+	if (length <= 0.0)  return 0;
+	
+	if (EXPECT_NOT(++_rayStamp == 0))
+	{
+		memset(_rayStamps, 0, _itemCount * sizeof *_rayStamps);
+		_rayStamp = 1;
+	}
+	
+	// Oversized entities aren't in any cell, so they're checked up front.
+	for (i = 0; i < _oversizedCount; i++)
+	{
+		OOSpatialGridItem *item = &_items[_oversized[i]];
+		if (!ItemCrossesRay(item, start, dir, length))  continue;
+		
+		length = function(item->entity, context);
+		found++;
+	}
+	
+	for (axis = 0; axis < 3; axis++)
+	{
+		cell[axis] = CellCoordinate(start[axis], _inverseCellSize);
+		if (dir[axis] > 0.0)
+		{
+			step[axis] = 1;
+			tNext[axis] = ((cell[axis] + 1) * _cellSize - start[axis]) / dir[axis];
+			tDelta[axis] = _cellSize / dir[axis];
+		}
+		else if (dir[axis] < 0.0)
+		{
+			step[axis] = -1;
+			tNext[axis] = (cell[axis] * _cellSize - start[axis]) / dir[axis];
+			tDelta[axis] = -_cellSize / dir[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tNext[axis] = INFINITY;
+			tDelta[axis] = INFINITY;
+		}
+	}
+	
+	for (;;)
+	{
+		_rayStatistics.cells++;
+		
+		// Binary search for the cell.
+		uint64_t	key = CellKey(cell[0], cell[1], cell[2]);
+		NSUInteger	low = 0, high = _cellCount;
+		while (low < high)
+		{
+			NSUInteger mid = (low + high) / 2;
+			if (_cellKeys[mid] < key)  low = mid + 1;
+			else  high = mid;
+		}
+		
+		if (low < _cellCount && _cellKeys[low] == key)
+		{
+			uint32_t	begin = _cellStarts[low], end = _cellStarts[low + 1];
+			
+			for (i = begin; i < end; i++)
+			{
+				uint32_t			index = _entries[i].item;
+				OOSpatialGridItem	*item = &_items[index];
+				
+				if (_rayStamps[index] == _rayStamp)  continue;
+				_rayStamps[index] = _rayStamp;
+				if (!ItemCrossesRay(item, start, dir, length))  continue;
+				
+				length = function(item->entity, context);
+				found++;
+			}
+		}
+		
+		// Step into whichever neighbouring cell the ray reaches first.
+		axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+		if (tNext[axis] > length)  break;
+		
+		cell[axis] += step[axis];
+		if (cell[axis] < -kCellCoordBias || cell[axis] > kCellCoordBias - 1)  break;
+		tNext[axis] += tDelta[axis];
+	}
+	
+	_rayStatistics.entities += found;
+	return found;
+}
+
+
+- (OOSpatialGridRayStatistics) rayStatistics
+{
+	return _rayStatistics;
+}
+
+
+- (void) resetRayStatistics
+{
+	_rayStatistics.rays = 0;
+	_rayStatistics.cells = 0;
+	_rayStatistics.entities = 0;
+}
+
+@end
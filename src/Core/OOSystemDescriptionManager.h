@@ -81,6 +81,7 @@ typedef enum
 	NSPoint						coordinatesCache[OO_SYSTEM_CACHE_LENGTH];
 	NSMutableArray				*neighbourCache[OO_SYSTEM_CACHE_LENGTH];
 	NSMutableDictionary			*scriptedChanges;
+	NSUInteger					routeGraphGeneration;
 }
 
 // this needs to be re-called every time system coordinates change
@@ -89,6 +90,12 @@ typedef enum
 // called just after the manager data is loaded.
 - (void) buildRouteCache;
 
+/*	Incremented whenever anything that affects route planning (coordinates
+	or concealment) may have changed, so that route graphs built from the
+	manager's data can tell when they're out of date.
+*/
+- (NSUInteger) routeGraphGeneration;
+
 - (void) setUniversalProperties:(NSDictionary *)properties;
 - (void) setInterstellarProperties:(NSDictionary *)properties;
 
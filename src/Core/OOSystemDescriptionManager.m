@@ -124,10 +124,17 @@ static NSString *kOOSystemLayerProperty = @"layer";
 			}
 		}
 	}
+	routeGraphGeneration++;
 
 }
 
 
+- (NSUInteger) routeGraphGeneration
+{
+	return routeGraphGeneration;
+}
+
+
 - (void) setUniversalProperties:(NSDictionary *)properties
 {
 	[universalProperties addEntriesFromDictionary:properties];
@@ -538,6 +545,7 @@ static NSString *kOOSystemLayerProperty = @"layer";
 
 	[propertyCache[i] removeAllObjects];
 	[propertyCache[i] addEntriesFromDictionary:current];
+	routeGraphGeneration++;
 }
 
 
@@ -554,6 +562,11 @@ static NSString *kOOSystemLayerProperty = @"layer";
 	{
 		[propertyCache[i] setObject:current forKey:property];
 	}
+	
+	if ([property isEqualToString:@"concealment"] || [property isEqualToString:@"coordinates"])
+	{
+		routeGraphGeneration++;
+	}
 }
 
 
@@ -45,3 +45,11 @@ OOPixMap OOScalePixMap(OOPixMap srcPixMap, OOPixMapDimension dstWidth, OOPixMapD
 	Buffer must have space for (4 * width * height) / 3 pixels.
 */
 BOOL OOGenerateMipMaps(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format);
+
+
+/*	As OOGenerateMipMaps(), but for RGBA textures whose colour channels are
+	sRGB-encoded: colour is averaged in linear space, so that fine bright
+	detail doesn't darken with distance. Alpha is averaged directly. Other
+	formats are passed to OOGenerateMipMaps().
+*/
+BOOL OOGenerateMipMapsSRGB(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format);
@@ -37,6 +37,27 @@ SOFTWARE.
 #define DUMP_SCALE		0
 
 
+/*	Vector versions of the ScaleToHalf functions are built where the compiler
+	targets SSE2 (always the case for x86-64) or NEON, and used when
+	OOCPUGetFeatures() confirms support.
+*/
+#if defined(__SSE2__)
+#define OO_SCALING_SSE2		1
+#include <emmintrin.h>
+#else
+#define OO_SCALING_SSE2		0
+#endif
+
+#if !OO_SCALING_SSE2 && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define OO_SCALING_NEON		1
+#include <arm_neon.h>
+#else
+#define OO_SCALING_NEON		0
+#endif
+
+#define OO_SCALING_SIMD		(OO_SCALING_SSE2 || OO_SCALING_NEON)
+
+
 /*	Internal function declarations.
 	
 	NOTE: the function definitions are grouped together for best code cache
@@ -45,6 +66,7 @@ SOFTWARE.
 static BOOL GenerateMipMaps1(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height) NONNULL_FUNC;
 static BOOL GenerateMipMaps2(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height) NONNULL_FUNC;
 static BOOL GenerateMipMaps4(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height) NONNULL_FUNC;
+static BOOL GenerateMipMaps4SRGB(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height) NONNULL_FUNC;
 
 
 /*	ScaleToHalf_P_xN functions
@@ -69,6 +91,25 @@ static void ScaleToHalf_4_x1(void *srcBytes, void *dstBytes, OOPixMapDimension s
 //	static void ScaleToHalf_2_x2(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight) NONNULL_FUNC;
 #endif
 
+/*	ScaleToHalf_P_SIMD functions
+	As above, using SSE2 or NEON to handle 32 bytes of each source row at a
+	time; srcWidth * P must be a multiple of 32. The results are identical to
+	the scalar versions.
+*/
+#if OO_SCALING_SIMD
+	static BOOL UseSIMDScaling(void);
+	static void ScaleToHalf_1_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight) NONNULL_FUNC;
+	static void ScaleToHalf_2_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight) NONNULL_FUNC;
+	static void ScaleToHalf_4_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight) NONNULL_FUNC;
+#endif
+
+/*	ScaleToHalf_4_SRGB
+	Like ScaleToHalf_4_x1, but treats the first three channels as sRGB-encoded
+	and averages them in linear space. The fourth channel (alpha) is averaged
+	directly.
+*/
+static void ScaleToHalf_4_SRGB(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight) NONNULL_FUNC;
+
 
 OOINLINE void StretchVertically(OOPixMap srcPx, OOPixMap dstPx) ALWAYS_INLINE_FUNC;
 OOINLINE void SqueezeVertically(OOPixMap pixMap, OOPixMapDimension dstHeight) ALWAYS_INLINE_FUNC;
@@ -374,6 +415,18 @@ BOOL OOGenerateMipMaps(void *textureBytes, OOPixMapDimension width, OOPixMapDime
 }
 
 
+BOOL OOGenerateMipMapsSRGB(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format)
+{
+	if (format != kOOPixMapRGBA || textureBytes == NULL || width != OORoundUpToPowerOf2_PixMap(width) || height != OORoundUpToPowerOf2_PixMap(height))
+	{
+		// Let OOGenerateMipMaps() handle other formats and report errors.
+		return OOGenerateMipMaps(textureBytes, width, height, format);
+	}
+	
+	return GenerateMipMaps4SRGB(textureBytes, width, height);
+}
+
+
 static BOOL GenerateMipMaps1(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height)
 {
 	OOPixMapDimension		w = width, h = height;
@@ -382,6 +435,23 @@ static BOOL GenerateMipMaps1(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(1);
 	curr = textureBytes;
 	
+#if OO_SCALING_SIMD
+	if (UseSIMDScaling())
+	{
+		while (32 <= w && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_1_SIMD(curr, next, w, h);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 #if OOLITE_NATIVE_64_BIT
 	while (8 < w && 1 < h)
 	{
@@ -604,6 +674,23 @@ static BOOL GenerateMipMaps2(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(2);
 	curr = textureBytes;
 	
+#if OO_SCALING_SIMD
+	if (UseSIMDScaling())
+	{
+		while (16 <= w && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_2_SIMD(curr, next, w, h);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 	// TODO: multiple pixel two-plane scalers.
 #if 0
 #if OOLITE_NATIVE_64_BIT
@@ -701,6 +788,23 @@ static BOOL GenerateMipMaps4(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(4);
 	curr = textureBytes;
 	
+#if OO_SCALING_SIMD
+	if (UseSIMDScaling())
+	{
+		while (8 <= w && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_4_SIMD(curr, next, w, h);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 #if OOLITE_NATIVE_64_BIT
 	while (2 < w && 1 < h)
 	{
@@ -877,6 +981,259 @@ static void ScaleToHalf_4_x2(void *srcBytes, void *dstBytes, OOPixMapDimension s
 #endif
 
 
+#if OO_SCALING_SIMD
+
+static BOOL UseSIMDScaling(void)
+{
+	return (OOCPUGetFeatures() & (kOOCPUFeatureSSE2 | kOOCPUFeatureNEON)) != 0;
+}
+
+
+/*	Sum each channel over 2x2 pixel blocks of 16 bytes from each of two rows,
+	and divide by four. Returns 8 bytes of output: 8, 4 or 2 pixels for 1, 2
+	or 4 planes respectively.
+*/
+#if OO_SCALING_SSE2
+
+OOINLINE __m128i HalveBlock_SSE2(const uint8_t *src0, const uint8_t *src1, unsigned planes)
+{
+	__m128i		zero = _mm_setzero_si128();
+	__m128i		a = _mm_loadu_si128((const __m128i *)src0);
+	__m128i		b = _mm_loadu_si128((const __m128i *)src1);
+	
+	// Add the rows together, widening to 16 bits per channel.
+	__m128i		lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+	__m128i		hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+	__m128i		sum;
+	
+	// Add horizontally adjacent pixels.
+	if (planes == 1)
+	{
+		__m128i mask = _mm_set1_epi32(0xFFFF);
+		lo = _mm_add_epi32(_mm_and_si128(lo, mask), _mm_srli_epi32(lo, 16));
+		hi = _mm_add_epi32(_mm_and_si128(hi, mask), _mm_srli_epi32(hi, 16));
+		sum = _mm_packs_epi32(lo, hi);
+	}
+	else
+	{
+		if (planes == 2)
+		{
+			// Reorder pixels 0 1 2 3 to 0 2 1 3, so pairs are in opposite halves as for four planes.
+			lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+			hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+		}
+		sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+	}
+	
+	return _mm_srli_epi16(sum, 2);
+}
+
+
+OOINLINE void ScaleToHalf_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight, unsigned planes)
+{
+	const uint8_t			*src0 = srcBytes, *src1;
+	uint8_t					*dst = dstBytes;
+	size_t					x, rowBytes = (size_t)srcWidth * planes;
+	OOPixMapDimension		y;
+	
+	for (y = srcHeight >> 1; y != 0; y--)
+	{
+		src1 = src0 + rowBytes;
+		for (x = 0; x < rowBytes; x += 32)
+		{
+			__m128i lo = HalveBlock_SSE2(src0 + x, src1 + x, planes);
+			__m128i hi = HalveBlock_SSE2(src0 + x + 16, src1 + x + 16, planes);
+			_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+			dst += 16;
+		}
+		
+		// Skip a row for each source row
+		src0 = src1 + rowBytes;
+	}
+}
+
+#else	// OO_SCALING_NEON
+
+OOINLINE uint8x8_t HalveBlock_NEON(const uint8_t *src0, const uint8_t *src1, unsigned planes)
+{
+	uint8x16_t			a = vld1q_u8(src0);
+	uint8x16_t			b = vld1q_u8(src1);
+	
+	// Add the rows together, widening to 16 bits per channel.
+	uint16x8_t			lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+	uint16x8_t			hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+	uint16x8_t			sum;
+	
+	// Add horizontally adjacent pixels.
+	if (planes == 1)
+	{
+		uint16x8x2_t pairs = vuzpq_u16(lo, hi);
+		sum = vaddq_u16(pairs.val[0], pairs.val[1]);
+	}
+	else if (planes == 2)
+	{
+		uint32x4x2_t pairs = vuzpq_u32(vreinterpretq_u32_u16(lo), vreinterpretq_u32_u16(hi));
+		sum = vaddq_u16(vreinterpretq_u16_u32(pairs.val[0]), vreinterpretq_u16_u32(pairs.val[1]));
+	}
+	else
+	{
+		sum = vaddq_u16(vcombine_u16(vget_low_u16(lo), vget_low_u16(hi)), vcombine_u16(vget_high_u16(lo), vget_high_u16(hi)));
+	}
+	
+	return vshrn_n_u16(sum, 2);
+}
+
+
+OOINLINE void ScaleToHalf_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight, unsigned planes)
+{
+	const uint8_t			*src0 = srcBytes, *src1;
+	uint8_t					*dst = dstBytes;
+	size_t					x, rowBytes = (size_t)srcWidth * planes;
+	OOPixMapDimension		y;
+	
+	for (y = srcHeight >> 1; y != 0; y--)
+	{
+		src1 = src0 + rowBytes;
+		for (x = 0; x < rowBytes; x += 32)
+		{
+			uint8x8_t lo = HalveBlock_NEON(src0 + x, src1 + x, planes);
+			uint8x8_t hi = HalveBlock_NEON(src0 + x + 16, src1 + x + 16, planes);
+			vst1q_u8(dst, vcombine_u8(lo, hi));
+			dst += 16;
+		}
+		
+		// Skip a row for each source row
+		src0 = src1 + rowBytes;
+	}
+}
+
+#endif
+
+
+static void ScaleToHalf_1_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight)
+{
+	ScaleToHalf_SIMD(srcBytes, dstBytes, srcWidth, srcHeight, 1);
+}
+
+
+static void ScaleToHalf_2_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight)
+{
+	ScaleToHalf_SIMD(srcBytes, dstBytes, srcWidth, srcHeight, 2);
+}
+
+
+static void ScaleToHalf_4_SIMD(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight)
+{
+	ScaleToHalf_SIMD(srcBytes, dstBytes, srcWidth, srcHeight, 4);
+}
+
+#endif	// OO_SCALING_SIMD
+
+
+/*	sRGB conversion tables for gamma-correct mip-mapping. Linear values are
+	16-bit; the sum of four of them, divided by 16, indexes the inverse table.
+	The tables are built on first use. Building them is idempotent, so
+	there's no harm if two loader threads race to do it.
+*/
+enum
+{
+	kLinearToSRGBShift		= 4,
+	kLinearToSRGBRound		= 1 << (kLinearToSRGBShift - 1),
+	kLinearToSRGBCount		= ((4 * 0xFFFF + kLinearToSRGBRound) >> kLinearToSRGBShift) + 1
+};
+
+static uint16_t				sSRGBToLinear[256];
+static uint8_t				sLinearToSRGB[kLinearToSRGBCount];
+static volatile BOOL		sSRGBTablesReady = NO;
+
+
+static void SetUpSRGBTables(void)
+{
+	unsigned i;
+	
+	if (sSRGBTablesReady)  return;
+	
+	for (i = 0; i < 256; i++)
+	{
+		double c = i / 255.0;
+		double linear = (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+		sSRGBToLinear[i] = (uint16_t)(linear * 65535.0 + 0.5);
+	}
+	for (i = 0; i < kLinearToSRGBCount; i++)
+	{
+		double linear = (double)(i << kLinearToSRGBShift) / (4 * 0xFFFF);
+		double c = (linear <= 0.0031308) ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+		sLinearToSRGB[i] = (uint8_t)(OOClamp_0_1_d(c) * 255.0 + 0.5);
+	}
+	
+	__sync_synchronize();
+	sSRGBTablesReady = YES;
+}
+
+
+static BOOL GenerateMipMaps4SRGB(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height)
+{
+	OOPixMapDimension		w = width, h = height;
+	uint32_t				*curr, *next;
+	
+	DUMP_MIP_MAP_PREPARE(4);
+	curr = textureBytes;
+	SetUpSRGBTables();
+	
+	while (1 < w && 1 < h)
+	{
+		DUMP_MIP_MAP_DUMP(curr, w, h);
+		
+		next = curr + w * h;
+		ScaleToHalf_4_SRGB(curr, next, w, h);
+		
+		w >>= 1;
+		h >>= 1;
+		curr = next;
+	}
+	
+	DUMP_MIP_MAP_DUMP(curr, w, h);
+	
+	// TODO: handle residual 1xN/Nx1 mips. For now, we just limit maximum mip level for non-square textures.
+	return YES;
+}
+
+
+static void ScaleToHalf_4_SRGB(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight)
+{
+	OOPixMapDimension		x, y;
+	uint8_t					*src0, *src1, *dst;
+	unsigned				c;
+	
+	src0 = srcBytes;
+	src1 = src0 + srcWidth * 4;
+	dst = dstBytes;
+	
+	y = srcHeight >> 1;
+	do
+	{
+		x = srcWidth >> 1;
+		do
+		{
+			for (c = 0; c < 3; c++)
+			{
+				uint_fast32_t sum = sSRGBToLinear[src0[c]] + sSRGBToLinear[src0[c + 4]] + sSRGBToLinear[src1[c]] + sSRGBToLinear[src1[c + 4]];
+				dst[c] = sLinearToSRGB[(sum + kLinearToSRGBRound) >> kLinearToSRGBShift];
+			}
+			dst[3] = (src0[3] + src0[7] + src1[3] + src1[7]) >> 2;
+			
+			src0 += 8;
+			src1 += 8;
+			dst += 4;
+		} while (--x);
+		
+		// Skip a row for each source row
+		src0 = src1;
+		src1 += srcWidth * 4;
+	} while (--y);
+}
+
+
 #if DUMP_MIP_MAPS
 static void DumpMipMap(void *data, OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format, SInt32 ID, uint32_t level)
 {
@@ -250,3 +250,10 @@ typedef enum
 
 	DETAIL_LEVEL_MAXIMUM		= 3
 } OOGraphicsDetail;
+
+
+typedef enum
+{
+	COLLISION_BROADPHASE_SWEEP	= 0,	// Axis-sorted linked lists and collision chains
+	COLLISION_BROADPHASE_GRID	= 1		// Uniform spatial hash grid (OOSpatialGrid)
+} OOCollisionBroadphase;
@@ -47,6 +47,7 @@ MA 02110-1301, USA.
 	unsigned char		*_collisionOctree;
 	
 	NSData				*_data;
+	id					_dataOwner;		// Keeps _data's bytes alive when _data doesn't own them.
 }
 
 /*
@@ -57,6 +58,16 @@ MA 02110-1301, USA.
 */
 - (id) initWithDictionary:(NSDictionary *)dictionary;
 
+/*
+	- (id) initWithBytes:length:radius:owner:
+	
+	Use serialized octree nodes in place, without copying them. owner is
+	retained for the life of the octree (and any scaled copies), and must
+	keep the bytes valid and unchanged; it is normally a memory-mapped
+	cache blob.
+*/
+- (id) initWithBytes:(const void *)bytes length:(NSUInteger)length radius:(GLfloat)radius owner:(id)owner;
+
 - (Octree *) octreeScaledBy:(GLfloat)factor;
 
 #ifndef OODEBUGLDRAWING_DISABLE
@@ -50,6 +50,9 @@ typedef struct
 
 @interface Octree (Private)
 
+- (id) initWithData:(NSData *)data radius:(GLfloat)radius;
+- (id) initWithData:(NSData *)data radius:(GLfloat)radius owner:(id)owner;
+
 #ifndef OODEBUGLDRAWING_DISABLE
 
 - (void) drawOctreeFromLocation:(uint32_t)loc :(GLfloat)scale :(Vector)offset;
@@ -86,13 +89,30 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 }
 
 
+- (id) initWithData:(NSData *)data
+			 radius:(GLfloat)radius
+{
+	return [self initWithData:data radius:radius owner:nil];
+}
+
+
+- (id) initWithBytes:(const void *)bytes length:(NSUInteger)length radius:(GLfloat)radius owner:(id)owner
+{
+	NSData *data = [NSData dataWithBytesNoCopy:(void *)bytes length:length freeWhenDone:NO];
+	return [self initWithData:data radius:radius owner:owner];
+}
+
+
 // Designated initializer.
 - (id) initWithData:(NSData *)data
 			 radius:(GLfloat)radius
+			  owner:(id)owner
 {
 	if ((self = [super init]))
 	{
+		// Immutable data is retained rather than copied, so this doesn't copy the nodes.
 		_data = [data copy];
+		_dataOwner = [owner retain];
 		_radius = radius;
 		
 		NSUInteger nodeCount = [_data length] / sizeof *_octree;
@@ -130,6 +150,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 - (void) dealloc
 {
 	DESTROY(_data);
+	DESTROY(_dataOwner);
 	free(_collisionOctree);
 	
 	[super dealloc];
@@ -163,7 +184,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 - (Octree *) octreeScaledBy:(GLfloat)factor
 {
 	// Since octree data is immutable, we can share.
-	return [[[Octree alloc] initWithData:_data radius:_radius * factor] autorelease];
+	return [[[Octree alloc] initWithData:_data radius:_radius * factor owner:_dataOwner] autorelease];
 }
 
 
@@ -37,6 +37,7 @@ MA 02110-1301, USA.
 #import "NSFileManagerOOExtensions.h"
 #import "OldSchoolPropertyListWriting.h"
 #import "OOOXZManager.h"
+#import "OOOXZArchive.h"
 #import "unzip.h"
 #import "HeadUpDisplay.h"
 #import "OODebugStandards.h"
@@ -2265,6 +2266,7 @@ static NSString *LogClassKeyRoot(NSString *key)
 
 + (void) clearCaches
 {
+	[OOOXZArchive closeAllArchives];
 	[sSoundCache release];
 	sSoundCache = nil;
 	[sStringCache release];
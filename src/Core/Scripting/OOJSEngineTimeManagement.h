@@ -86,6 +86,11 @@ void OOJSStopTimeLimiter(void);
 	OOJSGetTimeLimiterLimit()
 	OOJSSetTimeLimiterLimit()
 	Manipulate the timeout.
+	
+	OOJSProfileNoteEventDispatch()
+	Record that a world script event was sent to handlerCount of the
+	scriptCount loaded world scripts. While profiling, these are summed per
+	event and reported as the profile's eventDispatches.
 */
 
 
@@ -102,6 +107,8 @@ void OOJSResetTimeLimiter(void);
 OOTimeDelta OOJSGetTimeLimiterLimit(void);
 void OOJSSetTimeLimiterLimit(OOTimeDelta limit);
 
+void OOJSProfileNoteEventDispatch(jsid event, NSUInteger handlerCount, NSUInteger scriptCount);
+
 
 /*
 	NOTE: the profiler declarations that need to be visible to functions that
@@ -122,6 +129,7 @@ void OOJSSetTimeLimiterLimit(OOTimeDelta limit);
 	double						_profilerOverhead;
 	
 	NSArray						*_profileEntries;
+	NSDictionary				*_eventDispatches;
 }
 
 - (double) totalTime;
@@ -133,6 +141,11 @@ void OOJSSetTimeLimiterLimit(OOTimeDelta limit);
 
 - (NSArray *) profileEntries;	// Array of OOTimeProfileEntry
 
+/*	Event name -> dictionary with dispatchCount, handlerCount (handler calls
+	made) and skippedCount (world scripts not called for lack of a handler).
+*/
+- (NSDictionary *) eventDispatches;
+
 @end
 
 
@@ -31,6 +31,7 @@ SOFTWARE.
 #import "OOJSScript.h"
 #import "OOCollectionExtractors.h"
 #import "OOLoggingExtended.h"
+#import "OOFrameTracer.h"
 
 #if OOLITE_LINUX
 // Workaround for clang/glibc incompatibility.
@@ -276,6 +277,16 @@ static double					sProfilerTotalNativeTime;
 static double					sProfilerTotalJavaScriptTime;
 static double					sProfilerEntryTimeLimit;
 static OOHighResTimeValue		sProfilerStartTime;
+static NSMapTable				*sEventDispatchInfo;
+
+
+typedef struct
+{
+	jsid						event;
+	unsigned long				dispatchCount;
+	unsigned long				handlerCount;
+	unsigned long				skippedCount;
+} OOJSEventDispatchInfo;
 
 
 @interface OOTimeProfile (Private)
@@ -288,6 +299,7 @@ static OOHighResTimeValue		sProfilerStartTime;
 - (void) setProfilerOverhead:(double)value;
 - (void) setExtensionTime:(double)value;
 - (void) setProfileEntries:(NSArray *)value;
+- (void) setEventDispatches:(NSDictionary *)value;
 
 - (NSDictionary *) propertyListRepresentation;
 
@@ -314,6 +326,7 @@ void OOJSBeginProfiling(BOOL trace)
 	sProfiling = YES;
 	sTracing = trace;
 	sProfileInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100);
+	sEventDispatchInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSOwnedPointerMapValueCallBacks, 50);
 	sProfilerOverhead = 0.0;
 	sProfilerTotalNativeTime = 0.0;
 	sProfilerTotalJavaScriptTime = 0.0;
@@ -355,6 +368,24 @@ OOTimeProfile *OOJSEndProfiling(void)
 	
 	[result setProfileEntries:[NSAllMapTableValues(sProfileInfo) sortedArrayUsingSelector:@selector(compareBySelfTimeReverse:)]];
 	
+	NSMutableDictionary *eventDispatches = [NSMutableDictionary dictionaryWithCapacity:NSCountMapTable(sEventDispatchInfo)];
+	NSMapEnumerator eventEnum = NSEnumerateMapTable(sEventDispatchInfo);
+	void *eventKey = NULL;
+	OOJSEventDispatchInfo *eventInfo = NULL;
+	while (NSNextMapEnumeratorPair(&eventEnum, &eventKey, (void **)&eventInfo))
+	{
+		NSString *eventName = OOStringFromJSID(eventInfo->event);
+		if (eventName == nil)  continue;
+		[eventDispatches setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+									[NSNumber numberWithUnsignedLong:eventInfo->dispatchCount], @"dispatchCount",
+									[NSNumber numberWithUnsignedLong:eventInfo->handlerCount], @"handlerCount",
+									[NSNumber numberWithUnsignedLong:eventInfo->skippedCount], @"skippedCount",
+									nil]
+							forKey:eventName];
+	}
+	NSEndMapTableEnumeration(&eventEnum);
+	[result setEventDispatches:eventDispatches];
+	
 	if (sTracing)
 	{
 		OOLogOutdent();
@@ -364,6 +395,8 @@ OOTimeProfile *OOJSEndProfiling(void)
 	
 	// Clean up.
 	NSFreeMapTable(sProfileInfo);
+	NSFreeMapTable(sEventDispatchInfo);
+	sEventDispatchInfo = NULL;
 	OODisposeHighResTime(sProfilerStartTime);
 	
 	OODisposeHighResTime(now);
@@ -378,6 +411,27 @@ BOOL OOJSIsProfiling(void)
 	return sProfiling;
 }
 
+
+void OOJSProfileNoteEventDispatch(jsid event, NSUInteger handlerCount, NSUInteger scriptCount)
+{
+	if (EXPECT(!sProfiling))  return;
+	
+	// Event IDs are interned strings, so the ID bits are a stable key.
+	void *key = (void *)JSID_BITS(event);
+	OOJSEventDispatchInfo *info = NSMapGet(sEventDispatchInfo, key);
+	if (info == NULL)
+	{
+		info = calloc(1, sizeof *info);
+		if (EXPECT_NOT(info == NULL))  return;
+		info->event = event;
+		NSMapInsertKnownAbsent(sEventDispatchInfo, key, info);
+	}
+	
+	info->dispatchCount++;
+	info->handlerCount += handlerCount;
+	if (scriptCount > handlerCount)  info->skippedCount += scriptCount - handlerCount;
+}
+
 void OOJSBeginTracing(void);
 void OOJSEndTracing(void);
 BOOL OOJSIsTracing(void);
@@ -386,6 +440,16 @@ BOOL OOJSIsTracing(void);
 static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame *frame);
 
 
+/*	The profile stack isn't thread-safe, and JavaScript only runs on the main
+	thread anyway. Native functions called on worker threads, such as mesh
+	loading during cache preloading, are left out of the profile.
+*/
+OOINLINE BOOL ProfilerIsOnThisThread(void)
+{
+	return [NSThread isMainThread];
+}
+
+
 #ifdef MOZ_TRACE_JSCALLS
 static void CleanUpJSFrame(OOJSProfileStackFrame *frame)
 {
@@ -526,7 +590,8 @@ static void FunctionCallback(JSFunction *function, JSScript *script, JSContext *
 
 void OOJSProfileEnter(OOJSProfileStackFrame *frame, const char *function)
 {
-	if (EXPECT(!sProfiling))  return;
+	OOFrameTraceBeginCString(function);
+	if (EXPECT(!sProfiling) || !ProfilerIsOnThisThread())  return;
 	if (EXPECT_NOT(sTracing))
 	{
 		// We use EXPECT_NOT here because profiles are time-critical and traces are not.
@@ -548,7 +613,8 @@ void OOJSProfileEnter(OOJSProfileStackFrame *frame, const char *function)
 
 void OOJSProfileExit(OOJSProfileStackFrame *frame)
 {
-	if (EXPECT(!sProfiling))  return;
+	OOFrameTraceEnd();
+	if (EXPECT(!sProfiling) || !ProfilerIsOnThisThread())  return;
 	
 	OOHighResTimeValue	now = OOGetHighResTime();
 	NSAutoreleasePool	*pool = [NSAutoreleasePool new];
@@ -618,6 +684,7 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 - (void) dealloc
 {
 	DESTROY(_profileEntries);
+	DESTROY(_eventDispatches);
 	
 	[super dealloc];
 }
@@ -658,6 +725,22 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 		}
 	}
 	
+	NSDictionary *eventDispatches = [self eventDispatches];
+	if ([eventDispatches count] != 0)
+	{
+		[result appendString:@"\n\n                                       EVENT  DISPATCHES  HANDLERS   SKIPPED"];
+		NSString *eventName = nil;
+		foreach (eventName, [[eventDispatches allKeys] sortedArrayUsingSelector:@selector(compare:)])
+		{
+			NSDictionary *counts = [eventDispatches objectForKey:eventName];
+			[result appendFormat:@"\n%44s  %10lu  %8lu  %8lu",
+			 [eventName UTF8String],
+			 [[counts objectForKey:@"dispatchCount"] unsignedLongValue],
+			 [[counts objectForKey:@"handlerCount"] unsignedLongValue],
+			 [[counts objectForKey:@"skippedCount"] unsignedLongValue]];
+		}
+	}
+	
 	return result;
 }
 
@@ -750,6 +833,22 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 }
 
 
+- (NSDictionary *) eventDispatches
+{
+	return _eventDispatches;
+}
+
+
+- (void) setEventDispatches:(NSDictionary *)value
+{
+	if (_eventDispatches != value)
+	{
+		[_eventDispatches release];
+		_eventDispatches = [value copy];
+	}
+}
+
+
 - (jsval) oo_jsValueInContext:(JSContext *)context
 {
 	return OOJSValueFromNativeObject(context, [self propertyListRepresentation]);
@@ -774,6 +873,7 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 			[NSNumber numberWithDouble:[self extensionTime]], @"extensionTime",
 			[NSNumber numberWithDouble:[self nonExtensionTime]], @"nonExtensionTime",
 			[NSNumber numberWithDouble:[self profilerOverhead]], @"profilerOverhead",
+			[self eventDispatches], @"eventDispatches",
 			nil];
 }
 
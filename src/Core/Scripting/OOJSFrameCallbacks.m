@@ -28,6 +28,7 @@ SOFTWARE.
 #import "OOJSFrameCallbacks.h"
 #import "OOJSEngineTimeManagement.h"
 #import "OOCollectionExtractors.h"
+#import "OOFrameTracer.h"
 
 
 /*
@@ -150,6 +151,7 @@ void OOJSFrameCallbacksInvoke(OOTimeDelta inDeltaT)
 				but in testrelease builds at least we can keep them on a short leash.
 			*/
 			OOJSStartTimeLimiterWithTimeLimit(0.1);
+			OOFrameTraceBegin(@"frame callbacks");
 			
 			for (i = 0; i < sCount; i++)
 			{
@@ -158,6 +160,7 @@ void OOJSFrameCallbacksInvoke(OOTimeDelta inDeltaT)
 				JS_ReportPendingException(context);
 			}
 			
+			OOFrameTraceEnd();
 			OOJSStopTimeLimiter();
 			sRunning = NO;
 			
@@ -39,6 +39,7 @@ static NSString * const kLocalManifestProperty = @"oolite_manifest_identifier";
 	NSString			*filePath;
 	
 	OOWeakReference		*weakSelf;
+	BOOL				_isWorldScript;
 }
 
 + (id) scriptWithPath:(NSString *)path properties:(NSDictionary *)properties;
@@ -56,6 +57,18 @@ static NSString * const kLocalManifestProperty = @"oolite_manifest_identifier";
 + (void) pushScript:(OOJSScript *)script;
 + (void) popScript:(OOJSScript *)script;
 
+/*	Event handler generation. Incremented whenever a property is added to or
+	deleted from a world script, or a world script property is set to a
+	function. Caches of which world scripts handle which events (see
+	PlayerEntity's world script dispatch) are valid until the generation
+	changes. Ship scripts and other scripts don't affect it.
+*/
++ (uint32_t) eventHandlerGeneration;
+
+// Set by PlayerEntity for the scripts in its world script list.
+- (BOOL) isWorldScript;
+- (void) setIsWorldScript:(BOOL)value;
+
 /*	Call a method.
 	Requires a request on context.
 	outResult may be NULL.
@@ -65,6 +78,12 @@ static NSString * const kLocalManifestProperty = @"oolite_manifest_identifier";
 	  withArguments:(jsval *)argv count:(intN)argc
 			 result:(jsval *)outResult;
 
+/*	Test whether the script has a handler for methodID, i.e. whether
+	-callMethod:... would call anything.
+	Requires a request on context.
+*/
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context;
+
 - (id) propertyWithID:(jsid)propID inContext:(JSContext *)context;
 // Set a property which can be modified or deleted by the script.
 - (BOOL) setProperty:(id)value withID:(jsid)propID inContext:(JSContext *)context;
@@ -86,6 +105,8 @@ static NSString * const kLocalManifestProperty = @"oolite_manifest_identifier";
 	  withArguments:(jsval *)argv count:(intN)argc
 			 result:(jsval *)outResult;
 
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context;
+
 @end
 
 
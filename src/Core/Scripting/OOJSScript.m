@@ -58,6 +58,7 @@ struct RunningStack
 
 static JSObject			*sScriptPrototype;
 static RunningStack		*sRunningStack = NULL;
+static uint32_t			sEventHandlerGeneration = 0;
 
 
 static void AddStackToArrayReversed(NSMutableArray *array, RunningStack *stack);
@@ -73,6 +74,8 @@ static NSString *StrippedName(NSString *string);
 
 
 static JSBool ScriptAddProperty(JSContext *context, JSObject *this, jsid propID, jsval *value);
+static JSBool ScriptDeleteProperty(JSContext *context, JSObject *this, jsid propID, jsval *value);
+static JSBool ScriptSetProperty(JSContext *context, JSObject *this, jsid propID, JSBool strict, jsval *value);
 
 
 static JSClass sScriptClass =
@@ -81,9 +84,9 @@ static JSClass sScriptClass =
 	JSCLASS_HAS_PRIVATE,
 	
 	ScriptAddProperty,
+	ScriptDeleteProperty,
 	JS_PropertyStub,
-	JS_PropertyStub,
-	JS_StrictPropertyStub,
+	ScriptSetProperty,
 	JS_EnumerateStub,
 	JS_ResolveStub,
 	JS_ConvertStub,
@@ -352,6 +355,24 @@ static JSFunctionSpec sScriptMethods[] =
 }
 
 
++ (uint32_t) eventHandlerGeneration
+{
+	return sEventHandlerGeneration;
+}
+
+
+- (BOOL) isWorldScript
+{
+	return _isWorldScript;
+}
+
+
+- (void) setIsWorldScript:(BOOL)value
+{
+	_isWorldScript = !!value;
+}
+
+
 - (id) weakRetain
 {
 	if (weakSelf == nil)  weakSelf = [OOWeakReference weakRefWithObject:self];
@@ -453,6 +474,17 @@ static JSFunctionSpec sScriptMethods[] =
 }
 
 
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context
+{
+	NSParameterAssert(context != NULL && JS_IsInRequest(context));
+	if (_jsSelf == NULL)  return NO;
+	
+	// Same test as -callMethod:..., but without running anything.
+	jsval					method = JSVAL_VOID;
+	return JS_LookupPropertyById(context, _jsSelf, methodID, &method) && !JSVAL_IS_VOID(method);
+}
+
+
 - (id) propertyWithID:(jsid)propID inContext:(JSContext *)context
 {
 	NSParameterAssert(context != NULL && JS_IsInRequest(context));
@@ -656,6 +688,12 @@ static JSFunctionSpec sScriptMethods[] =
 	return NO;
 }
 
+
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context
+{
+	return NO;
+}
+
 @end
 
 
@@ -666,6 +704,14 @@ void InitOOJSScript(JSContext *context, JSObject *global)
 }
 
 
+// Only world script handlers are indexed, so other scripts' properties don't invalidate the index.
+static void NoteEventHandlersChanged(JSContext *context, JSObject *scriptObj)
+{
+	OOJSScript *script = [(id)JS_GetPrivate(context, scriptObj) weakRefUnderlyingObject];
+	if ([script isWorldScript])  sEventHandlerGeneration++;
+}
+
+
 static JSBool ScriptAddProperty(JSContext *context, JSObject *this, jsid propID, jsval *value)
 {
 	// Complain about attempts to set the property tickle.
@@ -680,6 +726,25 @@ static JSBool ScriptAddProperty(JSContext *context, JSObject *this, jsid propID,
 		}
 	}
 	
+	NoteEventHandlersChanged(context, this);
+	return YES;
+}
+
+
+static JSBool ScriptDeleteProperty(JSContext *context, JSObject *this, jsid propID, jsval *value)
+{
+	NoteEventHandlersChanged(context, this);
+	return YES;
+}
+
+
+static JSBool ScriptSetProperty(JSContext *context, JSObject *this, jsid propID, JSBool strict, jsval *value)
+{
+	/*	Only assigning a function can turn a property into an event handler.
+		Overwriting a handler with something else leaves the script listed as
+		a handler, which is harmless: it is looked up again when called.
+	*/
+	if (OOJSValueIsFunction(context, *value))  NoteEventHandlersChanged(context, this);
 	return YES;
 }
 
@@ -43,13 +43,16 @@ MA 02110-1301, USA.
 #include <espeak-ng/speak_lib.h>
 #endif
 
-@class	GameController, CollisionRegion, MyOpenGLView, GuiDisplayGen,
+@class	GameController, CollisionRegion, OOSpatialGrid, MyOpenGLView, GuiDisplayGen,
 	Entity, ShipEntity, StationEntity, OOPlanetEntity, OOSunEntity,
 	OOVisualEffectEntity, PlayerEntity, OORoleSet, WormholeEntity, 
-	DockEntity, OOJSScript, OOWaypointEntity, OOSystemDescriptionManager;
+	DockEntity, OOJSScript, OOWaypointEntity, OOSystemDescriptionManager,
+	OOGalaxyRouteGraph, OOParticleEngine;
 
 
 typedef BOOL (*EntityFilterPredicate)(Entity *entity, void *parameter);
+typedef BOOL (*EntityEnumerationFunction)(Entity *entity, void *context);	// Return NO to stop enumerating.
+typedef void (*EntityVisitorFunction)(Entity *entity, void *context);		// Always called for every entity.
 
 #ifndef OO_SCANCLASS_TYPE
 #define OO_SCANCLASS_TYPE
@@ -113,6 +116,8 @@ enum
 #define SUN_SKIM_RADIUS_FACTOR				1.15470053838	// 2 sqrt(3) / 3. Why? I have no idea. -- Ahruman 2009-10-04
 #define SUN_SPARKS_RADIUS_FACTOR			2.0
 
+#define ENTITY_QUERY_MAX_STALE				64
+
 #define KEY_TECHLEVEL						@"techlevel"
 #define KEY_ECONOMY							@"economy"
 #define KEY_ECONOMY_DESC					@"economy_description"
@@ -270,6 +275,9 @@ enum
 	NSArray					*_scenarios;			// game start scenarios
 	NSDictionary			*globalSettings;		// miscellaneous global game settings
 	OOSystemDescriptionManager	*systemManager; // planetinfo data manager
+	OOGalaxyRouteGraph		*routeGraph;			// jump graph of the current galaxy, for route planning
+	NSUInteger				routeGraphGeneration;	// value of [systemManager routeGraphGeneration] when routeGraph was built
+	OOParticleEngine		*particleEngine;		// sparks, flashes and explosion debris
 	NSDictionary			*missiontext;			// holds descriptive text for missions, loaded at initialisation
 	NSArray					*equipmentData;			// holds data on available equipment, loaded at initialisation
 	NSArray					*equipmentDataOutfitting;
@@ -304,6 +312,7 @@ enum
 	OOTimeDelta		next_repopulation;
 	NSString		*system_repopulator;
 	BOOL			deterministic_population;
+	NSMutableDictionary		*staticConditionRoleSets;	// Role -> OOProbabilitySet without ships whose system-constant conditions fail here.
 
 	NSArray					*closeSystems;
 	
@@ -322,6 +331,34 @@ enum
 	NSMutableArray			*characterPool;
 	
 	CollisionRegion			*universeRegion;
+	OOSpatialGrid			*collisionGrid;
+	OOCollisionBroadphase	collisionBroadphase;
+	
+	// spatial index for range-limited entity searches, rebuilt on demand at most once per tick
+	OOSpatialGrid			*entityQueryGrid;
+	OOSpatialGrid			*scannerGrid;			// ships only, in cells the size of the scanner range; built with entityQueryGrid
+	BOOL					entityQueryGridValid;
+	BOOL					entityQueryGridOverflowed;	// too many changes since the build; searches are linear until the next tick
+	BOOL					useEntityQueryGrid;
+	unsigned				entityQueryStaleCount;
+	unsigned				entityQueryUnbinnedCount;
+	Entity					*entityQueryStale[ENTITY_QUERY_MAX_STALE];		// grid entries to skip; only compared, never dereferenced
+	Entity					*entityQueryUnbinned[UNIVERSE_MAX_ENTITIES];	// added or moved since the build, and tested directly
+	NSUInteger				entityQueryGridRebuildCount;
+	NSUInteger				entityRemovalCount;
+	
+	// laser ray casts this tick, and totals for the last complete tick (for the debug display)
+	NSUInteger				laserRayCount;
+	NSUInteger				laserRayTestCount;
+	NSUInteger				laserRayTotalCount;
+	NSUInteger				lastTickLaserRayCount;
+	NSUInteger				lastTickLaserRayCellCount;
+	NSUInteger				lastTickLaserRayTestCount;
+	
+	// inverted indexes for role and scan class searches
+	NSMutableDictionary		*shipsByRole;			// role -> array of ships
+	NSMutableDictionary		*entitiesByScanClass;	// scan class (NSNumber) -> array of entities
+	NSMapTable				*entityIndexKeys;		// entity -> array of keys it is indexed under
 	
 	// check and maintain linked lists occasionally
 	BOOL					doLinkedListMaintenanceThisUpdate;
@@ -357,7 +394,15 @@ enum
 	BOOL					_witchspaceBreakPattern;
 	BOOL					_dockingClearanceProtocolActive;
 	BOOL					_doingStartUp;
+	BOOL					_renderInterpolating;
+	BOOL					_splitEntityUpdate;
+	BOOL					_deferringFlightModels;		// only during the entity update loop
+	unsigned				_deferredFlightModelCount;
+	ShipEntity				*_deferredFlightModels[UNIVERSE_MAX_ENTITIES];
+	NSUInteger				_interpolationStep;
 
+	struct OORenderSnapshotEntry *_renderSnapshot;	// Per-frame copy of visible entity draw state, taken and used on the main thread by -drawUniverse.
+	
 	GLuint					msaaTextureID;
 	GLuint					targetTextureID;
 	GLuint					passthroughTextureID[2];
@@ -565,6 +610,8 @@ enum
 - (void) removeAllEntitiesExceptPlayer;
 - (void) removeDemoShips;
 
+- (OOParticleEngine *) particleEngine;
+
 - (ShipEntity *) makeDemoShipWithRole:(NSString *)role spinning:(BOOL)spinning;
 
 - (BOOL) isVectorClearFromEntity:(Entity *) e1 toDistance:(double)dist fromPoint:(HPVector) p2;
@@ -611,6 +658,17 @@ enum
 - (id) nearestEntityMatchingPredicate:(EntityFilterPredicate)predicate
 							parameter:(void *)parameter
 					 relativeToEntity:(Entity *)entity;
+/*	Non-allocating search: calls function for each matching entity, in order
+	of distance from the player, and returns the number of entities passed to
+	it. Range-limited searches (as with the find and count methods above) use
+	a spatial index rather than testing every entity.
+*/
+- (unsigned) enumerateEntitiesMatchingPredicate:(EntityFilterPredicate)predicate
+									  parameter:(void *)parameter
+										inRange:(double)range
+									   ofEntity:(Entity *)entity
+								   withFunction:(EntityEnumerationFunction)function
+										context:(void *)context;
 - (id) nearestShipMatchingPredicate:(EntityFilterPredicate)predicate
 						  parameter:(void *)parameter
 				   relativeToEntity:(Entity *)entity;
@@ -620,7 +678,23 @@ enum
 - (OOTimeDelta) getTimeDelta;
 
 - (void) findCollisionsAndShadows;
+// Called when an entity is moved other than by its own update, so that searches made later in the same tick can find it.
+- (void) noteEntityRepositioned:(Entity *)entity;
+/*	Call function for every ship that may be within range of position,
+	including ships that are not scannable; the caller must test the range
+	and anything else of interest. Uses a per-tick grid of ships where
+	worthwhile. function must not add or remove entities, and cannot stop
+	the enumeration early.
+*/
+- (void) enumerateShipsNearPosition:(HPVector)position range:(double)range withFunction:(EntityVisitorFunction)function context:(void *)context;
+// Totals since start-up, for benchmarks.
+- (NSUInteger) entityQueryGridRebuildCount;
+- (NSUInteger) totalLaserRayCount;
+// Called when an entity's roles or scan class change, to keep the role and scan class indexes up to date.
+- (void) reindexEntity:(Entity *)entity;
 - (NSString*) collisionDescription;
+- (OOCollisionBroadphase) collisionBroadphase;
+- (void) setCollisionBroadphase:(OOCollisionBroadphase)broadphase;
 - (void) dumpCollisions;
 
 - (OOViewID) viewDirection;
@@ -646,6 +720,27 @@ enum
 
 - (void) update:(OOTimeDelta)delta_t;
 
+/*	Split entity update: if set, the flight model step of NPC ships (moving
+	them according to their speed, roll, pitch and yaw, as decided by their
+	behaviour) is run in parallel on the async work manager's threads once
+	every entity has been updated, and then committed serially.
+*/
+- (BOOL) splitEntityUpdate;
+- (void) setSplitEntityUpdate:(BOOL)value;
+// Called from -[ShipEntity update:]. Returns YES if the ship's flight model step has been deferred.
+- (BOOL) deferFlightModelForShip:(ShipEntity *)ship;
+
+/*	Render interpolation for the fixed timestep game loop (see GameController).
+	-saveEntityStatesForInterpolation is called before each fixed step.
+	Between -beginRenderInterpolation: and -endRenderInterpolation, entities
+	which existed before the most recent step are placed the given fraction
+	of the way from their state before that step to their current state, so
+	that drawing is smooth when steps and frames don't line up.
+*/
+- (void) saveEntityStatesForInterpolation;
+- (void) beginRenderInterpolation:(double)fraction;
+- (void) endRenderInterpolation;
+
 // Time Acelleration Factor. In deployment builds, this is always 1.0 and -setTimeAccelerationFactor: does nothing.
 - (double) timeAccelerationFactor;
 - (void) setTimeAccelerationFactor:(double)newTimeAccelerationFactor;
@@ -49,6 +49,7 @@ MA 02110-1301, USA.
 
 #import "Octree.h"
 #import "CollisionRegion.h"
+#import "OOSpatialGrid.h"
 #import "OOGraphicsResetManager.h"
 #import "OODebugSupport.h"
 #import "OOEntityFilterPredicate.h"
@@ -63,6 +64,7 @@ MA 02110-1301, USA.
 #import "PlayerEntityContracts.h"
 #import "PlayerEntityControls.h"
 #import "PlayerEntityScriptMethods.h"
+#import "PlayerEntityLegacyScriptEngine.h"
 #import "StationEntity.h"
 #import "DockEntity.h"
 #import "SkyEntity.h"
@@ -77,11 +79,13 @@ MA 02110-1301, USA.
 #import "ProxyPlayerEntity.h"
 #import "OORingEffectEntity.h"
 #import "OOLightParticleEntity.h"
-#import "OOFlashEffectEntity.h"
-#import "OOExplosionCloudEntity.h"
+#import "OOParticleEngine.h"
 #import "OOSystemDescriptionManager.h"
+#import "OOGalaxyRouteGraph.h"
 #import "OOMusicController.h"
 #import "OOAsyncWorkManager.h"
+#import "OOSimulationBenchmark.h"
+#import "OOFrameTracer.h"
 #import "OODebugFlags.h"
 #import "OODebugStandards.h"
 #import "OOLoggingExtended.h"
@@ -115,6 +119,12 @@ enum
 // currently twice scanner radius
 #define LANE_WIDTH			51200.0
 
+// Entity search index: below this many entities a linear search is faster.
+#define ENTITY_QUERY_GRID_MIN_ENTITIES		32
+#define ENTITY_QUERY_GRID_CELL_SIZE			5000.0f
+// Extra padding around each entity in the search index, on top of the distance it can move in one tick.
+#define ENTITY_QUERY_GRID_SLACK				100.0
+
 static NSString * const kOOLogUniversePopulateError			= @"universe.populate.error";
 static NSString * const kOOLogUniversePopulateWitchspace	= @"universe.populate.witchspace";
 static NSString * const kOOLogEntityVerificationError		= @"entity.linkedList.verify.error";
@@ -141,59 +151,38 @@ extern Entity *gOOJSPlayerIfStale;
 Entity *gOOJSPlayerIfStale = nil;
 
 
+/*	The state -drawUniverse needs from each visible entity, captured once per
+	frame before any drawing rather than queried from the live entity on each
+	depth pass.
+	
+	This is not a frame packet for a separate render thread, and drawing does
+	not overlap the next update. The snapshot has to be taken after render
+	interpolation, which happens after the last -update: of the frame; there
+	may be several updates per frame, or none while paused. Drawing also
+	still goes through the live entities: drawables and shader uniform
+	bindings call back into entities and scripts, and the GL context belongs
+	to the main thread.
+*/
+typedef struct OORenderSnapshotEntry
+{
+	Entity					*entity;
+	OOMatrix				rotation;				// -drawRotationMatrix
+	Vector					cameraRelativePosition;
+	GLfloat					rangeFront;
+	GLfloat					rangeBack;
+	BOOL					draw;					// Whether it belongs in this view (in flight vs. demo ship).
+	BOOL					isSunlit;
+	BOOL					isStellarObject;
+	BOOL					isImmuneToBreakPatternHide;
+} OORenderSnapshotEntry;
+
+
 static BOOL MaintainLinkedLists(Universe* uni);
 OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range);
 
 static OOComparisonResult compareName(id dict1, id dict2, void * context);
 static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 
-/* TODO: route calculation is really slow - find a way to safely enable this */
-#undef CACHE_ROUTE_FROM_SYSTEM_RESULTS
-
-@interface RouteElement: NSObject
-{
-@private
-	OOSystemID _location, _parent;
-	double _cost, _distance, _time;
-	int _jumps;
-}
-
-+ (instancetype) elementWithLocation:(OOSystemID) location parent:(OOSystemID)parent cost:(double) cost distance:(double) distance time:(double) time jumps:(int) jumps;
-- (OOSystemID) parent;
-- (OOSystemID) location;
-- (double) cost;
-- (double) distance;
-- (double) time;
-- (int) jumps;
-
-@end
-
-@implementation RouteElement
-
-+ (instancetype) elementWithLocation:(OOSystemID) location parent:(OOSystemID) parent cost:(double) cost distance:(double) distance time:(double) time jumps:(int) jumps
-{
-	RouteElement *r = [[RouteElement alloc] init];
-	
-	r->_location = location;
-	r->_parent = parent;
-	r->_cost = cost;
-	r->_distance = distance;
-	r->_time = time;
-	r->_jumps = jumps;
-	
-	return [r autorelease];
-}
-
-- (OOSystemID) parent { return _parent; }
-- (OOSystemID) location { return _location; }
-- (double) cost { return _cost; }
-- (double) distance { return _distance; }
-- (double) time { return _time; }
-- (int) jumps { return _jumps; }
-
-@end
-
-
 @interface Universe (OOPrivate)
 
 - (void) initTargetFramebufferWithViewSize:(NSSize)viewSize;
@@ -201,8 +190,29 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 - (void) resizeTargetFramebufferWithViewSize:(NSSize)viewSize;
 - (void) prepareToRenderIntoDefaultFramebuffer;
 - (void) drawTargetTextureIntoDefaultFramebuffer;
+- (unsigned) takeRenderSnapshotForDemoShipMode:(BOOL)demoShipMode;
 
 - (BOOL) doRemoveEntity:(Entity *)entity;
+- (void) applyDeferredFlightModels:(OOTimeDelta)delta_t;
+- (void) invalidateEntityQueryGrid;
+- (void) rebuildEntityQueryGrid;
+- (BOOL) entityQueryGridUsable;
+- (void) noteEntityAdded:(Entity *)entity;
+- (void) noteEntityRemoved:(Entity *)entity;
+- (void) markEntityQueryStale:(Entity *)entity;
+- (void) resetLaserRayCounts;
+- (unsigned) gatherEntityQueryCandidates:(Entity **)candidates capacity:(unsigned)capacity nearPosition:(HPVector)p1 range:(double)range;
+- (unsigned) enumerateCandidates:(Entity **)candidates
+						   count:(unsigned)count
+			   matchingPredicate:(EntityFilterPredicate)predicate
+					   parameter:(void *)parameter
+						 inRange:(double)range
+						ofEntity:(Entity *)e1
+					withFunction:(EntityEnumerationFunction)function
+						 context:(void *)context;
+- (NSArray *) indexedEntitiesForPredicate:(EntityFilterPredicate)predicate parameter:(void *)parameter;
+- (void) addEntityToIndexes:(Entity *)entity;
+- (void) removeEntityFromIndexes:(Entity *)entity;
 - (void) setUpCargoPods;
 - (void) setUpInitialUniverse;
 - (HPVector) fractionalPositionFrom:(HPVector)point0 to:(HPVector)point1 withFraction:(double)routeFraction;
@@ -248,6 +258,8 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 - (NSDictionary *)demoShipData;
 - (void) setLibraryTextForDemoShip;
 
+- (OOProbabilitySet *) staticConditionSetForRole:(NSString *)role;
+
 @end
 
 
@@ -791,6 +803,9 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[OOShipRegistry sharedRegistry];
 	
 	entities = [[NSMutableArray arrayWithCapacity:MAX_NUMBER_OF_ENTITIES] retain];
+	shipsByRole = [[NSMutableDictionary alloc] init];
+	entitiesByScanClass = [[NSMutableDictionary alloc] init];
+	entityIndexKeys = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, MAX_NUMBER_OF_ENTITIES);
 	
 	[[GameController sharedController] logProgress:OOExpandKeyRandomized(@"loading-miscellany")];
 	
@@ -809,7 +824,7 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	
 	// Preload particle effect textures:
 	[OOLightParticleEntity setUpTexture];
-	[OOFlashEffectEntity setUpTexture];
+	particleEngine = [[OOParticleEngine alloc] init];
 
 	
 	// set up cargopod templates
@@ -825,6 +840,12 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[self setUpInitialUniverse];
 	
 	universeRegion = [[CollisionRegion alloc] initAsUniverse];
+	collisionGrid = [[OOSpatialGrid alloc] initWithCellSize:[prefs oo_floatForKey:@"collision-grid-cell-size" defaultValue:OO_SPATIAL_GRID_DEFAULT_CELL_SIZE]];
+	entityQueryGrid = [[OOSpatialGrid alloc] initWithCellSize:[prefs oo_floatForKey:@"entity-query-grid-cell-size" defaultValue:ENTITY_QUERY_GRID_CELL_SIZE]];
+	scannerGrid = [[OOSpatialGrid alloc] initWithCellSize:SCANNER_MAX_RANGE];
+	useEntityQueryGrid = [prefs oo_boolForKey:@"entity-query-grid" defaultValue:YES];
+	[self setCollisionBroadphase:OOCollisionBroadphaseFromString([prefs oo_stringForKey:@"collision-broadphase" defaultValue:@"COLLISION_BROADPHASE_SWEEP"])];
+	[self setSplitEntityUpdate:[prefs oo_boolForKey:@"split-entity-update" defaultValue:NO]];
 	entitiesDeadThisUpdate = [[NSMutableSet alloc] init];
 	framesDoneThisUpdate = 0;
 	drawCounter = 0;
@@ -865,6 +886,10 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[comm_log_gui release];
 	
 	[entities release];
+	[shipsByRole release];
+	[entitiesByScanClass release];
+	free(_renderSnapshot);
+	if (entityIndexKeys != NULL)  NSFreeMapTable(entityIndexKeys);
 	
 	[commodities release];
 	
@@ -873,6 +898,8 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[customSounds release];
 	[globalSettings release];
 	[systemManager release];
+	[routeGraph release];
+	[particleEngine release];
 	[missiontext release];
 	[equipmentData release];
 	[equipmentDataOutfitting release];
@@ -881,6 +908,7 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[screenBackgrounds release];
 	[gameView release];
 	[populatorSettings release];
+	[staticConditionRoleSets release];
 	[system_repopulator release];
 	[allPlanets release];
 	[allStations release];
@@ -889,6 +917,9 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 	[activeWormholes release];				
 	[characterPool release];
 	[universeRegion release];
+	[collisionGrid release];
+	[entityQueryGrid release];
+	[scannerGrid release];
 	[cargoPods release];
 
 	DESTROY(_firstBeacon);
@@ -1399,6 +1430,9 @@ static GLfloat	docked_light_specular[4]	= { DOCKED_ILLUM_LEVEL, DOCKED_ILLUM_LEV
 
 	[[GameController sharedController] logProgress:DESC(@"populating-space")];
 	
+	// Arrived somewhere new, so ship conditions must be re-tested.
+	[staticConditionRoleSets removeAllObjects];
+	
 	sunGoneNova = [systeminfo oo_boolForKey:@"sun_gone_nova" defaultValue:NO];
 	
 	OO_DEBUG_PUSH_PROGRESS(@"%@", @"setUpSpace - clearSubRegions, sky, dust");
@@ -3899,6 +3933,50 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 #define PROFILE_SHIP_SELECTION 0
 
 
+/*	Legacy condition queries whose answers only change when the player
+	arrives in a new system (or a script changes the system's properties).
+*/
+static BOOL IsSystemConstantQuery(NSString *selector)
+{
+	static NSSet *sSystemConstantQueries = nil;
+	if (sSystemConstantQueries == nil)
+	{
+		sSystemConstantQueries = [[NSSet alloc] initWithObjects:
+								  @"galaxy_number", @"planet_number",
+								  @"systemGovernment_number", @"systemGovernment_string",
+								  @"systemEconomy_number", @"systemEconomy_string",
+								  @"systemTechLevel_number", @"systemPopulation_number",
+								  @"systemProductivity_number", nil];
+	}
+	return [sSystemConstantQueries containsObject:selector];
+}
+
+
+/*	YES if a sanitized legacy conditions array (see -scriptTestCondition:)
+	only depends on the current system, so that its result can be kept until
+	the player leaves.
+*/
+static BOOL ConditionsAreSystemConstant(NSArray *conditions)
+{
+	NSArray *condition = nil;
+	foreach (condition, conditions)
+	{
+		OOOperationType opType = [condition oo_unsignedIntAtIndex:0];
+		if (opType == OP_FALSE)  continue;
+		if (opType == OP_MISSION_VAR || opType == OP_LOCAL_VAR)  return NO;
+		if (!IsSystemConstantQuery([condition oo_stringAtIndex:2]))  return NO;
+		
+		NSArray *operand = nil;
+		foreach (operand, [condition oo_arrayAtIndex:4])
+		{
+			// Each operand is (isSelector, string).
+			if ([operand oo_boolAtIndex:0] && !IsSystemConstantQuery([operand oo_stringAtIndex:1]))  return NO;
+		}
+	}
+	return YES;
+}
+
+
 - (BOOL) canInstantiateShip:(NSString *)shipKey
 {
 	NSDictionary			*shipInfo = nil;
@@ -3951,15 +4029,18 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 	
 	OOShipRegistry			*registry = [OOShipRegistry sharedRegistry];
 	NSString				*shipKey = nil;
-	OOMutableProbabilitySet	*pset = nil;
+	OOProbabilitySet		*pset = nil;
+	OOMutableProbabilitySet	*filteredSet = nil;
 	
 #if PROFILE_SHIP_SELECTION
 	static unsigned long	profTotal = 0, profSlowPath = 0;
 	++profTotal;
 #endif
 	
+	pset = [self staticConditionSetForRole:role];
+	
 	// Select a ship, check conditions and return it if possible.
-	shipKey = [registry randomShipKeyForRole:role];
+	shipKey = [pset randomObject];
 	if ([self canInstantiateShip:shipKey])  return shipKey;
 	
 	/*	If we got here, condition check failed.
@@ -3967,6 +4048,10 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 		run out of candidates.
 		This is special-cased because it has more overhead than the more
 		common conditionless lookup.
+		Ships refused by conditions that only depend on the system have
+		already been left out of pset. Other refusals are not remembered
+		between calls: allowSpawnShip handlers and conditions such as
+		d100_number may give a different answer next time.
 	*/
 	
 #if PROFILE_SHIP_SELECTION
@@ -3977,16 +4062,17 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 	}
 #endif
 	
-	pset = [[[registry probabilitySetForRole:role] mutableCopy] autorelease];
+	filteredSet = [[pset mutableCopy] autorelease];
+	[filteredSet removeObject:shipKey];
 	
-	while ([pset count] > 0)
+	while ([filteredSet count] > 0)
 	{
 		// Select a ship, check conditions and return it if possible.
-		shipKey = [pset randomObject];
+		shipKey = [filteredSet randomObject];
 		if ([self canInstantiateShip:shipKey])  return shipKey;
 		
 		// Condition failed -> remove ship from consideration.
-		[pset removeObject:shipKey];
+		[filteredSet removeObject:shipKey];
 	}
 	
 	// If we got here, some ships existed but all failed conditions test.
@@ -3996,6 +4082,42 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 }
 
 
+/*	The role's probability set, less any ships whose shipdata conditions
+	depend only on the current system and fail here. Kept until the player
+	arrives somewhere else or the system's properties change.
+*/
+- (OOProbabilitySet *) staticConditionSetForRole:(NSString *)role
+{
+	OOShipRegistry			*registry = [OOShipRegistry sharedRegistry];
+	OOProbabilitySet		*pset = [registry probabilitySetForRole:role];
+	OOProbabilitySet		*result = nil;
+	OOMutableProbabilitySet	*filteredSet = nil;
+	NSString				*shipKey = nil;
+	
+	// Conditions can't be tested before the player exists.
+	if (role == nil || pset == nil || PLAYER == nil)  return pset;
+	
+	result = [staticConditionRoleSets objectForKey:role];
+	if (result != nil)  return result;
+	
+	foreach (shipKey, [pset allObjects])
+	{
+		NSArray *conditions = [[registry shipInfoForKey:shipKey] oo_arrayForKey:@"conditions"];
+		if (conditions == nil || !ConditionsAreSystemConstant(conditions))  continue;
+		if ([PLAYER scriptTestConditions:conditions])  continue;
+		
+		if (filteredSet == nil)  filteredSet = [[pset mutableCopy] autorelease];
+		[filteredSet removeObject:shipKey];
+	}
+	result = (filteredSet != nil) ? [[filteredSet copy] autorelease] : pset;
+	
+	if (staticConditionRoleSets == nil)  staticConditionRoleSets = [[NSMutableDictionary alloc] init];
+	[staticConditionRoleSets setObject:result forKey:role];
+	
+	return result;
+}
+
+
 - (ShipEntity *) newShipWithRole:(NSString *)role
 {
 	OOJS_PROFILE_ENTER
@@ -4105,7 +4227,10 @@ static BOOL IsFriendlyStationPredicate(Entity *entity, void *parameter)
 	}
 	else
 	{
-		shipClass = [self shipClassForShipDictionary:shipDict];
+		// The compiled template has already resolved the class, and will be used to set up the ship.
+		const OOShipTemplate *shipTemplate = [[OOShipRegistry sharedRegistry] shipTemplateForKey:shipKey definition:shipDict];
+		if (shipTemplate != NULL)  shipClass = shipTemplate->isStation ? [StationEntity class] : [ShipEntity class];
+		else  shipClass = [self shipClassForShipDictionary:shipDict];
 		if (usePlayerProxy && shipClass == [ShipEntity class])
 		{
 			shipClass = [ProxyPlayerEntity class];
@@ -4817,7 +4942,10 @@ static const OOMatrix	starboard_matrix =
 	int currentPostFX = [self currentPostFX];
 	BOOL hudSeparateRenderPass =  [self useShaders] && (currentPostFX == OO_POSTFX_NONE || ((currentPostFX == OO_POSTFX_CLOAK || currentPostFX == OO_POSTFX_CRTBADSIGNAL) && [self colorblindMode] == OO_POSTFX_NONE));
  	NSSize  viewSize = [gameView backingViewSize];
+	BOOL	traceStageOpen = NO;
 	OOLog(@"universe.profile.draw", @"%@", @"Begin draw");
+	OOFrameTraceBegin(@"Universe draw");
+	OOFrameTraceStage(&traceStageOpen, @"draw set-up");
 	
 	if (!no_update)
 	{
@@ -4844,11 +4972,10 @@ static const OOMatrix	starboard_matrix =
 			int				i, v_status, vdist;
 			Vector			view_dir, view_up;
 			OOMatrix		view_matrix;
-			int				ent_count =	n_entities;
-			Entity			*my_entities[ent_count];
-			int				draw_count = 0;
+			int				draw_count;
 			PlayerEntity	*player = PLAYER;
 			Entity			*drawthing = nil;
+			OORenderSnapshotEntry *snapshot = NULL;
 			BOOL			demoShipMode = [player showDemoShips];
 			
 			float   aspect = viewSize.height/viewSize.width;
@@ -4860,20 +4987,8 @@ static const OOMatrix	starboard_matrix =
 				else [UNIVERSE setMainLightPosition:kZeroVector];
 			}
 			wasDisplayGUI = displayGUI;
-			// use a non-mutable copy so this can't be changed under us.
-			for (i = 0; i < ent_count; i++)
-			{
-				/* BUG: this list is ordered nearest to furthest from
-				 * the player, and we just assume that the camera is
-				 * on/near the player. So long as everything uses
-				 * depth tests, we'll get away with it; it'll just
-				 * occasionally be inefficient. - CIM */
-				Entity *e = sortedEntities[i]; // ordered NEAREST -> FURTHEST AWAY
-				if ([e isVisible])
-				{
-					my_entities[draw_count++] = [[e retain] autorelease];
-				}
-			}
+			draw_count = [self takeRenderSnapshotForDemoShipMode:demoShipMode];
+			snapshot = _renderSnapshot;
 			
 			v_status = [player status];
 			
@@ -4903,13 +5018,13 @@ static const OOMatrix	starboard_matrix =
 			float breakPlane = INTERMEDIATE_CLEAR_DEPTH;
 			for( int i = 0; i < draw_count; i++ )
 			{
-				if ([my_entities[i] cameraRangeFront] > breakPlane)
+				if (snapshot[i].rangeFront > breakPlane)
 				{
 					continue;
 				}
-				if ([my_entities[i] cameraRangeBack] > breakPlane)
+				if (snapshot[i].rangeBack > breakPlane)
 				{
-					breakPlane = [my_entities[i] cameraRangeBack];
+					breakPlane = snapshot[i].rangeBack;
 				}
 			}
 
@@ -5027,22 +5142,23 @@ static const OOMatrix	starboard_matrix =
 					OOVerifyOpenGLState();
 					OOCheckOpenGLErrors(@"Universe after setting up for opaque pass");
 					OOLog(@"universe.profile.draw", @"%@", @"Begin opaque pass");
+					OOFrameTraceStage(&traceStageOpen, @"draw entities");
 
 				
 					//		DRAW ALL THE OPAQUE ENTITIES
 					for (i = furthest; i >= nearest; i--)
 					{
-						drawthing = my_entities[i];
-						OOEntityStatus d_status = [drawthing status];
+						OORenderSnapshotEntry *entry = &snapshot[i];
+						drawthing = entry->entity;
 					
-						if (bpHide && !drawthing->isImmuneToBreakPatternHide)  continue;
+						if (bpHide && !entry->isImmuneToBreakPatternHide)  continue;
 						if ([drawthing lastDrawCounter] == drawCounter) continue;
-						if (vdist == 0 && [drawthing cameraRangeFront] < nearPlane)
+						if (vdist == 0 && entry->rangeFront < nearPlane)
 						{
 							continue;
 						}
 
-						if (!((d_status == STATUS_COCKPIT_DISPLAY) ^ demoShipMode)) // either demo ship mode or in flight
+						if (entry->draw) // either demo ship mode or in flight
 						{
 							// reset material properties
 							// FIXME: should be part of SetState
@@ -5054,10 +5170,9 @@ static const OOMatrix	starboard_matrix =
 							{
 								//translate the object
 								// HPVect: camera relative
-								[drawthing updateCameraRelativePosition];
-								OOGLTranslateModelView([drawthing cameraRelativePosition]);
+								OOGLTranslateModelView(entry->cameraRelativePosition);
 								//rotate the object
-								OOGLMultModelView([drawthing drawRotationMatrix]);
+								OOGLMultModelView(entry->rotation);
 							}
 							else
 							{
@@ -5068,7 +5183,7 @@ static const OOMatrix	starboard_matrix =
 							}
 						
 							// atmospheric fog
-							fogging = (inAtmosphere && ![drawthing isStellarObject]);
+							fogging = (inAtmosphere && !entry->isStellarObject);
 						
 							if (fogging)
 							{
@@ -5079,11 +5194,11 @@ static const OOMatrix	starboard_matrix =
 								OOGL(glFogfv(GL_FOG_COLOR, skyClearColor));
 								OOGL(glFogf(GL_FOG_START, half_scale));
 								OOGL(glFogf(GL_FOG_END, fog_scale));
-								fog_blend = OOClamp_0_1_f((magnitude([drawthing cameraRelativePosition]) - half_scale)/half_scale);
+								fog_blend = OOClamp_0_1_f((magnitude(entry->cameraRelativePosition) - half_scale)/half_scale);
 								[drawthing setAtmosphereFogging: [OOColor colorWithRed: skyClearColor[0] green: skyClearColor[1] blue: skyClearColor[2] alpha: fog_blend]];
 							}
 						
-							[self lightForEntity:demoShipMode || drawthing->isSunlit];
+							[self lightForEntity:demoShipMode || entry->isSunlit];
 						
 							// draw the thing
 							[drawthing setLastDrawCounter: drawCounter];
@@ -5100,17 +5215,16 @@ static const OOMatrix	starboard_matrix =
 						
 						}
 				
-						if (!((d_status == STATUS_COCKPIT_DISPLAY) ^ demoShipMode)) // either in flight or in demo ship mode
+						if (entry->draw) // either in flight or in demo ship mode
 						{
 							OOGLPushModelView();
 							if (EXPECT(drawthing != player))
 							{
 								//translate the object
 								// HPVect: camera relative positions
-								[drawthing updateCameraRelativePosition];
-								OOGLTranslateModelView([drawthing cameraRelativePosition]);
+								OOGLTranslateModelView(entry->cameraRelativePosition);
 								//rotate the object
-								OOGLMultModelView([drawthing drawRotationMatrix]);
+								OOGLMultModelView(entry->rotation);
 							}
 							else
 							{
@@ -5121,7 +5235,7 @@ static const OOMatrix	starboard_matrix =
 							}
 						
 							// experimental - atmospheric fog
-							fogging = (inAtmosphere && ![drawthing isStellarObject]);
+							fogging = (inAtmosphere && !entry->isStellarObject);
 						
 							if (fogging)
 							{
@@ -5132,7 +5246,7 @@ static const OOMatrix	starboard_matrix =
 								OOGL(glFogfv(GL_FOG_COLOR, skyClearColor));
 								OOGL(glFogf(GL_FOG_START, half_scale));
 								OOGL(glFogf(GL_FOG_END, fog_scale));
-								fog_blend = OOClamp_0_1_f((magnitude([drawthing cameraRelativePosition]) - half_scale)/half_scale);
+								fog_blend = OOClamp_0_1_f((magnitude(entry->cameraRelativePosition) - half_scale)/half_scale);
 								[drawthing setAtmosphereFogging: [OOColor colorWithRed: skyClearColor[0] green: skyClearColor[1] blue: skyClearColor[2] alpha: fog_blend]];
 							}
 						
@@ -5150,6 +5264,15 @@ static const OOMatrix	starboard_matrix =
 							OOGLPopModelView();
 						}
 					}
+					
+					//		DRAW PARTICLE EFFECTS IN THIS DEPTH RANGE
+					if (EXPECT(!demoShipMode && !bpHide))
+					{
+						[particleEngine drawFromViewpoint:[player viewpointPosition]
+											   viewMatrix:viewMatrix
+												 minRange:vdist ? 0.0f : INTERMEDIATE_CLEAR_DEPTH
+												 maxRange:vdist ? INTERMEDIATE_CLEAR_DEPTH : MAX_CLEAR_DEPTH];
+					}
 				}
 
 				OOGLPopModelView();
@@ -5178,8 +5301,10 @@ static const OOMatrix	starboard_matrix =
 				OOGL(glBindFramebuffer(GL_FRAMEBUFFER, defaultDrawFBO));
 				
 				OOLog(@"universe.profile.secondPassDraw", @"%@", @"Begin second pass draw");
+				OOFrameTraceBegin(@"second pass draw");
 				[self drawTargetTextureIntoDefaultFramebuffer];
 				OOCheckOpenGLErrors(@"Universe after drawing from custom framebuffer to screen framebuffer");
+				OOFrameTraceEnd();
 				OOLog(@"universe.profile.secondPassDraw", @"%@", @"End second pass drawing");
 	
 				OOLog(@"universe.profile.drawHUD", @"%@", @"Begin HUD drawing");
@@ -5188,6 +5313,7 @@ static const OOMatrix	starboard_matrix =
 			/* Reset for HUD drawing */
 			OOCheckOpenGLErrors(@"Universe after drawing entities");
 			OOLog(@"universe.profile.draw", @"%@", @"Begin HUD");
+			OOFrameTraceStage(&traceStageOpen, @"draw HUD");
 			
 			GLfloat	lineWidth = [gameView backingViewSize].width / 1024.0; // restore line size
 			if (lineWidth < 1.0)  lineWidth = 1.0;
@@ -5278,6 +5404,7 @@ static const OOMatrix	starboard_matrix =
 	}
 	
 	OOLog(@"universe.profile.draw", @"%@", @"End drawing");
+	OOFrameTraceStage(&traceStageOpen, nil);
 	
 	// actions when the HUD should be rendered together with the 3d universe
 	if(!hudSeparateRenderPass)
@@ -5288,10 +5415,59 @@ static const OOMatrix	starboard_matrix =
 			OOGL(glBindFramebuffer(GL_FRAMEBUFFER, defaultDrawFBO));
 			
 			OOLog(@"universe.profile.secondPassDraw", @"%@", @"Begin second pass draw");
+			OOFrameTraceBegin(@"second pass draw");
 			[self drawTargetTextureIntoDefaultFramebuffer];
+			OOFrameTraceEnd();
 			OOLog(@"universe.profile.secondPassDraw", @"%@", @"End second pass drawing");
 		}
 	}
+	
+	OOFrameTraceEnd();
+}
+
+
+/*	Capture the draw state of all visible entities, ordered nearest to
+	furthest, into _renderSnapshot. Returns the number of entries.
+*/
+- (unsigned) takeRenderSnapshotForDemoShipMode:(BOOL)demoShipMode
+{
+	unsigned		i, count = 0;
+	PlayerEntity	*player = PLAYER;
+	
+	if (_renderSnapshot == NULL)
+	{
+		_renderSnapshot = malloc(sizeof *_renderSnapshot * UNIVERSE_MAX_ENTITIES);
+		if (_renderSnapshot == NULL)  return 0;
+	}
+	
+	for (i = 0; i < n_entities; i++)
+	{
+		/* BUG: this list is ordered nearest to furthest from
+		 * the player, and we just assume that the camera is
+		 * on/near the player. So long as everything uses
+		 * depth tests, we'll get away with it; it'll just
+		 * occasionally be inefficient. - CIM */
+		Entity *e = sortedEntities[i]; // ordered NEAREST -> FURTHEST AWAY
+		if (![e isVisible])  continue;
+		
+		OORenderSnapshotEntry *entry = &_renderSnapshot[count++];
+		entry->entity = [[e retain] autorelease];
+		entry->draw = !(([e status] == STATUS_COCKPIT_DISPLAY) ^ demoShipMode);
+		if (entry->draw && e != player)
+		{
+			// HPVect: camera-relative position
+			[e updateCameraRelativePosition];
+			entry->rotation = [e drawRotationMatrix];
+		}
+		entry->cameraRelativePosition = [e cameraRelativePosition];
+		entry->rangeFront = [e cameraRangeFront];
+		entry->rangeBack = [e cameraRangeBack];
+		entry->isSunlit = e->isSunlit;
+		entry->isStellarObject = [e isStellarObject];
+		entry->isImmuneToBreakPatternHide = e->isImmuneToBreakPatternHide;
+	}
+	
+	return count;
 }
 
 
@@ -5666,6 +5842,8 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		
 		// increase n_entities...
 		n_entities++;
+		[self noteEntityAdded:entity];
+		[self addEntityToIndexes:entity];
 		
 		// add entity to linked lists
 		[entity addToLinkedLists];	// position and universe have been set - so we can do this
@@ -5770,6 +5948,8 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	// maintain sorted list
 	n_entities = 1;
 	
+	[particleEngine removeAllParticles];
+	
 	cachedSun = nil;
 	cachedPlanet = nil;
 	cachedStation = nil;
@@ -5783,6 +5963,12 @@ static BOOL MaintainLinkedLists(Universe *uni)
 }
 
 
+- (OOParticleEngine *) particleEngine
+{
+	return particleEngine;
+}
+
+
 - (void) removeDemoShips
 {
 	int i;
@@ -6113,9 +6299,7 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	{
 		NSString *key = (randf() < 0.5) ? @"oolite-hull-spark" : @"oolite-hull-spark-b";
 		NSDictionary *settings = [UNIVERSE explosionSetting:key];
-		OOExplosionCloudEntity* burst = [OOExplosionCloudEntity explosionCloudFromEntity:target withSettings:settings];
-		[burst setPosition:pos];
-		[self addEntity: burst];
+		[particleEngine addExplosionCloudFromEntity:target position:pos size:0.0f settings:settings];
 		if ([target energy] * randf() < damage)
 		{
 			ShipEntity *wreck = [self addWreckageFrom:target withRole:@"oolite-wreckage-chunk" at:pos scale:0.05 lifetime:(125.0+(randf()*200.0))];
@@ -6128,8 +6312,70 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	}
 	else
 	{
-		[self addEntity:[OOFlashEffectEntity laserFlashWithPosition:pos velocity:[target velocity] color:color]];
+		[particleEngine addLaserFlashAt:pos velocity:[target velocity] color:color];
+	}
+}
+
+
+typedef struct
+{
+	ShipEntity			*source;
+	ShipEntity			*parent;
+	HPVector			p0;
+	HPVector			p1;
+	Vector				r1, u1, f1;
+	double				nearest;
+	ShipEntity			*hitEntity;
+	ShipEntity			*hitSubentity;
+	Entity				**stale;
+	unsigned			staleCount;
+	NSUInteger			tests;
+} OOLaserRayContext;
+
+
+static void TestLaserRayAgainstEntity(OOLaserRayContext *ray, Entity *entity)
+{
+	if (entity == ray->source || entity == ray->parent || ![entity isShip] || ![entity canCollide])  return;
+	ray->tests++;
+	
+	// check outermost bounding sphere
+	GLfloat cr = entity->collision_radius;
+	Vector rpos = HPVectorToVector(HPvector_subtract(entity->position, ray->p0));
+	Vector v_off = make_vector(dot_product(rpos, ray->r1), dot_product(rpos, ray->u1), dot_product(rpos, ray->f1));
+	if (v_off.z > 0.0 && v_off.z < ray->nearest + cr &&							// ahead AND within range
+		v_off.x < cr && v_off.x > -cr && v_off.y < cr && v_off.y > -cr &&		// AND not off to one side or another
+		v_off.x * v_off.x + v_off.y * v_off.y < cr * cr)						// AND not off to both sides
+	{
+		ShipEntity *entHit = nil;
+		GLfloat hit = [(ShipEntity *)entity doesHitLine:ray->p0 :ray->p1 :&entHit];	// octree detection
+		
+		if (hit > 0.0 && hit < ray->nearest)
+		{
+			if ([entHit isSubEntity])
+			{
+				ray->hitSubentity = entHit;
+			}
+			ray->hitEntity = (ShipEntity *)entity;
+			ray->nearest = hit;
+			ray->p1 = HPvector_add(ray->p0, vectorToHPVector(vector_multiply_scalar(ray->f1, hit)));
+		}
+	}
+}
+
+
+static OOHPScalar LaserRayGridFunction(Entity *entity, void *context)
+{
+	OOLaserRayContext *ray = context;
+	unsigned i;
+	
+	// Stale entries are for entities that have moved, and are tested separately, or have gone.
+	for (i = 0; i < ray->staleCount; i++)
+	{
+		if (ray->stale[i] == entity)  return ray->nearest;
 	}
+	
+	TestLaserRayAgainstEntity(ray, entity);
+	return ray->nearest;
 }
 
 
@@ -6137,8 +6383,6 @@ static BOOL MaintainLinkedLists(Universe *uni)
 {
 	if (srcEntity == nil) return nil;
 	
-	ShipEntity		*hit_entity = nil;
-	ShipEntity		*hit_subentity = nil;
 	HPVector			p0 = [srcEntity position];
 	Quaternion		q1 = [srcEntity normalOrientation];
 	ShipEntity		*parent = [srcEntity parentEntity];
@@ -6154,20 +6398,7 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	}
 	
 	double			nearest = [srcEntity weaponRange];
-	int				i;
-	int				ent_count = n_entities;
-	int				ship_count = 0;
-	ShipEntity		*my_entities[ent_count];
-	
-	for (i = 0; i < ent_count; i++)
-	{
-		Entity* ent = sortedEntities[i];
-		if (ent != srcEntity && ent != parent && [ent isShip] && [ent canCollide])
-		{
-			my_entities[ship_count++] = [(ShipEntity *)ent retain];
-		}
-	}
-	
+	unsigned		i;
 	
 	Vector u1, f1, r1;
 	basis_vectors_from_quaternion(q1, &r1, &u1, &f1);
@@ -6193,49 +6424,60 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	}
 	
 	basis_vectors_from_quaternion(q1, &r1, NULL, &f1);
-	HPVector p1 = HPvector_add(p0, vectorToHPVector(vector_multiply_scalar(f1, nearest)));	//endpoint
 	
-	for (i = 0; i < ship_count; i++)
+	OOLaserRayContext ray =
+	{
+		srcEntity, parent,
+		p0, HPvector_add(p0, vectorToHPVector(vector_multiply_scalar(f1, nearest))),	// endpoint
+		r1, u1, f1,
+		nearest,
+		nil, nil,
+		NULL, 0,
+		0
+	};
+	
+	/*	Nothing here can add or remove entities, so the candidates are not
+		retained. With enough entities around, only those near the beam are
+		looked at, nearest cells first.
+	*/
+	if ([self entityQueryGridUsable])
 	{
-		ShipEntity *e2 = my_entities[i];
+		if (!entityQueryGridValid)  [self rebuildEntityQueryGrid];
 		
-		// check outermost bounding sphere
-		GLfloat cr = e2->collision_radius;
-		Vector rpos = HPVectorToVector(HPvector_subtract(e2->position, p0));
-		Vector v_off = make_vector(dot_product(rpos, r1), dot_product(rpos, u1), dot_product(rpos, f1));
-		if (v_off.z > 0.0 && v_off.z < nearest + cr &&								// ahead AND within range
-			v_off.x < cr && v_off.x > -cr && v_off.y < cr && v_off.y > -cr &&		// AND not off to one side or another
-			v_off.x * v_off.x + v_off.y * v_off.y < cr * cr)						// AND not off to both sides
+		ray.stale = entityQueryStale;
+		ray.staleCount = entityQueryStaleCount;
+		for (i = 0; i < entityQueryUnbinnedCount; i++)
 		{
-			ShipEntity *entHit = nil;
-			GLfloat hit = [(ShipEntity *)e2 doesHitLine:p0 :p1 :&entHit];	// octree detection
-			
-			if (hit > 0.0 && hit < nearest)
-			{
-				if ([entHit isSubEntity])
-				{
-					hit_subentity = entHit;
-				}
-				hit_entity = e2;
-				nearest = hit;
-				p1 = HPvector_add(p0, vectorToHPVector(vector_multiply_scalar(f1, nearest)));
-			}
+			TestLaserRayAgainstEntity(&ray, entityQueryUnbinned[i]);
+		}
+		
+		[entityQueryGrid enumerateEntitiesAlongRayFrom:p0 direction:f1 length:ray.nearest withFunction:LaserRayGridFunction context:&ray];
+	}
+	else
+	{
+		for (i = 0; i < n_entities; i++)
+		{
+			TestLaserRayAgainstEntity(&ray, sortedEntities[i]);
 		}
 	}
 	
+	laserRayCount++;
+	laserRayTotalCount++;
+	laserRayTestCount += ray.tests;
+	
+	ShipEntity *hit_entity = ray.hitEntity;
 	if (hit_entity)
 	{
 		// I think the above code does not guarantee that the closest hit_subentity belongs to the closest hit_entity.
+		ShipEntity *hit_subentity = ray.hitSubentity;
 		if (hit_subentity && [hit_subentity owner] == hit_entity)  [hit_entity setSubEntityTakingDamage:hit_subentity];
 		
 		if (range_ptr != NULL)
 		{
-			*range_ptr = nearest;
+			*range_ptr = ray.nearest;
 		}
 	}
 	
-	for (i = 0; i < ship_count; i++)  [my_entities[i] release]; //	released
-	
 	return hit_entity;
 }
 
@@ -6414,39 +6656,95 @@ static BOOL MaintainLinkedLists(Universe *uni)
 }
 
 
-- (unsigned) countEntitiesMatchingPredicate:(EntityFilterPredicate)predicate
-								  parameter:(void *)parameter
-									inRange:(double)range
-								   ofEntity:(Entity *)e1
+static BOOL CountEntityFunction(Entity *entity, void *context)
 {
-	unsigned		i, found = 0;
-	HPVector			p1;
-	double			distance, cr;
-	
-	if (predicate == NULL)  predicate = YESPredicate;
-	
-	if (e1 != nil)  p1 = e1->position;
-	else  p1 = kZeroHPVector;
+	return YES;
+}
+
+
+static BOOL AddEntityToArrayFunction(Entity *entity, void *context)
+{
+	[(NSMutableArray *)context addObject:entity];
+	return YES;
+}
+
+
+typedef struct
+{
+	Entity					**candidates;
+	unsigned				count;
+	unsigned				capacity;
+	Entity					**stale;
+	unsigned				staleCount;
+} OOEntityQueryGatherContext;
+
+
+static void GatherEntityQueryCandidate(Entity *entity, void *context)
+{
+	OOEntityQueryGatherContext *gather = context;
+	unsigned i;
 	
-	for (i = 0; i < n_entities; i++)
+	// Stale entries are for entities that have moved, and are added separately, or have gone.
+	for (i = 0; i < gather->staleCount; i++)
 	{
-		Entity *e2 = sortedEntities[i];
-		if (e2 != e1 && predicate(e2, parameter))
-		{
-			if (range < 0)  distance = -1;	// Negative range means infinity
-			else
-			{
-				cr = range + e2->collision_radius;
-				distance = HPdistance2(e2->position, p1) - cr * cr;
-			}
-			if (distance < 0)
-			{
-				found++;
-			}
-		}
+		if (gather->stale[i] == entity)  return;
 	}
+	if (EXPECT(gather->count < gather->capacity))  gather->candidates[gather->count++] = entity;
+}
+
+
+typedef struct
+{
+	EntityVisitorFunction		function;
+	void						*context;
+	Entity						**stale;
+	unsigned					staleCount;
+} OOScannerGridContext;
+
+
+static void ScannerGridFunction(Entity *entity, void *context)
+{
+	OOScannerGridContext *scan = context;
+	unsigned i;
 	
-	return found;
+	// Stale entries are for entities that have moved, and are reported separately, or have gone.
+	for (i = 0; i < scan->staleCount; i++)
+	{
+		if (scan->stale[i] == entity)  return;
+	}
+	scan->function(entity, scan->context);
+}
+
+
+/*	Short-lived effects such as laser and plasma shots and explosion flashes
+	can't be hit, scanned or seen by scripts, so they are left out of the
+	entity search index; combat adds and removes lots of them every tick.
+	Visual effects and waypoints can be searched for by scripts.
+*/
+OOINLINE BOOL EntityIsQueryIndexed(Entity *entity)
+{
+	return ![entity isEffect] || entity->isVisualEffect || [entity isWaypoint];
+}
+
+
+static int CompareEntitiesByZeroIndex(const void *a, const void *b)
+{
+	int ia = (*(Entity * const *)a)->zero_index, ib = (*(Entity * const *)b)->zero_index;
+	return (ia > ib) - (ia < ib);
+}
+
+
+- (unsigned) countEntitiesMatchingPredicate:(EntityFilterPredicate)predicate
+								  parameter:(void *)parameter
+									inRange:(double)range
+								   ofEntity:(Entity *)e1
+{
+	return [self enumerateEntitiesMatchingPredicate:predicate
+										  parameter:parameter
+											inRange:range
+										   ofEntity:e1
+									   withFunction:CountEntityFunction
+											context:NULL];
 }
 
 
@@ -6495,36 +6793,83 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 {
 	OOJS_PROFILE_ENTER
 	
-	unsigned		i;
-	HPVector			p1;
 	NSMutableArray	*result = nil;
 	
 	OOJSPauseTimeLimiter();
 	
-	if (predicate == NULL)  predicate = YESPredicate;
+	result = [NSMutableArray array];
+	[self enumerateEntitiesMatchingPredicate:predicate
+								   parameter:parameter
+									 inRange:range
+									ofEntity:e1
+								withFunction:AddEntityToArrayFunction
+									 context:result];
+	
+	OOJSResumeTimeLimiter();
 	
-	result = [NSMutableArray arrayWithCapacity:n_entities];
+	return result;
+	
+	OOJS_PROFILE_EXIT
+}
+
+
+- (unsigned) enumerateEntitiesMatchingPredicate:(EntityFilterPredicate)predicate
+									  parameter:(void *)parameter
+										inRange:(double)range
+									   ofEntity:(Entity *)e1
+								   withFunction:(EntityEnumerationFunction)function
+										context:(void *)context
+{
+	unsigned		i, found = 0;
+	HPVector		p1;
+	
+	NSParameterAssert(function != NULL);
+	
+	if (predicate == NULL)  predicate = YESPredicate;
 	
-	if (e1 != nil)  p1 = [e1 position];
+	if (e1 != nil)  p1 = e1->position;
 	else  p1 = kZeroHPVector;
 	
-	for (i = 0; i < n_entities; i++)
+	BOOL useGrid = range >= 0 && [self entityQueryGridUsable];
+	
+	/*	Searches by role or scan class only need to look at the entities with
+		that role or scan class, unless the result of a ranged search is
+		likely to be much smaller.
+	*/
+	NSArray *indexed = [self indexedEntitiesForPredicate:predicate parameter:parameter];
+	if (indexed != nil && (!useGrid || [indexed count] <= ENTITY_QUERY_GRID_MIN_ENTITIES))
 	{
-		Entity *e2 = sortedEntities[i];
+		unsigned count = (unsigned)[indexed count];
+		if (count == 0)  return 0;
 		
-		if (e1 != e2 &&
-			EntityInRange(p1, e2, range) &&
-			predicate(e2, parameter))
+		Entity *candidates[count];
+		[indexed getObjects:(id *)candidates];
+		if (count > 1)  qsort(candidates, count, sizeof *candidates, CompareEntitiesByZeroIndex);
+		
+		return [self enumerateCandidates:candidates count:count matchingPredicate:predicate parameter:parameter inRange:range ofEntity:e1 withFunction:function context:context];
+	}
+	
+	if (!useGrid)
+	{
+		for (i = 0; i < n_entities; i++)
 		{
-			[result addObject:e2];
+			Entity *e2 = sortedEntities[i];
+			
+			if (e1 != e2 &&
+				EntityInRange(p1, e2, range) &&
+				predicate(e2, parameter))
+			{
+				found++;
+				if (!function(e2, context))  break;
+			}
 		}
+		return found;
 	}
 	
-	OOJSResumeTimeLimiter();
-	
-	return result;
+	Entity			*candidates[n_entities];
+	unsigned		count = [self gatherEntityQueryCandidates:candidates capacity:n_entities nearPosition:p1 range:range];
 	
-	OOJS_PROFILE_EXIT
+	return [self enumerateCandidates:candidates count:count matchingPredicate:predicate parameter:parameter inRange:range ofEntity:e1 withFunction:function context:context];
 }
 
 
@@ -6663,6 +7008,25 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 }
 
 
+- (void) noteEntityRepositioned:(Entity *)entity
+{
+	if (!entityQueryGridValid || entityQueryGridOverflowed || !EntityIsQueryIndexed(entity))  return;
+	
+	// Entities not in the universe aren't in the index; -noteEntityAdded: deals with them when they are added.
+	int index = entity->zero_index;
+	if (index < 0 || (unsigned)index >= n_entities || sortedEntities[index] != entity)  return;
+	
+	unsigned i;
+	for (i = 0; i < entityQueryUnbinnedCount; i++)
+	{
+		if (entityQueryUnbinned[i] == entity)  return;
+	}
+	
+	[self markEntityQueryStale:entity];
+	if (!entityQueryGridOverflowed)  entityQueryUnbinned[entityQueryUnbinnedCount++] = entity;
+}
+
+
 - (OOTimeAbsolute) getTime
 {
 	return universal_time;
@@ -6688,18 +7052,43 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 	
 	if (![[self gameController] isGamePaused])
 	{
-		[universeRegion findCollisions];
-	}
-	
-	// do check for entities that can't see the sun!
-	[universeRegion findShadowedEntities];
+		if (collisionBroadphase == COLLISION_BROADPHASE_GRID)
+		{
+			[universeRegion findCollisionsUsingGrid:collisionGrid entities:sortedEntities count:n_entities];
+		}
+		else
+		{
+			[universeRegion findCollisions];
+		}
+	}
+	
+	// do check for entities that can't see the sun!
+	[universeRegion findShadowedEntities];
 }
 
 
 - (NSString*) collisionDescription
 {
-	if (universeRegion != nil)  return [universeRegion collisionDescription];
-	else  return @"-";
+	NSString *rays = [NSString stringWithFormat:@"r%lu/%lu/%lu", (unsigned long)lastTickLaserRayCount, (unsigned long)lastTickLaserRayCellCount, (unsigned long)lastTickLaserRayTestCount];
+	if (universeRegion != nil)  return [NSString stringWithFormat:@"%@ - %@", [universeRegion collisionDescription], rays];
+	else  return [NSString stringWithFormat:@"- - %@", rays];
+}
+
+
+- (OOCollisionBroadphase) collisionBroadphase
+{
+	return collisionBroadphase;
+}
+
+
+- (void) setCollisionBroadphase:(OOCollisionBroadphase)broadphase
+{
+	if (broadphase != COLLISION_BROADPHASE_GRID)  broadphase = COLLISION_BROADPHASE_SWEEP;
+	if (broadphase != collisionBroadphase)
+	{
+		OOLog(@"collision.broadphase", @"Using collision broadphase %@.", OOStringFromCollisionBroadphase(broadphase));
+	}
+	collisionBroadphase = broadphase;
 }
 
 
@@ -7104,11 +7493,160 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 }
 
 
+static BOOL sUpdateTraceStageOpen = NO;
+
+OOINLINE void NoteUpdateStage(NSString *stage)
+{
+	OOLog(@"universe.profile.update", @"%@", stage);
+	OOFrameTraceStage(&sUpdateTraceStageOpen, stage);
+	if (EXPECT_NOT(gOOSimulationBenchmarkActive))  OOSimulationBenchmarkNoteStage(stage);
+}
+
+
+OOINLINE void MaintainZeroDistanceOrder(Entity **sortedEntities, Entity *thing)
+{
+	GLfloat z_distance = thing->zero_distance;
+	
+	int index = thing->zero_index;
+	while (index > 0 && z_distance < sortedEntities[index - 1]->zero_distance)
+	{
+		sortedEntities[index] = sortedEntities[index - 1];	// bubble up the list, usually by just one position
+		sortedEntities[index - 1] = thing;
+		thing->zero_index = index - 1;
+		sortedEntities[index]->zero_index = index;
+		index--;
+	}
+}
+
+
+typedef struct
+{
+	ShipEntity		**ships;
+	OOTimeDelta		delta_t;
+} OOFlightModelContext;
+
+
+static void ApplyDeferredFlightModel(NSUInteger index, void *context)
+{
+	OOFlightModelContext *flightContext = context;
+	[flightContext->ships[index] applyDeferredFlightModel:flightContext->delta_t];
+}
+
+
+- (BOOL) splitEntityUpdate
+{
+	return _splitEntityUpdate;
+}
+
+
+- (void) setSplitEntityUpdate:(BOOL)value
+{
+	_splitEntityUpdate = !!value;
+}
+
+
+- (BOOL) deferFlightModelForShip:(ShipEntity *)ship
+{
+	if (!_deferringFlightModels || EXPECT_NOT(_deferredFlightModelCount == UNIVERSE_MAX_ENTITIES))  return NO;
+	
+	_deferredFlightModels[_deferredFlightModelCount++] = ship;
+	return YES;
+}
+
+
+/*	Parallel stage of the split entity update: move the ships whose flight
+	model step was deferred, then bring their distance from the player and
+	other bookkeeping done by -[Entity update:] up to date.
+*/
+- (void) applyDeferredFlightModels:(OOTimeDelta)delta_t
+{
+	unsigned i, count = 0;
+	
+	// Ships can be removed after their update, for instance when shot by a ship updated later.
+	for (i = 0; i < _deferredFlightModelCount; i++)
+	{
+		ShipEntity *ship = _deferredFlightModels[i];
+		int index = ship->zero_index;
+		if (index >= 0 && (unsigned)index < n_entities && sortedEntities[index] == ship)
+		{
+			_deferredFlightModels[count++] = ship;
+		}
+	}
+	_deferredFlightModelCount = 0;
+	if (count == 0)  return;
+	
+	OOFlightModelContext flightContext = { _deferredFlightModels, delta_t };
+	[[OOAsyncWorkManager sharedAsyncWorkManager] performBatchWithFunction:ApplyDeferredFlightModel
+																  context:&flightContext
+																	count:count];
+	
+	for (i = 0; i < count; i++)
+	{
+		ShipEntity *ship = _deferredFlightModels[i];
+		[ship commitDeferredFlightModel];
+		MaintainZeroDistanceOrder(sortedEntities, ship);
+	}
+}
+
+
+- (void) saveEntityStatesForInterpolation
+{
+	unsigned i;
+	
+	NSAssert(!_renderInterpolating, @"Entity states must not be saved while render interpolation is in effect.");
+	
+	_interpolationStep++;
+	for (i = 0; i < n_entities; i++)
+	{
+		[sortedEntities[i] saveInterpolationStateForStep:_interpolationStep];
+	}
+}
+
+
+- (void) beginRenderInterpolation:(double)fraction
+{
+	unsigned		i;
+	PlayerEntity	*player = PLAYER;
+	
+	if (_renderInterpolating)  return;
+	_renderInterpolating = YES;
+	
+	// The player goes first, since camera-relative positions depend on its viewpoint.
+	fraction = OOClamp_0_1_d(fraction);
+	[player beginRenderInterpolation:fraction forStep:_interpolationStep];
+	for (i = 0; i < n_entities; i++)
+	{
+		if (sortedEntities[i] != player)  [sortedEntities[i] beginRenderInterpolation:fraction forStep:_interpolationStep];
+	}
+	[particleEngine beginRenderInterpolation:fraction];
+}
+
+
+- (void) endRenderInterpolation
+{
+	unsigned		i;
+	PlayerEntity	*player = PLAYER;
+	
+	if (!_renderInterpolating)  return;
+	_renderInterpolating = NO;
+	
+	[player endRenderInterpolation];
+	for (i = 0; i < n_entities; i++)
+	{
+		if (sortedEntities[i] != player)  [sortedEntities[i] endRenderInterpolation];
+	}
+	[particleEngine endRenderInterpolation];
+}
+
+
 - (void) update:(OOTimeDelta)inDeltaT
 {
 	volatile OOTimeDelta delta_t = inDeltaT * [self timeAccelerationFactor];
 	NSUInteger sessionID = _sessionID;
-	OOLog(@"universe.profile.update", @"%@", @"Begin update");
+	OOFrameTraceBegin(@"Universe update");
+	NoteUpdateStage(@"Begin update");
+	[self invalidateEntityQueryGrid];	// entities are about to move
+	[self resetLaserRayCounts];
 	if (EXPECT(!no_update))
 	{
 		next_repopulation -= delta_t;
@@ -7227,9 +7765,15 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 				}
 			}
 			
+			update_stage = @"update:particles";
+			NoteUpdateStage(update_stage);
+			[particleEngine update:delta_t];
+			
 			update_stage = @"update:entity";
 			NSMutableSet *zombies = nil;
-			OOLog(@"universe.profile.update", @"%@", update_stage);
+			NoteUpdateStage(update_stage);
+			_deferredFlightModelCount = 0;
+			_deferringFlightModels = _splitEntityUpdate;
 			for (i = 0; i < ent_count; i++)
 			{
 				Entity *thing = my_entities[i];
@@ -7257,17 +7801,7 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 #endif
 				
 				// maintain distance-from-player list
-				GLfloat z_distance = thing->zero_distance;
-				
-				int index = thing->zero_index;
-				while (index > 0 && z_distance < sortedEntities[index - 1]->zero_distance)
-				{
-					sortedEntities[index] = sortedEntities[index - 1];	// bubble up the list, usually by just one position
-					sortedEntities[index - 1] = thing;
-					thing->zero_index = index - 1;
-					sortedEntities[index]->zero_index = index;
-					index--;
-				}
+				MaintainZeroDistanceOrder(sortedEntities, thing);
 				
 				// update deterministic AI
 				if ([thing isShip])
@@ -7290,6 +7824,15 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 #ifndef NDEBUG
 		update_stage_param = nil;
 #endif
+			_deferringFlightModels = NO;
+			
+			if (_deferredFlightModelCount != 0 && EXPECT(sessionID == _sessionID))
+			{
+				update_stage = @"update:flight model";
+				NoteUpdateStage(update_stage);
+				[self applyDeferredFlightModels:delta_t];
+			}
+			_deferredFlightModelCount = 0;
 			
 			if (zombies != nil)
 			{
@@ -7304,7 +7847,7 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 			
 			// Maintain x/y/z order lists
 			update_stage = @"updating linked lists";
-			OOLog(@"universe.profile.update", @"%@", update_stage);
+			NoteUpdateStage(update_stage);
 			for (i = 0; i < ent_count; i++)
 			{
 				[my_entities[i] updateLinkedLists];
@@ -7313,8 +7856,12 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 			// detect collisions and light ships that can see the sun
 			
 			update_stage = @"collision and shadow detection";
-			OOLog(@"universe.profile.update", @"%@", update_stage);
-			[self filterSortedLists];
+			NoteUpdateStage(update_stage);
+			if (collisionBroadphase == COLLISION_BROADPHASE_SWEEP)
+			{
+				// the grid broadphase does not use the collision chains
+				[self filterSortedLists];
+			}
 			[self findCollisionsAndShadows];
 			
 			// do any required check and maintenance of linked lists
@@ -7327,6 +7874,8 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 		}
 		@catch (NSException *exception)
 		{
+			_deferringFlightModels = NO;
+			_deferredFlightModelCount = 0;
 			if ([[exception name] hasPrefix:@"Oolite"])
 			{
 				[self handleOoliteException:exception];
@@ -7343,7 +7892,7 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 		
 		// dispose of the non-mutable copy and everything it references neatly
 		update_stage = @"clean up";
-		OOLog(@"universe.profile.update", @"%@", update_stage);
+		NoteUpdateStage(update_stage);
 		for (i = 0; i < ent_count; i++)
 		{
 			[my_entities[i] release];	// explicitly release each one
@@ -7357,7 +7906,7 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 		 * time. - CIM: 4/8/2013
 		 */
 		update_stage = @"JS Garbage Collection";
-		OOLog(@"universe.profile.update", @"%@", update_stage); 
+		NoteUpdateStage(update_stage);
 #ifndef NDEBUG
 		JSContext *context = OOJSAcquireContext(); 
 		uint32 gcbytes1 = JS_GetGCParameter(JS_GetRuntime(context),JSGC_BYTES);
@@ -7391,6 +7940,9 @@ OOINLINE BOOL EntityInRange(HPVector p1, Entity *e2, float range)
 #endif
 
 	OOLog(@"universe.profile.update", @"%@", @"Update complete");
+	OOFrameTraceStage(&sUpdateTraceStageOpen, nil);
+	OOFrameTraceEnd();
+	if (EXPECT_NOT(gOOSimulationBenchmarkActive))  OOSimulationBenchmarkNoteStage(nil);
 }
 
 
@@ -8306,6 +8858,7 @@ static void VerifyDesc(NSString *key, id desc)
 	if (sameSystem)
 	{
 		sysInfo = [systemManager getPropertiesForCurrentSystem];
+		[staticConditionRoleSets removeAllObjects];
 
 		OOSunEntity* the_sun = [self sun];
 		/* KEY_ECONOMY used to be here, but resetting the main station
@@ -8695,130 +9248,27 @@ static void VerifyDesc(NSString *key, id desc)
 
 - (NSDictionary *) routeFromSystem:(OOSystemID) start toSystem:(OOSystemID) goal optimizedBy:(OORouteType) optimizeBy
 {
-	/*
-	 time_cost = distance * distance
-	 jump_cost = jumps * max_total_distance + distance = max_total_tistance + distance
-	 
-	 max_total_distance is 7 * 256
-	 
-	 max_time_cost = max_planets * max_time_cost = 256 * (7 * 7)
-	 max_jump_cost = max_planets * max_jump_cost = 256 * (7 * 256 + 7)
-	 */
-	
 	// no interstellar space for start and/or goal please
 	if (start == -1 || goal == -1)  return nil;
-	
-#ifdef CACHE_ROUTE_FROM_SYSTEM_RESULTS
-	
-	static NSDictionary *c_route = nil;
-	static OOSystemID c_start, c_goal;
-	static OORouteType c_optimizeBy;
-	
-	if (c_route != nil && c_start == start && c_goal == goal && c_optimizeBy == optimizeBy)
-	{
-		return c_route;
-	}
-	
-#endif
-	
-	unsigned i, j;
-	
 	if (start > 255 || goal > 255) return nil;
 	
-	NSArray *neighbours[256];
-	BOOL concealed[256];
-	for (i = 0; i < 256; i++)
+	/*	The graph is rebuilt when the galaxy changes, or when the system
+		manager reports that coordinates or concealment have changed.
+	*/
+	NSUInteger generation = [systemManager routeGraphGeneration];
+	if (routeGraph == nil || [routeGraph galaxy] != galaxyID || routeGraphGeneration != generation)
 	{
-		NSDictionary *systemInfo = [systemManager getPropertiesForSystem:i inGalaxy:galaxyID];
-		NSInteger concealment = [systemInfo oo_intForKey:@"concealment" defaultValue:OO_SYSTEMCONCEALMENT_NONE];
-		if (concealment >= OO_SYSTEMCONCEALMENT_NOTHING) {
-			// system is not known
-			neighbours[i] = [NSArray array];
-			concealed[i] = YES;
-		}
-		else
+		[routeGraph release];
+		routeGraph = [[OOGalaxyRouteGraph alloc] initWithSystemManager:systemManager galaxy:galaxyID];
+		routeGraphGeneration = generation;
+		
+		if ([[NSUserDefaults standardUserDefaults] oo_boolForKey:@"precompute-all-routes" defaultValue:NO])
 		{
-			neighbours[i] = [self neighboursToSystem:i];
-			concealed[i] = NO;
+			[routeGraph precomputeAllRoutes];
 		}
 	}
 	
-	RouteElement *cheapest[256] = {0};
-	
-	double maxCost = optimizeBy == OPTIMIZED_BY_TIME ? 256 * (7 * 7) : 256 * (7 * 256 + 7);
-	
-	NSMutableArray *curr = [NSMutableArray arrayWithCapacity:256];
-	[curr addObject:cheapest[start] = [RouteElement elementWithLocation:start parent:-1 cost:0 distance:0 time:0 jumps: 0]];
-	
-	NSMutableArray *next = [NSMutableArray arrayWithCapacity:256];
-	while ([curr count] != 0)
-	{
-		for (i = 0; i < [curr count]; i++) {
-			RouteElement *elemI = [curr objectAtIndex:i];
-			NSArray *ns = neighbours[[elemI location]];
-			for (j = 0; j < [ns count]; j++)
-			{
-				RouteElement *ce = cheapest[[elemI location]];
-				OOSystemID n = [ns oo_intAtIndex:j];
-				if (concealed[n])
-				{
-					continue;
-				}
-				OOSystemID c = [ce location];
-				
-				NSPoint cpos = [systemManager getCoordinatesForSystem:c inGalaxy:galaxyID];
-				NSPoint npos = [systemManager getCoordinatesForSystem:n inGalaxy:galaxyID];
-
-				double lastDistance = distanceBetweenPlanetPositions(npos.x,npos.y,cpos.x,cpos.y);
-				double lastTime = lastDistance * lastDistance;
-				
-				double distance = [ce distance] + lastDistance;
-				double time = [ce time] + lastTime;
-				double cost = [ce cost] + (optimizeBy == OPTIMIZED_BY_TIME ? lastTime : 7 * 256 + lastDistance);
-				int jumps = [ce jumps] + 1;
-				
-				if (cost < maxCost && (cheapest[n] == nil || [cheapest[n] cost] > cost)) {
-					RouteElement *e = [RouteElement elementWithLocation:n parent:c cost:cost distance:distance time:time jumps:jumps];
-					cheapest[n] = e;
-					[next addObject:e];
-					
-					if (n == goal && cost < maxCost)
-						maxCost = cost;
-				}
-			}
-		}
-		[curr setArray:next];
-		[next removeAllObjects];
-	}
-	
-	
-	if (!cheapest[goal]) return nil;
-	
-	NSMutableArray *route = [NSMutableArray arrayWithCapacity:256];
-	RouteElement *e = cheapest[goal];
-	for (;;)
-	{
-		[route insertObject:[NSNumber numberWithInt:[e location]] atIndex:0];
-		if ([e parent] == -1) break;
-		e = cheapest[[e parent]];
-	}
-	
-#ifdef CACHE_ROUTE_FROM_SYSTEM_RESULTS
-	c_start = start;
-	c_goal = goal;
-	c_optimizeBy = optimizeBy;
-	[c_route release];
-	c_route = [[NSDictionary alloc] initWithObjectsAndKeys: route, @"route", [NSNumber numberWithDouble:[cheapest[goal] distance]], @"distance", nil];
-	
-	return c_route;
-#else
-	return [NSDictionary dictionaryWithObjectsAndKeys:
-			route, @"route",
-			[NSNumber numberWithDouble:[cheapest[goal] distance]], @"distance",
-			[NSNumber numberWithDouble:[cheapest[goal] time]], @"time",
-			[NSNumber numberWithInt:[cheapest[goal] jumps]], @"jumps",
-			nil];
-#endif
+	return [routeGraph routeFromSystem:start toSystem:goal optimizedBy:optimizeBy];
 }
 
 
@@ -10625,6 +11075,342 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void *context)
 }
 
 
+- (void) invalidateEntityQueryGrid
+{
+	entityQueryGridValid = NO;
+	entityQueryGridOverflowed = NO;
+	entityQueryStaleCount = 0;
+	entityQueryUnbinnedCount = 0;
+}
+
+
+/*	YES if range-limited searches should use the index; callers build it if
+	it isn't built yet this tick. Once built, the index is kept up to date
+	through -noteEntityAdded:, -noteEntityRemoved: and
+	-noteEntityRepositioned: rather than rebuilt, so that a tick with lots
+	of entities coming and going (every laser shot is an entity) still
+	builds it at most once. If too many indexed entities move or go away
+	before the next tick, searches fall back to a linear scan instead.
+*/
+- (BOOL) entityQueryGridUsable
+{
+	return useEntityQueryGrid && n_entities >= ENTITY_QUERY_GRID_MIN_ENTITIES && !entityQueryGridOverflowed;
+}
+
+
+- (void) noteEntityAdded:(Entity *)entity
+{
+	if (!entityQueryGridValid || entityQueryGridOverflowed || !EntityIsQueryIndexed(entity))  return;
+	
+	if (EXPECT(entityQueryUnbinnedCount < UNIVERSE_MAX_ENTITIES))
+	{
+		entityQueryUnbinned[entityQueryUnbinnedCount++] = entity;
+	}
+	else
+	{
+		entityQueryGridOverflowed = YES;
+	}
+}
+
+
+- (void) noteEntityRemoved:(Entity *)entity
+{
+	if (!entityQueryGridValid || entityQueryGridOverflowed || !EntityIsQueryIndexed(entity))  return;
+	
+	/*	An entity added since the build isn't in the grid, and one that has
+		moved already has a stale entry, so either only needs to come off
+		the unbinned list.
+	*/
+	unsigned i;
+	for (i = 0; i < entityQueryUnbinnedCount; i++)
+	{
+		if (entityQueryUnbinned[i] == entity)
+		{
+			entityQueryUnbinned[i] = entityQueryUnbinned[--entityQueryUnbinnedCount];
+			return;
+		}
+	}
+	
+	[self markEntityQueryStale:entity];
+}
+
+
+- (void) markEntityQueryStale:(Entity *)entity
+{
+	if (entityQueryStaleCount < ENTITY_QUERY_MAX_STALE)
+	{
+		entityQueryStale[entityQueryStaleCount++] = entity;
+	}
+	else
+	{
+		entityQueryGridOverflowed = YES;
+	}
+}
+
+
+- (NSUInteger) entityQueryGridRebuildCount
+{
+	return entityQueryGridRebuildCount;
+}
+
+
+- (NSUInteger) totalLaserRayCount
+{
+	return laserRayTotalCount;
+}
+
+
+// Keep the last tick's laser ray counts for the debug display, and start counting again.
+- (void) resetLaserRayCounts
+{
+	lastTickLaserRayCount = laserRayCount;
+	lastTickLaserRayTestCount = laserRayTestCount;
+	lastTickLaserRayCellCount = [entityQueryGrid rayStatistics].cells;
+	
+	laserRayCount = 0;
+	laserRayTestCount = 0;
+	[entityQueryGrid resetRayStatistics];
+}
+
+
+- (void) rebuildEntityQueryGrid
+{
+	unsigned i;
+	
+	[entityQueryGrid removeAllEntities];
+	[scannerGrid removeAllEntities];
+	for (i = 0; i < n_entities; i++)
+	{
+		Entity *entity = sortedEntities[i];
+		if (!EntityIsQueryIndexed(entity))  continue;
+		
+		/*	The index is used for the rest of the tick while entities keep
+			moving, so pad each entity by twice the distance it can cover in
+			a tick. Entities moved by other means are tracked separately; see
+			-noteEntityRepositioned:.
+		*/
+		double radius = entity->collision_radius + [entity speed] * time_delta * 2.0 + ENTITY_QUERY_GRID_SLACK;
+		[entityQueryGrid addEntity:entity position:entity->position radius:radius];
+		if (entity->isShip)  [scannerGrid addEntity:entity position:entity->position radius:radius];
+	}
+	[entityQueryGrid build];
+	[scannerGrid build];
+	
+	entityQueryStaleCount = 0;
+	entityQueryUnbinnedCount = 0;
+	entityQueryGridValid = YES;
+	entityQueryGridRebuildCount++;
+}
+
+
+/*	Fill candidates with every entity that may be within range of p1, in
+	order of distance from the player. The caller must still test the range,
+	and must have checked -entityQueryGridUsable.
+*/
+- (unsigned) gatherEntityQueryCandidates:(Entity **)candidates capacity:(unsigned)capacity nearPosition:(HPVector)p1 range:(double)range
+{
+	unsigned i;
+	
+	if (!entityQueryGridValid)  [self rebuildEntityQueryGrid];
+	
+	OOEntityQueryGatherContext gather =
+	{
+		candidates, 0, capacity,
+		entityQueryStale, entityQueryStaleCount
+	};
+	HPVector boxMin = make_HPvector(p1.x - range, p1.y - range, p1.z - range);
+	HPVector boxMax = make_HPvector(p1.x + range, p1.y + range, p1.z + range);
+	[entityQueryGrid enumerateEntitiesInBoxFrom:boxMin to:boxMax withFunction:GatherEntityQueryCandidate context:&gather];
+	
+	for (i = 0; i < entityQueryUnbinnedCount && gather.count < capacity; i++)
+	{
+		candidates[gather.count++] = entityQueryUnbinned[i];
+	}
+	
+	if (gather.count > 1)  qsort(candidates, gather.count, sizeof *candidates, CompareEntitiesByZeroIndex);
+	
+	return gather.count;
+}
+
+
+- (void) enumerateShipsNearPosition:(HPVector)position range:(double)range withFunction:(EntityVisitorFunction)function context:(void *)context
+{
+	unsigned i;
+	
+	NSParameterAssert(function != NULL);
+	
+	if (![self entityQueryGridUsable])
+	{
+		for (i = 0; i < n_entities; i++)
+		{
+			Entity *entity = sortedEntities[i];
+			if (entity->isShip)  function(entity, context);
+		}
+		return;
+	}
+	
+	if (!entityQueryGridValid)  [self rebuildEntityQueryGrid];
+	
+	OOScannerGridContext scan =
+	{
+		function, context,
+		entityQueryStale, entityQueryStaleCount
+	};
+	HPVector boxMin = make_HPvector(position.x - range, position.y - range, position.z - range);
+	HPVector boxMax = make_HPvector(position.x + range, position.y + range, position.z + range);
+	[scannerGrid enumerateEntitiesInBoxFrom:boxMin to:boxMax withFunction:ScannerGridFunction context:&scan];
+	
+	for (i = 0; i < entityQueryUnbinnedCount; i++)
+	{
+		Entity *entity = entityQueryUnbinned[i];
+		if (entity->isShip)  function(entity, context);
+	}
+}
+
+
+- (unsigned) enumerateCandidates:(Entity **)candidates
+						   count:(unsigned)count
+			   matchingPredicate:(EntityFilterPredicate)predicate
+					   parameter:(void *)parameter
+						 inRange:(double)range
+						ofEntity:(Entity *)e1
+					withFunction:(EntityEnumerationFunction)function
+						 context:(void *)context
+{
+	unsigned		i, found = 0;
+	HPVector		p1 = (e1 != nil) ? e1->position : kZeroHPVector;
+	NSUInteger		removalCount = entityRemovalCount;
+	
+	for (i = 0; i < count; i++)
+	{
+		Entity *e2 = candidates[i];
+		
+		/*	If the predicate or function removed any entities, candidates may
+			now be dangling, so check they're still in the universe before
+			touching them.
+		*/
+		if (EXPECT_NOT(removalCount != entityRemovalCount))
+		{
+			unsigned j;
+			for (j = 0; j < n_entities; j++)
+			{
+				if (sortedEntities[j] == e2)  break;
+			}
+			if (j == n_entities)  continue;
+		}
+		
+		if (e1 != e2 &&
+			EntityInRange(p1, e2, range) &&
+			predicate(e2, parameter))
+		{
+			found++;
+			if (!function(e2, context))  break;
+		}
+	}
+	
+	return found;
+}
+
+
+/*	If predicate can only match entities with a given role or scan class,
+	return the (possibly empty) list of those entities; otherwise nil. Every
+	conjunct of an AND is a necessary condition, so any of them will do.
+*/
+- (NSArray *) indexedEntitiesForPredicate:(EntityFilterPredicate)predicate parameter:(void *)parameter
+{
+	if (predicate == HasRolePredicate || predicate == HasPrimaryRolePredicate)
+	{
+		// Ships are indexed under every role they have, including the primary role.
+		NSArray *result = [shipsByRole objectForKey:(NSString *)parameter];
+		return result != nil ? result : [NSArray array];
+	}
+	if (predicate == HasScanClassPredicate)
+	{
+		// Cloaked ships report CLASS_NO_DRAW, so that can't be looked up.
+		if ([(NSNumber *)parameter intValue] == CLASS_NO_DRAW)  return nil;
+		NSArray *result = [entitiesByScanClass objectForKey:(NSNumber *)parameter];
+		return result != nil ? result : [NSArray array];
+	}
+	if (predicate == ANDPredicate)
+	{
+		BinaryOperationPredicateParameter *param = parameter;
+		NSArray *result = [self indexedEntitiesForPredicate:param->predicate1 parameter:param->parameter1];
+		if (result == nil)  result = [self indexedEntitiesForPredicate:param->predicate2 parameter:param->parameter2];
+		return result;
+	}
+	return nil;
+}
+
+
+- (void) addEntityToIndexes:(Entity *)entity
+{
+	NSMutableArray		*keys = nil;
+	NSMutableArray		*bucket = nil;
+	id					key = nil;
+	
+	if (entityIndexKeys == NULL || NSMapGet(entityIndexKeys, entity) != nil)  return;
+	
+	keys = [NSMutableArray array];
+	[keys addObject:[NSNumber numberWithInt:entity->scanClass]];
+	if ([entity isShip] && ![entity isSubEntity])
+	{
+		ShipEntity *ship = (ShipEntity *)entity;
+		// Index every role -hasRole: matches, which can go beyond the role set.
+		NSMutableSet *roles = [NSMutableSet setWithObject:[ship primaryRole]];	// Also makes sure a missing primary role is chosen now.
+		[roles unionSet:[[ship roleSet] roles]];
+		if ([ship shipDataKey] != nil)  [roles addObject:[ship shipDataKeyAutoRole]];
+		[keys addObjectsFromArray:[roles allObjects]];
+	}
+	
+	NSUInteger i, count = [keys count];
+	for (i = 0; i < count; i++)
+	{
+		key = [keys objectAtIndex:i];
+		NSMutableDictionary *index = (i == 0) ? entitiesByScanClass : shipsByRole;
+		bucket = [index objectForKey:key];
+		if (bucket == nil)
+		{
+			bucket = [NSMutableArray array];
+			[index setObject:bucket forKey:key];
+		}
+		[bucket addObject:entity];
+	}
+	
+	NSMapInsertKnownAbsent(entityIndexKeys, entity, keys);
+}
+
+
+- (void) removeEntityFromIndexes:(Entity *)entity
+{
+	NSArray				*keys = nil;
+	
+	if (entityIndexKeys == NULL)  return;
+	keys = NSMapGet(entityIndexKeys, entity);
+	if (keys == nil)  return;
+	
+	NSUInteger i, count = [keys count];
+	for (i = 0; i < count; i++)
+	{
+		NSMutableDictionary *index = (i == 0) ? entitiesByScanClass : shipsByRole;
+		id key = [keys objectAtIndex:i];
+		NSMutableArray *bucket = [index objectForKey:key];
+		[bucket removeObjectIdenticalTo:entity];
+		if ([bucket count] == 0)  [index removeObjectForKey:key];
+	}
+	
+	NSMapRemove(entityIndexKeys, entity);
+}
+
+
+- (void) reindexEntity:(Entity *)entity
+{
+	if (entityIndexKeys == NULL || NSMapGet(entityIndexKeys, entity) == nil)  return;
+	
+	[self removeEntityFromIndexes:entity];
+	[self addEntityToIndexes:entity];
+}
+
+
 - (BOOL)doRemoveEntity:(Entity *)entity
 {
 	// remove reference to entity in linked lists
@@ -10635,6 +11421,10 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void *context)
 	
 	[entity removeFromLinkedLists];
 	
+	[self noteEntityRemoved:entity];
+	[self removeEntityFromIndexes:entity];
+	entityRemovalCount++;
+	
 	// moved forward ^^
 	// remove from the reference dictionary
 	int old_id = [entity universalID];
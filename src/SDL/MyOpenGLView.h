@@ -218,6 +218,7 @@ extern int debug;
 	NSSize				currentWindowSize;
 
 	BOOL				showSplashScreen;
+	BOOL				headless;		// -simbench: hidden offscreen window, no audio.
 	SDL_Window			*splashWindow;
 	SDL_Window			*window;
 	SDL_GLContext			glContext;
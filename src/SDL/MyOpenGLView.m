@@ -23,6 +23,7 @@ MA 02110-1301, USA.
 */
 
 #include <SDL3/SDL_init.h>
+#include <SDL3/SDL_hints.h>
 #import "png.h"
 #import "MyOpenGLView.h"
 
@@ -39,6 +40,7 @@ MA 02110-1301, USA.
 #import "OOFullScreenController.h"
 #import "ResourceManager.h"
 #import "OOConstToString.h"
+#import "OOSimulationBenchmark.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #import "stb_image_write.h"
@@ -189,6 +191,7 @@ enum PreferredAppMode
 
 	NSString *windowCaption = [self getWindowCaption];
 	Uint32 windowFlags = SDL_WINDOW_OPENGL | SDL_WINDOW_BORDERLESS | SDL_WINDOW_HIGH_PIXEL_DENSITY;
+	if (headless)  windowFlags |= SDL_WINDOW_HIDDEN;
 
 	// Define modern SDL3 properties for window configuration
 	SDL_PropertiesID props = SDL_CreateProperties();
@@ -393,6 +396,14 @@ enum PreferredAppMode
 
 		if ([arg isEqual: @"-hdr"])  bitsPerColorComponent = 16;
 
+		// -simbench draws nothing, so don't show anything either.
+		if ([arg isEqual:@"-simbench"])
+		{
+			headless = YES;
+			showSplashScreen = NO;
+			noSplashArgFound = YES;
+		}
+
   		// build the startup command string so that we can log it
 		cmdLineArgsStr = [cmdLineArgsStr stringByAppendingFormat:@"%@ ", arg];
 	}
@@ -401,7 +412,11 @@ enum PreferredAppMode
 
 #if OOLITE_SPEECH_SYNTH
 #if OOLITE_ESPEAK
-	if (!SDL_getenv("ESPEAK_DATA_PATH"))
+	if (headless)
+	{
+		// No audio output; speech is never initialised.
+	}
+	else if (!SDL_getenv("ESPEAK_DATA_PATH"))
 	{
 		espeak_Initialize(AUDIO_OUTPUT_PLAYBACK, 100, [[ResourceManager builtInPath] UTF8String], 0);
 	}
@@ -417,12 +432,26 @@ enum PreferredAppMode
 	// TODO: This code up to and including stickHandler really ought
 	// not to be in this class.
 	OOLog(@"sdl.init", @"%@", @"initialising SDL");
-	if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMEPAD))
+	SDL_InitFlags sdlFlags = SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMEPAD;
+	if (headless)
+	{
+		/*	The offscreen driver gives us a GL context through EGL without
+			needing a display. A normal-priority hint means SDL_VIDEO_DRIVER
+			in the environment still wins.
+		*/
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		sdlFlags = SDL_INIT_VIDEO;
+	}
+	if (!SDL_Init(sdlFlags))
 	{
 		OOLog(@"sdl.init.failed", @"Unable to init SDL: %s\n", SDL_GetError());
 		[self dealloc];
 		return nil;
 	}
+	if (headless)
+	{
+		OOLog(@"sdl.init.headless", @"Running without a display, using the \"%s\" video driver.", SDL_GetCurrentVideoDriver());
+	}
 
 	[self populateFullScreenModelist];
 
@@ -431,6 +460,7 @@ enum PreferredAppMode
 	currentSize = 0;
 	[self loadWindowSize];
 	[self loadFullscreenSettings];
+	if (headless)  fullScreen = NO;
 
 	// Set up the drawing surface's dimensions.
 	firstScreen = (fullScreen) ? [self modeAsSize: currentSize] : currentWindowSize;
@@ -439,8 +469,11 @@ enum PreferredAppMode
 	[OOJoystickManager setStickHandlerClass:[OOSDLJoystickManager class]];
 	// end TODO
 
-	[OOSound setUp];
-	if (![OOSound isSoundOK])  OOLog(@"sound.init", @"%@", @"Sound system disabled.");
+	if (!headless)
+	{
+		[OOSound setUp];
+		if (![OOSound isSoundOK])  OOLog(@"sound.init", @"%@", @"Sound system disabled.");
+	}
 
 	grabMouseStatus = NO;
 
@@ -194,6 +194,7 @@ int main(int argc, char *argv[])
 							"-novsync"TABS3"Force disable V-Sync\n"
 							"--openstep"TABS2 TABS4"When compiling or exporting\n"TABS3 TABS4"system descriptions, use openstep\n"TABS3 TABS4"format *\n"
 							"-showversion"TABS2 TABS4"Display version at startup screen\n"
+							"-simbench [seconds]"TABS2"Run [seconds] of simulation at a fixed\n"TABS3 TABS4"timestep without a display, drawing or\n"TABS3 TABS4"sound, log timings and exit (see also\n"TABS3 TABS4"-simbench-rate, -simbench-seed,\n"TABS3 TABS4"-simbench-combat)\n"
 							"-splash"TABS3 TABS4"Force splash screen on startup\n"
 							"-verify-oxp [filepath]    "TABS1"Verify OXP at [filepath] *\n"
 							"--xml"TABS3 TABS4"When compiling or exporting\n"TABS3 TABS4"system descriptions, use xml\n"TABS3 TABS4"format *\n"
@@ -0,0 +1,403 @@
+/*
+
+EntityQueryBench.m
+
+Micro-benchmark for the entity search index in OOSpatialGrid.m, timing
+range searches and laser ray casts through the grid against the linear scan
+over every entity that Universe falls back on, for 100, 500 and 1000
+entities. Grid times include rebuilding the grid, which Universe does once
+per tick. The results of the two paths are also compared, since they are
+expected to find the same entities.
+
+This is not built by default; build and run it with:
+	meson compile -C <builddir> entity-query-bench
+	<builddir>/tools/entity-query-bench/entity-query-bench
+
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOSpatialGrid.h"
+
+
+enum
+{
+	kBenchSamples				= 5,
+	kBenchTicksPerSample		= 20,
+	kBenchRangeQueriesPerTick	= 100,	// Roughly one search per ship for AI scans and proximity checks.
+	kBenchRaysPerTick			= 50	// Laser shots fired in one tick of a busy fight.
+};
+
+
+// Scene and query sizes, in metres. The cell size matches Universe's default.
+#define kBenchCellSize			5000.0f
+#define kBenchSpaceSize			40000.0
+#define kBenchMinRadius			20.0
+#define kBenchMaxRadius			200.0
+#define kBenchPadding			150.0
+#define kBenchQueryRange		5000.0
+#define kBenchRayLength			12500.0
+
+
+/*	Stand-in for Entity; the grid only hands the pointers it is given back
+	to the query functions.
+*/
+typedef struct
+{
+	HPVector				position;
+	OOHPScalar				radius;
+} BenchEntity;
+
+
+typedef struct
+{
+	BenchEntity				*entities;
+	BenchEntity				**sorted;		// Linear scans go through pointers, like Universe's sortedEntities.
+	unsigned				count;
+	HPVector				*queryPoints;
+	BenchEntity				**raySources;
+	Vector					*rayDirections;
+} BenchScene;
+
+
+typedef struct
+{
+	HPVector				point;
+	OOHPScalar				range;
+	unsigned				found;
+} BenchRangeContext;
+
+
+typedef struct
+{
+	BenchEntity				*source;
+	HPVector				origin;
+	Vector					direction;
+	OOHPScalar				nearest;
+	BenchEntity				*hit;
+} BenchRayContext;
+
+
+static uint32_t		sSeed = 0x9E3779B9;
+static BOOL			sFailed = NO;
+
+
+static double BenchTime(void)
+{
+	return [NSDate timeIntervalSinceReferenceDate];
+}
+
+
+static OOHPScalar BenchRandom(OOHPScalar min, OOHPScalar max)
+{
+	sSeed = sSeed * 1664525 + 1013904223;
+	return min + (max - min) * (sSeed >> 8) / (OOHPScalar)(1 << 24);
+}
+
+
+static HPVector RandomPosition(void)
+{
+	OOHPScalar half = kBenchSpaceSize * 0.5;
+	return make_HPvector(BenchRandom(-half, half), BenchRandom(-half, half), BenchRandom(-half, half));
+}
+
+
+static Vector RandomDirection(void)
+{
+	Vector		v;
+	OOScalar	m2;
+	do
+	{
+		v = make_vector(BenchRandom(-1.0, 1.0), BenchRandom(-1.0, 1.0), BenchRandom(-1.0, 1.0));
+		m2 = magnitude2(v);
+	}
+	while (m2 < 0.01f || m2 > 1.0f);
+	return vector_multiply_scalar(v, 1.0f / sqrtf(m2));
+}
+
+
+static void *BenchAlloc(size_t size)
+{
+	void *result = malloc(size);
+	if (result == NULL)
+	{
+		fprintf(stderr, "Could not allocate %zu bytes.\n", size);
+		exit(EXIT_FAILURE);
+	}
+	return result;
+}
+
+
+static void MakeScene(BenchScene *scene, unsigned count)
+{
+	unsigned i;
+
+	scene->count = count;
+	scene->entities = BenchAlloc(count * sizeof *scene->entities);
+	scene->sorted = BenchAlloc(count * sizeof *scene->sorted);
+	scene->queryPoints = BenchAlloc(kBenchRangeQueriesPerTick * sizeof *scene->queryPoints);
+	scene->raySources = BenchAlloc(kBenchRaysPerTick * sizeof *scene->raySources);
+	scene->rayDirections = BenchAlloc(kBenchRaysPerTick * sizeof *scene->rayDirections);
+
+	for (i = 0; i < count; i++)
+	{
+		scene->entities[i].position = RandomPosition();
+		scene->entities[i].radius = BenchRandom(kBenchMinRadius, kBenchMaxRadius);
+		scene->sorted[i] = &scene->entities[i];
+	}
+	// Searches and shots start at entities, as they do in the game.
+	for (i = 0; i < kBenchRangeQueriesPerTick; i++)
+	{
+		scene->queryPoints[i] = scene->entities[i % count].position;
+	}
+	for (i = 0; i < kBenchRaysPerTick; i++)
+	{
+		scene->raySources[i] = &scene->entities[(i * 7) % count];
+		scene->rayDirections[i] = RandomDirection();
+	}
+}
+
+
+static void FreeScene(BenchScene *scene)
+{
+	free(scene->entities);
+	free(scene->sorted);
+	free(scene->queryPoints);
+	free(scene->raySources);
+	free(scene->rayDirections);
+}
+
+
+static void BuildGrid(OOSpatialGrid *grid, const BenchScene *scene)
+{
+	unsigned i;
+
+	[grid removeAllEntities];
+	for (i = 0; i < scene->count; i++)
+	{
+		BenchEntity *entity = scene->sorted[i];
+		[grid addEntity:(Entity *)entity position:entity->position radius:entity->radius + kBenchPadding];
+	}
+	[grid build];
+}
+
+
+OOINLINE BOOL EntityInRange(const BenchEntity *entity, HPVector point, OOHPScalar range)
+{
+	OOHPScalar reach = range + entity->radius;
+	return HPdistance2(entity->position, point) < reach * reach;
+}
+
+
+static void TestRayAgainstEntity(BenchRayContext *ray, BenchEntity *entity)
+{
+	// Nearest approach of the ray to the entity's centre, as in Universe's laser test.
+	if (entity == ray->source)  return;
+
+	HPVector	offset = HPvector_subtract(entity->position, ray->origin);
+	OOHPScalar	along = HPdot_product(offset, vectorToHPVector(ray->direction));
+
+	if (along < 0.0 || along - entity->radius > ray->nearest)  return;
+	if (HPmagnitude2(offset) - along * along < entity->radius * entity->radius && along < ray->nearest)
+	{
+		ray->nearest = along;
+		ray->hit = entity;
+	}
+}
+
+
+static void RangeGridFunction(Entity *entity, void *context)
+{
+	BenchRangeContext *query = context;
+	if (EntityInRange((BenchEntity *)entity, query->point, query->range))  query->found++;
+}
+
+
+static OOHPScalar RayGridFunction(Entity *entity, void *context)
+{
+	BenchRayContext *ray = context;
+	TestRayAgainstEntity(ray, (BenchEntity *)entity);
+	return ray->nearest;
+}
+
+
+static unsigned RangeQueryLinear(const BenchScene *scene, HPVector point, OOHPScalar range)
+{
+	unsigned i, found = 0;
+	for (i = 0; i < scene->count; i++)
+	{
+		if (EntityInRange(scene->sorted[i], point, range))  found++;
+	}
+	return found;
+}
+
+
+static unsigned RangeQueryGrid(OOSpatialGrid *grid, HPVector point, OOHPScalar range)
+{
+	BenchRangeContext query = { point, range, 0 };
+	HPVector boxMin = make_HPvector(point.x - range, point.y - range, point.z - range);
+	HPVector boxMax = make_HPvector(point.x + range, point.y + range, point.z + range);
+	[grid enumerateEntitiesInBoxFrom:boxMin to:boxMax withFunction:RangeGridFunction context:&query];
+	return query.found;
+}
+
+
+static BenchEntity *RayLinear(const BenchScene *scene, BenchEntity *source, Vector direction)
+{
+	BenchRayContext ray = { source, source->position, direction, kBenchRayLength, NULL };
+	unsigned i;
+	for (i = 0; i < scene->count; i++)
+	{
+		TestRayAgainstEntity(&ray, scene->sorted[i]);
+	}
+	return ray.hit;
+}
+
+
+static BenchEntity *RayGrid(OOSpatialGrid *grid, BenchEntity *source, Vector direction)
+{
+	BenchRayContext ray = { source, source->position, direction, kBenchRayLength, NULL };
+	[grid enumerateEntitiesAlongRayFrom:ray.origin direction:direction length:ray.nearest withFunction:RayGridFunction context:&ray];
+	return ray.hit;
+}
+
+
+/*	One tick's worth of searches, optionally rebuilding the grid first.
+	Returns a checksum of the results so the two paths can be compared.
+*/
+static unsigned long RunTick(const BenchScene *scene, OOSpatialGrid *grid, BOOL rangeQueries, BOOL rays)
+{
+	unsigned long	checksum = 0;
+	unsigned		i;
+
+	if (grid != nil)  BuildGrid(grid, scene);
+
+	if (rangeQueries)
+	{
+		for (i = 0; i < kBenchRangeQueriesPerTick; i++)
+		{
+			HPVector point = scene->queryPoints[i];
+			checksum += (grid != nil) ? RangeQueryGrid(grid, point, kBenchQueryRange) : RangeQueryLinear(scene, point, kBenchQueryRange);
+		}
+	}
+	if (rays)
+	{
+		for (i = 0; i < kBenchRaysPerTick; i++)
+		{
+			BenchEntity *source = scene->raySources[i];
+			Vector direction = scene->rayDirections[i];
+			BenchEntity *hit = (grid != nil) ? RayGrid(grid, source, direction) : RayLinear(scene, source, direction);
+			checksum = checksum * 31 + ((hit != NULL) ? (unsigned long)(hit - scene->entities) + 1 : 0);
+		}
+	}
+
+	return checksum;
+}
+
+
+// Best of kBenchSamples, in milliseconds per tick.
+static double TimeTicks(const BenchScene *scene, OOSpatialGrid *grid, BOOL rangeQueries, BOOL rays, unsigned long *outChecksum)
+{
+	unsigned		sample, tick;
+	double			best = HUGE_VAL;
+
+	for (sample = 0; sample < kBenchSamples; sample++)
+	{
+		double start = BenchTime();
+		for (tick = 0; tick < kBenchTicksPerSample; tick++)
+		{
+			*outChecksum = RunTick(scene, grid, rangeQueries, rays);
+		}
+		double elapsed = (BenchTime() - start) / kBenchTicksPerSample;
+		if (elapsed < best)  best = elapsed;
+	}
+
+	return best * 1000.0;
+}
+
+
+static double TimeBuild(const BenchScene *scene, OOSpatialGrid *grid)
+{
+	unsigned		sample, tick;
+	double			best = HUGE_VAL;
+
+	for (sample = 0; sample < kBenchSamples; sample++)
+	{
+		double start = BenchTime();
+		for (tick = 0; tick < kBenchTicksPerSample; tick++)
+		{
+			BuildGrid(grid, scene);
+		}
+		double elapsed = (BenchTime() - start) / kBenchTicksPerSample;
+		if (elapsed < best)  best = elapsed;
+	}
+
+	return best * 1000.0;
+}
+
+
+static void BenchQueries(const char *name, const BenchScene *scene, OOSpatialGrid *grid, BOOL rangeQueries, BOOL rays)
+{
+	unsigned long	linearChecksum, gridChecksum;
+	double			linearMS = TimeTicks(scene, nil, rangeQueries, rays, &linearChecksum);
+	double			gridMS = TimeTicks(scene, grid, rangeQueries, rays, &gridChecksum);
+
+	printf("%-16s %8u %10.3f %10.3f %8.2fx\n", name, scene->count, linearMS, gridMS, linearMS / gridMS);
+
+	if (linearChecksum != gridChecksum)
+	{
+		fprintf(stderr, "%s: grid results differ from linear scan results with %u entities.\n", name, scene->count);
+		sFailed = YES;
+	}
+}
+
+
+int main(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool = [[NSAutoreleasePool alloc] init];
+	static const unsigned	sizes[] = { 100, 500, 1000 };
+	unsigned				i;
+
+	printf("%u range searches (%g m) and %u rays (%g m) per tick; grid cell size %g m, %g m cube.\n",
+		   kBenchRangeQueriesPerTick, kBenchQueryRange, kBenchRaysPerTick, kBenchRayLength, kBenchCellSize, kBenchSpaceSize);
+	printf("Times are the best of %u samples, in ms per tick; grid times include one rebuild per tick.\n\n", kBenchSamples);
+	printf("%-16s %8s %10s %10s %9s\n", "query", "entities", "linear", "grid", "speedup");
+
+	for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+	{
+		NSAutoreleasePool	*innerPool = [[NSAutoreleasePool alloc] init];
+		OOSpatialGrid		*grid = [[OOSpatialGrid alloc] initWithCellSize:kBenchCellSize];
+		BenchScene			scene;
+
+		MakeScene(&scene, sizes[i]);
+
+		BenchQueries("range searches", &scene, grid, YES, NO);
+		BenchQueries("laser rays", &scene, grid, NO, YES);
+		BenchQueries("both", &scene, grid, YES, YES);
+		printf("%-16s %8u %10s %10.3f\n\n", "grid build only", scene.count, "-", TimeBuild(&scene, grid));
+
+		FreeScene(&scene);
+		[grid release];
+		[innerPool release];
+	}
+
+	[pool release];
+	return sFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/*
+
+TextureScalingBench.m
+
+Micro-benchmark for the mip-map generation kernels in OOTextureScaling.m,
+timing the portable scalar code against the SSE2/NEON code on 512 to 4096
+pixel square textures. The output of the two paths is also compared, since
+they are expected to be bit-identical.
+
+This is not built by default; build and run it with:
+	meson compile -C <builddir> texture-scaling-bench
+	<builddir>/tools/texture-scaling-bench/texture-scaling-bench
+
+
+Oolite
+Copyright (C) 2004-2013 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+
+/*	The kernels are static, so the scaler is compiled into the benchmark
+	directly. Its OOCPUGetFeatures() call is redirected through
+	BenchCPUGetFeatures() so that the vector paths can be switched off at
+	run time.
+*/
+#define OOCPUGetFeatures BenchCPUGetFeatures
+#include "OOTextureScaling.m"
+#undef OOCPUGetFeatures
+
+OOCPUFeatures OOCPUGetFeatures(void);
+
+
+#if OOLITE_NATIVE_64_BIT
+#define ScaleToHalf_1_Scalar	ScaleToHalf_1_x8
+#define ScaleToHalf_4_Scalar	ScaleToHalf_4_x2
+#else
+#define ScaleToHalf_1_Scalar	ScaleToHalf_1_x4
+#define ScaleToHalf_4_Scalar	ScaleToHalf_4_x1
+#endif
+#define ScaleToHalf_2_Scalar	ScaleToHalf_2_x1
+
+
+enum
+{
+	kBenchMinSize				= 512,
+	kBenchMaxSize				= 4096,
+	kBenchSamples				= 5,
+	kBenchPixelsPerSample		= 1 << 24	// Calls per sample are scaled to process about this many source pixels.
+};
+
+
+typedef void (*BenchHalfFunction)(void *srcBytes, void *dstBytes, OOPixMapDimension srcWidth, OOPixMapDimension srcHeight);
+typedef BOOL (*BenchMipFunction)(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height);
+
+
+static OOCPUFeatures	sFeatureMask = ~(OOCPUFeatures)0;
+static BOOL				sFailed = NO;
+
+
+OOCPUFeatures BenchCPUGetFeatures(void)
+{
+	return OOCPUGetFeatures() & sFeatureMask;
+}
+
+
+static void SetSIMDEnabled(BOOL enabled)
+{
+	sFeatureMask = enabled ? ~(OOCPUFeatures)0 : 0;
+}
+
+
+static BOOL SIMDAvailable(void)
+{
+#if OO_SCALING_SIMD
+	SetSIMDEnabled(YES);
+	return UseSIMDScaling();
+#else
+	return NO;
+#endif
+}
+
+
+static double BenchTime(void)
+{
+	return [NSDate timeIntervalSinceReferenceDate];
+}
+
+
+static unsigned CallsPerSample(OOPixMapDimension size)
+{
+	unsigned calls = kBenchPixelsPerSample / (size * size);
+	return (calls != 0) ? calls : 1;
+}
+
+
+// Texture plus room for its mip-maps, filled with repeatable noise.
+static uint8_t *MakeTexture(OOPixMapDimension size, unsigned planes, size_t *outByteCount)
+{
+	size_t		byteCount = (size_t)size * size * planes * 4 / 3;
+	uint8_t		*bytes = malloc(byteCount);
+	uint32_t	seed = 0x9E3779B9;
+	size_t		i;
+
+	if (bytes == NULL)
+	{
+		fprintf(stderr, "Could not allocate %zu bytes for a %ux%u texture.\n", byteCount, size, size);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < byteCount; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		bytes[i] = seed >> 24;
+	}
+
+	*outByteCount = byteCount;
+	return bytes;
+}
+
+
+// Best of kBenchSamples, in milliseconds per call.
+static double TimeHalf(BenchHalfFunction function, uint8_t *bytes, OOPixMapDimension size, unsigned planes)
+{
+	unsigned		sample, call, calls = CallsPerSample(size);
+	uint8_t			*dst = bytes + (size_t)size * size * planes;
+	double			best = HUGE_VAL;
+
+	for (sample = 0; sample < kBenchSamples; sample++)
+	{
+		double start = BenchTime();
+		for (call = 0; call < calls; call++)
+		{
+			function(bytes, dst, size, size);
+		}
+		double elapsed = (BenchTime() - start) / calls;
+		if (elapsed < best)  best = elapsed;
+	}
+
+	return best * 1000.0;
+}
+
+
+static double TimeMip(BenchMipFunction function, uint8_t *bytes, OOPixMapDimension size)
+{
+	unsigned		sample, call, calls = CallsPerSample(size);
+	double			best = HUGE_VAL;
+
+	for (sample = 0; sample < kBenchSamples; sample++)
+	{
+		double start = BenchTime();
+		for (call = 0; call < calls; call++)
+		{
+			function(bytes, size, size);
+		}
+		double elapsed = (BenchTime() - start) / calls;
+		if (elapsed < best)  best = elapsed;
+	}
+
+	return best * 1000.0;
+}
+
+
+static void PrintResult(const char *name, OOPixMapDimension size, double scalarMS, double simdMS)
+{
+	double megapixels = (double)size * size / 1e6;
+
+	if (simdMS > 0.0)
+	{
+		printf("%-24s %5u %10.3f %10.3f %8.2fx %10.1f\n", name, size, scalarMS, simdMS, scalarMS / simdMS, megapixels / (fmin(scalarMS, simdMS) / 1000.0));
+	}
+	else
+	{
+		printf("%-24s %5u %10.3f %10s %9s %10.1f\n", name, size, scalarMS, "-", "-", megapixels / (scalarMS / 1000.0));
+	}
+}
+
+
+static void CheckMatch(const char *name, OOPixMapDimension size, const uint8_t *scalarBytes, const uint8_t *simdBytes, size_t byteCount)
+{
+	if (memcmp(scalarBytes, simdBytes, byteCount) != 0)
+	{
+		fprintf(stderr, "%s: vector output differs from scalar output at %ux%u.\n", name, size, size);
+		sFailed = YES;
+	}
+}
+
+
+static void BenchHalf(const char *name, BenchHalfFunction scalar, BenchHalfFunction simd, OOPixMapDimension size, unsigned planes)
+{
+	size_t		byteCount;
+	uint8_t		*bytes = MakeTexture(size, planes, &byteCount);
+	double		scalarMS, simdMS = 0.0;
+
+	scalarMS = TimeHalf(scalar, bytes, size, planes);
+	if (simd != NULL)
+	{
+		uint8_t *scalarBytes = malloc(byteCount);
+		if (scalarBytes == NULL)  exit(EXIT_FAILURE);
+		memcpy(scalarBytes, bytes, byteCount);
+
+		simdMS = TimeHalf(simd, bytes, size, planes);
+		CheckMatch(name, size, scalarBytes, bytes, byteCount);
+		free(scalarBytes);
+	}
+
+	PrintResult(name, size, scalarMS, simdMS);
+	free(bytes);
+}
+
+
+static void BenchMip(const char *name, BenchMipFunction function, OOPixMapDimension size, unsigned planes, BOOL compareSIMD)
+{
+	size_t		byteCount;
+	uint8_t		*bytes = MakeTexture(size, planes, &byteCount);
+	double		scalarMS, simdMS = 0.0;
+
+	SetSIMDEnabled(NO);
+	scalarMS = TimeMip(function, bytes, size);
+	if (compareSIMD)
+	{
+		uint8_t *scalarBytes = malloc(byteCount);
+		if (scalarBytes == NULL)  exit(EXIT_FAILURE);
+		memcpy(scalarBytes, bytes, byteCount);
+
+		SetSIMDEnabled(YES);
+		simdMS = TimeMip(function, bytes, size);
+		CheckMatch(name, size, scalarBytes, bytes, byteCount);
+		free(scalarBytes);
+	}
+
+	PrintResult(name, size, scalarMS, simdMS);
+	free(bytes);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	NSAutoreleasePool		*pool = [[NSAutoreleasePool alloc] init];
+	OOPixMapDimension		size;
+	BOOL					simd = SIMDAvailable();
+
+#if OO_SCALING_SSE2
+	printf("Vector kernels: SSE2, %s at run time.\n", simd ? "available" : "not available");
+#elif OO_SCALING_NEON
+	printf("Vector kernels: NEON, %s at run time.\n", simd ? "available" : "not available");
+#else
+	printf("Vector kernels: not built for this target; timing scalar code only.\n");
+#endif
+	printf("Times are the best of %u samples, in ms per call; Mpx/s is source pixels for the faster path.\n\n", kBenchSamples);
+	printf("%-24s %5s %10s %10s %9s %10s\n", "kernel", "size", "scalar", "vector", "speedup", "Mpx/s");
+
+	for (size = kBenchMinSize; size <= kBenchMaxSize; size <<= 1)
+	{
+#if OO_SCALING_SIMD
+		BenchHalf("ScaleToHalf (1 plane)", ScaleToHalf_1_Scalar, simd ? ScaleToHalf_1_SIMD : NULL, size, 1);
+		BenchHalf("ScaleToHalf (2 planes)", ScaleToHalf_2_Scalar, simd ? ScaleToHalf_2_SIMD : NULL, size, 2);
+		BenchHalf("ScaleToHalf (4 planes)", ScaleToHalf_4_Scalar, simd ? ScaleToHalf_4_SIMD : NULL, size, 4);
+#else
+		BenchHalf("ScaleToHalf (1 plane)", ScaleToHalf_1_Scalar, NULL, size, 1);
+		BenchHalf("ScaleToHalf (2 planes)", ScaleToHalf_2_Scalar, NULL, size, 2);
+		BenchHalf("ScaleToHalf (4 planes)", ScaleToHalf_4_Scalar, NULL, size, 4);
+#endif
+		BenchMip("GenerateMipMaps4", GenerateMipMaps4, size, 4, simd);
+		// The sRGB path has no vector version; compare it against the line above.
+		BenchMip("GenerateMipMaps4SRGB", GenerateMipMaps4SRGB, size, 4, NO);
+		printf("\n");
+	}
+
+	[pool release];
+	return sFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// Minimal logging for the scaler and OOCPUInfo, which would otherwise pull in the whole game.
+NSString * const kOOLogParameterError = @"general.error.parameterError";
+
+
+void OOLogWithFunctionFileAndLine(NSString *inMessageClass, const char *inFunction, const char *inFile, unsigned long inLine, NSString *inFormat, ...)
+{
+	va_list		args;
+	NSString	*message;
+
+	va_start(args, inFormat);
+	message = [[NSString alloc] initWithFormat:inFormat arguments:args];
+	va_end(args);
+
+	fprintf(stderr, "[%s] %s\n", [inMessageClass UTF8String], [message UTF8String]);
+	[message release];
+}
+
+
+void OOLogGenericParameterErrorForFunction(const char *inFunction)
+{
+	fprintf(stderr, "***** %s: bad parameters.\n", inFunction);
+}